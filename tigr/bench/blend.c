@@ -0,0 +1,65 @@
+//
+// Compares tigrBlitBlend throughput for each blend mode with
+// tigrBlitTint and with a plain per-pixel additive loop.
+//
+
+#include "tigr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The kind of loop tigrBlitBlend replaces.
+static void addByHand(Tigr* dst, Tigr* src) {
+    for (int y = 0; y < src->h; y++) {
+        for (int x = 0; x < src->w; x++) {
+            TPixel s = tigrGet(src, x, y);
+            TPixel d = tigrGet(dst, x, y);
+            int r = d.r + s.r * s.a / 255;
+            int g = d.g + s.g * s.a / 255;
+            int b = d.b + s.b * s.a / 255;
+            tigrPlot(dst, x, y, tigrRGB(r > 255 ? 255 : r, g > 255 ? 255 : g, b > 255 ? 255 : b));
+        }
+    }
+}
+
+static double mpixPerSecond(Tigr* dst, Tigr* src, int blend, int rounds) {
+    TPixel tint = tigrRGBA(255, 255, 255, 255);
+    double start = now();
+    for (int i = 0; i < rounds; i++) {
+        if (blend < 0) {
+            tigrBlitTint(dst, src, 0, 0, 0, 0, src->w, src->h, tint);
+        } else if (blend > TIGR_SCREEN) {
+            addByHand(dst, src);
+        } else {
+            tigrBlitBlend(dst, src, 0, 0, 0, 0, src->w, src->h, tint, blend);
+        }
+    }
+    return (double)src->w * src->h * rounds / (now() - start) / 1e6;
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+
+    Tigr* dst = tigrBitmap(256, 256);
+    Tigr* src = tigrBitmap(256, 256);
+    srand(1);
+    for (int i = 0; i < src->w * src->h; i++) {
+        src->pix[i] = tigrRGBA(rand(), rand(), rand(), rand());
+    }
+
+    const char* names[] = { "tint", "add", "multiply", "screen", "add by hand" };
+    for (int blend = -1; blend <= TIGR_SCREEN + 1; blend++) {
+        mpixPerSecond(dst, src, blend, rounds / 10);
+        printf("%-12s %7.1f Mpix/s\n", names[blend + 1], mpixPerSecond(dst, src, blend, rounds));
+    }
+
+    tigrFree(src);
+    tigrFree(dst);
+    return 0;
+}
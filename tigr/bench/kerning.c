@@ -0,0 +1,72 @@
+//
+// Compares tigrPrint throughput for the stock font with and
+// without kerning pairs and glyph advances.
+//
+
+#include "tigr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double nsPerGlyph(Tigr* bmp, TigrFont* font, const char* text, int rounds) {
+    int glyphs = (int)strlen(text) * rounds;
+    double start = now();
+    for (int i = 0; i < rounds; i++) {
+        tigrPrint(bmp, font, 0, (i * 8) % bmp->h, tigrRGB(0xff, 0xff, 0xff), text);
+    }
+    return (now() - start) * 1e9 / glyphs;
+}
+
+int main(int argc, char* argv[]) {
+    const char* text = "AVAST! To Wally: Your yacht, Tom, looks very fast. LT AY Yo Wa Te";
+    int rounds = argc > 1 ? atoi(argv[1]) : 20000;
+
+    Tigr* bmp = tigrBitmap(640, 480);
+    tigrPreloadFonts();
+
+    // Same font sheet, with a pair for every two upper case letters
+    // and a nudge for every glyph.
+    TigrFont kerned = *tfont;
+    kerned.glyphs = (TigrGlyph*)malloc(tfont->numGlyphs * sizeof(TigrGlyph));
+    memcpy(kerned.glyphs, tfont->glyphs, tfont->numGlyphs * sizeof(TigrGlyph));
+    for (int i = 0; i < kerned.numGlyphs; i++) {
+        kerned.glyphs[i].bearing = 1;
+        kerned.glyphs[i].advance = kerned.glyphs[i].w + 1;
+    }
+
+    TigrKerningPair pairs[26 * 26];
+    int numPairs = 0;
+    for (int l = 'A'; l <= 'Z'; l++) {
+        for (int r = 'A'; r <= 'Z'; r++) {
+            pairs[numPairs].left = l;
+            pairs[numPairs].right = r;
+            pairs[numPairs].amount = -1;
+            numPairs++;
+        }
+    }
+    kerned.kerning = NULL;
+    tigrSetFontKerning(&kerned, pairs, numPairs);
+
+    // Warm up.
+    nsPerGlyph(bmp, tfont, text, rounds / 10);
+    nsPerGlyph(bmp, &kerned, text, rounds / 10);
+
+    double plain = nsPerGlyph(bmp, tfont, text, rounds);
+    double withKerning = nsPerGlyph(bmp, &kerned, text, rounds);
+
+    printf("plain:   %.1f ns/glyph\n", plain);
+    printf("kerning: %.1f ns/glyph (%d pairs, %+.1f%%)\n", withKerning, numPairs,
+           100 * (withKerning - plain) / plain);
+
+    free(kerned.glyphs);
+    free(kerned.kerning);
+    tigrFree(bmp);
+    return 0;
+}
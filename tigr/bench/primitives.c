@@ -0,0 +1,321 @@
+//
+// Measures the throughput of each drawing primitive over a range of sizes,
+// in millions of pixels per second. Runs headless, without a display.
+//
+//   primitives [--json] [seconds per measurement]
+//
+
+#include "tigr.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const int sizes[] = { 16, 64, 256, 1024 };
+#define NUM_SIZES ((int)(sizeof(sizes) / sizeof(sizes[0])))
+
+// Everything a measurement draws with, for one size n.
+static struct {
+    int n;
+    Tigr* dst;
+    Tigr* src;
+    TigrSprite* sprite;
+    TigrIndexed* indexed;
+    TigrTiled* tiled;
+    float rotation[6];
+    void* png;
+    int pngSize;
+    const char* text;
+} ctx;
+
+static const char* pngPath = "primitives.png";
+
+static TPixel white = { 0xff, 0xff, 0xff, 0xff };
+static TPixel translucent = { 0x40, 0x80, 0xc0, 0x80 };
+
+static void clear(int i) {
+    tigrClear(ctx.dst, tigrRGB(i, 0, 0));
+}
+
+static void fill(int i) {
+    tigrFill(ctx.dst, 0, 0, ctx.n, ctx.n, tigrRGB(i, 0, 0));
+}
+
+static void fillRect(int i) {
+    (void)i;
+    tigrFillRect(ctx.dst, 0, 0, ctx.n, ctx.n, translucent);
+}
+
+static void line(int i) {
+    tigrLine(ctx.dst, 0, i % ctx.n, ctx.n - 1, ctx.n - 1 - i % ctx.n, translucent);
+}
+
+static void circle(int i) {
+    (void)i;
+    tigrCircle(ctx.dst, ctx.n / 2, ctx.n / 2, ctx.n / 2 - 1, translucent);
+}
+
+static void fillCircle(int i) {
+    (void)i;
+    tigrFillCircle(ctx.dst, ctx.n / 2, ctx.n / 2, ctx.n / 2 - 1, translucent);
+}
+
+static void blit(int i) {
+    (void)i;
+    tigrBlit(ctx.dst, ctx.src, 0, 0, 0, 0, ctx.n, ctx.n);
+}
+
+static void blitAlpha(int i) {
+    (void)i;
+    tigrBlitAlpha(ctx.dst, ctx.src, 0, 0, 0, 0, ctx.n, ctx.n, 0.5f);
+}
+
+static void blitTint(int i) {
+    (void)i;
+    tigrBlitTint(ctx.dst, ctx.src, 0, 0, 0, 0, ctx.n, ctx.n, white);
+}
+
+static void blitScaled(int i) {
+    (void)i;
+    tigrBlitScaled(ctx.dst, ctx.src, 0, 0, ctx.n, ctx.n, 0, 0, ctx.n / 2, ctx.n / 2, white, TIGR_BILINEAR);
+}
+
+static void blitRotated(int i) {
+    (void)i;
+    tigrBlitTransformed(ctx.dst, ctx.src, 0, 0, ctx.n, ctx.n, ctx.rotation, white, TIGR_BILINEAR);
+}
+
+static void blitAdd(int i) {
+    (void)i;
+    tigrBlitBlend(ctx.dst, ctx.src, 0, 0, 0, 0, ctx.n, ctx.n, white, TIGR_ADD);
+}
+
+static void blitMultiply(int i) {
+    (void)i;
+    tigrBlitBlend(ctx.dst, ctx.src, 0, 0, 0, 0, ctx.n, ctx.n, white, TIGR_MULTIPLY);
+}
+
+static void blitScreen(int i) {
+    (void)i;
+    tigrBlitBlend(ctx.dst, ctx.src, 0, 0, 0, 0, ctx.n, ctx.n, white, TIGR_SCREEN);
+}
+
+static void blitSprite(int i) {
+    (void)i;
+    tigrBlitSprite(ctx.dst, ctx.sprite, 0, 0, white);
+}
+
+static void blitIndexed(int i) {
+    (void)i;
+    tigrBlitIndexed(ctx.dst, ctx.indexed, 0, 0, 0, 0, ctx.n, ctx.n, white);
+}
+
+static void blitTiledRotated(int i) {
+    (void)i;
+    tigrBlitTiledTransformed(ctx.dst, ctx.tiled, 0, 0, ctx.n, ctx.n, ctx.rotation, white, TIGR_BILINEAR);
+}
+
+static void print(int i) {
+    (void)i;
+    for (int y = 0; y + 12 <= ctx.n; y += 12) {
+        tigrPrint(ctx.dst, tfont, 0, y, white, ctx.text);
+    }
+}
+
+static void loadImageMem(int i) {
+    (void)i;
+    tigrFree(tigrLoadImageMem(ctx.png, ctx.pngSize));
+}
+
+static void saveImage(int i) {
+    (void)i;
+    tigrSaveImage(pngPath, ctx.src);
+}
+
+// Pixels touched by one run of each measurement.
+static double area(void) {
+    return (double)ctx.n * ctx.n;
+}
+
+static double lineLength(void) {
+    return ctx.n;
+}
+
+static double circumference(void) {
+    return 2 * M_PI * (ctx.n / 2 - 1);
+}
+
+static double disc(void) {
+    return M_PI * (ctx.n / 2 - 1) * (ctx.n / 2 - 1);
+}
+
+static double textArea(void) {
+    int lines = ctx.n / 12;
+    int w = tigrTextWidth(tfont, ctx.text);
+    return (double)lines * tigrTextHeight(tfont, ctx.text) * (w < ctx.n ? w : ctx.n);
+}
+
+typedef struct {
+    const char* name;
+    void (*run)(int i);
+    double (*pixels)(void);
+} Measurement;
+
+static const Measurement measurements[] = {
+    { "clear", clear, area },
+    { "fill", fill, area },
+    { "fillRect", fillRect, area },
+    { "line", line, lineLength },
+    { "circle", circle, circumference },
+    { "fillCircle", fillCircle, disc },
+    { "blit", blit, area },
+    { "blitAlpha", blitAlpha, area },
+    { "blitTint", blitTint, area },
+    { "blitScaled", blitScaled, area },
+    { "blitTransformed", blitRotated, area },
+    { "blitAdd", blitAdd, area },
+    { "blitMultiply", blitMultiply, area },
+    { "blitScreen", blitScreen, area },
+    { "blitSprite", blitSprite, area },
+    { "blitIndexed", blitIndexed, area },
+    { "blitTiledTransformed", blitTiledRotated, area },
+    { "print", print, textArea },
+    { "loadImageMem", loadImageMem, area },
+    { "saveImage", saveImage, area },
+};
+#define NUM_MEASUREMENTS ((int)(sizeof(measurements) / sizeof(measurements[0])))
+
+static void* readFile(const char* path, int* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = (int)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    void* data = malloc(*size);
+    if (fread(data, 1, *size, f) != (size_t)*size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+// Sets up bitmaps of size n: a source with opaque, transparent and soft edged areas.
+static void setup(int n) {
+    ctx.n = n;
+    ctx.dst = tigrBitmap(n, n);
+    ctx.src = tigrBitmap(n, n);
+    ctx.indexed = tigrIndexed(n, n, 8);
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            int d = (2 * x - n) * (2 * x - n) + (2 * y - n) * (2 * y - n);
+            int a = d < n * n / 2 ? 255 : d < n * n ? 255 * (n * n - d) / (n * n / 2) : 0;
+            tigrPlot(ctx.src, x, y, tigrRGBA(x * 255 / n, y * 255 / n, 128, (unsigned char)a));
+            tigrSetIndex(ctx.indexed, x, y, (x ^ y) & 255);
+        }
+    }
+    for (int i = 0; i < 256; i++) {
+        ctx.indexed->palette[i] = tigrRGB(i, 255 - i, i / 2);
+    }
+    ctx.sprite = tigrSprite(ctx.src);
+    ctx.tiled = tigrTiled(n, n);
+    tigrTile(ctx.tiled, ctx.src);
+
+    // Thirty degrees around the center.
+    float c = cosf((float)M_PI / 6), s = sinf((float)M_PI / 6);
+    float rotation[6] = { c, -s, n / 2 - c * n / 2 + s * n / 2, s, c, n / 2 - s * n / 2 - c * n / 2 };
+    memcpy(ctx.rotation, rotation, sizeof(rotation));
+
+    tigrSaveImage(pngPath, ctx.src);
+    ctx.png = readFile(pngPath, &ctx.pngSize);
+    ctx.text = "The quick brown fox jumps over the lazy dog. 0123456789";
+}
+
+static void teardown(void) {
+    free(ctx.png);
+    tigrFreeTiled(ctx.tiled);
+    tigrFreeIndexed(ctx.indexed);
+    tigrFreeSprite(ctx.sprite);
+    tigrFree(ctx.src);
+    tigrFree(ctx.dst);
+}
+
+// Runs a measurement for at least the given time, and returns Mpix/s.
+static double measure(const Measurement* m, double seconds) {
+    int rounds = 0;
+    double start = now();
+    double elapsed;
+    do {
+        for (int i = 0; i < 16; i++) {
+            m->run(rounds + i);
+        }
+        rounds += 16;
+        elapsed = now() - start;
+    } while (elapsed < seconds);
+    return m->pixels() * rounds / elapsed / 1e6;
+}
+
+int main(int argc, char* argv[]) {
+    int json = 0;
+    double seconds = 0.1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else {
+            seconds = atof(argv[i]);
+        }
+    }
+
+    tigrPreloadFonts();
+
+    double results[NUM_MEASUREMENTS][NUM_SIZES];
+    for (int s = 0; s < NUM_SIZES; s++) {
+        setup(sizes[s]);
+        for (int m = 0; m < NUM_MEASUREMENTS; m++) {
+            measure(&measurements[m], seconds / 10);
+            results[m][s] = measure(&measurements[m], seconds);
+        }
+        teardown();
+    }
+    remove(pngPath);
+
+    if (json) {
+        printf("{\n  \"unit\": \"Mpix/s\",\n  \"results\": [\n");
+        for (int m = 0; m < NUM_MEASUREMENTS; m++) {
+            for (int s = 0; s < NUM_SIZES; s++) {
+                int last = m == NUM_MEASUREMENTS - 1 && s == NUM_SIZES - 1;
+                printf("    { \"name\": \"%s\", \"size\": %d, \"mpix_per_s\": %.2f }%s\n", measurements[m].name,
+                       sizes[s], results[m][s], last ? "" : ",");
+            }
+        }
+        printf("  ]\n}\n");
+        return 0;
+    }
+
+    printf("%-22s", "Mpix/s");
+    for (int s = 0; s < NUM_SIZES; s++) {
+        printf("%10d", sizes[s]);
+    }
+    printf("\n");
+    for (int m = 0; m < NUM_MEASUREMENTS; m++) {
+        printf("%-22s", measurements[m].name);
+        for (int s = 0; s < NUM_SIZES; s++) {
+            printf("%10.1f", results[m][s]);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,58 @@
+//
+// Compares drawing a mostly transparent or opaque sprite
+// with tigrBlitTint and as a compiled sprite.
+//
+
+#include "tigr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double nsPerBlit(Tigr* dst, Tigr* src, TigrSprite* sprite, int rounds) {
+    double start = now();
+    for (int i = 0; i < rounds; i++) {
+        int x = (i * 37) % (dst->w - src->w);
+        int y = (i * 11) % (dst->h - src->h);
+        if (sprite) {
+            tigrBlitSprite(dst, sprite, x, y, tigrRGB(0xff, 0xff, 0xff));
+        } else {
+            tigrBlitTint(dst, src, x, y, 0, 0, src->w, src->h, tigrRGB(0xff, 0xff, 0xff));
+        }
+    }
+    return (now() - start) * 1e9 / rounds;
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 100000;
+
+    // A ball with a soft edge, in a square of transparent pixels.
+    Tigr* src = tigrBitmap(64, 64);
+    for (int y = 0; y < src->h; y++) {
+        for (int x = 0; x < src->w; x++) {
+            int d = (x - 32) * (x - 32) + (y - 32) * (y - 32);
+            int a = d < 26 * 26 ? 255 : d < 30 * 30 ? 255 * (30 * 30 - d) / (30 * 30 - 26 * 26) : 0;
+            tigrPlot(src, x, y, tigrRGBA(x * 4, y * 4, 200, (unsigned char)a));
+        }
+    }
+    Tigr* dst = tigrBitmap(640, 480);
+    TigrSprite* sprite = tigrSprite(src);
+
+    nsPerBlit(dst, src, NULL, rounds / 10);
+    nsPerBlit(dst, src, sprite, rounds / 10);
+    double tint = nsPerBlit(dst, src, NULL, rounds);
+    double compiled = nsPerBlit(dst, src, sprite, rounds);
+
+    printf("tigrBlitTint:   %.0f ns/blit\n", tint);
+    printf("tigrBlitSprite: %.0f ns/blit (%.1fx)\n", compiled, tint / compiled);
+
+    tigrFreeSprite(sprite);
+    tigrFree(dst);
+    tigrFree(src);
+    return 0;
+}
@@ -11,6 +11,7 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -276,6 +277,643 @@ void verifyDrawing() {
     assertBitmapsEqual(bmp, loaded);
 }
 
+void bitmapViews() {
+    Tigr* backing = tigrBitmap(240, 220);
+    TPixel border = tigrRGB(1, 2, 3);
+    tigrClear(backing, border);
+
+    Tigr* view = tigrBitmapFromMemory(backing->pix + 10 * backing->stride + 20, 200, 200, backing->stride);
+    assert(view != NULL);
+    assert(view->stride == 240);
+    drawTestPattern(view);
+    Tigr* loaded = tigrLoadImage("reference.png");
+    assertBitmapsEqual(view, loaded);
+    tigrFree(loaded);
+
+    // Nothing outside the view is touched.
+    for (int y = 0; y < backing->h; y++) {
+        for (int x = 0; x < backing->w; x++) {
+            if (x < 20 || x >= 220 || y < 10 || y >= 210) {
+                assertPixelsEqual(tigrGet(backing, x, y), border);
+            }
+        }
+    }
+
+    // Fonts can be scanned from a view.
+    Tigr* fontImage = tigrLoadImage("5x7.png");
+    Tigr* padded = tigrBitmap(fontImage->w + 7, fontImage->h);
+    tigrBlit(padded, fontImage, 0, 0, 0, 0, fontImage->w, fontImage->h);
+    Tigr* fontView = tigrBitmapFromMemory(padded->pix, fontImage->w, fontImage->h, padded->stride);
+    TigrFont* font = tigrLoadFont(fontImage, TCP_ASCII);
+    TigrFont* viewFont = tigrLoadFont(fontView, TCP_ASCII);
+    assert(font != NULL && viewFont != NULL);
+    assert(tigrTextWidth(font, "Hello") == tigrTextWidth(viewFont, "Hello"));
+    tigrFreeFont(viewFont);
+    tigrFreeFont(font);
+    tigrFree(padded);
+
+    tigrFree(view);
+    assert(tigrBitmapFromMemory(backing->pix, 10, 10, 5) == NULL);
+    tigrFree(backing);
+}
+
+void pixelStorage() {
+    Tigr* bmp = tigrBitmap(100, 100);
+    assert(((size_t)bmp->pix & 63) == 0);
+    assert(bmp->stride == 100);
+    TPixel* pix = bmp->pix;
+    tigrFree(bmp);
+
+    // Freed pixels are recycled, and new bitmaps still start out cleared.
+    bmp = tigrBitmap(100, 100);
+    assert(bmp->pix == pix);
+    assertPixelsEqual(tigrGet(bmp, 99, 99), tigrRGBA(0, 0, 0, 0));
+    tigrFree(bmp);
+
+    // Large bitmaps are mapped directly, and also start out cleared.
+    bmp = tigrBitmap(1024, 1024);
+    assert(((size_t)bmp->pix & 63) == 0);
+    assertPixelsEqual(tigrGet(bmp, 1023, 1023), tigrRGBA(0, 0, 0, 0));
+    tigrFree(bmp);
+
+    bmp = tigrBitmapUninit(1024, 1024);
+    assert(bmp->w == 1024 && bmp->stride == 1024);
+    tigrClear(bmp, tigrRGB(1, 2, 3));
+    assertPixelsEqual(tigrGet(bmp, 1023, 1023), tigrRGB(1, 2, 3));
+    tigrFree(bmp);
+
+    tigrSetRowAlignment(64);
+    bmp = tigrBitmap(200, 200);
+    assert(bmp->stride == 208);
+    tigrSetRowAlignment(4);
+    drawTestPattern(bmp);
+    Tigr* loaded = tigrLoadImage("reference.png");
+    assertBitmapsEqual(bmp, loaded);
+    tigrFree(loaded);
+    tigrFree(bmp);
+}
+
+void largeFills() {
+    tigrSetFillThreads(4);
+    Tigr* bmp = tigrBitmap(2048, 1024);
+    tigrClear(bmp, tigrRGB(1, 2, 3));
+    tigrFill(bmp, 1, 1, 2046, 1022, tigrRGB(4, 5, 6));
+    tigrSetFillThreads(1);
+
+    for (int y = 0; y < bmp->h; y++) {
+        for (int x = 0; x < bmp->w; x++) {
+            int edge = x == 0 || y == 0 || x == bmp->w - 1 || y == bmp->h - 1;
+            assertPixelsEqual(bmp->pix[y * bmp->stride + x], edge ? tigrRGB(1, 2, 3) : tigrRGB(4, 5, 6));
+        }
+    }
+    tigrFree(bmp);
+}
+
+void scaledBlits() {
+    Tigr* img = tigrLoadImage("../tigr.png");
+    assert(img != NULL);
+    TPixel tint = tigrRGBA(200, 150, 255, 180);
+
+    // At 1:1, both filters match tigrBlitTint, clipping included.
+    Tigr* expected = tigrBitmap(100, 80);
+    Tigr* actual = tigrBitmap(100, 80);
+    for (int filter = TIGR_NEAREST; filter <= TIGR_BILINEAR; filter++) {
+        tigrClear(expected, colors[3]);
+        tigrClear(actual, colors[3]);
+        tigrClip(expected, 5, 5, 80, 60);
+        tigrClip(actual, 5, 5, 80, 60);
+        tigrBlitTint(expected, img, -7, 3, 40, 100, 90, 70, tint);
+        tigrBlitScaled(actual, img, -7, 3, 90, 70, 40, 100, 90, 70, tint, filter);
+        assertBitmapsEqual(expected, actual);
+    }
+    tigrFree(expected);
+    tigrFree(actual);
+
+    // Nearest filtering at 2x, mirrored, repeats every source pixel twice.
+    TPixel white = tigrRGB(255, 255, 255);
+    Tigr* scaled = tigrBitmap(40, 20);
+    tigrBlitScaled(scaled, img, 0, 0, -40, 20, 50, 110, 20, 10, white, TIGR_NEAREST);
+    for (int y = 0; y < 20; y++) {
+        for (int x = 0; x < 40; x++) {
+            Tigr* pixel = tigrBitmap(1, 1);
+            tigrBlitTint(pixel, img, 0, 0, 50 + (39 - x) / 2, 110 + y / 2, 1, 1, white);
+            assertPixelsEqual(tigrGet(scaled, x, y), tigrGet(pixel, 0, 0));
+            tigrFree(pixel);
+        }
+    }
+
+    // A quarter turn.
+    float quarter[6] = { 0, -1, 10, 1, 0, 0 };
+    Tigr* rotated = tigrBitmap(20, 20);
+    tigrBlitMode(rotated, TIGR_KEEP_ALPHA);
+    tigrBlitMode(scaled, TIGR_KEEP_ALPHA);
+    tigrClear(scaled, tigrRGBA(0, 0, 0, 0));
+    tigrBlitTransformed(rotated, img, 50, 110, 20, 10, quarter, white, TIGR_NEAREST);
+    tigrBlitTint(scaled, img, 0, 0, 50, 110, 20, 10, white);
+    for (int y = 0; y < 20; y++) {
+        for (int x = 0; x < 10; x++) {
+            assertPixelsEqual(tigrGet(rotated, x, y), tigrGet(scaled, y, 9 - x));
+        }
+    }
+
+    tigrFree(rotated);
+    tigrFree(scaled);
+    tigrFree(img);
+}
+
+void assertPixelsClose(TPixel c1, TPixel c2, int tolerance) {
+    assert(abs(c1.r - c2.r) <= tolerance);
+    assert(abs(c1.g - c2.g) <= tolerance);
+    assert(abs(c1.b - c2.b) <= tolerance);
+    assert(abs(c1.a - c2.a) <= tolerance);
+}
+
+void premultipliedAlpha() {
+    Tigr* straight = tigrLoadImage("../tigr.png");
+    Tigr* premultiplied = tigrLoadImagePremultiplied("../tigr.png");
+    assert(premultiplied != NULL);
+    assert(premultiplied->flags & TIGR_BITMAP_PREMULTIPLIED);
+
+    // Converting after loading gives the same pixels.
+    Tigr* converted = tigrBitmap(straight->w, straight->h);
+    tigrBlit(converted, straight, 0, 0, 0, 0, straight->w, straight->h);
+    tigrPremultiply(converted);
+    assertBitmapsEqual(converted, premultiplied);
+
+    // Blitting onto an opaque target looks the same, give or take rounding.
+    TPixel tints[] = { tigrRGBA(255, 255, 255, 255), tigrRGBA(200, 100, 50, 128) };
+    for (int i = 0; i < 2; i++) {
+        Tigr* a = tigrBitmap(straight->w, straight->h);
+        Tigr* b = tigrBitmap(straight->w, straight->h);
+        tigrClear(a, tigrRGB(30, 60, 90));
+        tigrClear(b, tigrRGB(30, 60, 90));
+        tigrBlitTint(a, straight, 0, 0, 0, 0, straight->w, straight->h, tints[i]);
+        tigrBlitTint(b, premultiplied, 0, 0, 0, 0, straight->w, straight->h, tints[i]);
+        for (int y = 0; y < a->h; y++) {
+            for (int x = 0; x < a->w; x++) {
+                assertPixelsClose(tigrGet(a, x, y), tigrGet(b, x, y), 3);
+            }
+        }
+        tigrFree(a);
+        tigrFree(b);
+    }
+
+    // Converting back restores opaque pixels exactly, and others closely.
+    tigrUnpremultiply(converted);
+    assert(!(converted->flags & TIGR_BITMAP_PREMULTIPLIED));
+    for (int y = 0; y < straight->h; y++) {
+        for (int x = 0; x < straight->w; x++) {
+            TPixel p = tigrGet(straight, x, y);
+            if (p.a == 255) {
+                assertPixelsEqual(tigrGet(converted, x, y), p);
+            } else if (p.a >= 64) {
+                assertPixelsClose(tigrGet(converted, x, y), p, 2);
+            }
+        }
+    }
+
+    tigrFree(converted);
+    tigrFree(premultiplied);
+    tigrFree(straight);
+}
+
+// Blending onto an opaque premultiplied target keeps it opaque, and gives the colors that
+// straight alpha gives when keeping the target alpha, give or take rounding.
+void premultipliedTarget() {
+    Tigr* sprite = tigrBitmap(12, 12);
+    for (int i = 0; i < 12 * 12; i++) {
+        sprite->pix[i] = tigrRGBA(i * 7, 255 - i, i * 3, i * 13);
+    }
+    float m[6] = { 1.5f, 0.5f, 30, -0.5f, 1.5f, 40 };
+
+    Tigr* a = tigrBitmap(64, 64);
+    Tigr* b = tigrBitmap(64, 64);
+    for (int step = 0; step < 9; step++) {
+        tigrClear(a, tigrRGB(30, 60, 90));
+        tigrClear(b, tigrRGB(30, 60, 90));
+        tigrPremultiply(b);
+        for (int i = 0; i < 2; i++) {
+            Tigr* bmp = i ? b : a;
+            tigrBlitMode(bmp, i ? TIGR_BLEND_ALPHA : TIGR_KEEP_ALPHA);
+            switch (step) {
+                case 0:
+                    tigrFillRect(bmp, 2, 2, 30, 30, tigrRGBA(250, 120, 10, 100));
+                    break;
+                case 1:
+                    tigrRect(bmp, 10, 10, 30, 20, tigrRGBA(10, 250, 10, 160));
+                    break;
+                case 2:
+                    tigrLine(bmp, 0, 63, 63, 0, tigrRGBA(255, 255, 255, 60));
+                    break;
+                case 3:
+                    tigrCircle(bmp, 40, 40, 12, tigrRGBA(0, 0, 255, 200));
+                    break;
+                case 4:
+                    tigrFillCircle(bmp, 20, 44, 9, tigrRGBA(255, 0, 128, 90));
+                    break;
+                case 5:
+                    tigrPlot(bmp, 60, 60, tigrRGBA(255, 255, 0, 128));
+                    break;
+                case 6:
+                    tigrBlitTint(bmp, sprite, 44, 4, 0, 0, 12, 12, tigrRGBA(255, 200, 100, 180));
+                    break;
+                case 7:
+                    tigrBlitTransformed(bmp, sprite, 0, 0, 12, 12, m, tigrRGBA(255, 255, 255, 255), TIGR_NEAREST);
+                    break;
+                case 8:
+                    tigrBlitScaled(bmp, sprite, 2, 48, 20, 14, 0, 0, 12, 12, tigrRGBA(100, 255, 255, 200), TIGR_BILINEAR);
+                    break;
+            }
+        }
+        tigrPremultiply(a);
+        for (int y = 0; y < 64; y++) {
+            for (int x = 0; x < 64; x++) {
+                assertPixelsClose(tigrGet(a, x, y), tigrGet(b, x, y), 2);
+            }
+        }
+        tigrUnpremultiply(a);
+    }
+
+    // Fills store the premultiplied color.
+    tigrFill(a, 50, 50, 10, 10, tigrRGBA(200, 100, 50, 128));
+    tigrFill(b, 50, 50, 10, 10, tigrRGBA(200, 100, 50, 128));
+    tigrPremultiply(a);
+    assertPixelsEqual(tigrGet(a, 55, 55), tigrGet(b, 55, 55));
+    tigrClear(b, tigrRGBA(200, 100, 50, 128));
+    assertPixelsEqual(tigrGet(b, 0, 0), tigrRGBA(100, 50, 25, 128));
+
+    tigrFree(sprite);
+    tigrFree(a);
+    tigrFree(b);
+}
+
+void blendModes() {
+    Tigr* src = tigrBitmap(37, 5);
+    Tigr* dst = tigrBitmap(37, 5);
+    Tigr* ref = tigrBitmap(37, 5);
+
+    // Opaque white and black sources hit the ends of each blend.
+    tigrClear(src, tigrRGB(255, 255, 255));
+    tigrClear(dst, tigrRGBA(100, 150, 200, 40));
+    tigrBlitBlend(dst, src, 0, 0, 0, 0, src->w, src->h, tigrRGB(255, 255, 255), TIGR_ADD);
+    assertPixelsEqual(tigrGet(dst, 36, 4), tigrRGB(255, 255, 255));
+    tigrClear(dst, tigrRGB(100, 150, 200));
+    tigrBlitBlend(dst, src, 0, 0, 0, 0, src->w, src->h, tigrRGB(255, 255, 255), TIGR_MULTIPLY);
+    assertPixelsEqual(tigrGet(dst, 36, 4), tigrRGB(100, 150, 200));
+    tigrBlitBlend(dst, src, 0, 0, 0, 0, src->w, src->h, tigrRGB(0, 0, 0), TIGR_SCREEN);
+    assertPixelsEqual(tigrGet(dst, 36, 4), tigrRGB(100, 150, 200));
+    tigrBlitBlend(dst, src, 0, 0, 0, 0, src->w, src->h, tigrRGB(255, 0, 255), TIGR_MULTIPLY);
+    assertPixelsEqual(tigrGet(dst, 36, 4), tigrRGB(100, 0, 200));
+    tigrBlitBlend(dst, src, 0, 0, 0, 0, src->w, src->h, tigrRGB(0, 255, 0), TIGR_SCREEN);
+    assertPixelsEqual(tigrGet(dst, 36, 4), tigrRGB(100, 255, 200));
+
+    // Transparent sources leave the target alone.
+    tigrClear(src, tigrRGBA(255, 0, 0, 0));
+    tigrClear(dst, tigrRGB(100, 150, 200));
+    for (int blend = TIGR_ADD; blend <= TIGR_SCREEN; blend++) {
+        tigrBlitBlend(dst, src, 0, 0, 0, 0, src->w, src->h, tigrRGB(255, 255, 255), blend);
+        assertPixelsEqual(tigrGet(dst, 20, 2), tigrRGB(100, 150, 200));
+    }
+
+    // Whole rows, which take the vector path, match blending one pixel at a time.
+    srand(45);
+    for (int i = 0; i < src->w * src->h; i++) {
+        src->pix[i] = tigrRGBA(rand(), rand(), rand(), rand());
+        dst->pix[i] = tigrRGBA(rand(), rand(), rand(), rand());
+    }
+    TPixel tint = tigrRGBA(250, 180, 90, 200);
+    for (int mode = TIGR_KEEP_ALPHA; mode <= TIGR_BLEND_ALPHA; mode++) {
+        for (int blend = TIGR_ADD; blend <= TIGR_SCREEN; blend++) {
+            for (int premultiplied = 0; premultiplied < 2; premultiplied++) {
+                Tigr* out = tigrBitmap(dst->w, dst->h);
+                tigrBlit(out, dst, 0, 0, 0, 0, dst->w, dst->h);
+                tigrBlit(ref, dst, 0, 0, 0, 0, dst->w, dst->h);
+                src->flags = premultiplied ? TIGR_BITMAP_PREMULTIPLIED : 0;
+                tigrBlitMode(out, mode);
+                tigrBlitMode(ref, mode);
+                tigrBlitBlend(out, src, 0, 0, 0, 0, src->w, src->h, tint, blend);
+                for (int y = 0; y < src->h; y++) {
+                    for (int x = 0; x < src->w; x++) {
+                        tigrBlitBlend(ref, src, x, y, x, y, 1, 1, tint, blend);
+                    }
+                }
+                assertBitmapsEqual(out, ref);
+                tigrFree(out);
+            }
+        }
+    }
+
+    tigrFree(ref);
+    tigrFree(dst);
+    tigrFree(src);
+}
+
+void sprites() {
+    // Transparent, opaque and partly transparent areas, with runs of each kind.
+    Tigr* src = tigrBitmap(45, 30);
+    for (int y = 0; y < src->h; y++) {
+        for (int x = 0; x < src->w; x++) {
+            int d = (x - 22) * (x - 22) + (y - 15) * (y - 15);
+            unsigned char a = d < 100 ? 255 : d < 200 ? (unsigned char)(255 - d) : (x + y) % 7 == 0 ? 90 : 0;
+            tigrPlot(src, x, y, tigrRGBA(x * 5, y * 8, 128, a));
+        }
+    }
+    src->pix[0] = tigrRGBA(1, 2, 3, 255);
+
+    TPixel tints[] = { tigrRGBA(255, 255, 255, 255), tigrRGBA(200, 100, 50, 128) };
+    int offsets[][2] = { { 10, 5 }, { -7, -3 }, { 50, 40 }, { 57, 2 } };
+    for (int premultiplied = 0; premultiplied < 2; premultiplied++) {
+        if (premultiplied) {
+            tigrPremultiply(src);
+        }
+        TigrSprite* sprite = tigrSprite(src);
+        assert(sprite != NULL);
+        assert(sprite->w == src->w && sprite->h == src->h);
+
+        for (int mode = TIGR_KEEP_ALPHA; mode <= TIGR_BLEND_ALPHA; mode++) {
+            for (int t = 0; t < 2; t++) {
+                for (int o = 0; o < 4; o++) {
+                    Tigr* a = tigrBitmap(80, 60);
+                    Tigr* b = tigrBitmap(80, 60);
+                    tigrClear(a, tigrRGBA(30, 60, 90, 100));
+                    tigrClear(b, tigrRGBA(30, 60, 90, 100));
+                    tigrBlitMode(a, mode);
+                    tigrBlitMode(b, mode);
+                    tigrClip(a, 3, 4, 70, 50);
+                    tigrClip(b, 3, 4, 70, 50);
+                    tigrBlitTint(a, src, offsets[o][0], offsets[o][1], 0, 0, src->w, src->h, tints[t]);
+                    tigrBlitSprite(b, sprite, offsets[o][0], offsets[o][1], tints[t]);
+                    assertBitmapsEqual(a, b);
+                    tigrFree(a);
+                    tigrFree(b);
+                }
+            }
+        }
+        tigrFreeSprite(sprite);
+    }
+
+    tigrFree(src);
+}
+
+void opacityTracking() {
+    Tigr* src = tigrBitmap(40, 30);
+    tigrClear(src, tigrRGBA(10, 20, 30, 0));
+    tigrFill(src, 0, 0, 40, 10, tigrRGB(200, 100, 50));
+    tigrFill(src, 5, 20, 20, 5, tigrRGBA(90, 80, 70, 128));
+    Tigr* plain = tigrBitmap(40, 30);
+    tigrBlit(plain, src, 0, 0, 0, 0, src->w, src->h);
+    tigrTrackOpacity(src, 1);
+    assert(src->opacity != NULL);
+
+    // Blits match those without tracking, also after drawing and direct changes.
+    TPixel tints[] = { tigrRGBA(255, 255, 255, 255), tigrRGBA(200, 100, 50, 128) };
+    for (int step = 0; step < 3; step++) {
+        if (step == 1) {
+            tigrLine(src, 0, 0, 39, 29, tigrRGBA(0, 0, 0, 0));
+            tigrLine(plain, 0, 0, 39, 29, tigrRGBA(0, 0, 0, 0));
+        } else if (step == 2) {
+            src->pix[15 * src->stride + 3] = tigrRGBA(1, 2, 3, 4);
+            plain->pix[15 * plain->stride + 3] = tigrRGBA(1, 2, 3, 4);
+            tigrDirty(src, 3, 15, 1, 1);
+        }
+        for (int mode = TIGR_KEEP_ALPHA; mode <= TIGR_BLEND_ALPHA; mode++) {
+            for (int t = 0; t < 2; t++) {
+                Tigr* a = tigrBitmap(50, 40);
+                Tigr* b = tigrBitmap(50, 40);
+                tigrClear(a, tigrRGBA(30, 60, 90, 100));
+                tigrClear(b, tigrRGBA(30, 60, 90, 100));
+                tigrBlitMode(a, mode);
+                tigrBlitMode(b, mode);
+                tigrBlitTint(a, src, 3, 4, 0, 0, src->w, src->h, tints[t]);
+                tigrBlitTint(b, plain, 3, 4, 0, 0, plain->w, plain->h, tints[t]);
+                assertBitmapsEqual(a, b);
+                tigrFree(a);
+                tigrFree(b);
+            }
+        }
+    }
+
+    tigrFree(plain);
+    tigrFree(src);
+}
+
+void indexedBitmaps() {
+    // Paletted PNGs keep their indices, and blit like the loaded image.
+    Tigr* image = tigrLoadImage("ch.png");
+    TigrIndexed* indexed = tigrLoadIndexed("ch.png");
+    assert(indexed != NULL);
+    assert(indexed->w == image->w && indexed->h == image->h && indexed->bits == 8);
+    Tigr* a = tigrBitmap(image->w, image->h);
+    Tigr* b = tigrBitmap(image->w, image->h);
+    tigrBlitTint(a, image, 0, 0, 0, 0, image->w, image->h, tigrRGB(255, 255, 255));
+    tigrBlitIndexed(b, indexed, 0, 0, 0, 0, indexed->w, indexed->h, tigrRGB(255, 255, 255));
+    assertBitmapsEqual(a, b);
+    tigrFree(a);
+    tigrFree(b);
+    tigrFreeIndexed(indexed);
+    assert(tigrLoadIndexed("reference.png") == NULL);
+
+    // Every index size blits like its colors would, tinted or not, and recolors with the palette.
+    TPixel tints[] = { tigrRGBA(255, 255, 255, 255), tigrRGBA(200, 100, 50, 128) };
+    for (int bits = 1; bits <= 8; bits *= 2) {
+        TigrIndexed* src = tigrIndexed(37, 9, bits);
+        assert(src != NULL);
+        for (int y = 0; y < src->h; y++) {
+            for (int x = 0; x < src->w; x++) {
+                tigrSetIndex(src, x, y, (x * 7 + y * 3) % (1 << bits));
+                assert(tigrGetIndex(src, x, y) == (x * 7 + y * 3) % (1 << bits));
+            }
+        }
+        for (int palette = 0; palette < 2; palette++) {
+            for (int i = 0; i < 256; i++) {
+                unsigned char alpha = palette ? (unsigned char)(i * 40) : (i & 1) ? 255 : 0;
+                src->palette[i] = tigrRGBA(i * 50, 255 - i * 30, 128 + palette * 60, alpha);
+            }
+            Tigr* colors = tigrBitmap(src->w, src->h);
+            for (int y = 0; y < src->h; y++) {
+                for (int x = 0; x < src->w; x++) {
+                    colors->pix[y * colors->stride + x] = src->palette[tigrGetIndex(src, x, y)];
+                }
+            }
+            for (int t = 0; t < 2; t++) {
+                a = tigrBitmap(40, 12);
+                b = tigrBitmap(40, 12);
+                tigrClear(a, tigrRGBA(30, 60, 90, 100));
+                tigrClear(b, tigrRGBA(30, 60, 90, 100));
+                tigrBlitTint(a, colors, 5, 4, 3, 1, 33, 8, tints[t]);
+                tigrBlitIndexed(b, src, 5, 4, 3, 1, 33, 8, tints[t]);
+                assertBitmapsEqual(a, b);
+                tigrFree(a);
+                tigrFree(b);
+            }
+            tigrFree(colors);
+        }
+        tigrFreeIndexed(src);
+    }
+
+    tigrFree(image);
+}
+
+void tiledBitmaps() {
+    Tigr* bmp = tigrBitmap(45, 30);
+    TigrTiled* tiled = tigrTiled(45, 30);
+    assert(tiled != NULL);
+    srand(49);
+    for (int i = 0; i < bmp->w * bmp->h; i++) {
+        bmp->pix[i] = tigrRGBA(rand(), rand(), rand(), rand());
+    }
+
+    // Copying into tiles and back keeps every pixel.
+    tigrTile(tiled, bmp);
+    for (int y = 0; y < bmp->h; y++) {
+        for (int x = 0; x < bmp->w; x++) {
+            assertPixelsEqual(tigrTiledGet(tiled, x, y), tigrGet(bmp, x, y));
+        }
+    }
+
+    // Drawing into tiles matches drawing into rows.
+    tigrFill(bmp, 3, 5, 30, 20, tigrRGB(10, 20, 30));
+    tigrTiledFill(tiled, 3, 5, 30, 20, tigrRGB(10, 20, 30));
+    tigrFill(bmp, -4, 14, 60, 2, tigrRGBA(1, 2, 3, 4));
+    tigrTiledFill(tiled, -4, 14, 60, 2, tigrRGBA(1, 2, 3, 4));
+    tigrLine(bmp, 40, -2, 2, 29, tigrRGBA(200, 100, 0, 128));
+    tigrTiledLine(tiled, 40, -2, 2, 29, tigrRGBA(200, 100, 0, 128));
+    tigrPlot(bmp, 44, 29, tigrRGBA(0, 255, 0, 200));
+    tigrTiledPlot(tiled, 44, 29, tigrRGBA(0, 255, 0, 200));
+    Tigr* linear = tigrBitmap(45, 30);
+    tigrLinearize(linear, tiled);
+    assertBitmapsEqual(linear, bmp);
+
+    // Transformed blits read the same pixels.
+    const float m[6] = { 0.8f, -0.6f, 20, 0.6f, 0.8f, 2 };
+    for (int filter = TIGR_NEAREST; filter <= TIGR_BILINEAR; filter++) {
+        Tigr* a = tigrBitmap(60, 50);
+        Tigr* b = tigrBitmap(60, 50);
+        tigrBlitTransformed(a, bmp, 2, 1, 40, 27, m, tigrRGBA(255, 200, 100, 220), filter);
+        tigrBlitTiledTransformed(b, tiled, 2, 1, 40, 27, m, tigrRGBA(255, 200, 100, 220), filter);
+        assertBitmapsEqual(a, b);
+        tigrFree(a);
+        tigrFree(b);
+    }
+
+    tigrFree(linear);
+    tigrFreeTiled(tiled);
+    tigrFree(bmp);
+}
+
+void fontMetrics() {
+    Tigr* fontImage = tigrLoadImage("ch.png");
+    TigrFont* font = tigrLoadFont(fontImage, TCP_UTF32);
+    assert(font != 0);
+    assert(tigrSaveFontMetrics("ch.metrics", font));
+
+    int length = 0;
+    void* metrics = tigrReadFile("ch.metrics", &length);
+    assert(metrics != 0);
+    remove("ch.metrics");
+
+    TigrFont* loaded = tigrLoadFontMetrics(tigrLoadImage("ch.png"), metrics, length);
+    assert(loaded != 0);
+    assert(loaded->numGlyphs == font->numGlyphs);
+    assert(memcmp(loaded->glyphs, font->glyphs, font->numGlyphs * sizeof(TigrGlyph)) == 0);
+    tigrFreeFont(loaded);
+
+    assert(tigrLoadFontMetrics(tigrLoadImage("ch.png"), metrics, length / 2) == 0);
+
+    // Glyph rectangles that would wrap around when added up are rejected.
+    unsigned char* glyph = (unsigned char*)metrics + 16;
+    memcpy(glyph + 4, "\x01\x00\x00\x00", 4);
+    memcpy(glyph + 12, "\xff\xff\xff\x7f", 4);
+    assert(tigrLoadFontMetrics(tigrLoadImage("ch.png"), metrics, length) == 0);
+
+    free(metrics);
+    tigrFreeFont(font);
+
+    // A single glyph, without '?' to stand in for the others.
+    const unsigned char tiny[] = { 'T', 'F', 'N', 'T', 1, 0, 0, 0, 'G', 'L', 'Y', 'F', 20, 0, 0, 0,
+                                   'A', 0,   0,   0,   0, 0, 0, 0, 0,   0,   0,   0,   5,  0, 0, 0, 7, 0, 0, 0 };
+    TigrFont* single = tigrLoadFontMetrics(tigrLoadImage("5x7.png"), tiny, sizeof(tiny));
+    assert(single != 0);
+    assert(single->numGlyphs == 1);
+    assert(tigrTextWidth(single, "A~z") == 15);
+    Tigr* canvas = tigrBitmap(32, 8);
+    tigrPrint(canvas, single, 0, 0, tigrRGB(255, 255, 255), "~z");
+    tigrFree(canvas);
+    tigrFreeFont(single);
+}
+
+void fontKerning() {
+    TigrFont* font = tigrLoadFont(tigrLoadImage("5x7.png"), TCP_ASCII);
+    assert(font != 0);
+    int plainWidth = tigrTextWidth(font, "AVA");
+
+    TigrKerningPair pairs[] = { { 'A', 'V', -2 }, { 'V', 'A', -1 }, { 'A', 'A', 0 } };
+    tigrSetFontKerning(font, pairs, 3);
+    assert(tigrTextWidth(font, "AVA") == plainWidth - 3);
+    assert(tigrTextWidth(font, "AA") == 2 * tigrTextWidth(font, "A"));
+
+    assert(tigrSaveFontMetrics("5x7.metrics", font));
+    int length = 0;
+    void* metrics = tigrReadFile("5x7.metrics", &length);
+    assert(metrics != 0);
+    remove("5x7.metrics");
+
+    TigrFont* loaded = tigrLoadFontMetrics(tigrLoadImage("5x7.png"), metrics, length);
+    assert(loaded != 0);
+    assert(tigrTextWidth(loaded, "AVA") == plainWidth - 3);
+    tigrFreeFont(loaded);
+
+    tigrSetFontKerning(font, 0, 0);
+    assert(font->kerning == 0);
+    assert(tigrTextWidth(font, "AVA") == plainWidth);
+
+    free(metrics);
+    tigrFreeFont(font);
+}
+
+void dirtyTracking() {
+    Tigr* bmp = tigrBitmap(100, 100);
+    TPixel color = tigrRGB(255, 0, 0);
+
+    tigrPlot(bmp, 0, 0, color);
+    assert(bmp->dirty == 0);
+
+    tigrTrackDirty(bmp, 1);
+    assert(bmp->dirty != 0);
+    assert(bmp->dirty->full);
+    bmp->dirty->full = 0;
+
+    tigrPlot(bmp, 10, 10, color);
+    assert(bmp->dirty->count == 1);
+    int expected[4] = { 10, 10, 11, 11 };
+    assert(memcmp(bmp->dirty->rects[0], expected, sizeof(expected)) == 0);
+
+    // Touching regions are merged
+    tigrPlot(bmp, 11, 10, color);
+    tigrFill(bmp, 10, 11, 2, 2, color);
+    assert(bmp->dirty->count == 1);
+
+    // Regions are clipped
+    tigrFill(bmp, 90, 90, 20, 20, color);
+    assert(bmp->dirty->count == 2);
+    assert(bmp->dirty->rects[1][2] == 100 && bmp->dirty->rects[1][3] == 100);
+    tigrLine(bmp, -10, -10, -5, -5, color);
+    assert(bmp->dirty->count == 2);
+
+    // Running out of rects grows existing ones
+    for (int i = 0; i < 2 * TIGR_MAX_DIRTY; i++) {
+        tigrPlot(bmp, 3 * i, 50, color);
+    }
+    assert(bmp->dirty->count == TIGR_MAX_DIRTY);
+
+    tigrClear(bmp, color);
+    assert(bmp->dirty->full);
+
+    tigrTrackDirty(bmp, 0);
+    assert(bmp->dirty == 0);
+    tigrFree(bmp);
+}
+
 void directOpenGL() {
     Tigr* win = tigrWindow(100, 100, "CI", 0);
     assert(tigrBeginOpenGL(win));
@@ -303,6 +941,34 @@ void customShader() {
     tigrFree(win);
 }
 
+void postPasses() {
+    Tigr* win = tigrWindow(100, 100, "CI", 0);
+
+    const char copy[] =
+        "void fxShader(out vec4 color, in vec2 uv) {"
+        "   color = texture(image, uv);"
+        "}\n";
+    const char tint[] =
+        "layout(std140) uniform PassUniforms { vec4 tint; };"
+        "void fxShader(out vec4 color, in vec2 uv) {"
+        "   color = texture(image, uv) * tint + texture(source, uv) * (1.0 - tint);"
+        "}\n";
+
+    int half = tigrAddPostPass(win, copy, sizeof(copy) - 1, 0.5f);
+    int full = tigrAddPostPass(win, tint, sizeof(tint) - 1, 1.0f);
+    assert(half >= 0 && full >= 0 && half != full);
+    float color[4] = { 1, 0.5f, 0.25f, 1 };
+    tigrSetPostPassUniforms(win, full, color, sizeof(color));
+    tigrUpdate(win);
+
+    tigrEnablePostPass(win, half, 0);
+    tigrUpdate(win);
+    tigrEnablePostPass(win, half, 1);
+    tigrEnablePostPass(win, full, 0);
+    tigrUpdate(win);
+    tigrFree(win);
+}
+
 void timing() {
     float elapsed = tigrTime();
     assert(elapsed == 0);
@@ -314,6 +980,118 @@ void timing() {
     assert(elapsed > 0 && elapsed < 1);
 }
 
+void frameStats() {
+    TigrFrameStats stats;
+
+    Tigr* bmp = tigrBitmap(10, 10);
+    tigrGetFrameStats(bmp, &stats);
+    assert(stats.frames == 0);
+    tigrFree(bmp);
+
+    Tigr* win = tigrWindow(100, 100, "CI", 0);
+    for (int i = 0; i < 3; i++) {
+        tigrUpdate(win);
+    }
+    tigrGetFrameStats(win, &stats);
+    assert(stats.frames == 3);
+
+    int timed = 0;
+    for (int i = 0; i < TIGR_STATS_BUCKETS; i++) {
+        timed += stats.histogram[i];
+    }
+    assert(timed == 2);
+    assert(stats.frame > 0 && stats.worstFrame >= stats.frame);
+    tigrFree(win);
+}
+
+void frameRate() {
+    TigrFrameStats stats;
+
+    Tigr* win = tigrWindow(100, 100, "CI", 0);
+    tigrSetSwapInterval(win, 0);
+    tigrSetFrameRate(win, 25);
+    for (int i = 0; i < 5; i++) {
+        tigrUpdate(win);
+    }
+    tigrGetFrameStats(win, &stats);
+    assert(stats.frame > 35 && stats.frame < 1000);
+    tigrFree(win);
+}
+
+void timers() {
+    TigrTimer first = { 0 };
+    TigrTimer second = { 0 };
+    assert(tigrTimerDelta(&first) == 0);
+
+    unsigned long long start = tigrTimeNs();
+    while (tigrTimeNs() - start < 2000000) {
+    }
+
+    // Timers are independent of each other.
+    assert(tigrTimerDelta(&second) == 0);
+    float elapsed = tigrTimerDelta(&first);
+    assert(elapsed >= 0.002f && elapsed < 1);
+}
+
+#if !defined(_WIN32) && !defined(__ANDROID__)
+void sharedFrames() {
+    for (int buffers = 2; buffers <= 3; buffers++) {
+        Tigr* producer = tigrShared(NULL, 64, 48, buffers, TIGR_SHARED_KEEP);
+        assert(producer != NULL);
+        Tigr* consumer = tigrSharedOpen(NULL, tigrSharedFd(producer));
+        assert(consumer != NULL);
+        assert(consumer->w == 64 && consumer->h == 48);
+        assert(!tigrSharedAcquire(consumer));
+
+        for (int frame = 0; frame < 4; frame++) {
+            tigrFill(producer, frame, 0, 1, 1, tigrRGB(255, 0, frame));
+            assert(tigrSharedPublish(producer));
+            assert(tigrSharedAcquire(consumer));
+            assert(!tigrSharedAcquire(consumer));
+            assert(consumer->pix != producer->pix);
+            // Drawing continues from the published frame.
+            assertBitmapsEqual(consumer, producer);
+            // Releases the held frame, so that double buffering can proceed.
+            tigrFree(consumer);
+            consumer = tigrSharedOpen(NULL, tigrSharedFd(producer));
+        }
+
+        tigrFree(consumer);
+        tigrFree(producer);
+    }
+
+    // A consumer holding on to the other of two buffers times out publishing.
+    Tigr* producer = tigrShared(NULL, 8, 8, 2, 0);
+    Tigr* consumer = tigrSharedOpen(NULL, tigrSharedFd(producer));
+    assert(tigrSharedPublish(producer));
+    assert(tigrSharedAcquire(consumer));
+    tigrClear(producer, tigrRGB(4, 5, 6));
+    assert(!tigrSharedPublish(producer) && errno == ETIMEDOUT);
+    // The frame was published anyway, and publishing recovers once the buffer is let go.
+    tigrFree(consumer);
+    consumer = tigrSharedOpen(NULL, tigrSharedFd(producer));
+    assert(tigrSharedAcquire(consumer));
+    assertPixelsEqual(tigrGet(consumer, 7, 7), tigrRGB(4, 5, 6));
+    tigrFree(consumer);
+    assert(tigrSharedPublish(producer));
+    tigrFree(producer);
+
+    char name[64];
+    snprintf(name, sizeof(name), "/tigr-ci-%d", rand());
+    producer = tigrShared(name, 16, 16, 3, 0);
+    assert(producer != NULL);
+    tigrClear(producer, tigrRGB(1, 2, 3));
+    assert(tigrSharedPublish(producer));
+    consumer = tigrSharedOpen(name, -1);
+    assert(consumer != NULL);
+    assert(tigrSharedAcquire(consumer));
+    assertPixelsEqual(tigrGet(consumer, 15, 15), tigrRGB(1, 2, 3));
+    tigrFree(consumer);
+    tigrFree(producer);
+    assert(tigrSharedOpen(name, -1) == NULL);
+}
+#endif
+
 void input() {
     Tigr* win = tigrWindow(100, 100, "CI", 0);
     tigrUpdate(win);
@@ -321,6 +1099,23 @@ void input() {
     assert(tigrKeyHeld(win, TK_CONTROL) == tigrKeyDown(win, TK_CONTROL));
     assert(tigrReadChar(win) == 0);
 
+    // Events are read once, in order, and not replayed on the next frame.
+    TigrEvent event;
+    unsigned long long last = 0;
+    int polled = 0;
+    while (tigrPollEvent(win, &event)) {
+        assert(event.type >= TIGR_EVENT_KEY_DOWN && event.type <= TIGR_EVENT_TOUCH_UP);
+        assert(++polled <= 256);
+        last = event.time;
+    }
+    assert(tigrPollEvent(win, &event) == 0);
+    tigrUpdate(win);
+    polled = 0;
+    while (tigrPollEvent(win, &event)) {
+        assert(polled++ > 0 || event.time >= last);
+    }
+    assert(tigrPollEvent(win, &event) == 0);
+
     int nothing = 100000;
     int x = nothing;
     int y = nothing;
@@ -371,9 +1166,30 @@ int main(int argc, char* argv[]) {
     Test tests[] = { { "Create offscreen", offscreen, 0 },
                      { "Drawing API", verifyDrawing, 0 },
                      { "Window basics", windowBasics, 1 },
+                     { "Bitmap views", bitmapViews, 0 },
+                     { "Pixel storage", pixelStorage, 0 },
+                     { "Large fills", largeFills, 0 },
+                     { "Scaled blits", scaledBlits, 0 },
+                     { "Premultiplied alpha", premultipliedAlpha, 0 },
+                     { "Premultiplied targets", premultipliedTarget, 0 },
+                     { "Blend modes", blendModes, 0 },
+                     { "Sprites", sprites, 0 },
+                     { "Opacity tracking", opacityTracking, 0 },
+                     { "Indexed bitmaps", indexedBitmaps, 0 },
+                     { "Tiled bitmaps", tiledBitmaps, 0 },
                      { "Unicode", unicode, 0 },
+                     { "Font metrics", fontMetrics, 0 },
+                     { "Font kerning", fontKerning, 0 },
+                     { "Dirty tracking", dirtyTracking, 0 },
                      { "Timing", timing, 1 },
+                     { "Timers", timers, 0 },
+#if !defined(_WIN32) && !defined(__ANDROID__)
+                     { "Shared frames", sharedFrames, 0 },
+#endif
+                     { "Frame stats", frameStats, 1 },
+                     { "Frame rate cap", frameRate, 1 },
                      { "Custom fx shader", customShader, 2 },
+                     { "Post passes", postPasses, 2 },
                      { "Direct OpenGL calls", directOpenGL, 2 },
                      { "Input processing", input, 1 },
                      { 0 } };
@@ -6,6 +6,7 @@
 #include "tigr_upscale_gl_fs.h"
 
 #include "tigr_bitmaps.c"
+#include "tigr_shared.c"
 #include "tigr_loadpng.c"
 #include "tigr_savepng.c"
 #include "tigr_inflate.c"
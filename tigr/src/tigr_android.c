@@ -391,11 +391,76 @@ static int tigrKeyFromAndroidKey(int key) {
     }
 }
 
+static int toWindowX(TigrInternal* win, int x) {
+    return (x - win->pos[0]) / win->scale;
+}
+
+static int toWindowY(TigrInternal* win, int y) {
+    return (y - win->pos[1]) / win->scale;
+}
+
+// Queues touch events for the pointers changed by a motion event,
+// including the moves batched up since the last one.
+static void pushTouchEvents(TigrInternal* win, AInputEvent* motion, int32_t action) {
+    int32_t actionCode = action & AMOTION_EVENT_ACTION_MASK;
+    size_t index = (action & AMOTION_EVENT_ACTION_POINTER_INDEX_MASK) >> AMOTION_EVENT_ACTION_POINTER_INDEX_SHIFT;
+    size_t count = AMotionEvent_getPointerCount(motion);
+    TigrEvent event = { 0 };
+
+    for (size_t i = 0; i < count; i++) {
+        event.key = AMotionEvent_getPointerId(motion, i);
+        switch (actionCode) {
+            case AMOTION_EVENT_ACTION_DOWN:
+            case AMOTION_EVENT_ACTION_POINTER_DOWN:
+                event.type = TIGR_EVENT_TOUCH_DOWN;
+                break;
+            case AMOTION_EVENT_ACTION_UP:
+            case AMOTION_EVENT_ACTION_POINTER_UP:
+            case AMOTION_EVENT_ACTION_CANCEL:
+                event.type = TIGR_EVENT_TOUCH_UP;
+                break;
+            case AMOTION_EVENT_ACTION_MOVE:
+                event.type = TIGR_EVENT_TOUCH_MOVE;
+                for (size_t h = 0; h < AMotionEvent_getHistorySize(motion); h++) {
+                    event.time = AMotionEvent_getHistoricalEventTime(motion, h);
+                    event.x = toWindowX(win, AMotionEvent_getHistoricalX(motion, i, h));
+                    event.y = toWindowY(win, AMotionEvent_getHistoricalY(motion, i, h));
+                    tigrPushEvent(win, &event);
+                }
+                break;
+            default:
+                return;
+        }
+        if (event.type != TIGR_EVENT_TOUCH_MOVE && actionCode != AMOTION_EVENT_ACTION_CANCEL && i != index) {
+            continue;
+        }
+        event.time = AMotionEvent_getEventTime(motion);
+        event.x = toWindowX(win, AMotionEvent_getX(motion, i));
+        event.y = toWindowY(win, AMotionEvent_getY(motion, i));
+        tigrPushEvent(win, &event);
+    }
+}
+
 static int processInputEvent(AInputEvent* event, TigrInternal* win) {
     if (AInputEvent_getType(event) == AINPUT_EVENT_TYPE_MOTION) {
         int32_t action = AMotionEvent_getAction(event);
         int32_t actionCode = action & AMOTION_EVENT_ACTION_MASK;
 
+        if (actionCode == AMOTION_EVENT_ACTION_SCROLL) {
+            if (win) {
+                TigrEvent wheel = { 0 };
+                wheel.type = TIGR_EVENT_WHEEL;
+                wheel.time = AMotionEvent_getEventTime(event);
+                wheel.dx = AMotionEvent_getAxisValue(event, AMOTION_EVENT_AXIS_HSCROLL, 0);
+                wheel.dy = AMotionEvent_getAxisValue(event, AMOTION_EVENT_AXIS_VSCROLL, 0);
+                tigrPushEvent(win, &wheel);
+            }
+            return 1;
+        }
+        if (win) {
+            pushTouchEvents(win, event, action);
+        }
+
         size_t touchPoints = AMotionEvent_getPointerCount(event);
         size_t releasedIndex = -1;
         if (actionCode == AMOTION_EVENT_ACTION_POINTER_UP) {
@@ -434,11 +499,23 @@ static int processInputEvent(AInputEvent* event, TigrInternal* win) {
         // We pass the character in the scancode field from the Java side
         int32_t unicodeChar = AKeyEvent_getScanCode(event);
 
+        TigrEvent keyEvent = { 0 };
+        keyEvent.time = AKeyEvent_getEventTime(event);
+        keyEvent.key = key;
+
         if (action == AKEY_EVENT_ACTION_DOWN) {
             win->keys[key] = 1;
-            win->lastChar = unicodeChar;
+            keyEvent.type = TIGR_EVENT_KEY_DOWN;
+            tigrPushEvent(win, &keyEvent);
+            if (unicodeChar) {
+                keyEvent.type = TIGR_EVENT_CHAR;
+                keyEvent.key = unicodeChar;
+                tigrPushEvent(win, &keyEvent);
+            }
         } else if (action == AKEY_EVENT_ACTION_UP) {
             win->released[key] = 1;
+            keyEvent.type = TIGR_EVENT_KEY_UP;
+            tigrPushEvent(win, &keyEvent);
         }
         return 1;
     }
@@ -548,7 +625,6 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
     win->closed = 0;
     win->scale = scale;
 
-    win->lastChar = 0;
     win->flags = flags;
     win->p1 = win->p2 = win->p3 = 0;
     win->p4 = 1;
@@ -579,6 +655,11 @@ int tigrClosed(Tigr* bmp) {
     return win->closed;
 }
 
+int tigrSetSwapInterval(Tigr* bmp, int interval) {
+    // EGL has no adaptive vsync.
+    return interval >= 0 && eglSwapInterval(gState.display, interval);
+}
+
 int tigrGAPIBegin(Tigr* bmp) {
     assert(gState.display != EGL_NO_DISPLAY);
     assert(gState.surface != EGL_NO_SURFACE);
@@ -611,10 +692,7 @@ int tigrKeyHeld(Tigr* bmp, int key) {
 }
 
 int tigrReadChar(Tigr* bmp) {
-    TigrInternal* win = tigrInternal(bmp);
-    int c = win->lastChar;
-    win->lastChar = 0;
-    return c;
+    return tigrPopChar(tigrInternal(bmp));
 }
 
 static void tigrUpdateModifiers(TigrInternal* win) {
@@ -623,23 +701,18 @@ static void tigrUpdateModifiers(TigrInternal* win) {
     win->keys[TK_ALT] = win->keys[TK_LALT] || win->keys[TK_RALT];
 }
 
-static int toWindowX(TigrInternal* win, int x) {
-    return (x - win->pos[0]) / win->scale;
-}
-
-static int toWindowY(TigrInternal* win, int y) {
-    return (y - win->pos[1]) / win->scale;
-}
-
 void tigrUpdate(Tigr* bmp) {
     TigrInternal* win = tigrInternal(bmp);
+    tigrFrameBegin(win);
     memcpy(win->prev, win->keys, 256);
     for (int i = 0; i < 256; i++) {
         win->keys[i] ^= win->released[i];
         win->released[i] = 0;
     }
 
-    if (!processEvents(win)) {
+    int alive = processEvents(win);
+    tigrNextEvents(win);
+    if (!alive) {
         win->closed = 1;
         return;
     }
@@ -675,9 +748,13 @@ void tigrUpdate(Tigr* bmp) {
 
     tigrPosition(bmp, win->scale, gState.screenW, gState.screenH, win->pos);
     tigrGAPIBegin(bmp);
+    tigrFrameStage(win, TIGR_STAGE_INPUT);
     tigrGAPIPresent(bmp, gState.screenW, gState.screenH);
+    tigrFrameStage(win, TIGR_STAGE_DRAW);
     android_swap(gState.display, gState.surface);
     tigrGAPIEnd(bmp);
+    tigrFrameEnd(win, TIGR_STAGE_SWAP);
+    tigrFrameWait(win);
 }
 
 void tigrFree(Tigr* bmp) {
@@ -695,7 +772,9 @@ void tigrFree(Tigr* bmp) {
 
         win->context = EGL_NO_CONTEXT;
     }
-    free(bmp->pix);
+    free(bmp->dirty);
+    free(bmp->opacity);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -1,6 +1,15 @@
 #include "tigr_internal.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 // Expands 0-255 into 0-256
 #define EXPAND(X) ((X) + ((X) > 0))
@@ -27,47 +36,388 @@
     if (w <= 0 || h <= 0)       \
     return
 
-Tigr* tigrBitmap2(int w, int h, int extra) {
+// Records a changed region, if tracking.
+#define MARK(BMP, X, Y, W, H)         \
+    if (BMP->dirty || BMP->opacity)   \
+    tigrDirty(BMP, X, Y, W, H)
+
+// Row opacity, see tigrTrackOpacity.
+enum {
+    TIGR_ROW_UNKNOWN = 0,
+    TIGR_ROW_MIXED,
+    TIGR_ROW_OPAQUE,
+    TIGR_ROW_TRANSPARENT,
+};
+
+// Pixel buffers start with a block header, and are recycled through free lists per size class.
+typedef struct {
+    void* base;       // Start of the allocation
+    size_t capacity;  // Usable bytes from the pixels on
+    size_t mapped;    // Size of the mapping, or 0 if allocated from the heap
+} TigrBlock;
+
+#define TIGR_POOL_CLASSES 256
+#define TIGR_POOL_DEPTH 4
+
+static struct {
+    volatile long lock;
+    size_t bytes;
+    int count[TIGR_POOL_CLASSES];
+    TPixel* free[TIGR_POOL_CLASSES][TIGR_POOL_DEPTH];
+} pixelPool;
+
+static int rowAlignment = sizeof(TPixel);
+
+static TigrBlock* tigrBlock(TPixel* pix) {
+    return (TigrBlock*)pix - 1;
+}
+
+// Rounds a size up to its size class, with four classes per power of two.
+static int tigrSizeClass(size_t* size) {
+    size_t s = *size < 256 ? 256 : *size;
+    int e = 7;
+    while (((size_t)2 << e) < s)
+        e++;
+    size_t step = (size_t)1 << (e - 2);
+    s = (s + step - 1) / step * step;
+    *size = s;
+    return (e - 7) * 4 + (int)(s / step) - 5;
+}
+
+// Maps fresh pages, which the OS zeroes on first touch. Pages never touched cost nothing.
+static void* tigrMapPages(size_t size) {
+#ifdef _WIN32
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+#endif
+}
+
+static void tigrUnmapPages(void* mem, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(mem, 0, MEM_RELEASE);
+#else
+    munmap(mem, size);
+#endif
+}
+
+// Allocates aligned pixel storage of at least `size` bytes, zeroed unless `uninit` is set.
+static TPixel* tigrAllocPixels(size_t size, int uninit) {
+    size_t capacity = size;
+    int c = tigrSizeClass(&capacity);
+    TPixel* pix = NULL;
+
+    if (capacity <= TIGR_POOL_MAX_BUFFER) {
+        TIGR_LOCK(pixelPool.lock);
+        if (pixelPool.count[c] > 0) {
+            pix = pixelPool.free[c][--pixelPool.count[c]];
+            pixelPool.bytes -= capacity;
+        }
+        TIGR_UNLOCK(pixelPool.lock);
+    }
+
+    if (pix) {
+        if (!uninit) {
+            memset(pix, 0, size);
+        }
+        return pix;
+    }
+
+    // Pages are aligned, so the header fits in front of the pixels.
+    if (capacity >= TIGR_MMAP_THRESHOLD) {
+        size_t mapped = capacity + TIGR_PIXEL_ALIGN;
+        void* base = tigrMapPages(mapped);
+        if (base) {
+            pix = (TPixel*)((char*)base + TIGR_PIXEL_ALIGN);
+            tigrBlock(pix)->base = base;
+            tigrBlock(pix)->capacity = capacity;
+            tigrBlock(pix)->mapped = mapped;
+            return pix;
+        }
+    }
+
+    size_t total = capacity + sizeof(TigrBlock) + TIGR_PIXEL_ALIGN - 1;
+    void* base = uninit ? malloc(total) : calloc(1, total);
+    if (!base) {
+        return NULL;
+    }
+    uintptr_t start = (uintptr_t)base + sizeof(TigrBlock);
+    pix = (TPixel*)((start + TIGR_PIXEL_ALIGN - 1) & ~(uintptr_t)(TIGR_PIXEL_ALIGN - 1));
+    tigrBlock(pix)->base = base;
+    tigrBlock(pix)->capacity = capacity;
+    tigrBlock(pix)->mapped = 0;
+    return pix;
+}
+
+// Returns pixel storage to the pool, or frees it if the pool is full.
+static void tigrReleasePixels(TPixel* pix) {
+    if (!pix) {
+        return;
+    }
+
+    TigrBlock* block = tigrBlock(pix);
+    size_t capacity = block->capacity;
+    if (capacity <= TIGR_POOL_MAX_BUFFER) {
+        int c = tigrSizeClass(&capacity);
+        TIGR_LOCK(pixelPool.lock);
+        if (pixelPool.count[c] < TIGR_POOL_DEPTH && pixelPool.bytes + capacity <= TIGR_POOL_SIZE) {
+            pixelPool.free[c][pixelPool.count[c]++] = pix;
+            pixelPool.bytes += capacity;
+            pix = NULL;
+        }
+        TIGR_UNLOCK(pixelPool.lock);
+    }
+
+    if (pix && block->mapped) {
+        tigrUnmapPages(block->base, block->mapped);
+    } else if (pix) {
+        free(block->base);
+    }
+}
+
+// Row length in pixels for a bitmap width, padded to the row alignment.
+static int tigrStride(int w) {
+    int align = rowAlignment / sizeof(TPixel);
+    return (w + align - 1) / align * align;
+}
+
+void tigrSetRowAlignment(int bytes) {
+    if (bytes < (int)sizeof(TPixel)) {
+        bytes = sizeof(TPixel);
+    }
+    rowAlignment = bytes / sizeof(TPixel) * sizeof(TPixel);
+}
+
+static Tigr* tigrNewBitmap(int w, int h, int extra, int uninit) {
     Tigr* tigr = (Tigr*)calloc(1, sizeof(Tigr) + extra);
     tigr->w = w;
     tigr->h = h;
     tigr->cw = -1;
     tigr->ch = -1;
-    tigr->pix = (TPixel*)calloc(w * h, sizeof(TPixel));
+    tigr->stride = tigrStride(w);
+    tigr->pix = tigrAllocPixels((size_t)tigr->stride * h * sizeof(TPixel), uninit);
     tigr->blitMode = TIGR_BLEND_ALPHA;
     return tigr;
 }
 
+Tigr* tigrBitmap2(int w, int h, int extra) {
+    return tigrNewBitmap(w, h, extra, 0);
+}
+
 Tigr* tigrBitmap(int w, int h) {
-    return tigrBitmap2(w, h, 0);
+    return tigrNewBitmap(w, h, 0, 0);
+}
+
+Tigr* tigrBitmapUninit(int w, int h) {
+    return tigrNewBitmap(w, h, 0, 1);
+}
+
+Tigr* tigrBitmapFromMemory(TPixel* pix, int w, int h, int stride) {
+    if (!pix || w < 0 || h < 0 || stride < w) {
+        errno = EINVAL;
+        return NULL;
+    }
+    Tigr* tigr = (Tigr*)calloc(1, sizeof(Tigr));
+    tigr->w = w;
+    tigr->h = h;
+    tigr->cw = -1;
+    tigr->ch = -1;
+    tigr->pix = pix;
+    tigr->stride = stride;
+    tigr->flags = TIGR_BITMAP_EXTERNAL;
+    tigr->blitMode = TIGR_BLEND_ALPHA;
+    return tigr;
+}
+
+void tigrFreePixels(Tigr* bmp) {
+    if (bmp->shared) {
+        tigrSharedFree(bmp);
+        bmp->shared = NULL;
+    } else if (!(bmp->flags & TIGR_BITMAP_EXTERNAL)) {
+        tigrReleasePixels(bmp->pix);
+    }
+    bmp->pix = NULL;
 }
 
 #ifdef TIGR_HEADLESS
 void tigrFree(Tigr* bmp) {
-    free(bmp->pix);
+    free(bmp->dirty);
+    free(bmp->opacity);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 #endif // TIGR_HEADLESS
 
+void tigrTrackDirty(Tigr* bmp, int enable) {
+    if (!enable) {
+        free(bmp->dirty);
+        bmp->dirty = NULL;
+    } else if (!bmp->dirty) {
+        bmp->dirty = (TigrDirty*)calloc(1, sizeof(TigrDirty));
+        bmp->dirty->full = 1;
+    }
+}
+
+void tigrTrackOpacity(Tigr* bmp, int enable) {
+    if (!enable) {
+        free(bmp->opacity);
+        bmp->opacity = NULL;
+    } else if (!bmp->opacity && bmp->h > 0) {
+        bmp->opacity = (unsigned char*)calloc(bmp->h, 1);
+    }
+}
+
+// Checks a row of a bitmap with opacity tracking, unless known already.
+static int tigrRowOpacity(Tigr* bmp, int y) {
+    if (bmp->opacity[y] == TIGR_ROW_UNKNOWN) {
+        TPixel* row = &bmp->pix[y * bmp->stride];
+        int premultiplied = (bmp->flags & TIGR_BITMAP_PREMULTIPLIED) != 0;
+        int opaque = 1;
+        int transparent = 1;
+        for (int x = 0; x < bmp->w && (opaque || transparent); x++) {
+            opaque &= row[x].a == 255;
+            // Premultiplied pixels with color but no alpha still add light.
+            transparent &= premultiplied ? (row[x].r | row[x].g | row[x].b | row[x].a) == 0 : row[x].a == 0;
+        }
+        bmp->opacity[y] = opaque ? TIGR_ROW_OPAQUE : transparent ? TIGR_ROW_TRANSPARENT : TIGR_ROW_MIXED;
+    }
+    return bmp->opacity[y];
+}
+
+void tigrDirty(Tigr* bmp, int x, int y, int w, int h) {
+    TigrDirty* d = bmp->dirty;
+    if ((!d || d->full) && !bmp->opacity) {
+        return;
+    }
+
+    int x1 = x + w;
+    int y1 = y + h;
+    if (x < 0)
+        x = 0;
+    if (y < 0)
+        y = 0;
+    if (x1 > bmp->w)
+        x1 = bmp->w;
+    if (y1 > bmp->h)
+        y1 = bmp->h;
+    if (x >= x1 || y >= y1)
+        return;
+
+    if (bmp->opacity) {
+        memset(bmp->opacity + y, TIGR_ROW_UNKNOWN, y1 - y);
+    }
+    if (!d || d->full) {
+        return;
+    }
+
+    // Grow a rect that overlaps or touches the new one.
+    int* r = 0;
+    for (int i = 0; i < d->count && !r; i++) {
+        int* c = d->rects[i];
+        if (x <= c[2] && x1 >= c[0] && y <= c[3] && y1 >= c[1]) {
+            r = c;
+        }
+    }
+
+    if (!r && d->count < TIGR_MAX_DIRTY) {
+        r = d->rects[d->count++];
+        r[0] = x;
+        r[1] = y;
+        r[2] = x1;
+        r[3] = y1;
+        return;
+    }
+
+    // Out of rects, grow the one that grows the least.
+    if (!r) {
+        long best = 0;
+        for (int i = 0; i < d->count; i++) {
+            int* c = d->rects[i];
+            long area = (long)(c[2] - c[0]) * (c[3] - c[1]);
+            long grown = (long)((x1 > c[2] ? x1 : c[2]) - (x < c[0] ? x : c[0])) *
+                         ((y1 > c[3] ? y1 : c[3]) - (y < c[1] ? y : c[1]));
+            if (!r || grown - area < best) {
+                best = grown - area;
+                r = c;
+            }
+        }
+    }
+
+    if (x < r[0])
+        r[0] = x;
+    if (y < r[1])
+        r[1] = y;
+    if (x1 > r[2])
+        r[2] = x1;
+    if (y1 > r[3])
+        r[3] = y1;
+}
+
 
 void tigrResize(Tigr* bmp, int w, int h) {
     if (bmp->w == w && bmp->h == h) {
         return;
     }
+    if (bmp->shared) {
+        // The frames are laid out for the other process, so a shared bitmap keeps its size.
+        errno = EPERM;
+        return;
+    }
+
+    int y;
+    int stride = tigrStride(w);
+    size_t size = (size_t)stride * h * sizeof(TPixel);
+    int cw = (w < bmp->w) ? w : bmp->w;
+    int ch = (h < bmp->h) ? h : bmp->h;
+    int owned = !(bmp->flags & TIGR_BITMAP_EXTERNAL);
+    size_t capacity = owned ? tigrBlock(bmp->pix)->capacity : 0;
 
-    int y, cw, ch;
-    TPixel* newpix = (TPixel*)calloc(w * h, sizeof(TPixel));
-    cw = (w < bmp->w) ? w : bmp->w;
-    ch = (h < bmp->h) ? h : bmp->h;
+    if (size <= capacity && size >= capacity / 4) {
+        // Fits the current storage. Move rows in an order that never overwrites a row yet to be moved.
+        TPixel* pix = bmp->pix;
+        if (stride > bmp->stride) {
+            for (y = ch - 1; y >= 0; y--)
+                memmove(pix + y * stride, pix + y * bmp->stride, cw * sizeof(TPixel));
+        } else if (stride < bmp->stride) {
+            for (y = 0; y < ch; y++)
+                memmove(pix + y * stride, pix + y * bmp->stride, cw * sizeof(TPixel));
+        }
+    } else {
+        // Leave room to grow, since resizes tend to come in series while a window is dragged.
+        // Everything gets written below, so the new storage is left uninitialized.
+        TPixel* newpix = tigrAllocPixels(size > capacity ? size + size / 4 : size, 1);
 
-    // Copy any old data across.
-    for (y = 0; y < ch; y++)
-        memcpy(newpix + y * w, bmp->pix + y * bmp->w, cw * sizeof(TPixel));
+        // Copy any old data across.
+        for (y = 0; y < ch; y++)
+            memcpy(newpix + y * stride, bmp->pix + y * bmp->stride, cw * sizeof(TPixel));
 
-    free(bmp->pix);
-    bmp->pix = newpix;
+        tigrFreePixels(bmp);
+        bmp->pix = newpix;
+        bmp->flags &= ~TIGR_BITMAP_EXTERNAL;
+    }
+
+    // Clear whatever the old contents don't cover.
+    if (w > cw) {
+        for (y = 0; y < ch; y++)
+            memset(bmp->pix + y * stride + cw, 0, (w - cw) * sizeof(TPixel));
+    }
+    if (h > ch) {
+        memset(bmp->pix + ch * stride, 0, (size_t)(h - ch) * stride * sizeof(TPixel));
+    }
+
+    bmp->stride = stride;
     bmp->w = w;
     bmp->h = h;
+
+    if (bmp->dirty) {
+        bmp->dirty->full = 1;
+    }
+    if (bmp->opacity) {
+        free(bmp->opacity);
+        bmp->opacity = h > 0 ? (unsigned char*)calloc(h, 1) : NULL;
+    }
 }
 
 int tigrCalcScale(int bmpW, int bmpH, int areaW, int areaH) {
@@ -106,17 +456,283 @@ void tigrPosition(Tigr* bmp, int scale, int windowW, int windowH, int out[4]) {
     out[3] = out[1] + bmp->h * scale;
 }
 
+// Fills a run of pixels with a color.
+// Streaming stores bypass the cache, for targets too large to stay in it anyway.
+static void tigrFillPixels(TPixel* pix, int count, TPixel color, int stream) {
+    uint32_t c;
+    memcpy(&c, &color, sizeof(c));
+    uint32_t* d = (uint32_t*)pix;
+
+#if defined(TIGR_SSE2)
+    while (count > 0 && ((uintptr_t)d & 15)) {
+        *d++ = c;
+        count--;
+    }
+    __m128i v = _mm_set1_epi32((int)c);
+    if (stream) {
+        for (; count >= 16; count -= 16, d += 16) {
+            _mm_stream_si128((__m128i*)d, v);
+            _mm_stream_si128((__m128i*)(d + 4), v);
+            _mm_stream_si128((__m128i*)(d + 8), v);
+            _mm_stream_si128((__m128i*)(d + 12), v);
+        }
+    } else {
+        for (; count >= 16; count -= 16, d += 16) {
+            _mm_store_si128((__m128i*)d, v);
+            _mm_store_si128((__m128i*)(d + 4), v);
+            _mm_store_si128((__m128i*)(d + 8), v);
+            _mm_store_si128((__m128i*)(d + 12), v);
+        }
+    }
+    for (; count >= 4; count -= 4, d += 4) {
+        _mm_store_si128((__m128i*)d, v);
+    }
+#elif defined(TIGR_NEON)
+    (void)stream;
+    uint32x4_t v = vdupq_n_u32(c);
+    for (; count >= 16; count -= 16, d += 16) {
+        vst1q_u32(d, v);
+        vst1q_u32(d + 4, v);
+        vst1q_u32(d + 8, v);
+        vst1q_u32(d + 12, v);
+    }
+    for (; count >= 4; count -= 4, d += 4) {
+        vst1q_u32(d, v);
+    }
+#else
+    (void)stream;
+#endif
+
+    while (count-- > 0) {
+        *d++ = c;
+    }
+}
+
+// A band of rows to fill, possibly on another thread.
+typedef struct {
+    TPixel* pix;
+    int stride, w, h;
+    TPixel color;
+    int stream;
+} TigrFillJob;
+
+static void tigrFillRows(TigrFillJob* job) {
+    if (job->stride == job->w) {
+        tigrFillPixels(job->pix, job->w * job->h, job->color, job->stream);
+    } else {
+        for (int y = 0; y < job->h; y++) {
+            tigrFillPixels(job->pix + y * job->stride, job->w, job->color, job->stream);
+        }
+    }
+#ifdef TIGR_SSE2
+    if (job->stream) {
+        // Streaming stores are weakly ordered, make them visible before returning.
+        _mm_sfence();
+    }
+#endif
+}
+
+// Threads helping with large fills. They are started once by tigrSetFillThreads,
+// and then wait to be handed a band of rows for each fill.
+static struct {
+    int workers;             // Threads running, besides the one filling
+    TigrFillJob* jobs;       // Bands of the current fill, the first one for the filling thread
+    int count;               // Number of bands in the current fill
+    unsigned fill;           // Counts fills handed out, so workers can tell a new one
+    int pending;             // Bands still being filled by workers
+    int quit;
+#ifdef _WIN32
+    HANDLE threads[TIGR_MAX_FILL_THREADS];
+#else
+    pthread_t threads[TIGR_MAX_FILL_THREADS];
+#endif
+} fillPool;
+
+// Guards fillPool, with `wake` signalled for new fills and `done` once the workers are done.
+#ifdef _WIN32
+static SRWLOCK fillLock = SRWLOCK_INIT;
+static CONDITION_VARIABLE fillWake = CONDITION_VARIABLE_INIT, fillDone = CONDITION_VARIABLE_INIT;
+#define POOL_LOCK() AcquireSRWLockExclusive(&fillLock)
+#define POOL_UNLOCK() ReleaseSRWLockExclusive(&fillLock)
+#define POOL_WAIT(C) SleepConditionVariableSRW(&C, &fillLock, INFINITE, 0)
+#define POOL_SIGNAL(C) WakeAllConditionVariable(&C)
+#else
+static pthread_mutex_t fillLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fillWake = PTHREAD_COND_INITIALIZER, fillDone = PTHREAD_COND_INITIALIZER;
+#define POOL_LOCK() pthread_mutex_lock(&fillLock)
+#define POOL_UNLOCK() pthread_mutex_unlock(&fillLock)
+#define POOL_WAIT(C) pthread_cond_wait(&C, &fillLock)
+#define POOL_SIGNAL(C) pthread_cond_broadcast(&C)
+#endif
+
+// Taken by the thread handing out a fill, or changing the number of threads.
+static volatile long fillPoolBusy;
+
+static void tigrFillWorker(int band) {
+    unsigned seen = 0;
+    POOL_LOCK();
+    for (;;) {
+        while (fillPool.fill == seen && !fillPool.quit) {
+            POOL_WAIT(fillWake);
+        }
+        if (fillPool.quit) {
+            break;
+        }
+        seen = fillPool.fill;
+        if (band < fillPool.count) {
+            POOL_UNLOCK();
+            tigrFillRows(&fillPool.jobs[band]);
+            POOL_LOCK();
+            if (--fillPool.pending == 0) {
+                POOL_SIGNAL(fillDone);
+            }
+        }
+    }
+    POOL_UNLOCK();
+}
+
+#ifdef _WIN32
+static DWORD WINAPI tigrFillThread(LPVOID band) {
+    tigrFillWorker((int)(intptr_t)band);
+    return 0;
+}
+#else
+static void* tigrFillThread(void* band) {
+    tigrFillWorker((int)(intptr_t)band);
+    return NULL;
+}
+#endif
+
+static void tigrStopFillThreads(void) {
+    POOL_LOCK();
+    fillPool.quit = 1;
+    POOL_SIGNAL(fillWake);
+    POOL_UNLOCK();
+    for (int i = 1; i <= fillPool.workers; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(fillPool.threads[i], INFINITE);
+        CloseHandle(fillPool.threads[i]);
+#else
+        pthread_join(fillPool.threads[i], NULL);
+#endif
+    }
+    fillPool.workers = 0;
+    fillPool.quit = 0;
+}
+
+// Starts threads for bands 1 to count - 1, stopping at the first that fails to start.
+static void tigrStartFillThreads(int count) {
+    fillPool.fill = 0;
+    for (int i = 1; i < count; i++) {
+#ifdef _WIN32
+        fillPool.threads[i] = CreateThread(NULL, 0, tigrFillThread, (LPVOID)(intptr_t)i, 0, NULL);
+        if (!fillPool.threads[i]) {
+            break;
+        }
+#else
+        if (pthread_create(&fillPool.threads[i], NULL, tigrFillThread, (void*)(intptr_t)i) != 0) {
+            break;
+        }
+#endif
+        fillPool.workers = i;
+    }
+}
+
+void tigrSetFillThreads(int count) {
+    count = count < 1 ? 1 : (count > TIGR_MAX_FILL_THREADS ? TIGR_MAX_FILL_THREADS : count);
+    TIGR_LOCK(fillPoolBusy);
+    if (count != fillPool.workers + 1) {
+        tigrStopFillThreads();
+        tigrStartFillThreads(count);
+    }
+    TIGR_UNLOCK(fillPoolBusy);
+}
+
+// Size of the last level cache, or a guess.
+static size_t tigrCacheSize(void) {
+    static size_t size;
+    if (!size) {
+        size_t found = TIGR_STREAM_THRESHOLD;
+#if defined(__linux__) && defined(_SC_LEVEL3_CACHE_SIZE)
+        long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        if (l3 > 0) {
+            found = (size_t)l3;
+        }
+#endif
+        size = found;
+    }
+    return size;
+}
+
+// Fills an area without clipping. Large areas bypass the cache, and are split between threads if enabled.
+static void tigrFillArea(TPixel* pix, int stride, int w, int h, TPixel color) {
+    size_t bytes = (size_t)w * h * sizeof(TPixel);
+    TigrFillJob jobs[TIGR_MAX_FILL_THREADS];
+    jobs[0].pix = pix;
+    jobs[0].stride = stride;
+    jobs[0].w = w;
+    jobs[0].h = h;
+    jobs[0].color = color;
+    jobs[0].stream = bytes >= tigrCacheSize();
+
+    // The threads work on one fill at a time. Others, such as from other threads, fill on their own.
+    if (bytes < TIGR_THREADED_FILL_MIN || !TIGR_TRYLOCK(fillPoolBusy)) {
+        tigrFillRows(&jobs[0]);
+        return;
+    }
+
+    int count = fillPool.workers + 1;
+    if (count > h) {
+        count = h;
+    }
+    if (count <= 1) {
+        tigrFillRows(&jobs[0]);
+        TIGR_UNLOCK(fillPoolBusy);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        int y0 = h * i / count;
+        int y1 = h * (i + 1) / count;
+        jobs[i] = jobs[0];
+        jobs[i].pix = pix + y0 * stride;
+        jobs[i].h = y1 - y0;
+    }
+
+    POOL_LOCK();
+    fillPool.jobs = jobs;
+    fillPool.count = count;
+    fillPool.pending = count - 1;
+    fillPool.fill++;
+    POOL_SIGNAL(fillWake);
+    POOL_UNLOCK();
+
+    tigrFillRows(&jobs[0]);
+
+    POOL_LOCK();
+    while (fillPool.pending > 0) {
+        POOL_WAIT(fillDone);
+    }
+    POOL_UNLOCK();
+    TIGR_UNLOCK(fillPoolBusy);
+}
+
 void tigrClear(Tigr* bmp, TPixel color) {
-    int count = bmp->w * bmp->h;
-    int n;
-    for (n = 0; n < count; n++)
-        bmp->pix[n] = color;
+    if (bmp->flags & TIGR_BITMAP_PREMULTIPLIED) {
+        color = tigrPremultiplyPixel(color);
+    }
+    if (bmp->h > 0) {
+        tigrFillArea(bmp->pix, bmp->stride, bmp->w, bmp->h, color);
+    }
+
+    if (bmp->dirty) {
+        bmp->dirty->full = 1;
+    }
+    if (bmp->opacity) {
+        memset(bmp->opacity, color.a == 255 ? TIGR_ROW_OPAQUE : TIGR_ROW_UNKNOWN, bmp->h);
+    }
 }
 
 void tigrFill(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
-    TPixel* td;
-    int dt, i;
-
     if (x < 0) {
         w += x;
         x = 0;
@@ -134,16 +750,17 @@ void tigrFill(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
     if (w <= 0 || h <= 0)
         return;
 
-    td = &bmp->pix[y * bmp->w + x];
-    dt = bmp->w;
-    do {
-        for (i = 0; i < w; i++)
-            td[i] = color;
-        td += dt;
-    } while (--h);
+    MARK(bmp, x, y, w, h);
+
+    if (bmp->flags & TIGR_BITMAP_PREMULTIPLIED) {
+        color = tigrPremultiplyPixel(color);
+    }
+    tigrFillArea(&bmp->pix[y * bmp->stride + x], bmp->stride, w, h, color);
 }
 
-void tigrLine(Tigr* bmp, int x0, int y0, int x1, int y1, TPixel color) {
+static void plotPixel(Tigr* bmp, int x, int y, TPixel pix);
+
+static void drawLine(Tigr* bmp, int x0, int y0, int x1, int y1, TPixel color) {
     int sx, sy, dx, dy, err, e2;
     dx = abs(x1 - x0);
     dy = abs(y1 - y0);
@@ -158,7 +775,7 @@ void tigrLine(Tigr* bmp, int x0, int y0, int x1, int y1, TPixel color) {
     err = dx - dy;
 
     do {
-        tigrPlot(bmp, x0, y0, color);
+        plotPixel(bmp, x0, y0, color);
         e2 = 2 * err;
         if (e2 > -dy) {
             err -= dy;
@@ -171,6 +788,11 @@ void tigrLine(Tigr* bmp, int x0, int y0, int x1, int y1, TPixel color) {
     } while (x0 != x1 || y0 != y1);
 }
 
+void tigrLine(Tigr* bmp, int x0, int y0, int x1, int y1, TPixel color) {
+    MARK(bmp, x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, abs(x1 - x0) + 1, abs(y1 - y0) + 1);
+    drawLine(bmp, x0, y0, x1, y1, color);
+}
+
 void tigrFillRect(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
     x += 1;
     y += 1;
@@ -199,11 +821,30 @@ void tigrFillRect(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
     if (w <= 0 || h <= 0)
         return;
 
-    TPixel* td = &bmp->pix[y * bmp->w + x];
-    int dt = bmp->w;
+    MARK(bmp, x, y, w, h);
+
+    TPixel* td = &bmp->pix[y * bmp->stride + x];
+    int dt = bmp->stride;
     int xa = EXPAND(color.a);
     int a = xa * xa;
 
+    if (bmp->flags & TIGR_BITMAP_PREMULTIPLIED) {
+        // Same as a premultiplied blit of the color, tinted with its alpha.
+        TPixel p = tigrPremultiplyPixel(color);
+        unsigned pr = p.r * xa >> 8, pg = p.g * xa >> 8, pb = p.b * xa >> 8, pa = p.a * xa >> 8;
+        unsigned inv = 65536 - a;
+        do {
+            for (int i = 0; i < w; i++) {
+                td[i].r = (unsigned char)(pr + (td[i].r * inv >> 16));
+                td[i].g = (unsigned char)(pg + (td[i].g * inv >> 16));
+                td[i].b = (unsigned char)(pb + (td[i].b * inv >> 16));
+                td[i].a += (bmp->blitMode) * (unsigned char)(pa + (td[i].a * inv >> 16) - td[i].a);
+            }
+            td += dt;
+        } while (--h);
+        return;
+    }
+
     do {
         for (int i = 0; i < w; i++) {
             td[i].r += (unsigned char)((color.r - td[i].r) * a >> 16);
@@ -246,7 +887,9 @@ void tigrFillCircle(Tigr* bmp, int x0, int y0, int r, TPixel color) {
     int x = 0;
     int y = r;
 
-    tigrLine(bmp, x0 - r + 1, y0, x0 + r, y0, color);
+    MARK(bmp, x0 - r, y0 - r, 2 * r + 1, 2 * r + 1);
+
+    drawLine(bmp, x0 - r + 1, y0, x0 + r, y0, color);
 
     while (x < y - 1) {
         x++;
@@ -255,16 +898,16 @@ void tigrFillCircle(Tigr* bmp, int x0, int y0, int r, TPixel color) {
             y--;
             dy += 2;
             E += dy;
-            tigrLine(bmp, x0 - x + 1, y0 + y, x0 + x, y0 + y, color);
-            tigrLine(bmp, x0 - x + 1, y0 - y, x0 + x, y0 - y, color);
+            drawLine(bmp, x0 - x + 1, y0 + y, x0 + x, y0 + y, color);
+            drawLine(bmp, x0 - x + 1, y0 - y, x0 + x, y0 - y, color);
         }
 
         dx += 2;
         E += dx + 1;
 
         if (x != y) {
-            tigrLine(bmp, x0 - y + 1, y0 + x, x0 + y, y0 + x, color);
-            tigrLine(bmp, x0 - y + 1, y0 - x, x0 + y, y0 - x, color);
+            drawLine(bmp, x0 - y + 1, y0 + x, x0 + y, y0 + x, color);
+            drawLine(bmp, x0 - y + 1, y0 - x, x0 + y, y0 - x, color);
         }
     }
 }
@@ -276,10 +919,12 @@ void tigrCircle(Tigr* bmp, int x0, int y0, int r, TPixel color) {
     int x = 0;
     int y = r;
 
-    tigrPlot(bmp, x0, y0 + r, color);
-    tigrPlot(bmp, x0, y0 - r, color);
-    tigrPlot(bmp, x0 + r, y0, color);
-    tigrPlot(bmp, x0 - r, y0, color);
+    MARK(bmp, x0 - r, y0 - r, 2 * r + 1, 2 * r + 1);
+
+    plotPixel(bmp, x0, y0 + r, color);
+    plotPixel(bmp, x0, y0 - r, color);
+    plotPixel(bmp, x0 + r, y0, color);
+    plotPixel(bmp, x0 - r, y0, color);
 
     while (x < y - 1) {
         x++;
@@ -293,16 +938,16 @@ void tigrCircle(Tigr* bmp, int x0, int y0, int r, TPixel color) {
         dx += 2;
         E += dx + 1;
 
-        tigrPlot(bmp, x0 + x, y0 + y, color);
-        tigrPlot(bmp, x0 - x, y0 + y, color);
-        tigrPlot(bmp, x0 + x, y0 - y, color);
-        tigrPlot(bmp, x0 - x, y0 - y, color);
+        plotPixel(bmp, x0 + x, y0 + y, color);
+        plotPixel(bmp, x0 - x, y0 + y, color);
+        plotPixel(bmp, x0 + x, y0 - y, color);
+        plotPixel(bmp, x0 - x, y0 - y, color);
 
         if (x != y) {
-            tigrPlot(bmp, x0 + y, y0 + x, color);
-            tigrPlot(bmp, x0 - y, y0 + x, color);
-            tigrPlot(bmp, x0 + y, y0 - x, color);
-            tigrPlot(bmp, x0 - y, y0 - x, color);
+            plotPixel(bmp, x0 + y, y0 + x, color);
+            plotPixel(bmp, x0 - y, y0 + x, color);
+            plotPixel(bmp, x0 + y, y0 - x, color);
+            plotPixel(bmp, x0 - y, y0 - x, color);
         }
     }
 }
@@ -310,11 +955,11 @@ void tigrCircle(Tigr* bmp, int x0, int y0, int r, TPixel color) {
 TPixel tigrGet(Tigr* bmp, int x, int y) {
     TPixel empty = { 0, 0, 0, 0 };
     if (x >= 0 && y >= 0 && x < bmp->w && y < bmp->h)
-        return bmp->pix[y * bmp->w + x];
+        return bmp->pix[y * bmp->stride + x];
     return empty;
 }
 
-void tigrPlot(Tigr* bmp, int x, int y, TPixel pix) {
+static void plotPixel(Tigr* bmp, int x, int y, TPixel pix) {
     int xa, i, a;
 
     int cx = bmp->cx;
@@ -325,7 +970,19 @@ void tigrPlot(Tigr* bmp, int x, int y, TPixel pix) {
     if (x >= cx && y >= cy && x < cx + cw && y < cy + ch) {
         xa = EXPAND(pix.a);
         a = xa * xa;
-        i = y * bmp->w + x;
+        i = y * bmp->stride + x;
+
+        if (bmp->flags & TIGR_BITMAP_PREMULTIPLIED) {
+            // Same as tigrFillRect.
+            TPixel p = tigrPremultiplyPixel(pix);
+            unsigned inv = 65536 - a;
+            bmp->pix[i].r = (unsigned char)((p.r * xa >> 8) + (bmp->pix[i].r * inv >> 16));
+            bmp->pix[i].g = (unsigned char)((p.g * xa >> 8) + (bmp->pix[i].g * inv >> 16));
+            bmp->pix[i].b = (unsigned char)((p.b * xa >> 8) + (bmp->pix[i].b * inv >> 16));
+            bmp->pix[i].a +=
+                (bmp->blitMode) * (unsigned char)((p.a * xa >> 8) + (bmp->pix[i].a * inv >> 16) - bmp->pix[i].a);
+            return;
+        }
 
         bmp->pix[i].r += (unsigned char)((pix.r - bmp->pix[i].r) * a >> 16);
         bmp->pix[i].g += (unsigned char)((pix.g - bmp->pix[i].g) * a >> 16);
@@ -334,6 +991,11 @@ void tigrPlot(Tigr* bmp, int x, int y, TPixel pix) {
     }
 }
 
+void tigrPlot(Tigr* bmp, int x, int y, TPixel pix) {
+    MARK(bmp, x, y, 1, 1);
+    plotPixel(bmp, x, y, pix);
+}
+
 void tigrClip(Tigr* bmp, int cx, int cy, int cw, int ch) {
     bmp->cx = cx;
     bmp->cy = cy;
@@ -346,11 +1008,12 @@ void tigrBlit(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h
     int ch = dst->ch >= 0 ? dst->ch : dst->h;
 
     CLIP();
+    MARK(dst, dx, dy, w, h);
 
-    TPixel* ts = &src->pix[sy * src->w + sx];
-    TPixel* td = &dst->pix[dy * dst->w + dx];
-    int st = src->w;
-    int dt = dst->w;
+    TPixel* ts = &src->pix[sy * src->stride + sx];
+    TPixel* td = &dst->pix[dy * dst->stride + dx];
+    int st = src->stride;
+    int dt = dst->stride;
     do {
         memcpy(td, ts, w * sizeof(TPixel));
         ts += st;
@@ -358,21 +1021,48 @@ void tigrBlit(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h
     } while (--h);
 }
 
-void tigrBlitTint(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint) {
-    int cw = dst->cw >= 0 ? dst->cw : dst->w;
-    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+// Blends a premultiplied source, which takes one multiply per channel when the tint is plain white.
+static void tigrBlitPremultiplied(TPixel* td, int dt, TPixel* ts, int st, int w, int h, TPixel tint, int blitMode) {
+    if (tint.r == 255 && tint.g == 255 && tint.b == 255 && tint.a == 255) {
+        do {
+            for (int x = 0; x < w; x++) {
+                unsigned inv = 65536 - (EXPAND(ts[x].a) << 8);
+                td[x].r = (unsigned char)(ts[x].r + (td[x].r * inv >> 16));
+                td[x].g = (unsigned char)(ts[x].g + (td[x].g * inv >> 16));
+                td[x].b = (unsigned char)(ts[x].b + (td[x].b * inv >> 16));
+                td[x].a += blitMode * (unsigned char)(ts[x].a + (td[x].a * inv >> 16) - td[x].a);
+            }
+            ts += st;
+            td += dt;
+        } while (--h);
+        return;
+    }
 
-    CLIP();
+    int xa = EXPAND(tint.a);
+    unsigned tr = EXPAND(tint.r) * xa;
+    unsigned tg = EXPAND(tint.g) * xa;
+    unsigned tb = EXPAND(tint.b) * xa;
+    unsigned ta = xa << 8;
+    do {
+        for (int x = 0; x < w; x++) {
+            unsigned inv = 65536 - EXPAND(ts[x].a) * xa;
+            td[x].r = (unsigned char)((ts[x].r * tr >> 16) + (td[x].r * inv >> 16));
+            td[x].g = (unsigned char)((ts[x].g * tg >> 16) + (td[x].g * inv >> 16));
+            td[x].b = (unsigned char)((ts[x].b * tb >> 16) + (td[x].b * inv >> 16));
+            td[x].a += blitMode * (unsigned char)((ts[x].a * ta >> 16) + (td[x].a * inv >> 16) - td[x].a);
+        }
+        ts += st;
+        td += dt;
+    } while (--h);
+}
 
+// Blends a straight alpha source.
+static void tigrBlitStraight(TPixel* td, int dt, TPixel* ts, int st, int w, int h, TPixel tint, int blitMode) {
     int xr = EXPAND(tint.r);
     int xg = EXPAND(tint.g);
     int xb = EXPAND(tint.b);
     int xa = EXPAND(tint.a);
 
-    TPixel* ts = &src->pix[sy * src->w + sx];
-    TPixel* td = &dst->pix[dy * dst->w + dx];
-    int st = src->w;
-    int dt = dst->w;
     do {
         for (int x = 0; x < w; x++) {
             unsigned r = (xr * ts[x].r) >> 8;
@@ -382,13 +1072,295 @@ void tigrBlitTint(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, i
             td[x].r += (unsigned char)((r - td[x].r) * a >> 16);
             td[x].g += (unsigned char)((g - td[x].g) * a >> 16);
             td[x].b += (unsigned char)((b - td[x].b) * a >> 16);
-            td[x].a += (dst->blitMode) * (unsigned char)((ts[x].a - td[x].a) * a >> 16);
+            td[x].a += blitMode * (unsigned char)((ts[x].a - td[x].a) * a >> 16);
         }
         ts += st;
         td += dt;
     } while (--h);
 }
 
+// Blends a straight alpha source onto a premultiplied destination, premultiplying it on the way.
+static void tigrBlitToPremultiplied(TPixel* td, int dt, TPixel* ts, int st, int w, int h, TPixel tint, int blitMode) {
+    TPixel buffer[256];
+    do {
+        for (int x = 0; x < w; x += 256) {
+            int n = w - x < 256 ? w - x : 256;
+            for (int i = 0; i < n; i++) {
+                buffer[i] = tigrPremultiplyPixel(ts[x + i]);
+            }
+            tigrBlitPremultiplied(td + x, 0, buffer, 0, n, 1, tint, blitMode);
+        }
+        ts += st;
+        td += dt;
+    } while (--h);
+}
+
+typedef void (*TigrBlitFunc)(TPixel* td, int dt, TPixel* ts, int st, int w, int h, TPixel tint, int blitMode);
+
+// Picks the blend for a source with the given flags.
+static TigrBlitFunc tigrBlitFor(Tigr* dst, int flags) {
+    if (flags & TIGR_BITMAP_PREMULTIPLIED) {
+        return tigrBlitPremultiplied;
+    }
+    return (dst->flags & TIGR_BITMAP_PREMULTIPLIED) ? tigrBlitToPremultiplied : tigrBlitStraight;
+}
+
+void tigrBlitTint(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint) {
+    int cw = dst->cw >= 0 ? dst->cw : dst->w;
+    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+
+    CLIP();
+    MARK(dst, dx, dy, w, h);
+
+    TigrBlitFunc blend = tigrBlitFor(dst, src->flags);
+    if (!src->opacity) {
+        blend(&dst->pix[dy * dst->stride + dx], dst->stride, &src->pix[sy * src->stride + sx], src->stride, w, h,
+              tint, dst->blitMode);
+        return;
+    }
+
+    // Take rows of the same opacity together. Opaque pixels can be copied as they are,
+    // unless they are tinted or keep the destination alpha.
+    int copy = tint.r == 255 && tint.g == 255 && tint.b == 255 && tint.a == 255 && dst->blitMode;
+    while (h > 0) {
+        int opacity = tigrRowOpacity(src, sy);
+        int n = 1;
+        while (n < h && tigrRowOpacity(src, sy + n) == opacity) {
+            n++;
+        }
+        TPixel* ts = &src->pix[sy * src->stride + sx];
+        TPixel* td = &dst->pix[dy * dst->stride + dx];
+        if (opacity == TIGR_ROW_OPAQUE && copy) {
+            for (int y = 0; y < n; y++) {
+                memcpy(td + y * dst->stride, ts + y * src->stride, w * sizeof(TPixel));
+            }
+        } else if (opacity != TIGR_ROW_TRANSPARENT) {
+            blend(td, dst->stride, ts, src->stride, w, n, tint, dst->blitMode);
+        }
+        sy += n;
+        dy += n;
+        h -= n;
+    }
+}
+
+// Sprite pixels are left out if blending them changes nothing.
+static int tigrSpriteSkips(TPixel p, int premultiplied) {
+    return premultiplied ? (p.r | p.g | p.b | p.a) == 0 : p.a == 0;
+}
+
+// Splits a row into runs, or only counts them if runs and pix are NULL.
+static void tigrSpriteRow(TPixel* row, int w, int premultiplied, int* runs, TPixel* pix, int* numRuns, int* numPix) {
+    int x = 0;
+    while (x < w) {
+        int skip = x;
+        while (x < w && tigrSpriteSkips(row[x], premultiplied)) {
+            x++;
+        }
+        if (x == w) {
+            break;
+        }
+        int copy = x;
+        while (x < w && row[x].a == 255) {
+            x++;
+        }
+        int blend = x;
+        while (x < w && row[x].a != 255 && !tigrSpriteSkips(row[x], premultiplied)) {
+            x++;
+        }
+        if (runs) {
+            int* counts = &runs[3 * *numRuns];
+            counts[0] = copy - skip;
+            counts[1] = blend - copy;
+            counts[2] = x - blend;
+            memcpy(pix + *numPix, row + copy, (x - copy) * sizeof(TPixel));
+        }
+        *numRuns += 1;
+        *numPix += x - copy;
+    }
+}
+
+TigrSprite* tigrSprite(Tigr* src) {
+    int premultiplied = (src->flags & TIGR_BITMAP_PREMULTIPLIED) != 0;
+
+    // Count first, so everything fits one allocation.
+    int numRuns = 0;
+    int numPix = 0;
+    for (int y = 0; y < src->h; y++) {
+        tigrSpriteRow(&src->pix[y * src->stride], src->w, premultiplied, NULL, NULL, &numRuns, &numPix);
+    }
+
+    size_t size = sizeof(TigrSprite) + (size_t)numPix * sizeof(TPixel) + (2 * (size_t)src->h + 2) * sizeof(int) +
+                  3 * (size_t)numRuns * sizeof(int);
+    TigrSprite* sprite = (TigrSprite*)malloc(size);
+    if (!sprite) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    sprite->w = src->w;
+    sprite->h = src->h;
+    sprite->flags = src->flags & TIGR_BITMAP_PREMULTIPLIED;
+    sprite->pix = (TPixel*)(sprite + 1);
+    sprite->rows = (int*)(sprite->pix + numPix);
+    sprite->runs = sprite->rows + 2 * src->h + 2;
+
+    numRuns = 0;
+    numPix = 0;
+    for (int y = 0; y < src->h; y++) {
+        sprite->rows[2 * y] = numRuns;
+        sprite->rows[2 * y + 1] = numPix;
+        tigrSpriteRow(&src->pix[y * src->stride], src->w, premultiplied, sprite->runs, sprite->pix, &numRuns, &numPix);
+    }
+    sprite->rows[2 * src->h] = numRuns;
+    sprite->rows[2 * src->h + 1] = numPix;
+    return sprite;
+}
+
+void tigrBlitSprite(Tigr* dst, TigrSprite* sprite, int dx, int dy, TPixel tint) {
+    int cw = dst->cw >= 0 ? dst->cw : dst->w;
+    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+
+    // Visible part, in sprite coordinates.
+    int x0 = dst->cx - dx > 0 ? dst->cx - dx : 0;
+    int y0 = dst->cy - dy > 0 ? dst->cy - dy : 0;
+    int x1 = dst->cx + cw - dx < sprite->w ? dst->cx + cw - dx : sprite->w;
+    int y1 = dst->cy + ch - dy < sprite->h ? dst->cy + ch - dy : sprite->h;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    MARK(dst, dx + x0, dy + y0, x1 - x0, y1 - y0);
+
+    TigrBlitFunc blend = tigrBlitFor(dst, sprite->flags);
+    // Opaque pixels can be copied as they are, unless they are tinted or keep the destination alpha.
+    int copy = tint.r == 255 && tint.g == 255 && tint.b == 255 && tint.a == 255 && dst->blitMode;
+
+    for (int y = y0; y < y1; y++) {
+        int* run = &sprite->runs[3 * sprite->rows[2 * y]];
+        int* end = &sprite->runs[3 * sprite->rows[2 * y + 2]];
+        TPixel* ts = &sprite->pix[sprite->rows[2 * y + 1]];
+        TPixel* td = &dst->pix[(dy + y) * dst->stride + dx];
+        for (int x = 0; run < end && x < x1; run += 3) {
+            x += run[0];
+            // Copied pixels, then blended ones, each clipped to x0/x1.
+            for (int i = 1; i <= 2; i++) {
+                int a = x > x0 ? x : x0;
+                int b = x + run[i] < x1 ? x + run[i] : x1;
+                if (a < b) {
+                    if (i == 1 && copy) {
+                        memcpy(td + a, ts + a - x, (b - a) * sizeof(TPixel));
+                    } else {
+                        blend(td + a, 0, ts + a - x, 0, b - a, 1, tint, dst->blitMode);
+                    }
+                }
+                ts += run[i];
+                x += run[i];
+            }
+        }
+    }
+}
+
+void tigrFreeSprite(TigrSprite* sprite) {
+    free(sprite);
+}
+
+TigrIndexed* tigrIndexed(int w, int h, int bits) {
+    if (w <= 0 || h <= 0 || (bits != 1 && bits != 2 && bits != 4 && bits != 8) || w > INT_MAX / 8 - 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    int stride = (w * bits + 7) / 8;
+    TigrIndexed* bmp = (TigrIndexed*)calloc(1, sizeof(TigrIndexed) + (size_t)stride * h);
+    if (!bmp) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    bmp->w = w;
+    bmp->h = h;
+    bmp->bits = bits;
+    bmp->stride = stride;
+    bmp->data = (unsigned char*)(bmp + 1);
+    return bmp;
+}
+
+int tigrGetIndex(TigrIndexed* bmp, int x, int y) {
+    if (x < 0 || y < 0 || x >= bmp->w || y >= bmp->h) {
+        return 0;
+    }
+    int bit = x * bmp->bits;
+    int shift = 8 - bmp->bits - (bit & 7);
+    return (bmp->data[y * bmp->stride + (bit >> 3)] >> shift) & ((1 << bmp->bits) - 1);
+}
+
+void tigrSetIndex(TigrIndexed* bmp, int x, int y, int index) {
+    if (x < 0 || y < 0 || x >= bmp->w || y >= bmp->h) {
+        return;
+    }
+    int bit = x * bmp->bits;
+    int shift = 8 - bmp->bits - (bit & 7);
+    int mask = ((1 << bmp->bits) - 1) << shift;
+    unsigned char* p = &bmp->data[y * bmp->stride + (bit >> 3)];
+    *p = (unsigned char)((*p & ~mask) | ((index << shift) & mask));
+}
+
+// Looks up a run of indices in a palette, starting at pixel x of a row.
+static void tigrExpandIndices(TPixel* out, const unsigned char* row, int x, int n, int bits, const TPixel* palette) {
+    if (bits == 8) {
+        for (int i = 0; i < n; i++) {
+            out[i] = palette[row[x + i]];
+        }
+        return;
+    }
+    int mask = (1 << bits) - 1;
+    int perByte = 8 / bits;
+    const unsigned char* p = row + x / perByte;
+    int shift = 8 - bits - (x % perByte) * bits;
+    for (int i = 0; i < n; i++) {
+        out[i] = palette[(*p >> shift) & mask];
+        if ((shift -= bits) < 0) {
+            shift = 8 - bits;
+            p++;
+        }
+    }
+}
+
+void tigrBlitIndexed(Tigr* dst, TigrIndexed* src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint) {
+    int cw = dst->cw >= 0 ? dst->cw : dst->w;
+    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+
+    CLIP();
+    MARK(dst, dx, dy, w, h);
+
+    // With only opaque and fully transparent colors, and no tint, pixels are either written or skipped.
+    int colors = 1 << src->bits;
+    int direct = tint.r == 255 && tint.g == 255 && tint.b == 255 && tint.a == 255 && dst->blitMode;
+    for (int i = 0; i < colors && direct; i++) {
+        direct = src->palette[i].a == 0 || src->palette[i].a == 255;
+    }
+
+    TigrBlitFunc blend = tigrBlitFor(dst, 0);
+    TPixel buffer[256];
+    for (int y = 0; y < h; y++) {
+        const unsigned char* row = src->data + (sy + y) * src->stride;
+        TPixel* td = &dst->pix[(dy + y) * dst->stride + dx];
+        for (int x = 0; x < w; x += 256) {
+            int n = w - x < 256 ? w - x : 256;
+            tigrExpandIndices(buffer, row, sx + x, n, src->bits, src->palette);
+            if (direct) {
+                for (int i = 0; i < n; i++) {
+                    if (buffer[i].a) {
+                        td[x + i] = buffer[i];
+                    }
+                }
+            } else {
+                blend(td + x, 0, buffer, 0, n, 1, tint, dst->blitMode);
+            }
+        }
+    }
+}
+
+void tigrFreeIndexed(TigrIndexed* bmp) {
+    free(bmp);
+}
+
 void tigrBlitAlpha(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h, float alpha) {
     alpha = (alpha < 0) ? 0 : (alpha > 1 ? 1 : alpha);
     tigrBlitTint(dst, src, dx, dy, sx, sy, w, h, tigrRGBA(0xff, 0xff, 0xff, (unsigned char)(alpha * 255)));
@@ -398,6 +1370,700 @@ void tigrBlitMode(Tigr* dst, int mode) {
     dst->blitMode = mode;
 }
 
+// Blend ops for tigrBlitBlend, on a 0-255 destination channel D, the source color W
+// already weighted by its alpha (0-255), and the blend alpha A (0-256).
+#define BLEND_ADD(D, W, A) ((D) + (W) > 255 ? 255 : (D) + (W))
+#define BLEND_MULTIPLY(D, W, A) ((D) * (256 - (A) + EXPAND(W)) >> 8)
+#define BLEND_SCREEN(D, W, A) ((D) + (EXPAND(W) * (255 - (D)) >> 8))
+
+#ifdef TIGR_SSE2
+// Same on 16-bit lanes, giving identical results. Packing clamps the sum for BLEND_ADD.
+#define EXPAND16(X) _mm_add_epi16(X, _mm_min_epi16(X, one))
+#define BLEND_ADD_SSE2(D, W, A) _mm_add_epi16(D, W)
+#define BLEND_MULTIPLY_SSE2(D, W, A) \
+    _mm_srli_epi16(_mm_mullo_epi16(D, _mm_add_epi16(_mm_sub_epi16(k256, A), EXPAND16(W))), 8)
+#define BLEND_SCREEN_SSE2(D, W, A) \
+    _mm_add_epi16(D, _mm_srli_epi16(_mm_mullo_epi16(EXPAND16(W), _mm_sub_epi16(k255, D)), 8))
+
+// Blends two pixels unpacked to 16-bit lanes, like BLEND_PIXEL below.
+#define BLEND_LANES_SSE2(OUT, OP, S, D)                                                       \
+    {                                                                                         \
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(S, 0xff), 0xff);                 \
+        a = _mm_srli_epi16(_mm_mullo_epi16(a, xav), 8);                                       \
+        a = EXPAND16(a);                                                                      \
+        __m128i m = _mm_srli_epi16(_mm_mullo_epi16(tv, premultiplied ? xav : a), 8);         \
+        __m128i wc = _mm_srli_epi16(_mm_mullo_epi16(S, EXPAND16(m)), 8);                     \
+        __m128i na = _mm_add_epi16(_mm_mullo_epi16(k255, a), _mm_mullo_epi16(D, _mm_sub_epi16(k256, a))); \
+        OUT = _mm_or_si128(_mm_andnot_si128(amask, OP(D, wc, a)), _mm_and_si128(amask, _mm_srli_epi16(na, 8))); \
+    }
+
+// Blends four pixels at a time, leaving the rest of the row in x.
+#define BLEND_ROW_SSE2(OP)                                                                    \
+    for (; x + 4 <= w; x += 4) {                                                              \
+        __m128i sv = _mm_loadu_si128((const __m128i*)(ts + x));                               \
+        __m128i dv = _mm_loadu_si128((const __m128i*)(td + x));                               \
+        __m128i lo, hi;                                                                       \
+        BLEND_LANES_SSE2(lo, OP, _mm_unpacklo_epi8(sv, zero), _mm_unpacklo_epi8(dv, zero));  \
+        BLEND_LANES_SSE2(hi, OP, _mm_unpackhi_epi8(sv, zero), _mm_unpackhi_epi8(dv, zero));  \
+        __m128i out = _mm_packus_epi16(lo, hi);                                               \
+        _mm_storeu_si128((__m128i*)(td + x), _mm_or_si128(_mm_and_si128(keep, out), _mm_andnot_si128(keep, dv))); \
+    }
+
+#define BLEND_SETUP_SSE2()                                                                    \
+    __m128i zero = _mm_setzero_si128();                                                       \
+    __m128i one = _mm_set1_epi16(1);                                                          \
+    __m128i k255 = _mm_set1_epi16(255);                                                       \
+    __m128i k256 = _mm_set1_epi16(256);                                                       \
+    __m128i xav = _mm_set1_epi16((short)xa);                                                  \
+    __m128i tv = _mm_setr_epi16(tint.r, tint.g, tint.b, tint.a, tint.r, tint.g, tint.b, tint.a); \
+    __m128i amask = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);                                 \
+    __m128i keep = _mm_set1_epi32(blitMode ? -1 : 0x00ffffff);
+#else
+#define BLEND_ROW_SSE2(OP)
+#define BLEND_SETUP_SSE2()
+#endif
+
+// Weighs a source pixel by its alpha and the tint, and blends it onto the destination with OP.
+// A premultiplied source is only weighed by the tint.
+#define BLEND_PIXEL(OP)                                                                       \
+    {                                                                                         \
+        TPixel sp = ts[x];                                                                    \
+        TPixel dp = td[x];                                                                    \
+        unsigned a = EXPAND(xa * sp.a >> 8);                                                  \
+        unsigned f = premultiplied ? (unsigned)xa : a;                                        \
+        unsigned wr = sp.r * EXPAND(tint.r * f >> 8) >> 8;                                    \
+        unsigned wg = sp.g * EXPAND(tint.g * f >> 8) >> 8;                                    \
+        unsigned wb = sp.b * EXPAND(tint.b * f >> 8) >> 8;                                    \
+        td[x].r = (unsigned char)OP(dp.r, wr, a);                                             \
+        td[x].g = (unsigned char)OP(dp.g, wg, a);                                             \
+        td[x].b = (unsigned char)OP(dp.b, wb, a);                                             \
+        td[x].a = blitMode ? (unsigned char)((255 * a + dp.a * (256 - a)) >> 8) : dp.a;       \
+    }
+
+// Each blend mode gets a loop of its own.
+#define BLEND_KERNEL(NAME, OP)                                                                          \
+    static void NAME(TPixel* td, int dt, TPixel* ts, int st, int w, int h, TPixel tint, int blitMode,   \
+                     int premultiplied) {                                                               \
+        int xa = EXPAND(tint.a);                                                                        \
+        BLEND_SETUP_SSE2()                                                                              \
+        do {                                                                                            \
+            int x = 0;                                                                                  \
+            BLEND_ROW_SSE2(OP##_SSE2)                                                                   \
+            for (; x < w; x++) {                                                                        \
+                BLEND_PIXEL(OP)                                                                         \
+            }                                                                                           \
+            ts += st;                                                                                   \
+            td += dt;                                                                                   \
+        } while (--h);                                                                                  \
+    }
+
+BLEND_KERNEL(tigrBlendAdd, BLEND_ADD)
+BLEND_KERNEL(tigrBlendMultiply, BLEND_MULTIPLY)
+BLEND_KERNEL(tigrBlendScreen, BLEND_SCREEN)
+
+void tigrBlitBlend(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint, int blend) {
+    static void (*const kernels[])(TPixel*, int, TPixel*, int, int, int, TPixel, int, int) = {
+        tigrBlendAdd,
+        tigrBlendMultiply,
+        tigrBlendScreen,
+    };
+    int cw = dst->cw >= 0 ? dst->cw : dst->w;
+    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+
+    if (blend < 0 || blend >= (int)(sizeof(kernels) / sizeof(kernels[0]))) {
+        return;
+    }
+
+    CLIP();
+    MARK(dst, dx, dy, w, h);
+
+    kernels[blend](&dst->pix[dy * dst->stride + dx], dst->stride, &src->pix[sy * src->stride + sx], src->stride, w,
+                   h, tint, dst->blitMode, (src->flags & TIGR_BITMAP_PREMULTIPLIED) != 0);
+}
+
+// Tints a source pixel and blends it onto a destination pixel, like tigrBlitTint.
+#define BLEND_TINTED(TD, S)                                                  \
+    {                                                                        \
+        unsigned r = (xr * (S).r) >> 8;                                      \
+        unsigned g = (xg * (S).g) >> 8;                                      \
+        unsigned b = (xb * (S).b) >> 8;                                      \
+        unsigned a = xa * EXPAND((S).a);                                     \
+        (TD).r += (unsigned char)((r - (TD).r) * a >> 16);                   \
+        (TD).g += (unsigned char)((g - (TD).g) * a >> 16);                   \
+        (TD).b += (unsigned char)((b - (TD).b) * a >> 16);                   \
+        (TD).a += blitMode * (unsigned char)(((S).a - (TD).a) * a >> 16);    \
+    }
+
+// Same for a premultiplied source, with tr/tg/tb/ta being the tint scaled by its alpha.
+#define BLEND_PREMULTIPLIED(TD, S)                                                 \
+    {                                                                              \
+        unsigned inv = 65536 - EXPAND((S).a) * xa;                                 \
+        (TD).r = (unsigned char)(((S).r * tr >> 16) + ((TD).r * inv >> 16));      \
+        (TD).g = (unsigned char)(((S).g * tg >> 16) + ((TD).g * inv >> 16));      \
+        (TD).b = (unsigned char)(((S).b * tb >> 16) + ((TD).b * inv >> 16));      \
+        if (blitMode)                                                              \
+            (TD).a = (unsigned char)(((S).a * ta >> 16) + ((TD).a * inv >> 16));  \
+    }
+
+// Same for a straight source onto a premultiplied destination, like tigrBlitToPremultiplied.
+#define BLEND_OVER(TD, S)                          \
+    {                                              \
+        TPixel sp = tigrPremultiplyPixel(S);       \
+        BLEND_PREMULTIPLIED(TD, sp);               \
+    }
+
+#ifdef TIGR_SSE2
+// Splits 32-bit weights W of up to 65536 into H * 256 + L, packed as (L, H << 4) for MULSHIFT_SSE2.
+#define SPLIT_SSE2(W) _mm_or_si128(_mm_and_si128(W, byte), _mm_slli_epi32(_mm_srli_epi32(W, 8), 20))
+
+// X * W >> 16 on two pixels unpacked to 16-bit lanes X (-255 to 255), with the split weights
+// W0 and W1 for each channel of the first and second pixel. The products are summed in
+// 32-bit lanes as (X, X << 4) . (L, H << 4), so nothing is lost.
+#define MULSHIFT_SSE2(X, W0, W1)                                                                     \
+    _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(X, _mm_slli_epi16(X, 4)), W0), 16), \
+                    _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(X, _mm_slli_epi16(X, 4)), W1), 16))
+
+// Spreads the weight of each of four pixels across its channels.
+#define SPREAD_SSE2(W, I) _mm_shuffle_epi32(W, (I) * 0x55)
+
+// BLEND_TINTED on two pixels unpacked to 16-bit lanes, with tv holding (xr, xg, xb, 256)
+// and W the split weights xa * EXPAND(alpha) of all four pixels.
+#define TINTED_LANES_SSE2(OUT, S, D, W, I)                                                       \
+    {                                                                                            \
+        __m128i diff = _mm_sub_epi16(_mm_srli_epi16(_mm_mullo_epi16(tv, S), 8), D);              \
+        OUT = _mm_add_epi16(D, MULSHIFT_SSE2(diff, SPREAD_SSE2(W, I), SPREAD_SSE2(W, I + 1)));   \
+    }
+
+// BLEND_PREMULTIPLIED on two pixels, with tw holding tr/tg/tb/ta split up.
+// The destination is weighed by 65536 - xa * EXPAND(alpha).
+#define PREMULTIPLIED_LANES_SSE2(OUT, S, D, W, I)                                                \
+    OUT = _mm_add_epi16(MULSHIFT_SSE2(S, tw, tw),                                                \
+                        MULSHIFT_SSE2(D, SPREAD_SSE2(W, I), SPREAD_SSE2(W, I + 1)));
+#define TINTED_WEIGHT_SSE2(A) SPLIT_SSE2(A)
+#define PREMULTIPLIED_WEIGHT_SSE2(A) SPLIT_SSE2(_mm_sub_epi32(k65536, A))
+
+// Blends the four pixels S0-S3 onto TD, two at a time with NAME##_LANES_SSE2. Channels wrap
+// like the unsigned char stores of the scalar versions.
+#define BLEND4_SSE2(TD, S0, S1, S2, S3, NAME)                                                    \
+    {                                                                                            \
+        int c0, c1, c2, c3;                                                                      \
+        memcpy(&c0, &(S0), sizeof(int));                                                         \
+        memcpy(&c1, &(S1), sizeof(int));                                                         \
+        memcpy(&c2, &(S2), sizeof(int));                                                         \
+        memcpy(&c3, &(S3), sizeof(int));                                                         \
+        __m128i svec = _mm_setr_epi32(c0, c1, c2, c3);                                           \
+        __m128i dvec = _mm_loadu_si128((const __m128i*)(TD));                                    \
+        __m128i a = _mm_srli_epi32(svec, 24);                                                    \
+        a = _mm_madd_epi16(_mm_add_epi16(a, _mm_min_epi16(a, one)), xav);                        \
+        __m128i w = NAME##_WEIGHT_SSE2(a);                                                       \
+        __m128i slo = _mm_unpacklo_epi8(svec, zero), dlo = _mm_unpacklo_epi8(dvec, zero);        \
+        __m128i shi = _mm_unpackhi_epi8(svec, zero), dhi = _mm_unpackhi_epi8(dvec, zero);        \
+        __m128i out0, out1;                                                                      \
+        NAME##_LANES_SSE2(out0, slo, dlo, w, 0)                                                  \
+        NAME##_LANES_SSE2(out1, shi, dhi, w, 2)                                                  \
+        __m128i out = _mm_packus_epi16(_mm_and_si128(out0, k255), _mm_and_si128(out1, k255));    \
+        _mm_storeu_si128((__m128i*)(TD), _mm_or_si128(_mm_and_si128(keep, out), _mm_andnot_si128(keep, dvec))); \
+    }
+#define BLEND_TINTED_SSE2(TD, S0, S1, S2, S3) BLEND4_SSE2(TD, S0, S1, S2, S3, TINTED)
+#define BLEND_PREMULTIPLIED_SSE2(TD, S0, S1, S2, S3) BLEND4_SSE2(TD, S0, S1, S2, S3, PREMULTIPLIED)
+#define BLEND_OVER_SSE2(TD, S0, S1, S2, S3)                                                      \
+    {                                                                                            \
+        TPixel p0 = tigrPremultiplyPixel(S0), p1 = tigrPremultiplyPixel(S1);                     \
+        TPixel p2 = tigrPremultiplyPixel(S2), p3 = tigrPremultiplyPixel(S3);                     \
+        BLEND_PREMULTIPLIED_SSE2(TD, p0, p1, p2, p3)                                             \
+    }
+#endif
+
+// Interpolates between four pixels, with 8-bit fractions fx and fy.
+static TPixel tigrBilinear(TPixel p00, TPixel p01, TPixel p10, TPixel p11, int fx, int fy) {
+    int w11 = (fx * fy) >> 8;
+    int w01 = fx - w11;
+    int w10 = fy - w11;
+    int w00 = 256 - w01 - w10 - w11;
+#ifdef TIGR_SSE2
+    int c[4];
+    memcpy(&c[0], &p00, sizeof(int));
+    memcpy(&c[1], &p01, sizeof(int));
+    memcpy(&c[2], &p10, sizeof(int));
+    memcpy(&c[3], &p11, sizeof(int));
+    __m128i zero = _mm_setzero_si128();
+    __m128i top = _mm_unpacklo_epi8(_mm_setr_epi32(c[0], c[1], 0, 0), zero);
+    __m128i bottom = _mm_unpacklo_epi8(_mm_setr_epi32(c[2], c[3], 0, 0), zero);
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(top, _mm_setr_epi16(w00, w00, w00, w00, w01, w01, w01, w01)),
+                                _mm_mullo_epi16(bottom, _mm_setr_epi16(w10, w10, w10, w10, w11, w11, w11, w11)));
+    sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+    sum = _mm_srli_epi16(sum, 8);
+    int packed = _mm_cvtsi128_si32(_mm_packus_epi16(sum, zero));
+    TPixel out;
+    memcpy(&out, &packed, sizeof(out));
+    return out;
+#else
+    TPixel out;
+    out.r = (unsigned char)((p00.r * w00 + p01.r * w01 + p10.r * w10 + p11.r * w11) >> 8);
+    out.g = (unsigned char)((p00.g * w00 + p01.g * w01 + p10.g * w10 + p11.g * w11) >> 8);
+    out.b = (unsigned char)((p00.b * w00 + p01.b * w01 + p10.b * w10 + p11.b * w11) >> 8);
+    out.a = (unsigned char)((p00.a * w00 + p01.a * w01 + p10.a * w10 + p11.a * w11) >> 8);
+    return out;
+#endif
+}
+
+// Rounds num / den up, for den > 0.
+static long long tigrCeilDiv(long long num, long long den) {
+    return num >= 0 ? (num + den - 1) / den : -(-num / den);
+}
+
+// Rounds down, without needing libm.
+static long long tigrFloor(double x) {
+    long long t = (long long)x;
+    return t - (t > x);
+}
+
+// Finds the run of steps k in [0, n) for which lo <= base + step * k < hi.
+// The ends may be off by one where the bounds are hit exactly, callers check them.
+static void tigrSpan(long long base, long long step, long long lo, long long hi, int n, int* k0, int* k1) {
+    if (step == 0) {
+        if (base < lo || base >= hi) {
+            *k1 = *k0;
+        }
+        return;
+    }
+    long long a = step > 0 ? tigrCeilDiv(lo - base, step) : tigrCeilDiv(base - hi, -step);
+    long long b = step > 0 ? tigrCeilDiv(hi - base, step) : tigrCeilDiv(base - lo, -step);
+    if (a > *k0) {
+        *k0 = a < n ? (int)a : n;
+    }
+    if (b < *k1) {
+        *k1 = b > 0 ? (int)b : 0;
+    }
+    if (*k1 < *k0) {
+        *k1 = *k0;
+    }
+}
+
+// Transformed blit from source pixels in rows of `stride` pixels, or in tiles if tilesX is non-zero.
+static void tigrTransform(Tigr* dst, TPixel* pix, int stride, int tilesX, int srcW, int srcH, int flags, int sx,
+                          int sy, int sw, int sh, const float m[6], TPixel tint, int filter) {
+    double det = (double)m[0] * m[4] - (double)m[1] * m[3];
+    if (sw <= 0 || sh <= 0 || det == 0) {
+        return;
+    }
+
+    // Part of the source rect inside the source bitmap, relative to sx, sy.
+    int u0 = sx < 0 ? -sx : 0;
+    int v0 = sy < 0 ? -sy : 0;
+    int u1 = sx + sw > srcW ? srcW - sx : sw;
+    int v1 = sy + sh > srcH ? srcH - sy : sh;
+    if (u0 >= u1 || v0 >= v1) {
+        return;
+    }
+
+    // Destination bounds, clipped.
+    float minX = m[2], maxX = m[2], minY = m[5], maxY = m[5];
+    for (int i = 1; i < 4; i++) {
+        float u = (i & 1) ? (float)sw : 0;
+        float v = (i & 2) ? (float)sh : 0;
+        float x = m[0] * u + m[1] * v + m[2];
+        float y = m[3] * u + m[4] * v + m[5];
+        minX = x < minX ? x : minX;
+        maxX = x > maxX ? x : maxX;
+        minY = y < minY ? y : minY;
+        maxY = y > maxY ? y : maxY;
+    }
+
+    int cx0 = dst->cx > 0 ? dst->cx : 0;
+    int cy0 = dst->cy > 0 ? dst->cy : 0;
+    int cx1 = dst->cw >= 0 ? dst->cx + dst->cw : dst->w;
+    int cy1 = dst->ch >= 0 ? dst->cy + dst->ch : dst->h;
+    cx1 = cx1 < dst->w ? cx1 : dst->w;
+    cy1 = cy1 < dst->h ? cy1 : dst->h;
+
+    if (maxX <= cx0 || maxY <= cy0 || minX >= cx1 || minY >= cy1) {
+        return;
+    }
+    int x0 = minX > cx0 ? (int)tigrFloor(minX) : cx0;
+    int y0 = minY > cy0 ? (int)tigrFloor(minY) : cy0;
+    int x1 = maxX < cx1 ? (int)-tigrFloor(-maxX) : cx1;
+    int y1 = maxY < cy1 ? (int)-tigrFloor(-maxY) : cy1;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    MARK(dst, x0, y0, x1 - x0, y1 - y0);
+
+    // Source position of destination pixel centers, stepped in 16.16 fixed point.
+    double ia = m[4] / det, ib = -m[1] / det;
+    double ic = -m[3] / det, id = m[0] / det;
+    long long du = (long long)(ia * 65536.0);
+    long long dv = (long long)(ic * 65536.0);
+    long long lu0 = (long long)u0 << 16, lu1 = (long long)u1 << 16;
+    long long lv0 = (long long)v0 << 16, lv1 = (long long)v1 << 16;
+
+    int xr = EXPAND(tint.r);
+    int xg = EXPAND(tint.g);
+    int xb = EXPAND(tint.b);
+    int xa = EXPAND(tint.a);
+    int blitMode = dst->blitMode;
+    int premultiplied = flags & TIGR_BITMAP_PREMULTIPLIED;
+    int over = dst->flags & TIGR_BITMAP_PREMULTIPLIED;
+    unsigned tr = xr * xa, tg = xg * xa, tb = xb * xa, ta = xa << 8;
+    TPixel* base = tilesX ? pix : pix + sy * stride + sx;
+    int st = stride;
+    int n = x1 - x0;
+#ifdef TIGR_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i one = _mm_set1_epi16(1);
+    __m128i k255 = _mm_set1_epi16(255);
+    __m128i byte = _mm_set1_epi32(255);
+    __m128i k65536 = _mm_set1_epi32(65536);
+    __m128i xav = _mm_set1_epi32(xa);
+    __m128i tv = _mm_setr_epi16(xr, xg, xb, 256, xr, xg, xb, 256);
+    __m128i tw = SPLIT_SSE2(_mm_setr_epi32(tr, tg, tb, ta));
+    __m128i keep = _mm_set1_epi32(blitMode ? -1 : 0x00ffffff);
+#endif
+
+    for (int y = y0; y < y1; y++) {
+        double rx = x0 + 0.5 - m[2];
+        double ry = y + 0.5 - m[5];
+        long long ub = tigrFloor((ia * rx + ib * ry) * 65536.0);
+        long long vb = tigrFloor((ic * rx + id * ry) * 65536.0);
+
+        // Clip the scanline to the pixels whose centers map into the source.
+        int k0 = 0, k1 = n;
+        tigrSpan(ub, du, lu0, lu1, n, &k0, &k1);
+        tigrSpan(vb, dv, lv0, lv1, n, &k0, &k1);
+#define INSIDE(K)                                                                                          \
+    (ub + du * (K) >= lu0 && ub + du * (K) < lu1 && vb + dv * (K) >= lv0 && vb + dv * (K) < lv1)
+        while (k0 < k1 && !INSIDE(k0))
+            k0++;
+        while (k1 > k0 && !INSIDE(k1 - 1))
+            k1--;
+        if (k0 == k1) {
+            continue;
+        }
+        while (k0 > 0 && INSIDE(k0 - 1))
+            k0--;
+        while (k1 < n && INSIDE(k1))
+            k1++;
+#undef INSIDE
+
+        TPixel* td = dst->pix + y * dst->stride + x0;
+        long long u = ub + du * k0;
+        long long v = vb + dv * k0;
+
+        // Source pixels relative to sx/sy, from rows or tiles.
+#define ROW_TEXEL(X, Y) base[(Y) * st + (X)]
+#define TILE_TEXEL(X, Y)                                                                              \
+    base[(((unsigned)(sy + (Y)) / TIGR_TILE) * tilesX + (unsigned)(sx + (X)) / TIGR_TILE) *            \
+             (TIGR_TILE * TIGR_TILE) +                                                                \
+         ((unsigned)(sy + (Y)) % TIGR_TILE) * TIGR_TILE + (unsigned)(sx + (X)) % TIGR_TILE]
+
+        // Sample around the pixel center, clamping to the edges of the source rect.
+#define BILINEAR_SAMPLE(S, TEXEL)                                                                 \
+    {                                                                                             \
+        long long su = u - 32768;                                                                 \
+        long long sv = v - 32768;                                                                 \
+        int px = (int)(su >> 16);                                                                 \
+        int py = (int)(sv >> 16);                                                                 \
+        int fx = (int)(su >> 8) & 0xff;                                                           \
+        int fy = (int)(sv >> 8) & 0xff;                                                           \
+        int qx = px + 1;                                                                          \
+        int qy = py + 1;                                                                          \
+        px = px < u0 ? u0 : px;                                                                   \
+        py = py < v0 ? v0 : py;                                                                   \
+        qx = qx >= u1 ? u1 - 1 : qx;                                                              \
+        qy = qy >= v1 ? v1 - 1 : qy;                                                              \
+        S = tigrBilinear(TEXEL(px, py), TEXEL(qx, py), TEXEL(px, qy), TEXEL(qx, qy), fx, fy);     \
+    }
+#define NEAREST_SAMPLE(S, TEXEL) S = TEXEL((int)(u >> 16), (int)(v >> 16))
+
+        // With SSE2, gather four source pixels and blend them together, then finish the row singly.
+#ifdef TIGR_SSE2
+#define BLEND4_LOOP(BLEND, SAMPLE, TEXEL)                                                         \
+    for (; k + 4 <= k1; k += 4) {                                                                 \
+        TPixel s0, s1, s2, s3;                                                                    \
+        SAMPLE(s0, TEXEL);                                                                        \
+        u += du, v += dv;                                                                         \
+        SAMPLE(s1, TEXEL);                                                                        \
+        u += du, v += dv;                                                                         \
+        SAMPLE(s2, TEXEL);                                                                        \
+        u += du, v += dv;                                                                         \
+        SAMPLE(s3, TEXEL);                                                                        \
+        u += du, v += dv;                                                                         \
+        BLEND##_SSE2(td + k, s0, s1, s2, s3);                                                     \
+    }
+#else
+#define BLEND4_LOOP(BLEND, SAMPLE, TEXEL)
+#endif
+#define SAMPLE_LOOP(BLEND, SAMPLE, TEXEL)                                                         \
+    {                                                                                             \
+        int k = k0;                                                                               \
+        BLEND4_LOOP(BLEND, SAMPLE, TEXEL)                                                         \
+        for (; k < k1; k++, u += du, v += dv) {                                                   \
+            TPixel s;                                                                             \
+            SAMPLE(s, TEXEL);                                                                     \
+            BLEND(td[k], s);                                                                      \
+        }                                                                                         \
+    }
+#define FILTER_LOOP(BLEND, TEXEL)                     \
+    if (filter == TIGR_BILINEAR) {                    \
+        SAMPLE_LOOP(BLEND, BILINEAR_SAMPLE, TEXEL);   \
+    } else {                                          \
+        SAMPLE_LOOP(BLEND, NEAREST_SAMPLE, TEXEL);    \
+    }
+
+        if (tilesX) {
+            if (premultiplied) {
+                FILTER_LOOP(BLEND_PREMULTIPLIED, TILE_TEXEL);
+            } else if (over) {
+                FILTER_LOOP(BLEND_OVER, TILE_TEXEL);
+            } else {
+                FILTER_LOOP(BLEND_TINTED, TILE_TEXEL);
+            }
+        } else {
+            if (premultiplied) {
+                FILTER_LOOP(BLEND_PREMULTIPLIED, ROW_TEXEL);
+            } else if (over) {
+                FILTER_LOOP(BLEND_OVER, ROW_TEXEL);
+            } else {
+                FILTER_LOOP(BLEND_TINTED, ROW_TEXEL);
+            }
+        }
+#undef ROW_TEXEL
+#undef TILE_TEXEL
+#undef BILINEAR_SAMPLE
+#undef NEAREST_SAMPLE
+#undef BLEND4_LOOP
+#undef SAMPLE_LOOP
+#undef FILTER_LOOP
+    }
+}
+
+void tigrBlitTransformed(Tigr* dst, Tigr* src, int sx, int sy, int sw, int sh, const float m[6], TPixel tint,
+                         int filter) {
+    tigrTransform(dst, src->pix, src->stride, 0, src->w, src->h, src->flags, sx, sy, sw, sh, m, tint, filter);
+}
+
+void tigrBlitTiledTransformed(Tigr* dst, TigrTiled* src, int sx, int sy, int sw, int sh, const float m[6],
+                              TPixel tint, int filter) {
+    tigrTransform(dst, src->pix, 0, src->tilesX, src->w, src->h, 0, sx, sy, sw, sh, m, tint, filter);
+}
+
+void tigrBlitScaled(Tigr* dst, Tigr* src, int dx, int dy, int dw, int dh, int sx, int sy, int sw, int sh,
+                    TPixel tint, int filter) {
+    if (sw <= 0 || sh <= 0) {
+        return;
+    }
+    float m[6] = { (float)dw / sw, 0, (float)dx, 0, (float)dh / sh, (float)dy };
+    if (dw < 0) {
+        m[2] -= dw;
+    }
+    if (dh < 0) {
+        m[5] -= dh;
+    }
+    tigrBlitTransformed(dst, src, sx, sy, sw, sh, m, tint, filter);
+}
+
+#undef BLEND_TINTED
+#undef BLEND_PREMULTIPLIED
+#undef BLEND_OVER
+#ifdef TIGR_SSE2
+#undef SPLIT_SSE2
+#undef MULSHIFT_SSE2
+#undef SPREAD_SSE2
+#undef TINTED_LANES_SSE2
+#undef PREMULTIPLIED_LANES_SSE2
+#undef TINTED_WEIGHT_SSE2
+#undef PREMULTIPLIED_WEIGHT_SSE2
+#undef BLEND4_SSE2
+#undef BLEND_TINTED_SSE2
+#undef BLEND_PREMULTIPLIED_SSE2
+#undef BLEND_OVER_SSE2
+#endif
+
+TigrTiled* tigrTiled(int w, int h) {
+    if (w <= 0 || h <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    TigrTiled* bmp = (TigrTiled*)calloc(1, sizeof(TigrTiled));
+    if (!bmp) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    bmp->w = w;
+    bmp->h = h;
+    bmp->tilesX = (w + TIGR_TILE - 1) / TIGR_TILE;
+    int tilesY = (h + TIGR_TILE - 1) / TIGR_TILE;
+    bmp->pix = tigrAllocPixels((size_t)bmp->tilesX * tilesY * TIGR_TILE * TIGR_TILE * sizeof(TPixel), 0);
+    if (!bmp->pix) {
+        free(bmp);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return bmp;
+}
+
+TPixel tigrTiledGet(TigrTiled* bmp, int x, int y) {
+    TPixel empty = { 0, 0, 0, 0 };
+    if (x >= 0 && y >= 0 && x < bmp->w && y < bmp->h)
+        return *tigrTiledPixel(bmp, x, y);
+    return empty;
+}
+
+void tigrTiledPlot(TigrTiled* bmp, int x, int y, TPixel pix) {
+    if (x >= 0 && y >= 0 && x < bmp->w && y < bmp->h) {
+        int xa = EXPAND(pix.a);
+        int a = xa * xa;
+        TPixel* p = tigrTiledPixel(bmp, x, y);
+        p->r += (unsigned char)((pix.r - p->r) * a >> 16);
+        p->g += (unsigned char)((pix.g - p->g) * a >> 16);
+        p->b += (unsigned char)((pix.b - p->b) * a >> 16);
+        p->a += (unsigned char)((pix.a - p->a) * a >> 16);
+    }
+}
+
+void tigrTiledFill(TigrTiled* bmp, int x, int y, int w, int h, TPixel color) {
+    int x1 = x + w < bmp->w ? x + w : bmp->w;
+    int y1 = y + h < bmp->h ? y + h : bmp->h;
+    x = x > 0 ? x : 0;
+    y = y > 0 ? y : 0;
+    if (x >= x1 || y >= y1) {
+        return;
+    }
+
+    // Tiles next to each other are next to each other in memory, so whole tiles are filled in one go.
+    for (int ty = y / TIGR_TILE; ty <= (y1 - 1) / TIGR_TILE; ty++) {
+        int r0 = y > ty * TIGR_TILE ? y - ty * TIGR_TILE : 0;
+        int r1 = y1 < (ty + 1) * TIGR_TILE ? y1 - ty * TIGR_TILE : TIGR_TILE;
+        int tx = x / TIGR_TILE;
+        while (tx <= (x1 - 1) / TIGR_TILE) {
+            int c0 = x > tx * TIGR_TILE ? x - tx * TIGR_TILE : 0;
+            int c1 = x1 < (tx + 1) * TIGR_TILE ? x1 - tx * TIGR_TILE : TIGR_TILE;
+            TPixel* tile = bmp->pix + (ty * bmp->tilesX + tx) * (TIGR_TILE * TIGR_TILE);
+            int n = 0;
+            if (r0 == 0 && r1 == TIGR_TILE && c0 == 0) {
+                while ((tx + n + 1) * TIGR_TILE <= x1) {
+                    n++;
+                }
+            }
+            if (n > 0) {
+                tigrFillArea(tile, n * TIGR_TILE * TIGR_TILE, n * TIGR_TILE * TIGR_TILE, 1, color);
+                tx += n;
+            } else {
+                tigrFillArea(tile + r0 * TIGR_TILE + c0, TIGR_TILE, c1 - c0, r1 - r0, color);
+                tx++;
+            }
+        }
+    }
+}
+
+void tigrTiledLine(TigrTiled* bmp, int x0, int y0, int x1, int y1, TPixel color) {
+    int sx = x0 < x1 ? 1 : -1;
+    int sy = y0 < y1 ? 1 : -1;
+    int dx = abs(x1 - x0);
+    int dy = abs(y1 - y0);
+    int err = dx - dy;
+
+    do {
+        tigrTiledPlot(bmp, x0, y0, color);
+        int e2 = 2 * err;
+        if (e2 > -dy) {
+            err -= dy;
+            x0 += sx;
+        }
+        if (e2 < dx) {
+            err += dx;
+            y0 += sy;
+        }
+    } while (x0 != x1 || y0 != y1);
+}
+
+// Copies between rows and tiles, one row of a tile at a time.
+static void tigrCopyTiles(Tigr* bmp, TigrTiled* tiled, int toTiles) {
+    int w = bmp->w < tiled->w ? bmp->w : tiled->w;
+    int h = bmp->h < tiled->h ? bmp->h : tiled->h;
+    for (int y = 0; y < h; y++) {
+        TPixel* row = &bmp->pix[y * bmp->stride];
+        TPixel* tileRow = tiled->pix + (y / TIGR_TILE) * tiled->tilesX * (TIGR_TILE * TIGR_TILE) +
+                          (y % TIGR_TILE) * TIGR_TILE;
+        for (int x = 0; x < w; x += TIGR_TILE, tileRow += TIGR_TILE * TIGR_TILE) {
+            int n = w - x < TIGR_TILE ? w - x : TIGR_TILE;
+            if (toTiles) {
+                memcpy(tileRow, row + x, n * sizeof(TPixel));
+            } else {
+                memcpy(row + x, tileRow, n * sizeof(TPixel));
+            }
+        }
+    }
+}
+
+void tigrTile(TigrTiled* dst, Tigr* src) {
+    tigrCopyTiles(src, dst, 1);
+}
+
+void tigrLinearize(Tigr* dst, TigrTiled* src) {
+    MARK(dst, 0, 0, src->w, src->h);
+    tigrCopyTiles(dst, src, 0);
+}
+
+void tigrFreeTiled(TigrTiled* bmp) {
+    if (bmp) {
+        tigrReleasePixels(bmp->pix);
+        free(bmp);
+    }
+}
+
+TPixel tigrPremultiplyPixel(TPixel p) {
+    p.r = (unsigned char)TIGR_MUL255(p.r, p.a);
+    p.g = (unsigned char)TIGR_MUL255(p.g, p.a);
+    p.b = (unsigned char)TIGR_MUL255(p.b, p.a);
+    return p;
+}
+
+TPixel tigrUnpremultiplyPixel(TPixel p) {
+    if (p.a == 0) {
+        return tigrRGBA(0, 0, 0, 0);
+    }
+    if (p.a < 255) {
+        unsigned r = (p.r * 255 + p.a / 2) / p.a;
+        unsigned g = (p.g * 255 + p.a / 2) / p.a;
+        unsigned b = (p.b * 255 + p.a / 2) / p.a;
+        p.r = (unsigned char)(r > 255 ? 255 : r);
+        p.g = (unsigned char)(g > 255 ? 255 : g);
+        p.b = (unsigned char)(b > 255 ? 255 : b);
+    }
+    return p;
+}
+
+void tigrPremultiply(Tigr* bmp) {
+    if (bmp->flags & TIGR_BITMAP_PREMULTIPLIED) {
+        return;
+    }
+    for (int y = 0; y < bmp->h; y++) {
+        TPixel* row = bmp->pix + y * bmp->stride;
+        for (int x = 0; x < bmp->w; x++) {
+            row[x] = tigrPremultiplyPixel(row[x]);
+        }
+    }
+    bmp->flags |= TIGR_BITMAP_PREMULTIPLIED;
+    MARK(bmp, 0, 0, bmp->w, bmp->h);
+}
+
+void tigrUnpremultiply(Tigr* bmp) {
+    if (!(bmp->flags & TIGR_BITMAP_PREMULTIPLIED)) {
+        return;
+    }
+    for (int y = 0; y < bmp->h; y++) {
+        TPixel* row = bmp->pix + y * bmp->stride;
+        for (int x = 0; x < bmp->w; x++) {
+            row[x] = tigrUnpremultiplyPixel(row[x]);
+        }
+    }
+    bmp->flags &= ~TIGR_BITMAP_PREMULTIPLIED;
+    MARK(bmp, 0, 0, bmp->w, bmp->h);
+}
+
 #undef CLIP0
 #undef CLIP1
 #undef CLIP
+#undef MARK
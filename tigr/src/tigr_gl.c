@@ -2,6 +2,10 @@
 
 #include "tigr_internal.h"
 #include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifdef TIGR_GAPI_GL
 #if __linux__
@@ -28,18 +32,38 @@ extern const int tigr_upscale_gl_vs_size, tigr_upscale_gl_fs_size, tigr_default_
 #define APIENTRYP APIENTRY*
 #endif
 typedef ptrdiff_t GLsizeiptr;
+typedef ptrdiff_t GLintptr;
 #define GL_COMPILE_STATUS 0x8B81
 #define GL_LINK_STATUS 0x8B82
 #define GL_ARRAY_BUFFER 0x8892
 #define GL_STATIC_DRAW 0x88E4
+#define GL_STREAM_DRAW 0x88E0
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
 #define GL_VERTEX_SHADER 0x8B31
 #define GL_FRAGMENT_SHADER 0x8B30
 #define GL_BGRA 0x80E1
 #define GL_TEXTURE0 0x84C0
+#define GL_MAJOR_VERSION 0x821B
+#define GL_MINOR_VERSION 0x821C
+#define GL_NUM_EXTENSIONS 0x821D
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_TEXTURE1 0x84C1
+#define GL_FRAMEBUFFER 0x8D40
+#define GL_FRAMEBUFFER_BINDING 0x8CA6
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#define GL_UNIFORM_BUFFER 0x8A11
+#define GL_DYNAMIC_DRAW 0x88E8
+#define GL_INVALID_INDEX 0xFFFFFFFFu
 typedef void(APIENTRYP PFNGLGENVERTEXARRAYSPROC)(GLsizei n, GLuint* arrays);
 typedef void(APIENTRYP PFNGLGENBUFFERSARBPROC)(GLsizei n, GLuint* buffers);
 typedef void(APIENTRYP PFNGLBINDBUFFERPROC)(GLenum target, GLuint buffer);
 typedef void(APIENTRYP PFNGLBUFFERDATAPROC)(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+typedef void(APIENTRYP PFNGLDELETEBUFFERSPROC)(GLsizei n, const GLuint* buffers);
+typedef void*(APIENTRYP PFNGLMAPBUFFERRANGEPROC)(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean(APIENTRYP PFNGLUNMAPBUFFERPROC)(GLenum target);
 typedef void(APIENTRYP PFNGLBINDVERTEXARRAYPROC)(GLuint array);
 typedef void(APIENTRYP PFNGLENABLEVERTEXATTRIBARRAYPROC)(GLuint index);
 typedef void(APIENTRYP PFNGLVERTEXATTRIBPOINTERPROC)(GLuint index,
@@ -72,6 +96,28 @@ typedef void(APIENTRYP PFNGLUNIFORMMATRIX4FVPROC)(GLint location,
                                                   GLboolean transpose,
                                                   const GLfloat* value);
 typedef void(APIENTRYP PFNGLACTIVETEXTUREPROC)(GLenum texture);
+typedef const GLubyte*(APIENTRYP PFNGLGETSTRINGIPROC)(GLenum name, GLuint index);
+typedef void(APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program,
+                                                  GLsizei bufSize,
+                                                  GLsizei* length,
+                                                  GLenum* binaryFormat,
+                                                  void* binary);
+typedef void(APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void(APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+typedef void(APIENTRYP PFNGLUNIFORM1IPROC)(GLint location, GLint v0);
+typedef void(APIENTRYP PFNGLGENFRAMEBUFFERSPROC)(GLsizei n, GLuint* framebuffers);
+typedef void(APIENTRYP PFNGLDELETEFRAMEBUFFERSPROC)(GLsizei n, const GLuint* framebuffers);
+typedef void(APIENTRYP PFNGLBINDFRAMEBUFFERPROC)(GLenum target, GLuint framebuffer);
+typedef void(APIENTRYP PFNGLFRAMEBUFFERTEXTURE2DPROC)(GLenum target,
+                                                      GLenum attachment,
+                                                      GLenum textarget,
+                                                      GLuint texture,
+                                                      GLint level);
+typedef GLuint(APIENTRYP PFNGLGETUNIFORMBLOCKINDEXPROC)(GLuint program, const GLchar* uniformBlockName);
+typedef void(APIENTRYP PFNGLUNIFORMBLOCKBINDINGPROC)(GLuint program,
+                                                     GLuint uniformBlockIndex,
+                                                     GLuint uniformBlockBinding);
+typedef void(APIENTRYP PFNGLBINDBUFFERBASEPROC)(GLenum target, GLuint index, GLuint buffer);
 #define WGL_DRAW_TO_WINDOW_ARB 0x2001
 #define WGL_SUPPORT_OPENGL_ARB 0x2010
 #define WGL_DOUBLE_BUFFER_ARB 0x2011
@@ -97,6 +143,9 @@ PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
 PFNGLGENBUFFERSARBPROC glGenBuffers;
 PFNGLBINDBUFFERPROC glBindBuffer;
 PFNGLBUFFERDATAPROC glBufferData;
+PFNGLDELETEBUFFERSPROC glDeleteBuffers;
+PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+PFNGLUNMAPBUFFERPROC glUnmapBuffer;
 PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
 PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
 PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
@@ -117,6 +166,18 @@ PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation;
 PFNGLUNIFORM4FPROC glUniform4f;
 PFNGLUNIFORMMATRIX4FVPROC glUniformMatrix4fv;
 PFNGLACTIVETEXTUREPROC glActiveTexture;
+PFNGLGETSTRINGIPROC glGetStringi;
+PFNGLGETPROGRAMBINARYPROC glGetProgramBinary;
+PFNGLPROGRAMBINARYPROC glProgramBinary;
+PFNGLPROGRAMPARAMETERIPROC glProgramParameteri;
+PFNGLUNIFORM1IPROC glUniform1i;
+PFNGLGENFRAMEBUFFERSPROC glGenFramebuffers;
+PFNGLDELETEFRAMEBUFFERSPROC glDeleteFramebuffers;
+PFNGLBINDFRAMEBUFFERPROC glBindFramebuffer;
+PFNGLFRAMEBUFFERTEXTURE2DPROC glFramebufferTexture2D;
+PFNGLGETUNIFORMBLOCKINDEXPROC glGetUniformBlockIndex;
+PFNGLUNIFORMBLOCKBINDINGPROC glUniformBlockBinding;
+PFNGLBINDBUFFERBASEPROC glBindBufferBase;
 int tigrGL11Init(Tigr* bmp) {
     int pixel_format;
     TigrInternal* win = tigrInternal(bmp);
@@ -182,6 +243,9 @@ int tigrGL33Init(Tigr* bmp) {
     glGenBuffers = (PFNGLGENBUFFERSARBPROC)wglGetProcAddress("glGenBuffers");
     glBindBuffer = (PFNGLBINDBUFFERPROC)wglGetProcAddress("glBindBuffer");
     glBufferData = (PFNGLBUFFERDATAPROC)wglGetProcAddress("glBufferData");
+    glDeleteBuffers = (PFNGLDELETEBUFFERSPROC)wglGetProcAddress("glDeleteBuffers");
+    glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)wglGetProcAddress("glMapBufferRange");
+    glUnmapBuffer = (PFNGLUNMAPBUFFERPROC)wglGetProcAddress("glUnmapBuffer");
     glBindVertexArray = (PFNGLBINDVERTEXARRAYPROC)wglGetProcAddress("glBindVertexArray");
     glEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC)wglGetProcAddress("glEnableVertexAttribArray");
     glVertexAttribPointer = (PFNGLVERTEXATTRIBPOINTERPROC)wglGetProcAddress("glVertexAttribPointer");
@@ -202,6 +266,18 @@ int tigrGL33Init(Tigr* bmp) {
     glUniform4f = (PFNGLUNIFORM4FPROC)wglGetProcAddress("glUniform4f");
     glUniformMatrix4fv = (PFNGLUNIFORMMATRIX4FVPROC)wglGetProcAddress("glUniformMatrix4fv");
     glActiveTexture = (PFNGLACTIVETEXTUREPROC)wglGetProcAddress("glActiveTexture");
+    glGetStringi = (PFNGLGETSTRINGIPROC)wglGetProcAddress("glGetStringi");
+    glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)wglGetProcAddress("glGetProgramBinary");
+    glProgramBinary = (PFNGLPROGRAMBINARYPROC)wglGetProcAddress("glProgramBinary");
+    glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)wglGetProcAddress("glProgramParameteri");
+    glUniform1i = (PFNGLUNIFORM1IPROC)wglGetProcAddress("glUniform1i");
+    glGenFramebuffers = (PFNGLGENFRAMEBUFFERSPROC)wglGetProcAddress("glGenFramebuffers");
+    glDeleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSPROC)wglGetProcAddress("glDeleteFramebuffers");
+    glBindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC)wglGetProcAddress("glBindFramebuffer");
+    glFramebufferTexture2D = (PFNGLFRAMEBUFFERTEXTURE2DPROC)wglGetProcAddress("glFramebufferTexture2D");
+    glGetUniformBlockIndex = (PFNGLGETUNIFORMBLOCKINDEXPROC)wglGetProcAddress("glGetUniformBlockIndex");
+    glUniformBlockBinding = (PFNGLUNIFORMBLOCKBINDINGPROC)wglGetProcAddress("glUniformBlockBinding");
+    glBindBufferBase = (PFNGLBINDBUFFERBASEPROC)wglGetProcAddress("glBindBufferBase");
 
     if (!wglChoosePixelFormat || !wglCreateContextAttribs) {
         tigrError(bmp, "Cannot create OpenGL context.\n");
@@ -267,42 +343,298 @@ void tigrCheckProgramErrors(GLuint object) {
     }
 }
 
-void tigrCreateShaderProgram(GLStuff* gl, const char* fxSource, int fxSize) {
-    if (gl->program != 0) {
-        glDeleteProgram(gl->program);
-        gl->program = 0;
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+static char shaderCacheDir[512];
+
+void tigrSetShaderCache(const char* directory) {
+    snprintf(shaderCacheDir, sizeof(shaderCacheDir), "%s", directory ? directory : "");
+}
+
+static unsigned long long tigrHashSource(unsigned long long hash, const char* source, int size) {
+    for (int i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char)source[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static int tigrHasGLExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (ext && strcmp(ext, name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void tigrShaderCachePath(TigrProgram* p, char* path, int size) {
+    // Binaries are only valid for the driver that produced them.
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    const char* version = (const char*)glGetString(GL_VERSION);
+    unsigned long long hash = p->hash;
+    hash = tigrHashSource(hash, renderer, (int)strlen(renderer));
+    hash = tigrHashSource(hash, version, (int)strlen(version));
+    snprintf(path, size, "%s/tigr-%016llx.bin", shaderCacheDir, hash);
+}
+
+// Tries to create a program from a binary saved by an earlier run.
+static int tigrLoadProgramBinary(TigrProgram* p) {
+    char path[600];
+    char magic[4];
+    GLenum format;
+    GLint length;
+
+    tigrShaderCachePath(p, path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return 0;
     }
 
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+    void* binary = NULL;
+    if (fread(magic, 4, 1, file) == 1 && memcmp(magic, "TGPB", 4) == 0 && fread(&format, sizeof(format), 1, file) == 1 &&
+        fread(&length, sizeof(length), 1, file) == 1 && length > 0) {
+        binary = malloc(length);
+        if (binary && fread(binary, length, 1, file) != 1) {
+            free(binary);
+            binary = NULL;
+        }
+    }
+    fclose(file);
+    if (!binary) {
+        return 0;
+    }
+
+    GLint success = 0;
+    p->program = glCreateProgram();
+    glProgramBinary(p->program, format, binary, length);
+    glGetProgramiv(p->program, GL_LINK_STATUS, &success);
+    free(binary);
+
+    if (!success) {
+        // Stale binary, typically after a driver update. Clear the error and compile instead.
+        glGetError();
+        glDeleteProgram(p->program);
+        p->program = 0;
+    }
+    return success;
+}
+
+static void tigrSaveProgramBinary(TigrProgram* p) {
+    char path[600];
+    GLint length = 0;
+    GLenum format = 0;
+
+    glGetProgramiv(p->program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    void* binary = malloc(length);
+    if (!binary) {
+        return;
+    }
+    glGetProgramBinary(p->program, length, &length, &format, binary);
+
+    tigrShaderCachePath(p, path, sizeof(path));
+    FILE* file = fopen(path, "wb");
+    if (file) {
+        fwrite("TGPB", 4, 1, file);
+        fwrite(&format, sizeof(format), 1, file);
+        fwrite(&length, sizeof(length), 1, file);
+        fwrite(binary, length, 1, file);
+        fclose(file);
+    }
+    free(binary);
+}
+
+// Compiles and links a program without waiting for the result.
+// Errors are checked once the program is finished, see tigrFinishProgram.
+static void tigrStartProgram(GLStuff* gl, TigrProgram* p) {
+    p->vs = glCreateShader(GL_VERTEX_SHADER);
     const char* vs_source = (const char*)&tigr_upscale_gl_vs;
-    glShaderSource(vs, 1, &vs_source, &tigr_upscale_gl_vs_size);
-    glCompileShader(vs);
-    tigrCheckShaderErrors(vs);
+    glShaderSource(p->vs, 1, &vs_source, &tigr_upscale_gl_vs_size);
+    glCompileShader(p->vs);
 
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+    p->fs = glCreateShader(GL_FRAGMENT_SHADER);
     const char* fs_sources[] = {
         (const char*)tigr_upscale_gl_fs,
-        fxSource,
+        p->source,
     };
     const int fs_lengths[] = {
         tigr_upscale_gl_fs_size,
-        fxSize,
+        p->size,
     };
-    glShaderSource(fs, 2, fs_sources, fs_lengths);
-    glCompileShader(fs);
-    tigrCheckShaderErrors(fs);
-
-    gl->program = glCreateProgram();
-    glAttachShader(gl->program, vs);
-    glAttachShader(gl->program, fs);
-    glLinkProgram(gl->program);
-    tigrCheckProgramErrors(gl->program);
-    glDeleteShader(vs);
-    glDeleteShader(fs);
-
-    gl->uniform_projection = glGetUniformLocation(gl->program, "projection");
-    gl->uniform_model = glGetUniformLocation(gl->program, "model");
-    gl->uniform_parameters = glGetUniformLocation(gl->program, "parameters");
+    glShaderSource(p->fs, 2, fs_sources, fs_lengths);
+    glCompileShader(p->fs);
+
+    p->program = glCreateProgram();
+    glAttachShader(p->program, p->vs);
+    glAttachShader(p->program, p->fs);
+    if (gl->program_binary && shaderCacheDir[0]) {
+        glProgramParameteri(p->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(p->program);
+}
+
+static void tigrFinishProgram(GLStuff* gl, TigrProgram* p) {
+    if (p->vs) {
+        tigrCheckShaderErrors(p->vs);
+        tigrCheckShaderErrors(p->fs);
+        tigrCheckProgramErrors(p->program);
+        glDeleteShader(p->vs);
+        glDeleteShader(p->fs);
+        p->vs = p->fs = 0;
+
+        if (gl->program_binary && shaderCacheDir[0]) {
+            tigrSaveProgramBinary(p);
+        }
+    }
+
+    p->uniform_projection = glGetUniformLocation(p->program, "projection");
+    p->uniform_model = glGetUniformLocation(p->program, "model");
+    p->uniform_parameters = glGetUniformLocation(p->program, "parameters");
+
+    // The window bitmap is always on texture unit 1, pass uniforms on binding 0.
+    glUseProgram(p->program);
+    glUniform1i(glGetUniformLocation(p->program, "source"), 1);
+    GLuint block = glGetUniformBlockIndex(p->program, "PassUniforms");
+    if (block != GL_INVALID_INDEX) {
+        glUniformBlockBinding(p->program, block, 0);
+    }
+    p->ready = 1;
+}
+
+// Returns whether a program can be used, finishing it when linking is done.
+// Waits for linking if asked to, or if the driver cannot tell whether it is done.
+static int tigrProgramReady(GLStuff* gl, TigrProgram* p, int wait) {
+    if (p->ready) {
+        return 1;
+    }
+    if (!wait && gl->parallel_compile) {
+        GLint done = 0;
+        glGetProgramiv(p->program, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done) {
+            return 0;
+        }
+    }
+    tigrFinishProgram(gl, p);
+    return 1;
+}
+
+static int tigrProgramInUse(GLStuff* gl, TigrProgram* p) {
+    if (p->program == gl->program || p == gl->pending) {
+        return 1;
+    }
+    for (int i = 0; i < gl->pass_count; i++) {
+        if (gl->passes[i].program == p) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void tigrDeleteProgram(TigrProgram* p) {
+    if (p->vs) {
+        glDeleteShader(p->vs);
+        glDeleteShader(p->fs);
+    }
+    if (p->program) {
+        glDeleteProgram(p->program);
+    }
+    free(p->source);
+    memset(p, 0, sizeof(TigrProgram));
+}
+
+static void tigrUseProgram(GLStuff* gl, TigrProgram* p) {
+    gl->program = p->program;
+    gl->uniform_projection = p->uniform_projection;
+    gl->uniform_model = p->uniform_model;
+    gl->uniform_parameters = p->uniform_parameters;
+    p->used = ++gl->program_uses;
+}
+
+// Finds a cached program for an effect, or starts building one
+// in the least recently used slot.
+static TigrProgram* tigrFindProgram(GLStuff* gl, const char* fxSource, int fxSize) {
+    unsigned long long hash = 0xcbf29ce484222325ull;
+    hash = tigrHashSource(hash, tigr_upscale_gl_vs, tigr_upscale_gl_vs_size);
+    hash = tigrHashSource(hash, tigr_upscale_gl_fs, tigr_upscale_gl_fs_size);
+    hash = tigrHashSource(hash, fxSource, fxSize);
+
+    TigrProgram* slot = NULL;
+    for (int i = 0; i < TIGR_PROGRAM_CACHE_SIZE; i++) {
+        TigrProgram* p = &gl->programs[i];
+        if (!p->program) {
+            if (!slot || slot->program) {
+                slot = p;
+            }
+            continue;
+        }
+        if (p->hash == hash && p->size == fxSize && memcmp(p->source, fxSource, fxSize) == 0) {
+            return p;
+        }
+        if (tigrProgramInUse(gl, p)) {
+            continue;
+        }
+        if (!slot || (slot->program && p->used < slot->used)) {
+            slot = p;
+        }
+    }
+
+    tigrDeleteProgram(slot);
+    slot->hash = hash;
+    slot->size = fxSize;
+    slot->source = (char*)malloc(fxSize);
+    memcpy(slot->source, fxSource, fxSize);
+
+    if (gl->program_binary && shaderCacheDir[0] && tigrLoadProgramBinary(slot)) {
+        tigrFinishProgram(gl, slot);
+    } else {
+        tigrStartProgram(gl, slot);
+    }
+    return slot;
+}
+
+// Switches to a post shader program. Cached programs are used right away,
+// new ones replace the current program once they have finished linking.
+void tigrSelectShaderProgram(GLStuff* gl, const char* fxSource, int fxSize) {
+    if (gl->gl_legacy) {
+        return;
+    }
+    TigrProgram* p = tigrFindProgram(gl, fxSource, fxSize);
+    if (p->ready) {
+        tigrUseProgram(gl, p);
+        gl->pending = NULL;
+    } else {
+        gl->pending = p;
+    }
+}
+
+// Picks up a pending program. Without a way to ask if linking is done,
+// this waits for it, which still moves the stall from tigrSetPostShader
+// to the next frame, leaving the driver time to link in the background.
+static void tigrUpdateShaderProgram(GLStuff* gl) {
+    TigrProgram* p = gl->pending;
+    if (p && tigrProgramReady(gl, p, !gl->program)) {
+        tigrUseProgram(gl, p);
+        gl->pending = NULL;
+    }
+}
+
+int tigrAddShaderPass(GLStuff* gl, const char* fxSource, int fxSize, float scale) {
+    if (gl->gl_legacy || gl->pass_count == TIGR_MAX_POST_PASSES) {
+        return -1;
+    }
+    TigrPostPass* pass = &gl->passes[gl->pass_count];
+    memset(pass, 0, sizeof(TigrPostPass));
+    pass->program = tigrFindProgram(gl, fxSource, fxSize);
+    pass->scale = scale > 0 ? scale : 1.0f;
+    pass->enabled = 1;
+    return gl->pass_count++;
 }
 
 void tigrGAPICreate(Tigr* bmp) {
@@ -332,8 +664,26 @@ void tigrGAPICreate(Tigr* bmp) {
         glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), NULL);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), NULL);
 
+        // check for program binaries and background shader compilation
+#if __ANDROID__ || __IOS__
+        gl->program_binary = 1;
+#else
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        gl->program_binary = major * 10 + minor >= 41 || tigrHasGLExtension("GL_ARB_get_program_binary");
+#ifdef _WIN32
+        gl->program_binary = gl->program_binary && glGetProgramBinary && glProgramBinary && glProgramParameteri;
+#endif
+#endif
+        gl->parallel_compile =
+            tigrHasGLExtension("GL_KHR_parallel_shader_compile") || tigrHasGLExtension("GL_ARB_parallel_shader_compile");
+
         // create program
-        tigrCreateShaderProgram(gl, tigr_default_fx_gl_fs, tigr_default_fx_gl_fs_size);
+        tigrSelectShaderProgram(gl, tigr_default_fx_gl_fs, tigr_default_fx_gl_fs_size);
+
+        // create pixel buffers for texture uploads
+        glGenBuffers(TIGR_PBO_COUNT, gl->pbo);
     }
 
     // create textures
@@ -363,7 +713,24 @@ void tigrGAPIDestroy(Tigr* bmp) {
 
     if (!gl->gl_legacy) {
         glDeleteTextures(2, gl->tex);
-        glDeleteProgram(gl->program);
+        for (int i = 0; i < TIGR_PROGRAM_CACHE_SIZE; i++) {
+            tigrDeleteProgram(&gl->programs[i]);
+        }
+        gl->program = 0;
+        gl->pending = NULL;
+        for (int i = 0; i < gl->pass_count; i++) {
+            TigrPostPass* pass = &gl->passes[i];
+            if (pass->fbo) {
+                glDeleteFramebuffers(1, &pass->fbo);
+                glDeleteTextures(1, &pass->tex);
+            }
+            if (pass->ubo) {
+                glDeleteBuffers(1, &pass->ubo);
+            }
+            free(pass->uniforms);
+        }
+        gl->pass_count = 0;
+        glDeleteBuffers(TIGR_PBO_COUNT, gl->pbo);
     }
 
     tigrCheckGLError("destroy");
@@ -374,9 +741,97 @@ void tigrGAPIDestroy(Tigr* bmp) {
     }
 }
 
+// Copies bitmap regions into the next pixel buffer of the ring, and leaves it bound.
+// The buffer keeps the bitmap layout, so regions are uploaded from the same offsets.
+// Returns the address to upload from, which is an offset into the buffer,
+// or the bitmap pixels themselves when pixel buffers are not available.
+static uintptr_t tigrGAPIStage(GLStuff* gl, Tigr* bmp, int (*rects)[4], int count) {
+    if (gl->gl_legacy) {
+        return (uintptr_t)bmp->pix;
+    }
+
+    int size = ((bmp->h - 1) * bmp->stride + bmp->w) * sizeof(TPixel);
+    int index = gl->pbo_index;
+    gl->pbo_index = (index + 1) % TIGR_PBO_COUNT;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo[index]);
+    if (gl->pbo_size[index] != size) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        gl->pbo_size[index] = size;
+    }
+
+    // Invalidating lets the driver hand out fresh storage instead of
+    // waiting for pending uploads from this buffer to finish.
+    TPixel* mapped =
+        (TPixel*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return (uintptr_t)bmp->pix;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int* r = rects[i];
+        if (r[2] - r[0] == bmp->w) {
+            int offset = r[1] * bmp->stride;
+            memcpy(mapped + offset, bmp->pix + offset, ((r[3] - r[1] - 1) * bmp->stride + bmp->w) * sizeof(TPixel));
+        } else {
+            for (int y = r[1]; y < r[3]; y++) {
+                int offset = y * bmp->stride + r[0];
+                memcpy(mapped + offset, bmp->pix + offset, (r[2] - r[0]) * sizeof(TPixel));
+            }
+        }
+    }
+
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    return 0;
+}
+
+// Uploads bitmap contents to one of the textures.
+// Only the dirty regions are uploaded when tracking dirty regions.
+void tigrGAPIUpload(GLStuff* gl, int index, Tigr* bmp) {
+    TigrDirty* dirty = bmp->dirty;
+    int all[1][4] = { { 0, 0, bmp->w, bmp->h } };
+    int(*rects)[4] = all;
+    int count = 1;
+
+    glBindTexture(GL_TEXTURE_2D, gl->tex[index]);
+
+    if (gl->tex_w[index] != bmp->w || gl->tex_h[index] != bmp->h) {
+        // Texture storage is only allocated when the size changes.
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, bmp->w, bmp->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        gl->tex_w[index] = bmp->w;
+        gl->tex_h[index] = bmp->h;
+    } else if (dirty && !dirty->full) {
+        rects = dirty->rects;
+        count = dirty->count;
+    }
+
+    // An empty bitmap has nothing to upload, and its staging size would come out negative.
+    if (count > 0 && bmp->w > 0 && bmp->h > 0) {
+        uintptr_t base = tigrGAPIStage(gl, bmp, rects, count);
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, bmp->stride);
+        for (int i = 0; i < count; i++) {
+            int* r = rects[i];
+            uintptr_t offset = (r[1] * bmp->stride + r[0]) * sizeof(TPixel);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, r[0], r[1], r[2] - r[0], r[3] - r[1], GL_RGBA, GL_UNSIGNED_BYTE,
+                            (const void*)(base + offset));
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+        if (!gl->gl_legacy) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    if (dirty) {
+        dirty->full = 0;
+        dirty->count = 0;
+    }
+}
+
 void tigrGAPIDraw(int legacy, GLuint uniform_model, GLuint tex, Tigr* bmp, int x1, int y1, int x2, int y2) {
     glBindTexture(GL_TEXTURE_2D, tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, bmp->w, bmp->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, bmp->pix);
 
     if (!legacy) {
         float sx = (float)(x2 - x1);
@@ -406,9 +861,89 @@ void tigrGAPIDraw(int legacy, GLuint uniform_model, GLuint tex, Tigr* bmp, int x
     }
 }
 
+// Runs the enabled post passes, each one reading the output of the one before.
+// Passes still being linked are skipped. Returns the texture holding the result.
+static GLuint tigrGAPIRunPasses(GLStuff* gl, TigrInternal* win, Tigr* bmp) {
+    GLuint image = gl->tex[0];
+    GLint target = 0;
+
+    if (gl->pass_count == 0) {
+        return image;
+    }
+
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+    glDisable(GL_BLEND);
+
+    for (int i = 0; i < gl->pass_count; i++) {
+        TigrPostPass* pass = &gl->passes[i];
+        if (!pass->enabled || !tigrProgramReady(gl, pass->program, 0)) {
+            continue;
+        }
+
+        int w = (int)(bmp->w * pass->scale + 0.5f);
+        int h = (int)(bmp->h * pass->scale + 0.5f);
+        w = w > 0 ? w : 1;
+        h = h > 0 ? h : 1;
+
+        if (!pass->fbo) {
+            glGenFramebuffers(1, &pass->fbo);
+            glGenTextures(1, &pass->tex);
+            glBindTexture(GL_TEXTURE_2D, pass->tex);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, pass->fbo);
+        if (pass->w != w || pass->h != h) {
+            glBindTexture(GL_TEXTURE_2D, pass->tex);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pass->tex, 0);
+            pass->w = w;
+            pass->h = h;
+        }
+
+        if (pass->uniforms_dirty) {
+            if (!pass->ubo) {
+                glGenBuffers(1, &pass->ubo);
+            }
+            glBindBuffer(GL_UNIFORM_BUFFER, pass->ubo);
+            glBufferData(GL_UNIFORM_BUFFER, pass->uniforms_size, pass->uniforms, GL_DYNAMIC_DRAW);
+            pass->uniforms_dirty = 0;
+        }
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, pass->ubo);
+
+        // Unlike the window, targets are not flipped, so they keep the bitmap layout.
+        float projection[16] = { 2.0f / w, 0.0f, 0.0f, 0.0f, 0.0f,  2.0f / h, 0.0f, 0.0f,
+                                 0.0f,     0.0f, 1.0f, 0.0f, -1.0f, -1.0f,    0.0f, 1.0f };
+
+        TigrProgram* p = pass->program;
+        glViewport(0, 0, w, h);
+        glUseProgram(p->program);
+        glUniformMatrix4fv(p->uniform_projection, 1, GL_FALSE, projection);
+        glUniform4f(p->uniform_parameters, win->p1, win->p2, win->p3, win->p4);
+        tigrGAPIDraw(0, p->uniform_model, image, bmp, 0, 0, w, h);
+        image = pass->tex;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    return image;
+}
+
 void tigrGAPIPresent(Tigr* bmp, int w, int h) {
     TigrInternal* win = tigrInternal(bmp);
     GLStuff* gl = &win->gl;
+    GLuint image = gl->tex[0];
+
+    tigrGAPIUpload(gl, 0, bmp);
+    tigrFrameStage(win, TIGR_STAGE_UPLOAD);
+    if (!gl->gl_legacy) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, gl->tex[0]);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(gl->vao);
+        image = tigrGAPIRunPasses(gl, win, bmp);
+    }
 
     glViewport(0, 0, w, h);
     if (!gl->gl_user_opengl_rendering) {
@@ -420,8 +955,8 @@ void tigrGAPIPresent(Tigr* bmp, int w, int h) {
         float projection[16] = { 2.0f / w, 0.0f, 0.0f, 0.0f, 0.0f,  -2.0f / h, 0.0f, 0.0f,
                                  0.0f,     0.0f, 1.0f, 0.0f, -1.0f, 1.0f,      0.0f, 1.0f };
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindVertexArray(gl->vao);
+        tigrUpdateShaderProgram(gl);
+
         glUseProgram(gl->program);
         glUniformMatrix4fv(gl->uniform_projection, 1, GL_FALSE, projection);
         glUniform4f(gl->uniform_parameters, win->p1, win->p2, win->p3, win->p4);
@@ -442,11 +977,12 @@ void tigrGAPIPresent(Tigr* bmp, int w, int h) {
     } else {
         glDisable(GL_BLEND);
     }
-    tigrGAPIDraw(gl->gl_legacy, gl->uniform_model, gl->tex[0], bmp, win->pos[0], win->pos[1], win->pos[2], win->pos[3]);
+    tigrGAPIDraw(gl->gl_legacy, gl->uniform_model, image, bmp, win->pos[0], win->pos[1], win->pos[2], win->pos[3]);
 
     if (win->widgetsScale > 0) {
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        tigrGAPIUpload(gl, 1, win->widgets);
         tigrGAPIDraw(gl->gl_legacy, gl->uniform_model, gl->tex[1], win->widgets,
                      (int)(w - win->widgets->w * win->widgetsScale), 0, w, (int)(win->widgets->h * win->widgetsScale));
     }
@@ -13,8 +13,67 @@
 Tigr* tigrBitmap2(int w, int h, int extra);
 
 // Resizes an existing bitmap.
+// Shared bitmaps are left unchanged, with errno set to EPERM.
 void tigrResize(Tigr* bmp, int w, int h);
 
+// Vector instructions used by the drawing routines, when the target has them.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TIGR_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define TIGR_NEON
+#include <arm_neon.h>
+#endif
+
+// Fills larger than this are written around the cache, unless the last level cache size is known.
+#ifndef TIGR_STREAM_THRESHOLD
+#define TIGR_STREAM_THRESHOLD (8 << 20)
+#endif
+
+// Fills are only split between threads from this size on.
+#ifndef TIGR_THREADED_FILL_MIN
+#define TIGR_THREADED_FILL_MIN (4 << 20)
+#endif
+
+#define TIGR_MAX_FILL_THREADS 16
+
+// Pixel buffers are aligned to this many bytes.
+#define TIGR_PIXEL_ALIGN 64
+
+// Largest pixel buffer kept for reuse after being freed.
+#ifndef TIGR_POOL_MAX_BUFFER
+#define TIGR_POOL_MAX_BUFFER (16 << 20)
+#endif
+
+// Pixel buffers at least this large are mapped directly from the OS.
+#ifndef TIGR_MMAP_THRESHOLD
+#define TIGR_MMAP_THRESHOLD (1 << 20)
+#endif
+
+// Total size of the pixel buffers kept for reuse.
+#ifndef TIGR_POOL_SIZE
+#define TIGR_POOL_SIZE (64 << 20)
+#endif
+
+// Longest tigrSharedPublish waits for a consumer to let go of a buffer, in milliseconds.
+#ifndef TIGR_SHARED_TIMEOUT
+#define TIGR_SHARED_TIMEOUT 1000
+#endif
+
+// Multiplies a 0-255 color channel by a 0-255 alpha, rounding like C * A / 255.
+#define TIGR_MUL255(C, A) ((((C) * (A) + 128) + (((C) * (A) + 128) >> 8)) >> 8)
+
+// Converts a straight alpha pixel to premultiplied alpha, and back.
+TPixel tigrPremultiplyPixel(TPixel p);
+TPixel tigrUnpremultiplyPixel(TPixel p);
+
+// Releases the pixels of a bitmap.
+void tigrFreePixels(Tigr* bmp);
+
+// Shared memory frames, see tigrShared.
+typedef struct TigrShared TigrShared;
+void tigrSharedFree(Tigr* bmp);
+
 // Calculates the biggest scale that a bitmap can fit into an area at.
 int tigrCalcScale(int bmpW, int bmpH, int areaW, int areaH);
 
@@ -24,6 +83,9 @@ int tigrEnforceScale(int scale, int flags);
 // Calculates the correct position for a bitmap to fit into a window.
 void tigrPosition(Tigr* bmp, int scale, int windowW, int windowH, int out[4]);
 
+// Loads the stock font if needed.
+void tigrSetupFont(TigrFont* font);
+
 // ----------------------------------------------------------
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -66,6 +128,40 @@ void tigrPosition(Tigr* bmp, int scale, int windowW, int windowH, int out[4]);
 #include <OpenGLES/ES3/gl.h>
 #endif
 
+// Number of pixel buffers used for streaming texture uploads.
+#define TIGR_PBO_COUNT 3
+
+// Number of post shader programs kept linked per window.
+#define TIGR_PROGRAM_CACHE_SIZE 16
+
+// Maximum number of post passes per window.
+#define TIGR_MAX_POST_PASSES 8
+
+typedef struct {
+    unsigned long long hash;
+    char* source;  // effect source, to tell hash collisions apart
+    int size;
+    GLuint program;
+    GLuint vs, fs;  // kept until linking has finished, for error reporting
+    GLuint uniform_projection;
+    GLuint uniform_model;
+    GLuint uniform_parameters;
+    int ready;
+    unsigned used;
+} TigrProgram;
+
+typedef struct {
+    TigrProgram* program;
+    float scale;
+    int enabled;
+    GLuint fbo, tex;
+    int w, h;
+    GLuint ubo;
+    void* uniforms;
+    int uniforms_size;
+    int uniforms_dirty;
+} TigrPostPass;
+
 typedef struct {
 #ifdef _WIN32
     HGLRC hglrc;
@@ -75,11 +171,22 @@ typedef struct {
     void* glContext;
 #endif
     GLuint tex[2];
+    int tex_w[2], tex_h[2];
+    GLuint pbo[TIGR_PBO_COUNT];
+    int pbo_size[TIGR_PBO_COUNT];
+    int pbo_index;
     GLuint vao;
     GLuint program;
     GLuint uniform_projection;
     GLuint uniform_model;
     GLuint uniform_parameters;
+    TigrProgram programs[TIGR_PROGRAM_CACHE_SIZE];
+    TigrProgram* pending;
+    unsigned program_uses;
+    int program_binary;
+    int parallel_compile;
+    TigrPostPass passes[TIGR_MAX_POST_PASSES];
+    int pass_count;
     int gl_legacy;
     int gl_user_opengl_rendering;
 } GLStuff;
@@ -87,6 +194,67 @@ typedef struct {
 
 #define MAX_TOUCH_POINTS 10
 
+// Number of input events and typed characters kept per frame.
+// Both must be powers of two.
+#define TIGR_EVENT_QUEUE 256
+#define TIGR_CHAR_QUEUE 64
+
+// Ordered access to queue positions shared between threads.
+#ifdef _WIN32
+#define TIGR_LOAD_ACQUIRE(P) ((unsigned)InterlockedCompareExchange((volatile LONG*)(P), 0, 0))
+#define TIGR_STORE_RELEASE(P, V) InterlockedExchange((volatile LONG*)(P), (LONG)(V))
+#else
+#define TIGR_LOAD_ACQUIRE(P) __atomic_load_n((P), __ATOMIC_ACQUIRE)
+#define TIGR_STORE_RELEASE(P, V) __atomic_store_n((P), (V), __ATOMIC_RELEASE)
+#endif
+
+// Spin lock for short critical sections, on a `volatile long` starting out as 0.
+#ifdef _WIN32
+#define TIGR_LOCK(L)                    \
+    while (InterlockedExchange(&(L), 1)) \
+    Sleep(0)
+#define TIGR_UNLOCK(L) InterlockedExchange(&(L), 0)
+#else
+#define TIGR_LOCK(L)                                         \
+    while (__atomic_exchange_n(&(L), 1, __ATOMIC_ACQUIRE)) \
+    sched_yield()
+#define TIGR_UNLOCK(L) __atomic_store_n(&(L), 0, __ATOMIC_RELEASE)
+#endif
+
+// Takes a spin lock if it is free, evaluating to non-zero if it was taken.
+#ifdef _WIN32
+#define TIGR_TRYLOCK(L) (InterlockedExchange(&(L), 1) == 0)
+#else
+#define TIGR_TRYLOCK(L) (__atomic_exchange_n(&(L), 1, __ATOMIC_ACQUIRE) == 0)
+#endif
+
+// Input events, with the characters typed also queued for tigrReadChar.
+// Only the producer moves a head and only the consumer moves a tail,
+// so a backend may fill the queues from an input thread without locking.
+// The frame marks, also owned by the consumer, are where the heads were at
+// the last tigrUpdate: only events before them are read, and only those
+// are dropped when left unread, so events queued during a frame carry over.
+typedef struct {
+    TigrEvent events[TIGR_EVENT_QUEUE];
+    unsigned head, tail, frame;
+    int chars[TIGR_CHAR_QUEUE];
+    unsigned charHead, charTail, charFrame;
+} TigrEventQueue;
+
+typedef struct {
+    unsigned long long frameStart, mark;
+    float recent[TIGR_STATS_WINDOW];
+    int recentPos, recentCount;
+    TigrFrameStats stats;
+} TigrFrameTimer;
+
+typedef struct {
+    unsigned long long interval, next;
+#ifdef _WIN32
+    HANDLE timer;
+#endif
+} TigrLimiter;
+
 typedef struct {
     int shown, closed;
 #ifdef TIGR_GAPI_GL
@@ -115,11 +283,15 @@ typedef struct {
 
     float p1, p2, p3, p4;
 
+    TigrFrameTimer timer;
+    TigrLimiter limiter;
+
     int flags;
     int scale;
     int pos[4];
     int lastChar;
     char keys[256], prev[256];
+    TigrEventQueue events;
 #if defined(__ANDROID__)
     char released[256];
 #endif  // __ANDROID__
@@ -146,6 +318,29 @@ typedef struct {
 
 TigrInternal* tigrInternal(Tigr* bmp);
 
+// Frame timing, see tigrGetFrameStats.
+// Time since the last mark is charged to the given stage.
+void tigrFrameBegin(TigrInternal* win);
+void tigrFrameStage(TigrInternal* win, int stage);
+void tigrFrameEnd(TigrInternal* win, int stage);
+
+// Sleeps for the frame rate cap, timing it apart from the stages.
+void tigrFrameWait(TigrInternal* win);
+
+// Queues an input event for tigrPollEvent, dropping it if the queue is full.
+// Character events are also queued for tigrReadChar.
+void tigrPushEvent(TigrInternal* win, const TigrEvent* event);
+
+// Drops events and characters left unread from the last frame, and makes
+// those queued since readable. Called once per tigrUpdate, after input is read.
+void tigrNextEvents(TigrInternal* win);
+
+// Returns the next queued character, or 0 if none.
+int tigrPopChar(TigrInternal* win);
+
+// Sleeps until the next frame is due, if the limiter has a frame rate.
+void tigrLimitFrame(TigrLimiter* limiter);
+
 void tigrGAPICreate(Tigr* bmp);
 void tigrGAPIDestroy(Tigr* bmp);
 int tigrGAPIBegin(Tigr* bmp);
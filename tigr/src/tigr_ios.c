@@ -401,6 +401,7 @@ static int toWindowY(TigrInternal* win, int y) {
 
 void tigrUpdate(Tigr* bmp) {
     TigrInternal* win = tigrInternal(bmp);
+    tigrFrameBegin(win);
 
     processEvents(win);
 
@@ -423,8 +424,12 @@ void tigrUpdate(Tigr* bmp) {
     }
 
     tigrPosition(bmp, win->scale, gState.screenW, gState.screenH, win->pos);
+    tigrFrameStage(win, TIGR_STAGE_INPUT);
     tigrGAPIPresent(bmp, gState.screenW, gState.screenH);
+    tigrFrameStage(win, TIGR_STAGE_DRAW);
     waitForFrame();
+    tigrFrameEnd(win, TIGR_STAGE_SWAP);
+    tigrFrameWait(win);
 }
 
 int tigrClosed(Tigr* bmp) {
@@ -483,10 +488,17 @@ void tigrFree(Tigr* bmp) {
     if (bmp->handle) {
         TigrInternal* win = tigrInternal(bmp);
     }
-    free(bmp->pix);
+    free(bmp->dirty);
+    free(bmp->opacity);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
+int tigrSetSwapInterval(Tigr* bmp, int interval) {
+    // Frames are always paced by the display link.
+    return interval == 1;
+}
+
 int tigrGAPIBegin(Tigr* bmp) {
     (void)bmp;
     return 0;
@@ -9,7 +9,6 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdarg.h>
-#include <sys/time.h>
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xlocale.h>
@@ -26,6 +25,14 @@ static GLXFBConfig fbConfig;
 
 static PFNGLXCREATECONTEXTATTRIBSARBPROC glXCreateContextAttribsARB = 0;
 
+// Events read by tigrProcessInput.
+#define INPUT_EVENT_MASK \
+    (KeyPressMask | KeyReleaseMask | ButtonPressMask | ButtonReleaseMask | PointerMotionMask | FocusChangeMask)
+
+// Open windows, for handing them events read while updating another window.
+static TigrInternal** windows;
+static int numWindows;
+
 static void tearDownX11Stuff() {
     XCloseDisplay(dpy);
 }
@@ -82,6 +89,9 @@ static void initX11Stuff() {
 
         wmDeleteMessage = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
 
+        // Report held keys as repeated presses, without the fake releases in between.
+        XkbSetDetectableAutoRepeat(dpy, True, NULL);
+
         atexit(tearDownX11Stuff);
 
         done = 1;
@@ -104,26 +114,33 @@ static int hasGLXExtension(Display* display, const char* wanted) {
     return found != 0;
 }
 
-static void setupVSync(Display* display, Window win) {
+// Sets the swap interval of the current context, negative intervals being adaptive.
+static int setupVSync(Display* display, Window win, int interval) {
     if (hasGLXExtension(display, "GLX_EXT_swap_control")) {
+        if (interval < 0 && !hasGLXExtension(display, "GLX_EXT_swap_control_tear")) {
+            return 0;
+        }
         PFNGLXSWAPINTERVALEXTPROC glXSwapIntervalEXT =
             (PFNGLXSWAPINTERVALEXTPROC)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalEXT");
         if (glXSwapIntervalEXT) {
-            glXSwapIntervalEXT(display, win, 1);
+            glXSwapIntervalEXT(display, win, interval);
+            return 1;
         }
     } else if (hasGLXExtension(display, "GLX_MESA_swap_control")) {
         PFNGLXSWAPINTERVALMESAPROC glXSwapIntervalMESA =
             (PFNGLXSWAPINTERVALMESAPROC)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalMESA");
-        if (glXSwapIntervalMESA) {
-            glXSwapIntervalMESA(1);
+        if (glXSwapIntervalMESA && interval >= 0) {
+            return glXSwapIntervalMESA(interval) == 0;
         }
     } else if (hasGLXExtension(display, "GLX_SGI_swap_control")) {
         PFNGLXSWAPINTERVALSGIPROC glXSwapIntervalSGI =
             (PFNGLXSWAPINTERVALSGIPROC)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalSGI");
-        if (glXSwapIntervalSGI) {
-            glXSwapIntervalSGI(1);
+        // SGI has no way to turn vsync off.
+        if (glXSwapIntervalSGI && interval > 0) {
+            return glXSwapIntervalSGI(interval) == 0;
         }
     }
+    return 0;
 }
 
 static void tigrHideCursor(TigrInternal* win) {
@@ -204,8 +221,8 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
         XResizeWindow(dpy, xwin, w * scale, h * scale);
     }
 
-    // Enable mouse events reporting (needed for mouse wheel events)
-    XSelectInput(dpy, xwin, ButtonPressMask);
+    // Input is read from the event queue, see tigrProcessInput.
+    XSelectInput(dpy, xwin, INPUT_EVENT_MASK);
 
     XTextProperty prop;
     int result = Xutf8TextListToTextProperty(dpy, (char**)&title, 1, XUTF8StringStyle, &prop);
@@ -228,7 +245,7 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
     glc = glXCreateContextAttribsARB(dpy, fbConfig, NULL, GL_TRUE, contextAttributes);
     glXMakeCurrent(dpy, xwin, glc);
 
-    setupVSync(dpy, xwin);
+    setupVSync(dpy, xwin, 1);
 
     bmp = tigrBitmap2(w, h, sizeof(TigrInternal));
     bmp->handle = (void*)xwin;
@@ -243,7 +260,6 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
     win->closed = 0;
     win->scale = scale;
 
-    win->lastChar = 0;
     win->flags = flags;
     win->p1 = win->p2 = win->p3 = 0;
     win->p4 = 1;
@@ -264,6 +280,12 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
     tigrGAPICreate(bmp);
     tigrGAPIBegin(bmp);
 
+    TigrInternal** grown = (TigrInternal**)realloc(windows, (numWindows + 1) * sizeof(TigrInternal*));
+    if (grown) {
+        windows = grown;
+        windows[numWindows++] = win;
+    }
+
     return bmp;
 }
 
@@ -272,6 +294,12 @@ int tigrClosed(Tigr* bmp) {
     return win->win == 0;
 }
 
+int tigrSetSwapInterval(Tigr* bmp, int interval) {
+    TigrInternal* win = tigrInternal(bmp);
+    glXMakeCurrent(win->dpy, win->win, win->glc);
+    return setupVSync(win->dpy, win->win, interval);
+}
+
 int tigrGAPIBegin(Tigr* bmp) {
     TigrInternal* win = tigrInternal(bmp);
     return glXMakeCurrent(win->dpy, win->win, win->glc) ? 0 : -1;
@@ -297,10 +325,7 @@ int tigrKeyHeld(Tigr* bmp, int key) {
 }
 
 int tigrReadChar(Tigr* bmp) {
-    TigrInternal* win = tigrInternal(bmp);
-    int c = win->lastChar;
-    win->lastChar = 0;
-    return c;
+    return tigrPopChar(tigrInternal(bmp));
 }
 
 uint8_t tigrKeyFromX11(KeySym sym) {
@@ -461,124 +486,198 @@ static void tigrUpdateModifiers(TigrInternal* win) {
     win->keys[TK_ALT] = win->keys[TK_LALT] || win->keys[TK_RALT];
 }
 
-static void tigrInterpretChar(TigrInternal* win, Window root, unsigned int keycode, unsigned int mask) {
-    XKeyEvent event;
-    memset(&event, 0, sizeof(event));
-    event.type = KeyPress;
-    event.display = win->dpy;
-    event.root = root;
-    event.window = win->win;
-    event.state = mask;
-    event.keycode = keycode;
-    char inputTextUTF8[10];
-    Status status = 0;
-    Xutf8LookupString(win->ic, &event, inputTextUTF8, sizeof(inputTextUTF8), NULL, &status);
-
-    if (status == XLookupChars) {
-        tigrDecodeUTF8(inputTextUTF8, &win->lastChar);
+// Maps X server timestamps (ms) onto the monotonic clock.
+// The smallest offset seen is the one with the least delivery delay.
+static unsigned long long tigrEventTime(Time time) {
+    static long long offset;
+    static int synced = 0;
+    long long now = (long long)tigrTimeNs();
+    long long server = (long long)time * 1000000;
+
+    // Also resync if the 32-bit server time wraps around.
+    if (!synced || now - server < offset || now - (server + offset) > 10000000000ll) {
+        offset = now - server;
+        synced = 1;
     }
+    return (unsigned long long)(server + offset);
 }
 
-static void tigrProcessInput(TigrInternal* win, int winWidth, int winHeight) {
-    {
-        Window focused;
-        int revertTo;
-        XGetInputFocus(win->dpy, &focused, &revertTo);
+// Text input is skipped for key presses the input method has filtered, as part of a
+// dead key or composed sequence, but their key state still counts.
+static void tigrProcessKey(TigrInternal* win, XKeyEvent* xkey, int filtered) {
+    TigrEvent event = { 0 };
+    event.time = tigrEventTime(xkey->time);
+
+    KeySym keySym = XkbKeycodeToKeysym(win->dpy, xkey->keycode, 0, 0);
+    if (keySym != NoSymbol) {
+        int key = tigrKeyFromX11(keySym);
+        win->keys[key] = xkey->type == KeyPress;
+        tigrUpdateModifiers(win);
+
+        event.type = xkey->type == KeyPress ? TIGR_EVENT_KEY_DOWN : TIGR_EVENT_KEY_UP;
+        event.key = key;
+        tigrPushEvent(win, &event);
+    }
 
-        if (win->win != focused) {
-            return;
+    if (xkey->type == KeyPress && !filtered) {
+        char inputTextUTF8[32];
+        Status status = 0;
+        int length = Xutf8LookupString(win->ic, xkey, inputTextUTF8, sizeof(inputTextUTF8) - 1, NULL, &status);
+
+        if (status == XLookupChars) {
+            inputTextUTF8[length] = 0;
+            event.type = TIGR_EVENT_CHAR;
+            for (const char* text = inputTextUTF8; *text;) {
+                text = tigrDecodeUTF8(text, &event.key);
+                tigrPushEvent(win, &event);
+            }
         }
     }
+}
 
-    Window root;
-    Window child;
-    int rootX;
-    int rootY;
-    int winX;
-    int winY;
-    unsigned int mask;
-
-    if (XQueryPointer(win->dpy, win->win, &root, &child, &rootX, &rootY, &winX, &winY, &mask)) {
-        static unsigned int prevButtons;
-        unsigned int buttons = mask & (Button1Mask | Button2Mask | Button3Mask);
+static void tigrProcessButton(TigrInternal* win, XButtonEvent* xbutton) {
+    TigrEvent event = { 0 };
+    event.time = tigrEventTime(xbutton->time);
+    event.x = win->mouseX = (xbutton->x - win->pos[0]) / win->scale;
+    event.y = win->mouseY = (xbutton->y - win->pos[1]) / win->scale;
+
+    // Button4 = WheelUp / Button5 = WheelDown, 6 and 7 scroll sideways.
+    if (xbutton->button >= Button4 && xbutton->button <= 7) {
+        if (xbutton->type == ButtonPress) {
+            event.type = TIGR_EVENT_WHEEL;
+            event.dy = xbutton->button == Button4 ? 1.0f : xbutton->button == Button5 ? -1.0f : 0.0f;
+            event.dx = xbutton->button == 6 ? 1.0f : xbutton->button == 7 ? -1.0f : 0.0f;
+            win->scrollDeltaX += event.dx;
+            win->scrollDeltaY += event.dy;
+            tigrPushEvent(win, &event);
+        }
+        return;
+    }
 
-        win->mouseX = (winX - win->pos[0]) / win->scale;
-        win->mouseY = (winY - win->pos[1]) / win->scale;
+    int button = xbutton->button == Button1 ? 1 : xbutton->button == Button3 ? 2 : xbutton->button == Button2 ? 4 : 0;
+    if (button) {
+        if (xbutton->type == ButtonPress) {
+            win->mouseButtons |= button;
+        } else {
+            win->mouseButtons &= ~button;
+        }
+        event.type = xbutton->type == ButtonPress ? TIGR_EVENT_MOUSE_DOWN : TIGR_EVENT_MOUSE_UP;
+        event.key = button;
+        tigrPushEvent(win, &event);
+    }
+}
 
-        if (buttons != prevButtons && (winX > 0 && winX < winWidth) && (winY > 0 && winY < winHeight)) {
-            win->mouseButtons = (buttons & Button1Mask)       ? 1
-                                : 0 | (buttons & Button3Mask) ? 2
-                                : 0 | (buttons & Button2Mask) ? 4
-                                                              : 0;
+// Releases everything held when the window loses focus,
+// since the releases themselves go to another window.
+static void tigrReleaseAll(TigrInternal* win) {
+    TigrEvent event = { 0 };
+    event.time = tigrTimeNs();
+    event.type = TIGR_EVENT_KEY_UP;
+    for (int key = 0; key < 256; key++) {
+        if (win->keys[key]) {
+            win->keys[key] = 0;
+            event.key = key;
+            tigrPushEvent(win, &event);
         }
-        prevButtons = buttons;
     }
+    event.type = TIGR_EVENT_MOUSE_UP;
+    event.x = win->mouseX;
+    event.y = win->mouseY;
+    for (int button = 1; button <= 4; button <<= 1) {
+        if (win->mouseButtons & button) {
+            win->mouseButtons &= ~button;
+            event.key = button;
+            tigrPushEvent(win, &event);
+        }
+    }
+}
 
-    // Retrieve mouse wheel events - Cannot be done in the XQueryPointer call
-    // -> https://comp.unix.programmer.narkive.com/eOnjkQ6L/xlib-xquerypointer-and-button4mask-button5mask#post2
-    // Button4 = WheelUp / Button5 = WheelDown
-    XEvent mouseButtonEvent;
-    while (XPending(win->dpy)) {
-        XPeekEvent(win->dpy, &mouseButtonEvent);
-        if (mouseButtonEvent.xany.type == ButtonPress) {
-            switch (mouseButtonEvent.xbutton.button) {
-                case Button4:
-                    win->scrollDeltaY += 1;
-                    break;
-                case Button5:
-                    win->scrollDeltaY -= 1;
-                    break;
-                case 6:
-                    win->scrollDeltaX += 1;
-                    break;
-                case 7:
-                    win->scrollDeltaX -= 1;
-                    break;
-            }
-            XNextEvent(win->dpy, &mouseButtonEvent);
-        } else {
-            break;
+static TigrInternal* tigrFindWindow(Window xwin) {
+    for (int i = 0; i < numWindows; i++) {
+        if (windows[i]->win == xwin) {
+            return windows[i];
         }
     }
+    return NULL;
+}
 
-    static char prevKeys[32];
-    char keys[32];
-    XQueryKeymap(win->dpy, keys);
-    for (int i = 0; i < 32; i++) {
-        char thisBlock = keys[i];
-        char prevBlock = prevKeys[i];
-        if (thisBlock != prevBlock) {
-            for (int j = 0; j < 8; j++) {
-                int thisBit = thisBlock & 1;
-                int prevBit = prevBlock & 1;
-                thisBlock >>= 1;
-                prevBlock >>= 1;
-                if (thisBit != prevBit) {
-                    int keyCode = 8 * i + j;
-                    KeySym keySym = XkbKeycodeToKeysym(win->dpy, keyCode, 0, 0);
-                    if (keySym != NoSymbol) {
-                        int key = tigrKeyFromX11(keySym);
-                        win->keys[key] = thisBit;
-                        tigrUpdateModifiers(win);
-
-                        if (thisBit) {
-                            tigrInterpretChar(win, root, keyCode, mask);
-                        }
-                    }
-                }
+static void tigrCloseWindow(TigrInternal* win) {
+    glXMakeCurrent(win->dpy, None, NULL);
+    glXDestroyContext(win->dpy, win->glc);
+    XDestroyWindow(win->dpy, win->win);
+    win->win = 0;
+}
+
+// Hands an event to the window it is for.
+static void tigrDispatchEvent(XEvent* event) {
+    // Input methods consume the keys of dead key and composed sequences.
+    int filtered = XFilterEvent(event, None);
+
+    if (event->type == MappingNotify) {
+        XRefreshKeyboardMapping(&event->xmapping);
+        return;
+    }
+
+    TigrInternal* win = tigrFindWindow(event->xany.window);
+    if (!win) {
+        return;
+    }
+
+    switch (event->type) {
+        case KeyPress:
+        case KeyRelease:
+            tigrProcessKey(win, &event->xkey, filtered);
+            break;
+        case ButtonPress:
+        case ButtonRelease:
+            if (!filtered) {
+                tigrProcessButton(win, &event->xbutton);
             }
-        }
+            break;
+        case MotionNotify:
+            if (!filtered) {
+                TigrEvent move = { 0 };
+                move.type = TIGR_EVENT_MOUSE_MOVE;
+                move.time = tigrEventTime(event->xmotion.time);
+                move.x = win->mouseX = (event->xmotion.x - win->pos[0]) / win->scale;
+                move.y = win->mouseY = (event->xmotion.y - win->pos[1]) / win->scale;
+                tigrPushEvent(win, &move);
+            }
+            break;
+        case FocusIn:
+            if (event->xfocus.mode != NotifyGrab && event->xfocus.mode != NotifyUngrab) {
+                XSetICFocus(win->ic);
+            }
+            break;
+        case FocusOut:
+            // Keyboard grabs, such as during a window manager drag, move focus
+            // only for their duration, and keys held through them stay held.
+            if (event->xfocus.mode != NotifyGrab && event->xfocus.mode != NotifyUngrab) {
+                XUnsetICFocus(win->ic);
+                tigrReleaseAll(win);
+            }
+            break;
+        case ClientMessage:
+            if (!filtered && (Atom)event->xclient.data.l[0] == wmDeleteMessage) {
+                tigrCloseWindow(win);
+            }
+            break;
     }
-    memcpy(prevKeys, keys, 32);
+}
 
+// Reads queued input events, rather than querying input state,
+// which would cost a server round trip each and miss short presses.
+// Events for other windows are handed to them, to be read on their next update.
+static void tigrProcessInput(TigrInternal* win) {
     XEvent event;
-    while (XCheckTypedWindowEvent(win->dpy, win->win, ClientMessage, &event)) {
-        if (event.xclient.data.l[0] == wmDeleteMessage) {
-            glXMakeCurrent(win->dpy, None, NULL);
-            glXDestroyContext(win->dpy, win->glc);
-            XDestroyWindow(win->dpy, win->win);
-            win->win = 0;
-        }
+    while (XPending(win->dpy)) {
+        XNextEvent(win->dpy, &event);
+        tigrDispatchEvent(&event);
+    }
+
+    // Closing another window may have released this one's context.
+    if (win->win && glXGetCurrentContext() != win->glc) {
+        glXMakeCurrent(win->dpy, win->win, win->glc);
     }
     XFlush(win->dpy);
 }
@@ -587,6 +686,7 @@ void tigrUpdate(Tigr* bmp) {
     XWindowAttributes gwa;
 
     TigrInternal* win = tigrInternal(bmp);
+    tigrFrameBegin(win);
 
     memcpy(win->prev, win->keys, 256);
     win->scrollDeltaX = 0;
@@ -601,23 +701,34 @@ void tigrUpdate(Tigr* bmp) {
 
     tigrPosition(bmp, win->scale, gwa.width, gwa.height, win->pos);
     glXMakeCurrent(win->dpy, win->win, win->glc);
+    tigrFrameStage(win, TIGR_STAGE_INPUT);
     tigrGAPIPresent(bmp, gwa.width, gwa.height);
+    tigrFrameStage(win, TIGR_STAGE_DRAW);
     glXSwapBuffers(win->dpy, win->win);
+    tigrFrameStage(win, TIGR_STAGE_SWAP);
+    tigrFrameWait(win);
 
-    tigrProcessInput(win, gwa.width, gwa.height);
+    tigrProcessInput(win);
+    tigrNextEvents(win);
+    tigrFrameEnd(win, TIGR_STAGE_INPUT);
 }
 
 void tigrFree(Tigr* bmp) {
     if (bmp->handle) {
         TigrInternal* win = tigrInternal(bmp);
         if (win->win) {
-            glXMakeCurrent(win->dpy, None, NULL);
-            glXDestroyContext(win->dpy, win->glc);
-            XDestroyWindow(win->dpy, win->win);
-            win->win = 0;
+            tigrCloseWindow(win);
+        }
+        for (int i = 0; i < numWindows; i++) {
+            if (windows[i] == win) {
+                windows[i] = windows[--numWindows];
+                break;
+            }
         }
     }
-    free(bmp->pix);
+    free(bmp->dirty);
+    free(bmp->opacity);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -636,16 +747,8 @@ void tigrError(Tigr* bmp, const char* message, ...) {
 }
 
 float tigrTime() {
-    static double lastTime = 0;
-
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-
-    double now = (double)tv.tv_sec + (tv.tv_usec / 1000000.0);
-    double elapsed = lastTime == 0 ? 0 : now - lastTime;
-    lastTime = now;
-
-    return (float)elapsed;
+    static TigrTimer timer;
+    return tigrTimerDelta(&timer);
 }
 
 void tigrMouse(Tigr* bmp, int* x, int* y, int* buttons) {
@@ -69,45 +69,61 @@ static int unfilter(int w, int h, int bipp, unsigned char* raw) {
     return 1;
 }
 
-static void convert(int bypp, int w, int h, const unsigned char* src, TPixel* dest, const unsigned char* trns) {
+static void convert(int bypp, int w, int h, const unsigned char* src, TPixel* dest, const unsigned char* trns,
+                    int premultiply) {
     int x, y;
     for (y = 0; y < h; y++) {
         src++;  // skip filter byte
         for (x = 0; x < w; x++, src += bypp) {
+            TPixel p;
             switch (bypp) {
                 case 1: {
                     unsigned char c = src[0];
                     if (trns && c == *trns) {
-                        *dest++ = tigrRGBA(c, c, c, 0);
+                        p = tigrRGBA(c, c, c, 0);
                         break;
                     } else {
-                        *dest++ = tigrRGB(c, c, c);
+                        p = tigrRGB(c, c, c);
                         break;
                     }
                 }
                 case 2:
-                    *dest++ = tigrRGBA(src[0], src[0], src[0], src[1]);
+                    p = tigrRGBA(src[0], src[0], src[0], src[1]);
                     break;
                 case 3: {
                     unsigned char r = src[0];
                     unsigned char g = src[1];
                     unsigned char b = src[2];
                     if (trns && trns[1] == r && trns[3] == g && trns[5] == b) {
-                        *dest++ = tigrRGBA(r, g, b, 0);
+                        p = tigrRGBA(r, g, b, 0);
                         break;
                     } else {
-                        *dest++ = tigrRGB(r, g, b);
+                        p = tigrRGB(r, g, b);
                         break;
                     }
                 }
-                case 4:
-                    *dest++ = tigrRGBA(src[0], src[1], src[2], src[3]);
+                default:
+                    p = tigrRGBA(src[0], src[1], src[2], src[3]);
                     break;
             }
+            if (premultiply && p.a != 255) {
+                p = tigrPremultiplyPixel(p);
+            }
+            *dest++ = p;
         }
     }
 }
 
+// Reads PLTE and tRNS into 256 colors. Colors missing from the file are transparent black.
+static void readPalette(TPixel palette[256], const unsigned char* plte, const unsigned char* trns, int trnsSize) {
+    int colors = get32(plte - 8) / 3;
+    memset(palette, 0, 256 * sizeof(TPixel));
+    for (int c = 0; c < colors && c < 256; c++) {
+        unsigned char alpha = c < trnsSize ? trns[c] : 255;
+        palette[c] = tigrRGBA(plte[c * 3 + 0], plte[c * 3 + 1], plte[c * 3 + 2], alpha);
+    }
+}
+
 static void depalette(int w,
                       int h,
                       unsigned char* src,
@@ -115,10 +131,19 @@ static void depalette(int w,
                       int bipp,
                       const unsigned char* plte,
                       const unsigned char* trns,
-                      int trnsSize) {
+                      int trnsSize,
+                      int premultiply) {
     int x, y, c;
-    unsigned char alpha;
     int mask = 0, len = 0;
+    TPixel palette[256];
+
+    // Colors are looked up ready to use, premultiplied if asked to.
+    readPalette(palette, plte, trns, trnsSize);
+    if (premultiply) {
+        for (c = 0; c < 256; c++) {
+            palette[c] = tigrPremultiplyPixel(palette[c]);
+        }
+    }
 
     switch (bipp) {
         case 4:
@@ -146,11 +171,11 @@ static void depalette(int w,
                     src++;
                 }
             }
-            alpha = 255;
-            if (c < trnsSize) {
-                alpha = trns[c];
-            }
-            *dest++ = tigrRGBA(plte[c * 3 + 0], plte[c * 3 + 1], plte[c * 3 + 2], alpha);
+            *dest++ = palette[c];
+        }
+        // Rows start on a byte boundary.
+        if (bipp < 8 && (w & len)) {
+            src++;
         }
     }
 }
@@ -164,18 +189,25 @@ static void depalette(int w,
     if (!(X))    \
     FAIL()
 
-static int outsize(Tigr* bmp, int bipp) {
-    return (rowBytes(bmp->w, bipp) + 1) * bmp->h;
+static int outsize(int w, int h, int bipp) {
+    return (rowBytes(w, bipp) + 1) * h;
 }
 
-static Tigr* tigrLoadPng(PNG* png) {
-    const unsigned char *ihdr, *idat, *plte, *trns, *first;
-    int trnsSize = 0;
+// Chunks and image data of a PNG file.
+typedef struct {
+    int w, h;
     int depth, ctype, bipp;
-    int datalen = 0;
-    unsigned char *data = NULL, *out;
-    Tigr* bmp = NULL;
+    const unsigned char *plte, *trns;
+    int trnsSize;
+    unsigned char* data;  // Joined IDAT chunks
+    int datalen;
+} PNGImage;
+
+// Reads the chunks of a PNG file. Frees img->data on error.
+static int readPng(PNG* png, PNGImage* img) {
+    const unsigned char *ihdr, *idat, *first;
 
+    memset(img, 0, sizeof(PNGImage));
     CHECK(memcmp(png->p, "\211PNG\r\n\032\n", 8) == 0);  // PNG signature
     png->p += 8;
     first = png->p;
@@ -183,98 +215,157 @@ static Tigr* tigrLoadPng(PNG* png) {
     // Read IHDR
     ihdr = find(png, "IHDR", 13);
     CHECK(ihdr);
-    depth = ihdr[8];
-    ctype = ihdr[9];
-    switch (ctype) {
+    img->w = get32(ihdr + 0);
+    img->h = get32(ihdr + 4);
+    img->depth = ihdr[8];
+    img->ctype = ihdr[9];
+    switch (img->ctype) {
         case 0:
-            bipp = depth;
+            img->bipp = img->depth;
             break;  // greyscale
         case 2:
-            bipp = 3 * depth;
+            img->bipp = 3 * img->depth;
             break;  // RGB
         case 3:
-            bipp = depth;
+            img->bipp = img->depth;
             break;  // paletted
         case 4:
-            bipp = 2 * depth;
+            img->bipp = 2 * img->depth;
             break;  // grey+alpha
         case 6:
-            bipp = 4 * depth;
+            img->bipp = 4 * img->depth;
             break;  // RGBA
         default:
             FAIL();
     }
 
-    // Allocate bitmap (+1 width to save room for stupid PNG filter bytes)
-    bmp = tigrBitmap(get32(ihdr + 0) + 1, get32(ihdr + 4));
-    CHECK(bmp);
-    bmp->w--;
-
     // We support 8-bit color components and 1, 2, 4 and 8 bit palette formats.
     // No interlacing, or wacky filter types.
-    CHECK((depth != 16) && ihdr[10] == 0 && ihdr[11] == 0 && ihdr[12] == 0);
+    CHECK((img->depth != 16) && ihdr[10] == 0 && ihdr[11] == 0 && ihdr[12] == 0);
 
     // Join IDAT chunks.
     for (idat = find(png, "IDAT", 0); idat; idat = find(png, "IDAT", 0)) {
         unsigned len = get32(idat - 8);
-        data = (unsigned char*)realloc(data, datalen + len);
-        if (!data)
-            break;
-
-        memcpy(data + datalen, idat, len);
-        datalen += len;
+        unsigned char* data = (unsigned char*)realloc(img->data, img->datalen + len);
+        CHECK(data);
+        img->data = data;
+        memcpy(img->data + img->datalen, idat, len);
+        img->datalen += len;
     }
 
     // Find palette.
     png->p = first;
-    plte = find(png, "PLTE", 0);
+    img->plte = find(png, "PLTE", 0);
 
     // Find transparency info.
     png->p = first;
-    trns = find(png, "tRNS", 0);
-    if (trns) {
-        trnsSize = get32(trns - 8);
+    img->trns = find(png, "tRNS", 0);
+    if (img->trns) {
+        img->trnsSize = get32(img->trns - 8);
+    }
+
+    CHECK(img->data && img->datalen >= 6);
+    CHECK((img->data[0] & 0x0f) == 0x08     // compression method (RFC 1950)
+          && (img->data[0] & 0xf0) <= 0x70  // window size
+          && (img->data[1] & 0x20) == 0);   // preset dictionary present
+    return 1;
+
+err:
+    free(img->data);
+    img->data = NULL;
+    return 0;
+}
+
+// Inflates and unfilters the image data into out, each row starting with its filter byte.
+static int decodePng(PNGImage* img, unsigned char* out) {
+    return tigrInflate(out, outsize(img->w, img->h, img->bipp), img->data + 2, img->datalen - 6) &&
+           unfilter(img->w, img->h, img->bipp, out);
+}
+
+static Tigr* tigrLoadPng(PNG* png, int premultiply) {
+    PNGImage img;
+    unsigned char* out;
+    Tigr* bmp = NULL;
+
+    if (!readPng(png, &img)) {
+        return NULL;
     }
 
-    CHECK(data && datalen >= 6);
-    CHECK((data[0] & 0x0f) == 0x08     // compression method (RFC 1950)
-          && (data[0] & 0xf0) <= 0x70  // window size
-          && (data[1] & 0x20) == 0);   // preset dictionary present
+    // Allocate bitmap (+1 width to save room for stupid PNG filter bytes)
+    // Decoding writes every pixel, so there is no need to clear the bitmap first.
+    bmp = tigrBitmapUninit(img.w + 1, img.h);
+    CHECK(bmp);
+    bmp->w--;
+    bmp->stride = bmp->w;
 
-    out = (unsigned char*)bmp->pix + outsize(bmp, 32) - outsize(bmp, bipp);
-    CHECK(tigrInflate(out, outsize(bmp, bipp), data + 2, datalen - 6));
-    CHECK(unfilter(bmp->w, bmp->h, bipp, out));
+    out = (unsigned char*)bmp->pix + outsize(bmp->w, bmp->h, 32) - outsize(bmp->w, bmp->h, img.bipp);
+    CHECK(decodePng(&img, out));
 
-    if (ctype == 3) {
-        CHECK(plte);
-        depalette(bmp->w, bmp->h, out, bmp->pix, bipp, plte, trns, trnsSize);
+    if (img.ctype == 3) {
+        CHECK(img.plte);
+        depalette(bmp->w, bmp->h, out, bmp->pix, img.bipp, img.plte, img.trns, img.trnsSize, premultiply);
     } else {
-        CHECK(bipp % 8 == 0);
-        convert(bipp / 8, bmp->w, bmp->h, out, bmp->pix, trns);
+        CHECK(img.bipp % 8 == 0);
+        convert(img.bipp / 8, bmp->w, bmp->h, out, bmp->pix, img.trns, premultiply);
+    }
+    if (premultiply) {
+        bmp->flags |= TIGR_BITMAP_PREMULTIPLIED;
     }
 
-    free(data);
+    free(img.data);
     return bmp;
 
 err:
-    if (data)
-        free(data);
+    free(img.data);
     if (bmp)
         tigrFree(bmp);
     return NULL;
 }
 
+// Keeps the indices of a paletted PNG, instead of looking up their colors.
+static TigrIndexed* tigrLoadIndexedPng(PNG* png) {
+    PNGImage img;
+    unsigned char* out = NULL;
+    TigrIndexed* bmp = NULL;
+
+    if (!readPng(png, &img)) {
+        return NULL;
+    }
+    CHECK(img.ctype == 3 && img.plte);
+
+    bmp = tigrIndexed(img.w, img.h, img.depth);
+    out = (unsigned char*)malloc(outsize(img.w, img.h, img.bipp));
+    CHECK(bmp && out);
+    CHECK(decodePng(&img, out));
+
+    // PNG rows are packed the same way, after their filter byte.
+    for (int y = 0; y < img.h; y++) {
+        memcpy(bmp->data + y * bmp->stride, out + y * (bmp->stride + 1) + 1, bmp->stride);
+    }
+    readPalette(bmp->palette, img.plte, img.trns, img.trnsSize);
+
+    free(out);
+    free(img.data);
+    return bmp;
+
+err:
+    free(out);
+    free(img.data);
+    tigrFreeIndexed(bmp);
+    return NULL;
+}
+
 #undef CHECK
 #undef FAIL
 
-Tigr* tigrLoadImageMem(const void* data, int length) {
+static Tigr* tigrLoadPngMem(const void* data, int length, int premultiply) {
     PNG png;
     png.p = (unsigned char*)data;
     png.end = (unsigned char*)data + length;
-    return tigrLoadPng(&png);
+    return tigrLoadPng(&png, premultiply);
 }
 
-Tigr* tigrLoadImage(const char* fileName) {
+static Tigr* tigrLoadPngFile(const char* fileName, int premultiply) {
     int len;
     void* data;
     Tigr* bmp;
@@ -283,7 +374,44 @@ Tigr* tigrLoadImage(const char* fileName) {
     if (!data)
         return NULL;
 
-    bmp = tigrLoadImageMem(data, len);
+    bmp = tigrLoadPngMem(data, len, premultiply);
+    free(data);
+    return bmp;
+}
+
+Tigr* tigrLoadImageMem(const void* data, int length) {
+    return tigrLoadPngMem(data, length, 0);
+}
+
+Tigr* tigrLoadImage(const char* fileName) {
+    return tigrLoadPngFile(fileName, 0);
+}
+
+Tigr* tigrLoadImageMemPremultiplied(const void* data, int length) {
+    return tigrLoadPngMem(data, length, 1);
+}
+
+Tigr* tigrLoadImagePremultiplied(const char* fileName) {
+    return tigrLoadPngFile(fileName, 1);
+}
+
+TigrIndexed* tigrLoadIndexedMem(const void* data, int length) {
+    PNG png;
+    png.p = (unsigned char*)data;
+    png.end = (unsigned char*)data + length;
+    return tigrLoadIndexedPng(&png);
+}
+
+TigrIndexed* tigrLoadIndexed(const char* fileName) {
+    int len;
+    void* data;
+    TigrIndexed* bmp;
+
+    data = tigrReadFile(fileName, &len);
+    if (!data)
+        return NULL;
+
+    bmp = tigrLoadIndexedMem(data, len);
     free(data);
     return bmp;
 }
@@ -473,7 +473,9 @@ void tigrFree(Tigr* bmp) {
         objc_msgSend_void((id)win->gl.glContext, sel("release"));
         objc_msgSend_void(window, sel("release"));
     }
-    free(bmp->pix);
+    free(bmp->dirty);
+    free(bmp->opacity);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -937,6 +939,7 @@ void tigrUpdate(Tigr* bmp) {
     win = tigrInternal(bmp);
     window = (id)bmp->handle;
     openGLContext = (id)win->gl.glContext;
+    tigrFrameBegin(win);
 
     if (terminated || _tigrIsWindowClosed(window)) {
         return;
@@ -990,7 +993,9 @@ void tigrUpdate(Tigr* bmp) {
         win->scale = tigrEnforceScale(tigrCalcScale(bmp->w, bmp->h, windowSize.width, windowSize.height), win->flags);
 
     tigrPosition(bmp, win->scale, windowSize.width, windowSize.height, win->pos);
+    tigrFrameStage(win, TIGR_STAGE_INPUT);
     tigrGAPIPresent(bmp, windowSize.width, windowSize.height);
+    tigrFrameStage(win, TIGR_STAGE_DRAW);
     objc_msgSend_void(openGLContext, sel("flushBuffer"));
     tigrGAPIEnd(bmp);
 
@@ -1014,6 +1019,22 @@ void tigrUpdate(Tigr* bmp) {
             break;
         }
     }
+    tigrFrameEnd(win, TIGR_STAGE_SWAP);
+    tigrFrameWait(win);
+}
+
+int tigrSetSwapInterval(Tigr* bmp, int interval) {
+    TigrInternal* win = tigrInternal(bmp);
+    GLint swapInterval = interval;
+    NSInteger NSOpenGLCPSwapInterval = 222;
+
+    // No adaptive vsync on macOS.
+    if (interval < 0) {
+        return 0;
+    }
+    objc_msgSend_t(void, GLint*, NSInteger)((id)win->gl.glContext, sel("setValues:forParameter:"), &swapInterval,
+                                            NSOpenGLCPSwapInterval);
+    return 1;
 }
 
 int tigrGAPIBegin(Tigr* bmp) {
@@ -4,6 +4,10 @@
 #include <stdarg.h>
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 #ifdef _MSC_VER
 #define vsnprintf _vsnprintf
@@ -26,22 +30,22 @@ static int cp1252[] = {
     0x00f5, 0x00f6, 0x00f7, 0x00f8, 0x00f9, 0x00fa, 0x00fb, 0x00fc, 0x00fd, 0x00fe, 0x00ff,
 };
 
-static int border(Tigr* bmp, int x, int y) {
-    TPixel top = tigrGet(bmp, 0, 0);
-    TPixel c = tigrGet(bmp, x, y);
-    return (c.r == top.r && c.g == top.g && c.b == top.b) || x >= bmp->w || y >= bmp->h;
+static int border(TPixel c, TPixel top) {
+    return c.r == top.r && c.g == top.g && c.b == top.b;
 }
 
-static void scan(Tigr* bmp, int* x, int* y, int* rowh) {
+// Finds the top left corner of the next glyph, scanning row by row.
+static void scan(Tigr* bmp, TPixel top, int* x, int* y, int* rowh) {
     while (*y < bmp->h) {
-        if (*x >= bmp->w) {
-            *x = 0;
-            (*y) += *rowh;
-            *rowh = 1;
+        TPixel* row = &bmp->pix[*y * bmp->stride];
+        while (*x < bmp->w) {
+            if (!border(row[*x], top))
+                return;
+            (*x)++;
         }
-        if (!border(bmp, *x, *y))
-            return;
-        (*x)++;
+        *x = 0;
+        (*y) += *rowh;
+        *rowh = 1;
     }
 }
 
@@ -71,6 +75,22 @@ static int readWatermark(Tigr* bmp, int x, int y, int* big, int* small) {
     return 1;
 }
 
+static int compareGlyphs(const void* a, const void* b) {
+    int ca = ((const TigrGlyph*)a)->code;
+    int cb = ((const TigrGlyph*)b)->code;
+    return (ca > cb) - (ca < cb);
+}
+
+// Sorts glyphs by code point, unless they already are.
+static void sortGlyphs(TigrFont* font) {
+    for (int i = 1; i < font->numGlyphs; i++) {
+        if (font->glyphs[i - 1].code > font->glyphs[i].code) {
+            qsort(font->glyphs, font->numGlyphs, sizeof(TigrGlyph), compareGlyphs);
+            return;
+        }
+    }
+}
+
 int tigrLoadGlyphs(TigrFont* font, int codepage) {
     int x = 0;
     int y = 0;
@@ -78,6 +98,9 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
     int h = 0;
     int rowh = 1;
 
+    Tigr* bmp = font->bitmap;
+    TPixel top = bmp->pix[0];
+
     TigrGlyph* g;
     switch (codepage) {
         case TCP_ASCII:
@@ -87,7 +110,8 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
             font->numGlyphs = 256 - 32;
             break;
         case TCP_UTF32:
-            if (!readWatermark(font->bitmap, 0, 0, &font->numGlyphs, &rowh)) {
+            if (!readWatermark(bmp, 0, 0, &font->numGlyphs, &rowh) || font->numGlyphs <= 0) {
+                errno = EINVAL;
                 return 0;
             }
             h = rowh;
@@ -106,20 +130,22 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
 
         if (codepage != TCP_UTF32) {
             // Find the next glyph.
-            scan(font->bitmap, &x, &y, &rowh);
+            scan(bmp, top, &x, &y, &rowh);
 
-            if (y >= font->bitmap->h) {
+            if (y >= bmp->h) {
                 errno = EINVAL;
                 return 0;
             }
 
             // Scan the width and height
+            TPixel* p = &bmp->pix[y * bmp->stride + x];
             w = h = 0;
-            while (!border(font->bitmap, x + w, y)) {
+            while (x + w < bmp->w && !border(p[w], top)) {
                 w++;
             }
 
-            while (!border(font->bitmap, x, y + h)) {
+            while (y + h < bmp->h && !border(*p, top)) {
+                p += bmp->stride;
                 h++;
             }
         }
@@ -136,11 +162,12 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
                 }
                 break;
             case TCP_UTF32:
-                if (!readWatermark(font->bitmap, x, y, &g->code, &w)) {
+                if (!readWatermark(bmp, x, y, &g->code, &w)) {
                     // Maybe we are at the end of a row?
                     x = 0;
                     y += rowh;
-                    if (!readWatermark(font->bitmap, x, y, &g->code, &w)) {
+                    if (!readWatermark(bmp, x, y, &g->code, &w)) {
+                        errno = EINVAL;
                         return 0;
                     }
                 }
@@ -154,6 +181,7 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
         g->y = y;
         g->w = w;
         g->h = h;
+        g->advance = w;
         x += w;
         if (h != font->glyphs[0].h) {
             errno = EINVAL;
@@ -165,20 +193,171 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
         }
     }
 
-    // Sort by code point.
-    for (int i = 1; i < font->numGlyphs; i++) {
-        int j = i;
-        TigrGlyph g = font->glyphs[i];
-        while (j > 0 && font->glyphs[j - 1].code > g.code) {
-            font->glyphs[j] = font->glyphs[j - 1];
-            j--;
+    sortGlyphs(font);
+    return 1;
+}
+
+/*
+ * Glyph metrics sidecar files start with the magic "TFNT" and a version
+ * number, followed by chunks of a four character id, a byte length and
+ * the chunk data. All numbers are 32-bit little endian.
+ *
+ * "GLYF" - code, x, y, w, h for each glyph, sorted by code point
+ * "ADVN" - bearing, advance for each glyph, in "GLYF" order (optional)
+ * "KERN" - left, right, amount for each kerning pair (optional)
+ *
+ * Unknown chunks are skipped.
+ */
+#define METRICS_VERSION 1
+
+static unsigned getLE32(const unsigned char* v) {
+    return v[0] | (v[1] << 8) | (v[2] << 16) | ((unsigned)v[3] << 24);
+}
+
+static void putLE32(FILE* out, unsigned v) {
+    fputc(v & 0xff, out);
+    fputc((v >> 8) & 0xff, out);
+    fputc((v >> 16) & 0xff, out);
+    fputc((v >> 24) & 0xff, out);
+}
+
+static int loadGlyphMetrics(TigrFont* font, const unsigned char* p, const unsigned char* end) {
+    if (end - p < 8 || memcmp(p, "TFNT", 4) != 0 || getLE32(p + 4) != METRICS_VERSION) {
+        return 0;
+    }
+    p += 8;
+
+    while (end - p >= 8) {
+        unsigned len = getLE32(p + 4);
+        const unsigned char* data = p + 8;
+        if (len > (unsigned)(end - data)) {
+            return 0;
         }
-        font->glyphs[j] = g;
+        const unsigned char* next = data + len;
+
+        if (memcmp(p, "GLYF", 4) == 0 && !font->glyphs) {
+            if (len == 0 || len % 20 != 0) {
+                return 0;
+            }
+            font->numGlyphs = len / 20;
+            font->glyphs = (TigrGlyph*)calloc(font->numGlyphs, sizeof(TigrGlyph));
+            for (int i = 0; i < font->numGlyphs; i++, data += 20) {
+                TigrGlyph* g = &font->glyphs[i];
+                g->code = getLE32(data + 0);
+                g->x = getLE32(data + 4);
+                g->y = getLE32(data + 8);
+                g->w = getLE32(data + 12);
+                g->h = getLE32(data + 16);
+                g->advance = g->w;
+                if (g->x < 0 || g->y < 0 || g->w < 0 || g->h < 0 || g->x > font->bitmap->w ||
+                    g->y > font->bitmap->h || g->w > font->bitmap->w - g->x || g->h > font->bitmap->h - g->y) {
+                    return 0;
+                }
+            }
+        } else if (memcmp(p, "ADVN", 4) == 0) {
+            if (!font->glyphs || len != (unsigned)font->numGlyphs * 8) {
+                return 0;
+            }
+            for (int i = 0; i < font->numGlyphs; i++, data += 8) {
+                font->glyphs[i].bearing = (int)getLE32(data + 0);
+                font->glyphs[i].advance = (int)getLE32(data + 4);
+            }
+        } else if (memcmp(p, "KERN", 4) == 0) {
+            if (len % 12 != 0) {
+                return 0;
+            }
+            int numPairs = len / 12;
+            TigrKerningPair* pairs = (TigrKerningPair*)malloc(numPairs * sizeof(TigrKerningPair));
+            for (int i = 0; i < numPairs; i++, data += 12) {
+                pairs[i].left = getLE32(data + 0);
+                pairs[i].right = getLE32(data + 4);
+                pairs[i].amount = (int)getLE32(data + 8);
+            }
+            tigrSetFontKerning(font, pairs, numPairs);
+            free(pairs);
+        }
+
+        p = next;
     }
 
+    if (!font->glyphs) {
+        return 0;
+    }
+
+    sortGlyphs(font);
     return 1;
 }
 
+TigrFont* tigrLoadFontMetrics(Tigr* bitmap, const void* data, int length) {
+    TigrFont* font = (TigrFont*)calloc(1, sizeof(TigrFont));
+    font->bitmap = bitmap;
+    if (!loadGlyphMetrics(font, (const unsigned char*)data, (const unsigned char*)data + length)) {
+        errno = EINVAL;
+        tigrFreeFont(font);
+        return NULL;
+    }
+    return font;
+}
+
+int tigrSaveFontMetrics(const char* fileName, TigrFont* font) {
+    FILE* out = fopen(fileName, "wb");
+    if (!out)
+        return 0;
+
+    tigrSetupFont(font);
+
+    fwrite("TFNT", 4, 1, out);
+    putLE32(out, METRICS_VERSION);
+
+    fwrite("GLYF", 4, 1, out);
+    putLE32(out, font->numGlyphs * 20);
+    for (int i = 0; i < font->numGlyphs; i++) {
+        TigrGlyph* g = &font->glyphs[i];
+        putLE32(out, g->code);
+        putLE32(out, g->x);
+        putLE32(out, g->y);
+        putLE32(out, g->w);
+        putLE32(out, g->h);
+    }
+
+    int hasAdvances = 0;
+    for (int i = 0; i < font->numGlyphs; i++) {
+        TigrGlyph* g = &font->glyphs[i];
+        hasAdvances |= g->bearing != 0 || g->advance != g->w;
+    }
+
+    if (hasAdvances) {
+        fwrite("ADVN", 4, 1, out);
+        putLE32(out, font->numGlyphs * 8);
+        for (int i = 0; i < font->numGlyphs; i++) {
+            putLE32(out, font->glyphs[i].bearing);
+            putLE32(out, font->glyphs[i].advance);
+        }
+    }
+
+    if (font->kerning) {
+        int numPairs = 0;
+        for (int i = 0; i <= font->kerningMask; i++) {
+            numPairs += font->kerning[i].amount != 0;
+        }
+
+        fwrite("KERN", 4, 1, out);
+        putLE32(out, numPairs * 12);
+        for (int i = 0; i <= font->kerningMask; i++) {
+            TigrKerningPair* k = &font->kerning[i];
+            if (k->amount != 0) {
+                putLE32(out, k->left);
+                putLE32(out, k->right);
+                putLE32(out, k->amount);
+            }
+        }
+    }
+
+    int err = ferror(out);
+    fclose(out);
+    return !err;
+}
+
 TigrFont* tigrLoadFont(Tigr* bitmap, int codepage) {
     TigrFont* font = (TigrFont*)calloc(1, sizeof(TigrFont));
     font->bitmap = bitmap;
@@ -192,10 +371,68 @@ TigrFont* tigrLoadFont(Tigr* bitmap, int codepage) {
 void tigrFreeFont(TigrFont* font) {
     tigrFree(font->bitmap);
     free(font->glyphs);
+    free(font->kerning);
     free(font);
 }
 
-static TigrGlyph* get(TigrFont* font, int code) {
+static unsigned hashPair(int left, int right) {
+    return ((unsigned)left * 0x9e3779b1u) ^ ((unsigned)right * 0x85ebca77u);
+}
+
+void tigrSetFontKerning(TigrFont* font, const TigrKerningPair* pairs, int numPairs) {
+    free(font->kerning);
+    font->kerning = NULL;
+    font->kerningMask = 0;
+
+    // Open addressing, kept at most half full so that probing stays short
+    // and always finds an empty slot.
+    unsigned size = 1;
+    while (size < 2 * (unsigned)numPairs) {
+        size *= 2;
+    }
+
+    TigrKerningPair* table = (TigrKerningPair*)calloc(size, sizeof(TigrKerningPair));
+    int used = 0;
+
+    for (int i = 0; i < numPairs; i++) {
+        const TigrKerningPair* pair = &pairs[i];
+        if (pair->amount == 0) {
+            continue;
+        }
+        for (unsigned h = hashPair(pair->left, pair->right);; h++) {
+            TigrKerningPair* k = &table[h & (size - 1)];
+            if (k->amount == 0) {
+                *k = *pair;
+                used++;
+                break;
+            }
+            if (k->left == pair->left && k->right == pair->right) {
+                k->amount = pair->amount;
+                break;
+            }
+        }
+    }
+
+    if (used == 0) {
+        free(table);
+        return;
+    }
+
+    font->kerning = table;
+    font->kerningMask = size - 1;
+}
+
+// Returns the kerning between two code points. Empty slots have a zero amount.
+static int kerning(TigrFont* font, int left, int right) {
+    for (unsigned h = hashPair(left, right);; h++) {
+        TigrKerningPair* k = &font->kerning[h & font->kerningMask];
+        if (k->amount == 0 || (k->left == left && k->right == right)) {
+            return k->amount;
+        }
+    }
+}
+
+static TigrGlyph* findGlyph(TigrFont* font, int code) {
     unsigned lo = 0, hi = font->numGlyphs;
     while (lo < hi) {
         unsigned guess = (lo + hi) / 2;
@@ -206,16 +443,48 @@ static TigrGlyph* get(TigrFont* font, int code) {
     }
 
     if (lo == 0 || font->glyphs[lo - 1].code != code)
-        return &font->glyphs['?' - 32];
+        return NULL;
     else
         return &font->glyphs[lo - 1];
 }
 
+// Unknown code points are drawn as '?', or the first glyph if the font has none.
+static TigrGlyph* get(TigrFont* font, int code) {
+    TigrGlyph* g = findGlyph(font, code);
+    if (!g) {
+        g = findGlyph(font, '?');
+    }
+    return g ? g : &font->glyphs[0];
+}
+
+static void loadStockFont(void) {
+    tigrStockFont.bitmap = tigrLoadImageMem(tigr_font, tigr_font_size);
+    tigrLoadGlyphs(&tigrStockFont, 1252);
+}
+
+#ifdef _WIN32
+static INIT_ONCE stockFontOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK loadStockFontOnce(PINIT_ONCE once, PVOID param, PVOID* context) {
+    loadStockFont();
+    return TRUE;
+}
+#else
+static pthread_once_t stockFontOnce = PTHREAD_ONCE_INIT;
+#endif
+
+void tigrPreloadFonts(void) {
+#ifdef _WIN32
+    InitOnceExecuteOnce(&stockFontOnce, loadStockFontOnce, NULL, NULL);
+#else
+    pthread_once(&stockFontOnce, loadStockFont);
+#endif
+}
+
 void tigrSetupFont(TigrFont* font) {
     // Load the stock font if needed.
-    if (font == tfont && !tfont->bitmap) {
-        tfont->bitmap = tigrLoadImageMem(tigr_font, tigr_font_size);
-        tigrLoadGlyphs(tfont, 1252);
+    if (font == tfont) {
+        tigrPreloadFonts();
     }
 }
 
@@ -224,9 +493,10 @@ void tigrPrint(Tigr* dest, TigrFont* font, int x, int y, TPixel color, const cha
     TigrGlyph* g;
     va_list args;
     const char* p;
-    int start = x, c;
+    int start = x, c, prev = 0;
 
     tigrSetupFont(font);
+    int rowh = get(font, 0)->h;
 
     // Expand the formatting string.
     va_start(args, text);
@@ -242,26 +512,36 @@ void tigrPrint(Tigr* dest, TigrFont* font, int x, int y, TPixel color, const cha
             continue;
         if (c == '\n') {
             x = start;
-            y += tigrTextHeight(font, "");
+            y += rowh;
+            prev = 0;
             continue;
         }
         g = get(font, c);
-        tigrBlitTint(dest, font->bitmap, x, y, g->x, g->y, g->w, g->h, color);
-        x += g->w;
+        if (font->kerning && prev) {
+            x += kerning(font, prev, c);
+        }
+        tigrBlitTint(dest, font->bitmap, x + g->bearing, y, g->x, g->y, g->w, g->h, color);
+        x += g->advance;
+        prev = c;
     }
 }
 
 int tigrTextWidth(TigrFont* font, const char* text) {
-    int x = 0, w = 0, c;
+    int x = 0, w = 0, c, prev = 0;
     tigrSetupFont(font);
 
     while (*text) {
         text = tigrDecodeUTF8(text, &c);
         if (c == '\n' || c == '\r') {
             x = 0;
+            prev = 0;
         } else {
-            x += get(font, c)->w;
+            if (font->kerning && prev) {
+                x += kerning(font, prev, c);
+            }
+            x += get(font, c)->advance;
             w = (x > w) ? x : w;
+            prev = c;
         }
     }
     return w;
@@ -134,17 +134,20 @@ static long savePngData(Save* s, Tigr* bmp, long dataPos) {
     put(s, 0x08);      // zlib compression method
     put(s, 0x1d);      // zlib compression flags
     putbits(s, 3, 3);  // zlib last block + fixed dictionary
+    int premultiplied = bmp->flags & TIGR_BITMAP_PREMULTIPLIED;
     for (y = 0; y < bmp->h; y++) {
-        TPixel* row = &bmp->pix[y * bmp->w];
+        TPixel* row = &bmp->pix[y * bmp->stride];
         TPixel prev = tigrRGBA(0, 0, 0, 0);
 
         encodeByte(s, 1);  // sub filter
         for (x = 0; x < bmp->w; x++) {
-            encodeByte(s, row[x].r - prev.r);
-            encodeByte(s, row[x].g - prev.g);
-            encodeByte(s, row[x].b - prev.b);
-            encodeByte(s, row[x].a - prev.a);
-            prev = row[x];
+            // PNG stores straight alpha.
+            TPixel p = premultiplied ? tigrUnpremultiplyPixel(row[x]) : row[x];
+            encodeByte(s, p.r - prev.r);
+            encodeByte(s, p.g - prev.g);
+            encodeByte(s, p.b - prev.b);
+            encodeByte(s, p.a - prev.a);
+            prev = p;
         }
     }
     endrun(s);
@@ -0,0 +1,292 @@
+#include "tigr_internal.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Shared frames, for handing rendered frames to other local processes.
+#if !defined(_WIN32) && !defined(__ANDROID__)
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+// Frame buffers start on their own page.
+#define TIGR_SHARED_OFFSET 4096
+
+struct TigrShared {
+    TigrSharedHeader* header;
+    size_t size;
+    int fd;
+    int owner;                 // Non-zero in the creating process
+    int flags;                 // TIGR_SHARED_*, in the creating process
+    int current;               // Buffer being drawn, or held by the consumer
+    unsigned long long frame;  // Last frame published or acquired
+    char name[256];
+};
+
+static TPixel* tigrSharedBuffer(TigrShared* s, int i) {
+    TigrSharedHeader* hdr = s->header;
+    return (TPixel*)((char*)hdr + hdr->offset + (size_t)i * hdr->w * hdr->h * sizeof(TPixel));
+}
+
+static Tigr* tigrSharedBitmap(void* mem, size_t size, int fd, int owner, int flags) {
+    Tigr* bmp = (Tigr*)calloc(1, sizeof(Tigr) + sizeof(TigrShared));
+    TigrShared* s = (TigrShared*)(bmp + 1);
+    TigrSharedHeader* hdr = (TigrSharedHeader*)mem;
+    s->header = hdr;
+    s->size = size;
+    s->fd = fd;
+    s->owner = owner;
+    s->flags = flags;
+    s->current = owner ? 0 : -1;
+    bmp->w = hdr->w;
+    bmp->h = hdr->h;
+    bmp->cw = -1;
+    bmp->ch = -1;
+    bmp->pix = tigrSharedBuffer(s, 0);
+    bmp->stride = hdr->w;
+    bmp->blitMode = TIGR_BLEND_ALPHA;
+    bmp->shared = s;
+    return bmp;
+}
+
+// Creates shared memory that has no name, and so goes away with its last user.
+static int tigrAnonymousShm(void) {
+#ifdef __linux__
+    return (int)syscall(SYS_memfd_create, "tigr", 0);
+#else
+    static int counter;
+    char name[64];
+    for (int tries = 0; tries < 100; tries++) {
+        snprintf(name, sizeof(name), "/tigr-%d-%d", (int)getpid(), counter++);
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            shm_unlink(name);
+            return fd;
+        }
+        if (errno != EEXIST) {
+            break;
+        }
+    }
+    return -1;
+#endif
+}
+
+Tigr* tigrShared(const char* name, int w, int h, int buffers, int flags) {
+    if (w <= 0 || h <= 0 || buffers < 2 || buffers > 3 || (name && strlen(name) >= sizeof(((TigrShared*)0)->name))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    int fd;
+    if (name) {
+        // Replace any leftovers from an earlier run. Consumers still mapping them are not affected.
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    } else {
+        fd = tigrAnonymousShm();
+    }
+    if (fd < 0) {
+        return NULL;
+    }
+
+    size_t size = TIGR_SHARED_OFFSET + (size_t)buffers * w * h * sizeof(TPixel);
+    void* mem = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mem == MAP_FAILED) {
+        int error = errno;
+        close(fd);
+        if (name) {
+            shm_unlink(name);
+        }
+        errno = error;
+        return NULL;
+    }
+
+    TigrSharedHeader* hdr = (TigrSharedHeader*)mem;
+    hdr->w = w;
+    hdr->h = h;
+    hdr->buffers = buffers;
+    hdr->offset = TIGR_SHARED_OFFSET;
+    hdr->latest = -1;
+    hdr->reading = -1;
+    // Consumers check the magic before trusting the rest.
+    __atomic_store_n(&hdr->magic, TIGR_SHARED_MAGIC, __ATOMIC_RELEASE);
+
+    Tigr* bmp = tigrSharedBitmap(mem, size, fd, 1, flags);
+    if (name) {
+        strcpy(bmp->shared->name, name);
+    }
+    return bmp;
+}
+
+int tigrSharedPublish(Tigr* bmp) {
+    TigrShared* s = bmp->shared;
+    if (!s || !s->owner) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    TigrSharedHeader* hdr = s->header;
+    int published = s->current;
+    hdr->frame[published] = ++s->frame;
+    __atomic_store_n(&hdr->latest, published, __ATOMIC_SEQ_CST);
+
+    // Continue in a buffer the consumer can't be holding. The consumer re-checks `latest` after
+    // claiming a buffer, so a claim we don't see here is for a frame it will retry.
+    int next = -1;
+    unsigned long long deadline = tigrTimeNs() + TIGR_SHARED_TIMEOUT * 1000000ull;
+    for (;;) {
+        int reading = __atomic_load_n(&hdr->reading, __ATOMIC_SEQ_CST);
+        for (int i = 0; i < hdr->buffers && next < 0; i++) {
+            if (i != published && i != reading) {
+                next = i;
+            }
+        }
+        if (next >= 0) {
+            break;
+        }
+        // Double buffered, and the consumer holds the other buffer.
+        // It may have died holding it, so don't wait forever.
+        if (tigrTimeNs() > deadline) {
+            errno = ETIMEDOUT;
+            return 0;
+        }
+        sched_yield();
+    }
+
+    TPixel* pix = tigrSharedBuffer(s, next);
+    if (s->flags & TIGR_SHARED_KEEP) {
+        memcpy(pix, bmp->pix, (size_t)bmp->w * bmp->h * sizeof(TPixel));
+    }
+    bmp->pix = pix;
+    s->current = next;
+    return 1;
+}
+
+Tigr* tigrSharedOpen(const char* name, int fd) {
+    if (name) {
+        fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0) {
+            return NULL;
+        }
+    }
+
+    struct stat st;
+    void* mem = MAP_FAILED;
+    if (fstat(fd, &st) == 0) {
+        if (st.st_size >= TIGR_SHARED_OFFSET) {
+            mem = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        } else {
+            errno = EINVAL;
+        }
+    }
+    if (name) {
+        int error = errno;
+        close(fd);
+        errno = error;
+    }
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+
+    TigrSharedHeader* hdr = (TigrSharedHeader*)mem;
+    size_t size = (size_t)st.st_size;
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != TIGR_SHARED_MAGIC || hdr->w <= 0 || hdr->h <= 0 ||
+        hdr->buffers < 2 || hdr->buffers > 3 || hdr->offset < (int)sizeof(TigrSharedHeader) ||
+        hdr->offset + (size_t)hdr->buffers * hdr->w * hdr->h * sizeof(TPixel) > size) {
+        munmap(mem, size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return tigrSharedBitmap(mem, size, -1, 0, 0);
+}
+
+int tigrSharedAcquire(Tigr* bmp) {
+    TigrShared* s = bmp->shared;
+    if (!s || s->owner) {
+        return 0;
+    }
+
+    // Claim the newest frame, and make sure it still was the newest once claimed.
+    TigrSharedHeader* hdr = s->header;
+    int latest;
+    for (;;) {
+        latest = __atomic_load_n(&hdr->latest, __ATOMIC_SEQ_CST);
+        if (latest < 0 || latest >= hdr->buffers) {
+            return 0;
+        }
+        __atomic_store_n(&hdr->reading, latest, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&hdr->latest, __ATOMIC_SEQ_CST) == latest) {
+            break;
+        }
+    }
+
+    s->current = latest;
+    bmp->pix = tigrSharedBuffer(s, latest);
+    if (hdr->frame[latest] == s->frame) {
+        return 0;
+    }
+    s->frame = hdr->frame[latest];
+    if (bmp->opacity) {
+        memset(bmp->opacity, 0, bmp->h);
+    }
+    return 1;
+}
+
+int tigrSharedFd(Tigr* bmp) {
+    return bmp->shared ? bmp->shared->fd : -1;
+}
+
+void tigrSharedFree(Tigr* bmp) {
+    TigrShared* s = bmp->shared;
+    if (!s->owner && s->current >= 0) {
+        __atomic_store_n(&s->header->reading, -1, __ATOMIC_SEQ_CST);
+    }
+    munmap(s->header, s->size);
+    if (s->fd >= 0) {
+        close(s->fd);
+    }
+    if (s->name[0]) {
+        shm_unlink(s->name);
+    }
+}
+
+#else
+
+Tigr* tigrShared(const char* name, int w, int h, int buffers, int flags) {
+    errno = ENOSYS;
+    return NULL;
+}
+
+int tigrSharedPublish(Tigr* bmp) {
+    errno = ENOSYS;
+    return 0;
+}
+
+Tigr* tigrSharedOpen(const char* name, int fd) {
+    errno = ENOSYS;
+    return NULL;
+}
+
+int tigrSharedAcquire(Tigr* bmp) {
+    return 0;
+}
+
+int tigrSharedFd(Tigr* bmp) {
+    return -1;
+}
+
+void tigrSharedFree(Tigr* bmp) {
+}
+
+#endif
@@ -9,6 +9,7 @@ const char tigr_upscale_gl_fs[] = {
     "in vec2 uv;"
     "out vec4 color;"
     "uniform sampler2D image;"
+    "uniform sampler2D source;"
     "uniform vec4 parameters;"
     "void fxShader(out vec4 color, in vec2 coord);"
     "void main()"
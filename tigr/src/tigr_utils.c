@@ -1,6 +1,12 @@
 #include "tigr_internal.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sched.h>
+#include <time.h>
+#endif
 
 #ifndef __ANDROID__
 
@@ -108,7 +114,139 @@ char* tigrEncodeUTF8(char* text, int cp) {
 #undef EMIT
 }
 
+unsigned long long tigrTimeNs(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    unsigned long long seconds = now.QuadPart / freq.QuadPart;
+    unsigned long long rest = now.QuadPart % freq.QuadPart;
+    return seconds * 1000000000ull + rest * 1000000000ull / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+float tigrTimerDelta(TigrTimer* timer) {
+    unsigned long long now = tigrTimeNs();
+    float elapsed = timer->last ? (now - timer->last) / 1e9f : 0.0f;
+    timer->last = now;
+    return elapsed;
+}
+
+#ifdef _WIN32
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Sleep rounds up to the 15.6 ms system tick, which at 60 Hz loses whole frames.
+// High resolution waitable timers don't, but need Windows 10 1803 or later.
+// Without them, only whole ticks are slept and the rest is spun.
+static void tigrLimiterSleep(TigrLimiter* limiter, unsigned long long ns) {
+    static int noHighResolutionTimers;
+    if (!limiter->timer && !noHighResolutionTimers) {
+        limiter->timer =
+            CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        noHighResolutionTimers = limiter->timer == NULL;
+    }
+    if (limiter->timer) {
+        LARGE_INTEGER due;
+        due.QuadPart = -(LONGLONG)(ns / 100);
+        if (SetWaitableTimer(limiter->timer, &due, 0, NULL, NULL, FALSE)) {
+            WaitForSingleObject(limiter->timer, INFINITE);
+            return;
+        }
+    }
+    const unsigned long long tick = 16000000;
+    if (ns > tick) {
+        Sleep((DWORD)((ns - tick) / 1000000));
+    }
+}
+#endif
+
+void tigrLimitFrame(TigrLimiter* limiter) {
+    if (!limiter->interval) {
+        return;
+    }
+
+    unsigned long long now = tigrTimeNs();
+    if (now + limiter->interval < limiter->next || now > limiter->next + limiter->interval) {
+        // First frame, or far off schedule after a stall. Start over rather than catching up.
+        limiter->next = now + limiter->interval;
+        return;
+    }
+
+    // Sleep most of the way, since sleeps can overshoot by a scheduler tick,
+    // then yield until the deadline.
+    const unsigned long long margin = 2000000;
+    if (limiter->next > now + margin) {
+        unsigned long long sleep = limiter->next - now - margin;
+#ifdef _WIN32
+        tigrLimiterSleep(limiter, sleep);
+#else
+        struct timespec ts = { (time_t)(sleep / 1000000000ull), (long)(sleep % 1000000000ull) };
+        nanosleep(&ts, NULL);
+#endif
+    }
+    while (tigrTimeNs() < limiter->next) {
+#ifdef _WIN32
+        Sleep(0);
+#else
+        sched_yield();
+#endif
+    }
+    limiter->next += limiter->interval;
+}
+
+static TigrLimiter waitLimiter;
+
+static void setLimiterRate(TigrLimiter* limiter, float fps) {
+    limiter->interval = fps > 0 ? (unsigned long long)(1e9 / fps) : 0;
+    limiter->next = 0;
+}
+
+void tigrSetFrameRate(Tigr* bmp, float fps) {
+    if (!bmp) {
+        setLimiterRate(&waitLimiter, fps);
+    }
 #ifndef TIGR_HEADLESS
+    else if (bmp->handle) {
+        setLimiterRate(&tigrInternal(bmp)->limiter, fps);
+    }
+#endif
+}
+
+void tigrWaitFrame(void) {
+    tigrLimitFrame(&waitLimiter);
+}
+
+#ifdef TIGR_HEADLESS
+
+void tigrError(Tigr* bmp, const char* message, ...) {
+    char tmp[1024];
+
+    va_list args;
+    va_start(args, message);
+    vsnprintf(tmp, sizeof(tmp), message, args);
+    tmp[sizeof(tmp) - 1] = 0;
+    va_end(args);
+
+    fprintf(stderr, "tigr fatal error: %s\n", tmp);
+
+    exit(1);
+}
+
+float tigrTime(void) {
+    static TigrTimer timer;
+    return tigrTimerDelta(&timer);
+}
+
+#else
 
 int tigrBeginOpenGL(Tigr* bmp) {
 #ifdef TIGR_GAPI_GL
@@ -125,11 +263,171 @@ void tigrSetPostShader(Tigr* bmp, const char* code, int size) {
     tigrGAPIBegin(bmp);
     TigrInternal* win = tigrInternal(bmp);
     GLStuff* gl = &win->gl;
-    tigrCreateShaderProgram(gl, code, size);
+    tigrSelectShaderProgram(gl, code, size);
+    tigrGAPIEnd(bmp);
+#endif
+}
+
+int tigrAddPostPass(Tigr* bmp, const char* code, int size, float scale) {
+#ifdef TIGR_GAPI_GL
+    tigrGAPIBegin(bmp);
+    TigrInternal* win = tigrInternal(bmp);
+    int pass = tigrAddShaderPass(&win->gl, code, size, scale);
     tigrGAPIEnd(bmp);
+    return pass;
+#else
+    return -1;
+#endif
+}
+
+void tigrEnablePostPass(Tigr* bmp, int pass, int enable) {
+#ifdef TIGR_GAPI_GL
+    GLStuff* gl = &tigrInternal(bmp)->gl;
+    if (pass >= 0 && pass < gl->pass_count) {
+        gl->passes[pass].enabled = enable;
+    }
 #endif
 }
 
+void tigrSetPostPassUniforms(Tigr* bmp, int pass, const void* data, int size) {
+#ifdef TIGR_GAPI_GL
+    GLStuff* gl = &tigrInternal(bmp)->gl;
+    if (pass < 0 || pass >= gl->pass_count) {
+        return;
+    }
+    // Uploaded on the next present, so this can be called every frame.
+    TigrPostPass* p = &gl->passes[pass];
+    if (p->uniforms_size != size) {
+        void* uniforms = realloc(p->uniforms, size);
+        if (!uniforms) {
+            return;
+        }
+        p->uniforms = uniforms;
+        p->uniforms_size = size;
+    }
+    memcpy(p->uniforms, data, size);
+    p->uniforms_dirty = 1;
+#endif
+}
+
+void tigrPushEvent(TigrInternal* win, const TigrEvent* event) {
+    TigrEventQueue* q = &win->events;
+
+    if (q->head - TIGR_LOAD_ACQUIRE(&q->tail) < TIGR_EVENT_QUEUE) {
+        q->events[q->head % TIGR_EVENT_QUEUE] = *event;
+        TIGR_STORE_RELEASE(&q->head, q->head + 1);
+    }
+
+    if (event->type == TIGR_EVENT_CHAR && q->charHead - TIGR_LOAD_ACQUIRE(&q->charTail) < TIGR_CHAR_QUEUE) {
+        q->chars[q->charHead % TIGR_CHAR_QUEUE] = event->key;
+        TIGR_STORE_RELEASE(&q->charHead, q->charHead + 1);
+    }
+}
+
+void tigrNextEvents(TigrInternal* win) {
+    TigrEventQueue* q = &win->events;
+    TIGR_STORE_RELEASE(&q->tail, q->frame);
+    TIGR_STORE_RELEASE(&q->charTail, q->charFrame);
+    q->frame = TIGR_LOAD_ACQUIRE(&q->head);
+    q->charFrame = TIGR_LOAD_ACQUIRE(&q->charHead);
+}
+
+int tigrPopChar(TigrInternal* win) {
+    TigrEventQueue* q = &win->events;
+    if (q->charTail == q->charFrame) {
+        return 0;
+    }
+    int c = q->chars[q->charTail % TIGR_CHAR_QUEUE];
+    TIGR_STORE_RELEASE(&q->charTail, q->charTail + 1);
+    return c;
+}
+
+int tigrPollEvent(Tigr* bmp, TigrEvent* event) {
+    if (!bmp->handle) {
+        return 0;
+    }
+    TigrEventQueue* q = &tigrInternal(bmp)->events;
+    if (q->tail == q->frame) {
+        return 0;
+    }
+    *event = q->events[q->tail % TIGR_EVENT_QUEUE];
+    TIGR_STORE_RELEASE(&q->tail, q->tail + 1);
+    return 1;
+}
+
+static int frameBucket(float ms) {
+    return ms < TIGR_STATS_BUCKETS * 2 ? (int)ms / 2 : TIGR_STATS_BUCKETS - 1;
+}
+
+void tigrFrameBegin(TigrInternal* win) {
+    TigrFrameTimer* timer = &win->timer;
+    TigrFrameStats* stats = &timer->stats;
+    unsigned long long now = tigrTimeNs();
+
+    if (timer->frameStart) {
+        float frame = (now - timer->frameStart) / 1e6f;
+
+        // The histogram covers the most recent frames, drop the one falling out.
+        if (timer->recentCount == TIGR_STATS_WINDOW) {
+            stats->histogram[frameBucket(timer->recent[timer->recentPos])]--;
+        }
+        stats->histogram[frameBucket(frame)]++;
+        timer->recent[timer->recentPos] = frame;
+        timer->recentPos = (timer->recentPos + 1) % TIGR_STATS_WINDOW;
+
+        stats->frame = frame;
+        float average = timer->recentCount ? stats->averageFrame : frame;
+        stats->averageFrame = average + (frame - average) / 16;
+        if (timer->recentCount < TIGR_STATS_WINDOW) {
+            timer->recentCount++;
+        }
+    }
+
+    timer->frameStart = timer->mark = now;
+    memset(stats->stage, 0, sizeof(stats->stage));
+    stats->wait = 0;
+}
+
+void tigrFrameStage(TigrInternal* win, int stage) {
+    TigrFrameTimer* timer = &win->timer;
+    unsigned long long now = tigrTimeNs();
+    timer->stats.stage[stage] += (now - timer->mark) / 1e6f;
+    timer->mark = now;
+}
+
+void tigrFrameEnd(TigrInternal* win, int stage) {
+    TigrFrameStats* stats = &win->timer.stats;
+    tigrFrameStage(win, stage);
+    for (int i = 0; i < TIGR_STAGES; i++) {
+        float average = stats->frames ? stats->average[i] : stats->stage[i];
+        stats->average[i] = average + (stats->stage[i] - average) / 16;
+    }
+    stats->frames++;
+}
+
+void tigrFrameWait(TigrInternal* win) {
+    TigrFrameTimer* timer = &win->timer;
+    tigrLimitFrame(&win->limiter);
+    unsigned long long now = tigrTimeNs();
+    timer->stats.wait = (now - timer->mark) / 1e6f;
+    timer->mark = now;
+}
+
+void tigrGetFrameStats(Tigr* bmp, TigrFrameStats* stats) {
+    if (!bmp->handle) {
+        memset(stats, 0, sizeof(TigrFrameStats));
+        return;
+    }
+    TigrFrameTimer* timer = &tigrInternal(bmp)->timer;
+    *stats = timer->stats;
+    stats->worstFrame = 0;
+    for (int i = 0; i < timer->recentCount; i++) {
+        if (timer->recent[i] > stats->worstFrame) {
+            stats->worstFrame = timer->recent[i];
+        }
+    }
+}
+
 void tigrSetPostFX(Tigr* bmp, float p1, float p2, float p3, float p4) {
     TigrInternal* win = tigrInternal(bmp);
     win->p1 = p1;
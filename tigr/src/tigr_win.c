@@ -170,6 +170,7 @@ void tigrUpdate(Tigr* bmp) {
     RECT rc;
     int dw, dh;
     TigrInternal* win = tigrInternal(bmp);
+    tigrFrameBegin(win);
 
     if (!win->shown) {
         win->shown = 1;
@@ -186,8 +187,12 @@ void tigrUpdate(Tigr* bmp) {
     tigrWinUpdateWidgets(bmp, dw, dh);
 
     if (!tigrGAPIBegin(bmp)) {
+        tigrFrameStage(win, TIGR_STAGE_INPUT);
         tigrGAPIPresent(bmp, dw, dh);
+        tigrFrameStage(win, TIGR_STAGE_DRAW);
         SwapBuffers(win->gl.dc);
+        tigrFrameStage(win, TIGR_STAGE_SWAP);
+        tigrFrameWait(win);
         tigrGAPIEnd(bmp);
     }
 
@@ -203,11 +208,22 @@ void tigrUpdate(Tigr* bmp) {
         TranslateMessage(&msg);
         DispatchMessage(&msg);
     }
+    tigrFrameEnd(win, TIGR_STAGE_INPUT);
 }
 
 typedef BOOL(APIENTRY* PFNWGLSWAPINTERVALFARPROC_)(int);
 static PFNWGLSWAPINTERVALFARPROC_ wglSwapIntervalEXT_ = 0;
 
+int tigrSetSwapInterval(Tigr* bmp, int interval) {
+    int ok = 0;
+    if (wglSwapIntervalEXT_ && !tigrGAPIBegin(bmp)) {
+        // Negative intervals need WGL_EXT_swap_control_tear, the driver refuses them otherwise.
+        ok = wglSwapIntervalEXT_(interval) != 0;
+        tigrGAPIEnd(bmp);
+    }
+    return ok;
+}
+
 int tigrGAPIBegin(Tigr* bmp) {
     TigrInternal* win = tigrInternal(bmp);
 
@@ -536,10 +552,15 @@ void tigrFree(Tigr* bmp) {
         win->gl.dc = NULL;
 
         DestroyWindow((HWND)bmp->handle);
+        if (win->limiter.timer) {
+            CloseHandle(win->limiter.timer);
+        }
         free(win->wtitle);
         tigrFree(win->widgets);
     }
-    free(bmp->pix);
+    free(bmp->dirty);
+    free(bmp->opacity);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -20,8 +20,67 @@
 Tigr* tigrBitmap2(int w, int h, int extra);
 
 // Resizes an existing bitmap.
+// Shared bitmaps are left unchanged, with errno set to EPERM.
 void tigrResize(Tigr* bmp, int w, int h);
 
+// Vector instructions used by the drawing routines, when the target has them.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TIGR_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define TIGR_NEON
+#include <arm_neon.h>
+#endif
+
+// Fills larger than this are written around the cache, unless the last level cache size is known.
+#ifndef TIGR_STREAM_THRESHOLD
+#define TIGR_STREAM_THRESHOLD (8 << 20)
+#endif
+
+// Fills are only split between threads from this size on.
+#ifndef TIGR_THREADED_FILL_MIN
+#define TIGR_THREADED_FILL_MIN (4 << 20)
+#endif
+
+#define TIGR_MAX_FILL_THREADS 16
+
+// Pixel buffers are aligned to this many bytes.
+#define TIGR_PIXEL_ALIGN 64
+
+// Largest pixel buffer kept for reuse after being freed.
+#ifndef TIGR_POOL_MAX_BUFFER
+#define TIGR_POOL_MAX_BUFFER (16 << 20)
+#endif
+
+// Pixel buffers at least this large are mapped directly from the OS.
+#ifndef TIGR_MMAP_THRESHOLD
+#define TIGR_MMAP_THRESHOLD (1 << 20)
+#endif
+
+// Total size of the pixel buffers kept for reuse.
+#ifndef TIGR_POOL_SIZE
+#define TIGR_POOL_SIZE (64 << 20)
+#endif
+
+// Longest tigrSharedPublish waits for a consumer to let go of a buffer, in milliseconds.
+#ifndef TIGR_SHARED_TIMEOUT
+#define TIGR_SHARED_TIMEOUT 1000
+#endif
+
+// Multiplies a 0-255 color channel by a 0-255 alpha, rounding like C * A / 255.
+#define TIGR_MUL255(C, A) ((((C) * (A) + 128) + (((C) * (A) + 128) >> 8)) >> 8)
+
+// Converts a straight alpha pixel to premultiplied alpha, and back.
+TPixel tigrPremultiplyPixel(TPixel p);
+TPixel tigrUnpremultiplyPixel(TPixel p);
+
+// Releases the pixels of a bitmap.
+void tigrFreePixels(Tigr* bmp);
+
+// Shared memory frames, see tigrShared.
+typedef struct TigrShared TigrShared;
+void tigrSharedFree(Tigr* bmp);
+
 // Calculates the biggest scale that a bitmap can fit into an area at.
 int tigrCalcScale(int bmpW, int bmpH, int areaW, int areaH);
 
@@ -31,6 +90,9 @@ int tigrEnforceScale(int scale, int flags);
 // Calculates the correct position for a bitmap to fit into a window.
 void tigrPosition(Tigr* bmp, int scale, int windowW, int windowH, int out[4]);
 
+// Loads the stock font if needed.
+void tigrSetupFont(TigrFont* font);
+
 // ----------------------------------------------------------
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -73,6 +135,40 @@ void tigrPosition(Tigr* bmp, int scale, int windowW, int windowH, int out[4]);
 #include <OpenGLES/ES3/gl.h>
 #endif
 
+// Number of pixel buffers used for streaming texture uploads.
+#define TIGR_PBO_COUNT 3
+
+// Number of post shader programs kept linked per window.
+#define TIGR_PROGRAM_CACHE_SIZE 16
+
+// Maximum number of post passes per window.
+#define TIGR_MAX_POST_PASSES 8
+
+typedef struct {
+    unsigned long long hash;
+    char* source;  // effect source, to tell hash collisions apart
+    int size;
+    GLuint program;
+    GLuint vs, fs;  // kept until linking has finished, for error reporting
+    GLuint uniform_projection;
+    GLuint uniform_model;
+    GLuint uniform_parameters;
+    int ready;
+    unsigned used;
+} TigrProgram;
+
+typedef struct {
+    TigrProgram* program;
+    float scale;
+    int enabled;
+    GLuint fbo, tex;
+    int w, h;
+    GLuint ubo;
+    void* uniforms;
+    int uniforms_size;
+    int uniforms_dirty;
+} TigrPostPass;
+
 typedef struct {
 #ifdef _WIN32
     HGLRC hglrc;
@@ -82,11 +178,22 @@ typedef struct {
     void* glContext;
 #endif
     GLuint tex[2];
+    int tex_w[2], tex_h[2];
+    GLuint pbo[TIGR_PBO_COUNT];
+    int pbo_size[TIGR_PBO_COUNT];
+    int pbo_index;
     GLuint vao;
     GLuint program;
     GLuint uniform_projection;
     GLuint uniform_model;
     GLuint uniform_parameters;
+    TigrProgram programs[TIGR_PROGRAM_CACHE_SIZE];
+    TigrProgram* pending;
+    unsigned program_uses;
+    int program_binary;
+    int parallel_compile;
+    TigrPostPass passes[TIGR_MAX_POST_PASSES];
+    int pass_count;
     int gl_legacy;
     int gl_user_opengl_rendering;
 } GLStuff;
@@ -94,6 +201,67 @@ typedef struct {
 
 #define MAX_TOUCH_POINTS 10
 
+// Number of input events and typed characters kept per frame.
+// Both must be powers of two.
+#define TIGR_EVENT_QUEUE 256
+#define TIGR_CHAR_QUEUE 64
+
+// Ordered access to queue positions shared between threads.
+#ifdef _WIN32
+#define TIGR_LOAD_ACQUIRE(P) ((unsigned)InterlockedCompareExchange((volatile LONG*)(P), 0, 0))
+#define TIGR_STORE_RELEASE(P, V) InterlockedExchange((volatile LONG*)(P), (LONG)(V))
+#else
+#define TIGR_LOAD_ACQUIRE(P) __atomic_load_n((P), __ATOMIC_ACQUIRE)
+#define TIGR_STORE_RELEASE(P, V) __atomic_store_n((P), (V), __ATOMIC_RELEASE)
+#endif
+
+// Spin lock for short critical sections, on a `volatile long` starting out as 0.
+#ifdef _WIN32
+#define TIGR_LOCK(L)                    \
+    while (InterlockedExchange(&(L), 1)) \
+    Sleep(0)
+#define TIGR_UNLOCK(L) InterlockedExchange(&(L), 0)
+#else
+#define TIGR_LOCK(L)                                         \
+    while (__atomic_exchange_n(&(L), 1, __ATOMIC_ACQUIRE)) \
+    sched_yield()
+#define TIGR_UNLOCK(L) __atomic_store_n(&(L), 0, __ATOMIC_RELEASE)
+#endif
+
+// Takes a spin lock if it is free, evaluating to non-zero if it was taken.
+#ifdef _WIN32
+#define TIGR_TRYLOCK(L) (InterlockedExchange(&(L), 1) == 0)
+#else
+#define TIGR_TRYLOCK(L) (__atomic_exchange_n(&(L), 1, __ATOMIC_ACQUIRE) == 0)
+#endif
+
+// Input events, with the characters typed also queued for tigrReadChar.
+// Only the producer moves a head and only the consumer moves a tail,
+// so a backend may fill the queues from an input thread without locking.
+// The frame marks, also owned by the consumer, are where the heads were at
+// the last tigrUpdate: only events before them are read, and only those
+// are dropped when left unread, so events queued during a frame carry over.
+typedef struct {
+    TigrEvent events[TIGR_EVENT_QUEUE];
+    unsigned head, tail, frame;
+    int chars[TIGR_CHAR_QUEUE];
+    unsigned charHead, charTail, charFrame;
+} TigrEventQueue;
+
+typedef struct {
+    unsigned long long frameStart, mark;
+    float recent[TIGR_STATS_WINDOW];
+    int recentPos, recentCount;
+    TigrFrameStats stats;
+} TigrFrameTimer;
+
+typedef struct {
+    unsigned long long interval, next;
+#ifdef _WIN32
+    HANDLE timer;
+#endif
+} TigrLimiter;
+
 typedef struct {
     int shown, closed;
 #ifdef TIGR_GAPI_GL
@@ -122,11 +290,15 @@ typedef struct {
 
     float p1, p2, p3, p4;
 
+    TigrFrameTimer timer;
+    TigrLimiter limiter;
+
     int flags;
     int scale;
     int pos[4];
     int lastChar;
     char keys[256], prev[256];
+    TigrEventQueue events;
 #if defined(__ANDROID__)
     char released[256];
 #endif  // __ANDROID__
@@ -153,6 +325,29 @@ typedef struct {
 
 TigrInternal* tigrInternal(Tigr* bmp);
 
+// Frame timing, see tigrGetFrameStats.
+// Time since the last mark is charged to the given stage.
+void tigrFrameBegin(TigrInternal* win);
+void tigrFrameStage(TigrInternal* win, int stage);
+void tigrFrameEnd(TigrInternal* win, int stage);
+
+// Sleeps for the frame rate cap, timing it apart from the stages.
+void tigrFrameWait(TigrInternal* win);
+
+// Queues an input event for tigrPollEvent, dropping it if the queue is full.
+// Character events are also queued for tigrReadChar.
+void tigrPushEvent(TigrInternal* win, const TigrEvent* event);
+
+// Drops events and characters left unread from the last frame, and makes
+// those queued since readable. Called once per tigrUpdate, after input is read.
+void tigrNextEvents(TigrInternal* win);
+
+// Returns the next queued character, or 0 if none.
+int tigrPopChar(TigrInternal* win);
+
+// Sleeps until the next frame is due, if the limiter has a frame rate.
+void tigrLimitFrame(TigrLimiter* limiter);
+
 void tigrGAPICreate(Tigr* bmp);
 void tigrGAPIDestroy(Tigr* bmp);
 int tigrGAPIBegin(Tigr* bmp);
@@ -221,6 +416,7 @@ const char tigr_upscale_gl_fs[] = {
     "in vec2 uv;"
     "out vec4 color;"
     "uniform sampler2D image;"
+    "uniform sampler2D source;"
     "uniform vec4 parameters;"
     "void fxShader(out vec4 color, in vec2 coord);"
     "void main()"
@@ -255,8 +451,17 @@ const int tigr_default_fx_gl_fs_size = (int)sizeof(tigr_default_fx_gl_fs) - 1;
 //////// Start of inlined file: tigr_bitmaps.c ////////
 
 //#include "tigr_internal.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 // Expands 0-255 into 0-256
 #define EXPAND(X) ((X) + ((X) > 0))
@@ -283,47 +488,388 @@ const int tigr_default_fx_gl_fs_size = (int)sizeof(tigr_default_fx_gl_fs) - 1;
     if (w <= 0 || h <= 0)       \
     return
 
-Tigr* tigrBitmap2(int w, int h, int extra) {
+// Records a changed region, if tracking.
+#define MARK(BMP, X, Y, W, H)         \
+    if (BMP->dirty || BMP->opacity)   \
+    tigrDirty(BMP, X, Y, W, H)
+
+// Row opacity, see tigrTrackOpacity.
+enum {
+    TIGR_ROW_UNKNOWN = 0,
+    TIGR_ROW_MIXED,
+    TIGR_ROW_OPAQUE,
+    TIGR_ROW_TRANSPARENT,
+};
+
+// Pixel buffers start with a block header, and are recycled through free lists per size class.
+typedef struct {
+    void* base;       // Start of the allocation
+    size_t capacity;  // Usable bytes from the pixels on
+    size_t mapped;    // Size of the mapping, or 0 if allocated from the heap
+} TigrBlock;
+
+#define TIGR_POOL_CLASSES 256
+#define TIGR_POOL_DEPTH 4
+
+static struct {
+    volatile long lock;
+    size_t bytes;
+    int count[TIGR_POOL_CLASSES];
+    TPixel* free[TIGR_POOL_CLASSES][TIGR_POOL_DEPTH];
+} pixelPool;
+
+static int rowAlignment = sizeof(TPixel);
+
+static TigrBlock* tigrBlock(TPixel* pix) {
+    return (TigrBlock*)pix - 1;
+}
+
+// Rounds a size up to its size class, with four classes per power of two.
+static int tigrSizeClass(size_t* size) {
+    size_t s = *size < 256 ? 256 : *size;
+    int e = 7;
+    while (((size_t)2 << e) < s)
+        e++;
+    size_t step = (size_t)1 << (e - 2);
+    s = (s + step - 1) / step * step;
+    *size = s;
+    return (e - 7) * 4 + (int)(s / step) - 5;
+}
+
+// Maps fresh pages, which the OS zeroes on first touch. Pages never touched cost nothing.
+static void* tigrMapPages(size_t size) {
+#ifdef _WIN32
+    return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+#endif
+}
+
+static void tigrUnmapPages(void* mem, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(mem, 0, MEM_RELEASE);
+#else
+    munmap(mem, size);
+#endif
+}
+
+// Allocates aligned pixel storage of at least `size` bytes, zeroed unless `uninit` is set.
+static TPixel* tigrAllocPixels(size_t size, int uninit) {
+    size_t capacity = size;
+    int c = tigrSizeClass(&capacity);
+    TPixel* pix = NULL;
+
+    if (capacity <= TIGR_POOL_MAX_BUFFER) {
+        TIGR_LOCK(pixelPool.lock);
+        if (pixelPool.count[c] > 0) {
+            pix = pixelPool.free[c][--pixelPool.count[c]];
+            pixelPool.bytes -= capacity;
+        }
+        TIGR_UNLOCK(pixelPool.lock);
+    }
+
+    if (pix) {
+        if (!uninit) {
+            memset(pix, 0, size);
+        }
+        return pix;
+    }
+
+    // Pages are aligned, so the header fits in front of the pixels.
+    if (capacity >= TIGR_MMAP_THRESHOLD) {
+        size_t mapped = capacity + TIGR_PIXEL_ALIGN;
+        void* base = tigrMapPages(mapped);
+        if (base) {
+            pix = (TPixel*)((char*)base + TIGR_PIXEL_ALIGN);
+            tigrBlock(pix)->base = base;
+            tigrBlock(pix)->capacity = capacity;
+            tigrBlock(pix)->mapped = mapped;
+            return pix;
+        }
+    }
+
+    size_t total = capacity + sizeof(TigrBlock) + TIGR_PIXEL_ALIGN - 1;
+    void* base = uninit ? malloc(total) : calloc(1, total);
+    if (!base) {
+        return NULL;
+    }
+    uintptr_t start = (uintptr_t)base + sizeof(TigrBlock);
+    pix = (TPixel*)((start + TIGR_PIXEL_ALIGN - 1) & ~(uintptr_t)(TIGR_PIXEL_ALIGN - 1));
+    tigrBlock(pix)->base = base;
+    tigrBlock(pix)->capacity = capacity;
+    tigrBlock(pix)->mapped = 0;
+    return pix;
+}
+
+// Returns pixel storage to the pool, or frees it if the pool is full.
+static void tigrReleasePixels(TPixel* pix) {
+    if (!pix) {
+        return;
+    }
+
+    TigrBlock* block = tigrBlock(pix);
+    size_t capacity = block->capacity;
+    if (capacity <= TIGR_POOL_MAX_BUFFER) {
+        int c = tigrSizeClass(&capacity);
+        TIGR_LOCK(pixelPool.lock);
+        if (pixelPool.count[c] < TIGR_POOL_DEPTH && pixelPool.bytes + capacity <= TIGR_POOL_SIZE) {
+            pixelPool.free[c][pixelPool.count[c]++] = pix;
+            pixelPool.bytes += capacity;
+            pix = NULL;
+        }
+        TIGR_UNLOCK(pixelPool.lock);
+    }
+
+    if (pix && block->mapped) {
+        tigrUnmapPages(block->base, block->mapped);
+    } else if (pix) {
+        free(block->base);
+    }
+}
+
+// Row length in pixels for a bitmap width, padded to the row alignment.
+static int tigrStride(int w) {
+    int align = rowAlignment / sizeof(TPixel);
+    return (w + align - 1) / align * align;
+}
+
+void tigrSetRowAlignment(int bytes) {
+    if (bytes < (int)sizeof(TPixel)) {
+        bytes = sizeof(TPixel);
+    }
+    rowAlignment = bytes / sizeof(TPixel) * sizeof(TPixel);
+}
+
+static Tigr* tigrNewBitmap(int w, int h, int extra, int uninit) {
     Tigr* tigr = (Tigr*)calloc(1, sizeof(Tigr) + extra);
     tigr->w = w;
     tigr->h = h;
     tigr->cw = -1;
     tigr->ch = -1;
-    tigr->pix = (TPixel*)calloc(w * h, sizeof(TPixel));
+    tigr->stride = tigrStride(w);
+    tigr->pix = tigrAllocPixels((size_t)tigr->stride * h * sizeof(TPixel), uninit);
     tigr->blitMode = TIGR_BLEND_ALPHA;
     return tigr;
 }
 
+Tigr* tigrBitmap2(int w, int h, int extra) {
+    return tigrNewBitmap(w, h, extra, 0);
+}
+
 Tigr* tigrBitmap(int w, int h) {
-    return tigrBitmap2(w, h, 0);
+    return tigrNewBitmap(w, h, 0, 0);
+}
+
+Tigr* tigrBitmapUninit(int w, int h) {
+    return tigrNewBitmap(w, h, 0, 1);
+}
+
+Tigr* tigrBitmapFromMemory(TPixel* pix, int w, int h, int stride) {
+    if (!pix || w < 0 || h < 0 || stride < w) {
+        errno = EINVAL;
+        return NULL;
+    }
+    Tigr* tigr = (Tigr*)calloc(1, sizeof(Tigr));
+    tigr->w = w;
+    tigr->h = h;
+    tigr->cw = -1;
+    tigr->ch = -1;
+    tigr->pix = pix;
+    tigr->stride = stride;
+    tigr->flags = TIGR_BITMAP_EXTERNAL;
+    tigr->blitMode = TIGR_BLEND_ALPHA;
+    return tigr;
+}
+
+void tigrFreePixels(Tigr* bmp) {
+    if (bmp->shared) {
+        tigrSharedFree(bmp);
+        bmp->shared = NULL;
+    } else if (!(bmp->flags & TIGR_BITMAP_EXTERNAL)) {
+        tigrReleasePixels(bmp->pix);
+    }
+    bmp->pix = NULL;
 }
 
 #ifdef TIGR_HEADLESS
 void tigrFree(Tigr* bmp) {
-    free(bmp->pix);
+    free(bmp->dirty);
+    free(bmp->opacity);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 #endif // TIGR_HEADLESS
 
+void tigrTrackDirty(Tigr* bmp, int enable) {
+    if (!enable) {
+        free(bmp->dirty);
+        bmp->dirty = NULL;
+    } else if (!bmp->dirty) {
+        bmp->dirty = (TigrDirty*)calloc(1, sizeof(TigrDirty));
+        bmp->dirty->full = 1;
+    }
+}
+
+void tigrTrackOpacity(Tigr* bmp, int enable) {
+    if (!enable) {
+        free(bmp->opacity);
+        bmp->opacity = NULL;
+    } else if (!bmp->opacity && bmp->h > 0) {
+        bmp->opacity = (unsigned char*)calloc(bmp->h, 1);
+    }
+}
+
+// Checks a row of a bitmap with opacity tracking, unless known already.
+static int tigrRowOpacity(Tigr* bmp, int y) {
+    if (bmp->opacity[y] == TIGR_ROW_UNKNOWN) {
+        TPixel* row = &bmp->pix[y * bmp->stride];
+        int premultiplied = (bmp->flags & TIGR_BITMAP_PREMULTIPLIED) != 0;
+        int opaque = 1;
+        int transparent = 1;
+        for (int x = 0; x < bmp->w && (opaque || transparent); x++) {
+            opaque &= row[x].a == 255;
+            // Premultiplied pixels with color but no alpha still add light.
+            transparent &= premultiplied ? (row[x].r | row[x].g | row[x].b | row[x].a) == 0 : row[x].a == 0;
+        }
+        bmp->opacity[y] = opaque ? TIGR_ROW_OPAQUE : transparent ? TIGR_ROW_TRANSPARENT : TIGR_ROW_MIXED;
+    }
+    return bmp->opacity[y];
+}
+
+void tigrDirty(Tigr* bmp, int x, int y, int w, int h) {
+    TigrDirty* d = bmp->dirty;
+    if ((!d || d->full) && !bmp->opacity) {
+        return;
+    }
+
+    int x1 = x + w;
+    int y1 = y + h;
+    if (x < 0)
+        x = 0;
+    if (y < 0)
+        y = 0;
+    if (x1 > bmp->w)
+        x1 = bmp->w;
+    if (y1 > bmp->h)
+        y1 = bmp->h;
+    if (x >= x1 || y >= y1)
+        return;
+
+    if (bmp->opacity) {
+        memset(bmp->opacity + y, TIGR_ROW_UNKNOWN, y1 - y);
+    }
+    if (!d || d->full) {
+        return;
+    }
+
+    // Grow a rect that overlaps or touches the new one.
+    int* r = 0;
+    for (int i = 0; i < d->count && !r; i++) {
+        int* c = d->rects[i];
+        if (x <= c[2] && x1 >= c[0] && y <= c[3] && y1 >= c[1]) {
+            r = c;
+        }
+    }
+
+    if (!r && d->count < TIGR_MAX_DIRTY) {
+        r = d->rects[d->count++];
+        r[0] = x;
+        r[1] = y;
+        r[2] = x1;
+        r[3] = y1;
+        return;
+    }
+
+    // Out of rects, grow the one that grows the least.
+    if (!r) {
+        long best = 0;
+        for (int i = 0; i < d->count; i++) {
+            int* c = d->rects[i];
+            long area = (long)(c[2] - c[0]) * (c[3] - c[1]);
+            long grown = (long)((x1 > c[2] ? x1 : c[2]) - (x < c[0] ? x : c[0])) *
+                         ((y1 > c[3] ? y1 : c[3]) - (y < c[1] ? y : c[1]));
+            if (!r || grown - area < best) {
+                best = grown - area;
+                r = c;
+            }
+        }
+    }
+
+    if (x < r[0])
+        r[0] = x;
+    if (y < r[1])
+        r[1] = y;
+    if (x1 > r[2])
+        r[2] = x1;
+    if (y1 > r[3])
+        r[3] = y1;
+}
+
 
 void tigrResize(Tigr* bmp, int w, int h) {
     if (bmp->w == w && bmp->h == h) {
         return;
     }
+    if (bmp->shared) {
+        // The frames are laid out for the other process, so a shared bitmap keeps its size.
+        errno = EPERM;
+        return;
+    }
 
-    int y, cw, ch;
-    TPixel* newpix = (TPixel*)calloc(w * h, sizeof(TPixel));
-    cw = (w < bmp->w) ? w : bmp->w;
-    ch = (h < bmp->h) ? h : bmp->h;
+    int y;
+    int stride = tigrStride(w);
+    size_t size = (size_t)stride * h * sizeof(TPixel);
+    int cw = (w < bmp->w) ? w : bmp->w;
+    int ch = (h < bmp->h) ? h : bmp->h;
+    int owned = !(bmp->flags & TIGR_BITMAP_EXTERNAL);
+    size_t capacity = owned ? tigrBlock(bmp->pix)->capacity : 0;
+
+    if (size <= capacity && size >= capacity / 4) {
+        // Fits the current storage. Move rows in an order that never overwrites a row yet to be moved.
+        TPixel* pix = bmp->pix;
+        if (stride > bmp->stride) {
+            for (y = ch - 1; y >= 0; y--)
+                memmove(pix + y * stride, pix + y * bmp->stride, cw * sizeof(TPixel));
+        } else if (stride < bmp->stride) {
+            for (y = 0; y < ch; y++)
+                memmove(pix + y * stride, pix + y * bmp->stride, cw * sizeof(TPixel));
+        }
+    } else {
+        // Leave room to grow, since resizes tend to come in series while a window is dragged.
+        // Everything gets written below, so the new storage is left uninitialized.
+        TPixel* newpix = tigrAllocPixels(size > capacity ? size + size / 4 : size, 1);
+
+        // Copy any old data across.
+        for (y = 0; y < ch; y++)
+            memcpy(newpix + y * stride, bmp->pix + y * bmp->stride, cw * sizeof(TPixel));
+
+        tigrFreePixels(bmp);
+        bmp->pix = newpix;
+        bmp->flags &= ~TIGR_BITMAP_EXTERNAL;
+    }
 
-    // Copy any old data across.
-    for (y = 0; y < ch; y++)
-        memcpy(newpix + y * w, bmp->pix + y * bmp->w, cw * sizeof(TPixel));
+    // Clear whatever the old contents don't cover.
+    if (w > cw) {
+        for (y = 0; y < ch; y++)
+            memset(bmp->pix + y * stride + cw, 0, (w - cw) * sizeof(TPixel));
+    }
+    if (h > ch) {
+        memset(bmp->pix + ch * stride, 0, (size_t)(h - ch) * stride * sizeof(TPixel));
+    }
 
-    free(bmp->pix);
-    bmp->pix = newpix;
+    bmp->stride = stride;
     bmp->w = w;
     bmp->h = h;
+
+    if (bmp->dirty) {
+        bmp->dirty->full = 1;
+    }
+    if (bmp->opacity) {
+        free(bmp->opacity);
+        bmp->opacity = h > 0 ? (unsigned char*)calloc(h, 1) : NULL;
+    }
 }
 
 int tigrCalcScale(int bmpW, int bmpH, int areaW, int areaH) {
@@ -362,88 +908,360 @@ void tigrPosition(Tigr* bmp, int scale, int windowW, int windowH, int out[4]) {
     out[3] = out[1] + bmp->h * scale;
 }
 
-void tigrClear(Tigr* bmp, TPixel color) {
-    int count = bmp->w * bmp->h;
-    int n;
-    for (n = 0; n < count; n++)
-        bmp->pix[n] = color;
-}
-
-void tigrFill(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
-    TPixel* td;
-    int dt, i;
-
-    if (x < 0) {
-        w += x;
-        x = 0;
+// Fills a run of pixels with a color.
+// Streaming stores bypass the cache, for targets too large to stay in it anyway.
+static void tigrFillPixels(TPixel* pix, int count, TPixel color, int stream) {
+    uint32_t c;
+    memcpy(&c, &color, sizeof(c));
+    uint32_t* d = (uint32_t*)pix;
+
+#if defined(TIGR_SSE2)
+    while (count > 0 && ((uintptr_t)d & 15)) {
+        *d++ = c;
+        count--;
+    }
+    __m128i v = _mm_set1_epi32((int)c);
+    if (stream) {
+        for (; count >= 16; count -= 16, d += 16) {
+            _mm_stream_si128((__m128i*)d, v);
+            _mm_stream_si128((__m128i*)(d + 4), v);
+            _mm_stream_si128((__m128i*)(d + 8), v);
+            _mm_stream_si128((__m128i*)(d + 12), v);
+        }
+    } else {
+        for (; count >= 16; count -= 16, d += 16) {
+            _mm_store_si128((__m128i*)d, v);
+            _mm_store_si128((__m128i*)(d + 4), v);
+            _mm_store_si128((__m128i*)(d + 8), v);
+            _mm_store_si128((__m128i*)(d + 12), v);
+        }
     }
-    if (y < 0) {
-        h += y;
-        y = 0;
+    for (; count >= 4; count -= 4, d += 4) {
+        _mm_store_si128((__m128i*)d, v);
     }
-    if (x + w > bmp->w) {
-        w = bmp->w - x;
+#elif defined(TIGR_NEON)
+    (void)stream;
+    uint32x4_t v = vdupq_n_u32(c);
+    for (; count >= 16; count -= 16, d += 16) {
+        vst1q_u32(d, v);
+        vst1q_u32(d + 4, v);
+        vst1q_u32(d + 8, v);
+        vst1q_u32(d + 12, v);
     }
-    if (y + h > bmp->h) {
-        h = bmp->h - y;
+    for (; count >= 4; count -= 4, d += 4) {
+        vst1q_u32(d, v);
     }
-    if (w <= 0 || h <= 0)
-        return;
+#else
+    (void)stream;
+#endif
 
-    td = &bmp->pix[y * bmp->w + x];
-    dt = bmp->w;
-    do {
-        for (i = 0; i < w; i++)
-            td[i] = color;
-        td += dt;
-    } while (--h);
+    while (count-- > 0) {
+        *d++ = c;
+    }
 }
 
-void tigrLine(Tigr* bmp, int x0, int y0, int x1, int y1, TPixel color) {
-    int sx, sy, dx, dy, err, e2;
-    dx = abs(x1 - x0);
-    dy = abs(y1 - y0);
-    if (x0 < x1)
-        sx = 1;
-    else
-        sx = -1;
-    if (y0 < y1)
-        sy = 1;
-    else
-        sy = -1;
-    err = dx - dy;
-
-    do {
-        tigrPlot(bmp, x0, y0, color);
-        e2 = 2 * err;
-        if (e2 > -dy) {
-            err -= dy;
-            x0 += sx;
-        }
-        if (e2 < dx) {
-            err += dx;
-            y0 += sy;
+// A band of rows to fill, possibly on another thread.
+typedef struct {
+    TPixel* pix;
+    int stride, w, h;
+    TPixel color;
+    int stream;
+} TigrFillJob;
+
+static void tigrFillRows(TigrFillJob* job) {
+    if (job->stride == job->w) {
+        tigrFillPixels(job->pix, job->w * job->h, job->color, job->stream);
+    } else {
+        for (int y = 0; y < job->h; y++) {
+            tigrFillPixels(job->pix + y * job->stride, job->w, job->color, job->stream);
         }
-    } while (x0 != x1 || y0 != y1);
+    }
+#ifdef TIGR_SSE2
+    if (job->stream) {
+        // Streaming stores are weakly ordered, make them visible before returning.
+        _mm_sfence();
+    }
+#endif
 }
 
-void tigrFillRect(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
-    x += 1;
-    y += 1;
-    w -= 2;
-    h -= 2;
+// Threads helping with large fills. They are started once by tigrSetFillThreads,
+// and then wait to be handed a band of rows for each fill.
+static struct {
+    int workers;             // Threads running, besides the one filling
+    TigrFillJob* jobs;       // Bands of the current fill, the first one for the filling thread
+    int count;               // Number of bands in the current fill
+    unsigned fill;           // Counts fills handed out, so workers can tell a new one
+    int pending;             // Bands still being filled by workers
+    int quit;
+#ifdef _WIN32
+    HANDLE threads[TIGR_MAX_FILL_THREADS];
+#else
+    pthread_t threads[TIGR_MAX_FILL_THREADS];
+#endif
+} fillPool;
 
-    int cx = bmp->cx;
-    int cy = bmp->cy;
-    int cw = bmp->cw >= 0 ? bmp->cw : bmp->w;
-    int ch = bmp->ch >= 0 ? bmp->ch : bmp->h;
+// Guards fillPool, with `wake` signalled for new fills and `done` once the workers are done.
+#ifdef _WIN32
+static SRWLOCK fillLock = SRWLOCK_INIT;
+static CONDITION_VARIABLE fillWake = CONDITION_VARIABLE_INIT, fillDone = CONDITION_VARIABLE_INIT;
+#define POOL_LOCK() AcquireSRWLockExclusive(&fillLock)
+#define POOL_UNLOCK() ReleaseSRWLockExclusive(&fillLock)
+#define POOL_WAIT(C) SleepConditionVariableSRW(&C, &fillLock, INFINITE, 0)
+#define POOL_SIGNAL(C) WakeAllConditionVariable(&C)
+#else
+static pthread_mutex_t fillLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fillWake = PTHREAD_COND_INITIALIZER, fillDone = PTHREAD_COND_INITIALIZER;
+#define POOL_LOCK() pthread_mutex_lock(&fillLock)
+#define POOL_UNLOCK() pthread_mutex_unlock(&fillLock)
+#define POOL_WAIT(C) pthread_cond_wait(&C, &fillLock)
+#define POOL_SIGNAL(C) pthread_cond_broadcast(&C)
+#endif
 
-    if (x < cx) {
-        w += (x - cx);
-        x = cx;
-    }
-    if (y < cy) {
-        h += (y - cy);
+// Taken by the thread handing out a fill, or changing the number of threads.
+static volatile long fillPoolBusy;
+
+static void tigrFillWorker(int band) {
+    unsigned seen = 0;
+    POOL_LOCK();
+    for (;;) {
+        while (fillPool.fill == seen && !fillPool.quit) {
+            POOL_WAIT(fillWake);
+        }
+        if (fillPool.quit) {
+            break;
+        }
+        seen = fillPool.fill;
+        if (band < fillPool.count) {
+            POOL_UNLOCK();
+            tigrFillRows(&fillPool.jobs[band]);
+            POOL_LOCK();
+            if (--fillPool.pending == 0) {
+                POOL_SIGNAL(fillDone);
+            }
+        }
+    }
+    POOL_UNLOCK();
+}
+
+#ifdef _WIN32
+static DWORD WINAPI tigrFillThread(LPVOID band) {
+    tigrFillWorker((int)(intptr_t)band);
+    return 0;
+}
+#else
+static void* tigrFillThread(void* band) {
+    tigrFillWorker((int)(intptr_t)band);
+    return NULL;
+}
+#endif
+
+static void tigrStopFillThreads(void) {
+    POOL_LOCK();
+    fillPool.quit = 1;
+    POOL_SIGNAL(fillWake);
+    POOL_UNLOCK();
+    for (int i = 1; i <= fillPool.workers; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(fillPool.threads[i], INFINITE);
+        CloseHandle(fillPool.threads[i]);
+#else
+        pthread_join(fillPool.threads[i], NULL);
+#endif
+    }
+    fillPool.workers = 0;
+    fillPool.quit = 0;
+}
+
+// Starts threads for bands 1 to count - 1, stopping at the first that fails to start.
+static void tigrStartFillThreads(int count) {
+    fillPool.fill = 0;
+    for (int i = 1; i < count; i++) {
+#ifdef _WIN32
+        fillPool.threads[i] = CreateThread(NULL, 0, tigrFillThread, (LPVOID)(intptr_t)i, 0, NULL);
+        if (!fillPool.threads[i]) {
+            break;
+        }
+#else
+        if (pthread_create(&fillPool.threads[i], NULL, tigrFillThread, (void*)(intptr_t)i) != 0) {
+            break;
+        }
+#endif
+        fillPool.workers = i;
+    }
+}
+
+void tigrSetFillThreads(int count) {
+    count = count < 1 ? 1 : (count > TIGR_MAX_FILL_THREADS ? TIGR_MAX_FILL_THREADS : count);
+    TIGR_LOCK(fillPoolBusy);
+    if (count != fillPool.workers + 1) {
+        tigrStopFillThreads();
+        tigrStartFillThreads(count);
+    }
+    TIGR_UNLOCK(fillPoolBusy);
+}
+
+// Size of the last level cache, or a guess.
+static size_t tigrCacheSize(void) {
+    static size_t size;
+    if (!size) {
+        size_t found = TIGR_STREAM_THRESHOLD;
+#if defined(__linux__) && defined(_SC_LEVEL3_CACHE_SIZE)
+        long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        if (l3 > 0) {
+            found = (size_t)l3;
+        }
+#endif
+        size = found;
+    }
+    return size;
+}
+
+// Fills an area without clipping. Large areas bypass the cache, and are split between threads if enabled.
+static void tigrFillArea(TPixel* pix, int stride, int w, int h, TPixel color) {
+    size_t bytes = (size_t)w * h * sizeof(TPixel);
+    TigrFillJob jobs[TIGR_MAX_FILL_THREADS];
+    jobs[0].pix = pix;
+    jobs[0].stride = stride;
+    jobs[0].w = w;
+    jobs[0].h = h;
+    jobs[0].color = color;
+    jobs[0].stream = bytes >= tigrCacheSize();
+
+    // The threads work on one fill at a time. Others, such as from other threads, fill on their own.
+    if (bytes < TIGR_THREADED_FILL_MIN || !TIGR_TRYLOCK(fillPoolBusy)) {
+        tigrFillRows(&jobs[0]);
+        return;
+    }
+
+    int count = fillPool.workers + 1;
+    if (count > h) {
+        count = h;
+    }
+    if (count <= 1) {
+        tigrFillRows(&jobs[0]);
+        TIGR_UNLOCK(fillPoolBusy);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        int y0 = h * i / count;
+        int y1 = h * (i + 1) / count;
+        jobs[i] = jobs[0];
+        jobs[i].pix = pix + y0 * stride;
+        jobs[i].h = y1 - y0;
+    }
+
+    POOL_LOCK();
+    fillPool.jobs = jobs;
+    fillPool.count = count;
+    fillPool.pending = count - 1;
+    fillPool.fill++;
+    POOL_SIGNAL(fillWake);
+    POOL_UNLOCK();
+
+    tigrFillRows(&jobs[0]);
+
+    POOL_LOCK();
+    while (fillPool.pending > 0) {
+        POOL_WAIT(fillDone);
+    }
+    POOL_UNLOCK();
+    TIGR_UNLOCK(fillPoolBusy);
+}
+
+void tigrClear(Tigr* bmp, TPixel color) {
+    if (bmp->flags & TIGR_BITMAP_PREMULTIPLIED) {
+        color = tigrPremultiplyPixel(color);
+    }
+    if (bmp->h > 0) {
+        tigrFillArea(bmp->pix, bmp->stride, bmp->w, bmp->h, color);
+    }
+
+    if (bmp->dirty) {
+        bmp->dirty->full = 1;
+    }
+    if (bmp->opacity) {
+        memset(bmp->opacity, color.a == 255 ? TIGR_ROW_OPAQUE : TIGR_ROW_UNKNOWN, bmp->h);
+    }
+}
+
+void tigrFill(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
+    if (x < 0) {
+        w += x;
+        x = 0;
+    }
+    if (y < 0) {
+        h += y;
+        y = 0;
+    }
+    if (x + w > bmp->w) {
+        w = bmp->w - x;
+    }
+    if (y + h > bmp->h) {
+        h = bmp->h - y;
+    }
+    if (w <= 0 || h <= 0)
+        return;
+
+    MARK(bmp, x, y, w, h);
+
+    if (bmp->flags & TIGR_BITMAP_PREMULTIPLIED) {
+        color = tigrPremultiplyPixel(color);
+    }
+    tigrFillArea(&bmp->pix[y * bmp->stride + x], bmp->stride, w, h, color);
+}
+
+static void plotPixel(Tigr* bmp, int x, int y, TPixel pix);
+
+static void drawLine(Tigr* bmp, int x0, int y0, int x1, int y1, TPixel color) {
+    int sx, sy, dx, dy, err, e2;
+    dx = abs(x1 - x0);
+    dy = abs(y1 - y0);
+    if (x0 < x1)
+        sx = 1;
+    else
+        sx = -1;
+    if (y0 < y1)
+        sy = 1;
+    else
+        sy = -1;
+    err = dx - dy;
+
+    do {
+        plotPixel(bmp, x0, y0, color);
+        e2 = 2 * err;
+        if (e2 > -dy) {
+            err -= dy;
+            x0 += sx;
+        }
+        if (e2 < dx) {
+            err += dx;
+            y0 += sy;
+        }
+    } while (x0 != x1 || y0 != y1);
+}
+
+void tigrLine(Tigr* bmp, int x0, int y0, int x1, int y1, TPixel color) {
+    MARK(bmp, x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, abs(x1 - x0) + 1, abs(y1 - y0) + 1);
+    drawLine(bmp, x0, y0, x1, y1, color);
+}
+
+void tigrFillRect(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
+    x += 1;
+    y += 1;
+    w -= 2;
+    h -= 2;
+
+    int cx = bmp->cx;
+    int cy = bmp->cy;
+    int cw = bmp->cw >= 0 ? bmp->cw : bmp->w;
+    int ch = bmp->ch >= 0 ? bmp->ch : bmp->h;
+
+    if (x < cx) {
+        w += (x - cx);
+        x = cx;
+    }
+    if (y < cy) {
+        h += (y - cy);
         y = cy;
     }
     if (x + w > cx + cw) {
@@ -455,11 +1273,30 @@ void tigrFillRect(Tigr* bmp, int x, int y, int w, int h, TPixel color) {
     if (w <= 0 || h <= 0)
         return;
 
-    TPixel* td = &bmp->pix[y * bmp->w + x];
-    int dt = bmp->w;
+    MARK(bmp, x, y, w, h);
+
+    TPixel* td = &bmp->pix[y * bmp->stride + x];
+    int dt = bmp->stride;
     int xa = EXPAND(color.a);
     int a = xa * xa;
 
+    if (bmp->flags & TIGR_BITMAP_PREMULTIPLIED) {
+        // Same as a premultiplied blit of the color, tinted with its alpha.
+        TPixel p = tigrPremultiplyPixel(color);
+        unsigned pr = p.r * xa >> 8, pg = p.g * xa >> 8, pb = p.b * xa >> 8, pa = p.a * xa >> 8;
+        unsigned inv = 65536 - a;
+        do {
+            for (int i = 0; i < w; i++) {
+                td[i].r = (unsigned char)(pr + (td[i].r * inv >> 16));
+                td[i].g = (unsigned char)(pg + (td[i].g * inv >> 16));
+                td[i].b = (unsigned char)(pb + (td[i].b * inv >> 16));
+                td[i].a += (bmp->blitMode) * (unsigned char)(pa + (td[i].a * inv >> 16) - td[i].a);
+            }
+            td += dt;
+        } while (--h);
+        return;
+    }
+
     do {
         for (int i = 0; i < w; i++) {
             td[i].r += (unsigned char)((color.r - td[i].r) * a >> 16);
@@ -502,7 +1339,9 @@ void tigrFillCircle(Tigr* bmp, int x0, int y0, int r, TPixel color) {
     int x = 0;
     int y = r;
 
-    tigrLine(bmp, x0 - r + 1, y0, x0 + r, y0, color);
+    MARK(bmp, x0 - r, y0 - r, 2 * r + 1, 2 * r + 1);
+
+    drawLine(bmp, x0 - r + 1, y0, x0 + r, y0, color);
 
     while (x < y - 1) {
         x++;
@@ -511,16 +1350,16 @@ void tigrFillCircle(Tigr* bmp, int x0, int y0, int r, TPixel color) {
             y--;
             dy += 2;
             E += dy;
-            tigrLine(bmp, x0 - x + 1, y0 + y, x0 + x, y0 + y, color);
-            tigrLine(bmp, x0 - x + 1, y0 - y, x0 + x, y0 - y, color);
+            drawLine(bmp, x0 - x + 1, y0 + y, x0 + x, y0 + y, color);
+            drawLine(bmp, x0 - x + 1, y0 - y, x0 + x, y0 - y, color);
         }
 
         dx += 2;
         E += dx + 1;
 
         if (x != y) {
-            tigrLine(bmp, x0 - y + 1, y0 + x, x0 + y, y0 + x, color);
-            tigrLine(bmp, x0 - y + 1, y0 - x, x0 + y, y0 - x, color);
+            drawLine(bmp, x0 - y + 1, y0 + x, x0 + y, y0 + x, color);
+            drawLine(bmp, x0 - y + 1, y0 - x, x0 + y, y0 - x, color);
         }
     }
 }
@@ -532,10 +1371,12 @@ void tigrCircle(Tigr* bmp, int x0, int y0, int r, TPixel color) {
     int x = 0;
     int y = r;
 
-    tigrPlot(bmp, x0, y0 + r, color);
-    tigrPlot(bmp, x0, y0 - r, color);
-    tigrPlot(bmp, x0 + r, y0, color);
-    tigrPlot(bmp, x0 - r, y0, color);
+    MARK(bmp, x0 - r, y0 - r, 2 * r + 1, 2 * r + 1);
+
+    plotPixel(bmp, x0, y0 + r, color);
+    plotPixel(bmp, x0, y0 - r, color);
+    plotPixel(bmp, x0 + r, y0, color);
+    plotPixel(bmp, x0 - r, y0, color);
 
     while (x < y - 1) {
         x++;
@@ -549,16 +1390,16 @@ void tigrCircle(Tigr* bmp, int x0, int y0, int r, TPixel color) {
         dx += 2;
         E += dx + 1;
 
-        tigrPlot(bmp, x0 + x, y0 + y, color);
-        tigrPlot(bmp, x0 - x, y0 + y, color);
-        tigrPlot(bmp, x0 + x, y0 - y, color);
-        tigrPlot(bmp, x0 - x, y0 - y, color);
+        plotPixel(bmp, x0 + x, y0 + y, color);
+        plotPixel(bmp, x0 - x, y0 + y, color);
+        plotPixel(bmp, x0 + x, y0 - y, color);
+        plotPixel(bmp, x0 - x, y0 - y, color);
 
         if (x != y) {
-            tigrPlot(bmp, x0 + y, y0 + x, color);
-            tigrPlot(bmp, x0 - y, y0 + x, color);
-            tigrPlot(bmp, x0 + y, y0 - x, color);
-            tigrPlot(bmp, x0 - y, y0 - x, color);
+            plotPixel(bmp, x0 + y, y0 + x, color);
+            plotPixel(bmp, x0 - y, y0 + x, color);
+            plotPixel(bmp, x0 + y, y0 - x, color);
+            plotPixel(bmp, x0 - y, y0 - x, color);
         }
     }
 }
@@ -566,11 +1407,11 @@ void tigrCircle(Tigr* bmp, int x0, int y0, int r, TPixel color) {
 TPixel tigrGet(Tigr* bmp, int x, int y) {
     TPixel empty = { 0, 0, 0, 0 };
     if (x >= 0 && y >= 0 && x < bmp->w && y < bmp->h)
-        return bmp->pix[y * bmp->w + x];
+        return bmp->pix[y * bmp->stride + x];
     return empty;
 }
 
-void tigrPlot(Tigr* bmp, int x, int y, TPixel pix) {
+static void plotPixel(Tigr* bmp, int x, int y, TPixel pix) {
     int xa, i, a;
 
     int cx = bmp->cx;
@@ -578,87 +1419,1405 @@ void tigrPlot(Tigr* bmp, int x, int y, TPixel pix) {
     int cw = bmp->cw >= 0 ? bmp->cw : bmp->w;
     int ch = bmp->ch >= 0 ? bmp->ch : bmp->h;
 
-    if (x >= cx && y >= cy && x < cx + cw && y < cy + ch) {
-        xa = EXPAND(pix.a);
-        a = xa * xa;
-        i = y * bmp->w + x;
+    if (x >= cx && y >= cy && x < cx + cw && y < cy + ch) {
+        xa = EXPAND(pix.a);
+        a = xa * xa;
+        i = y * bmp->stride + x;
+
+        if (bmp->flags & TIGR_BITMAP_PREMULTIPLIED) {
+            // Same as tigrFillRect.
+            TPixel p = tigrPremultiplyPixel(pix);
+            unsigned inv = 65536 - a;
+            bmp->pix[i].r = (unsigned char)((p.r * xa >> 8) + (bmp->pix[i].r * inv >> 16));
+            bmp->pix[i].g = (unsigned char)((p.g * xa >> 8) + (bmp->pix[i].g * inv >> 16));
+            bmp->pix[i].b = (unsigned char)((p.b * xa >> 8) + (bmp->pix[i].b * inv >> 16));
+            bmp->pix[i].a +=
+                (bmp->blitMode) * (unsigned char)((p.a * xa >> 8) + (bmp->pix[i].a * inv >> 16) - bmp->pix[i].a);
+            return;
+        }
+
+        bmp->pix[i].r += (unsigned char)((pix.r - bmp->pix[i].r) * a >> 16);
+        bmp->pix[i].g += (unsigned char)((pix.g - bmp->pix[i].g) * a >> 16);
+        bmp->pix[i].b += (unsigned char)((pix.b - bmp->pix[i].b) * a >> 16);
+        bmp->pix[i].a += (bmp->blitMode) * (unsigned char)((pix.a - bmp->pix[i].a) * a >> 16);
+    }
+}
+
+void tigrPlot(Tigr* bmp, int x, int y, TPixel pix) {
+    MARK(bmp, x, y, 1, 1);
+    plotPixel(bmp, x, y, pix);
+}
+
+void tigrClip(Tigr* bmp, int cx, int cy, int cw, int ch) {
+    bmp->cx = cx;
+    bmp->cy = cy;
+    bmp->cw = cw;
+    bmp->ch = ch;
+}
+
+void tigrBlit(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h) {
+    int cw = dst->cw >= 0 ? dst->cw : dst->w;
+    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+
+    CLIP();
+    MARK(dst, dx, dy, w, h);
+
+    TPixel* ts = &src->pix[sy * src->stride + sx];
+    TPixel* td = &dst->pix[dy * dst->stride + dx];
+    int st = src->stride;
+    int dt = dst->stride;
+    do {
+        memcpy(td, ts, w * sizeof(TPixel));
+        ts += st;
+        td += dt;
+    } while (--h);
+}
+
+// Blends a premultiplied source, which takes one multiply per channel when the tint is plain white.
+static void tigrBlitPremultiplied(TPixel* td, int dt, TPixel* ts, int st, int w, int h, TPixel tint, int blitMode) {
+    if (tint.r == 255 && tint.g == 255 && tint.b == 255 && tint.a == 255) {
+        do {
+            for (int x = 0; x < w; x++) {
+                unsigned inv = 65536 - (EXPAND(ts[x].a) << 8);
+                td[x].r = (unsigned char)(ts[x].r + (td[x].r * inv >> 16));
+                td[x].g = (unsigned char)(ts[x].g + (td[x].g * inv >> 16));
+                td[x].b = (unsigned char)(ts[x].b + (td[x].b * inv >> 16));
+                td[x].a += blitMode * (unsigned char)(ts[x].a + (td[x].a * inv >> 16) - td[x].a);
+            }
+            ts += st;
+            td += dt;
+        } while (--h);
+        return;
+    }
+
+    int xa = EXPAND(tint.a);
+    unsigned tr = EXPAND(tint.r) * xa;
+    unsigned tg = EXPAND(tint.g) * xa;
+    unsigned tb = EXPAND(tint.b) * xa;
+    unsigned ta = xa << 8;
+    do {
+        for (int x = 0; x < w; x++) {
+            unsigned inv = 65536 - EXPAND(ts[x].a) * xa;
+            td[x].r = (unsigned char)((ts[x].r * tr >> 16) + (td[x].r * inv >> 16));
+            td[x].g = (unsigned char)((ts[x].g * tg >> 16) + (td[x].g * inv >> 16));
+            td[x].b = (unsigned char)((ts[x].b * tb >> 16) + (td[x].b * inv >> 16));
+            td[x].a += blitMode * (unsigned char)((ts[x].a * ta >> 16) + (td[x].a * inv >> 16) - td[x].a);
+        }
+        ts += st;
+        td += dt;
+    } while (--h);
+}
+
+// Blends a straight alpha source.
+static void tigrBlitStraight(TPixel* td, int dt, TPixel* ts, int st, int w, int h, TPixel tint, int blitMode) {
+    int xr = EXPAND(tint.r);
+    int xg = EXPAND(tint.g);
+    int xb = EXPAND(tint.b);
+    int xa = EXPAND(tint.a);
+
+    do {
+        for (int x = 0; x < w; x++) {
+            unsigned r = (xr * ts[x].r) >> 8;
+            unsigned g = (xg * ts[x].g) >> 8;
+            unsigned b = (xb * ts[x].b) >> 8;
+            unsigned a = xa * EXPAND(ts[x].a);
+            td[x].r += (unsigned char)((r - td[x].r) * a >> 16);
+            td[x].g += (unsigned char)((g - td[x].g) * a >> 16);
+            td[x].b += (unsigned char)((b - td[x].b) * a >> 16);
+            td[x].a += blitMode * (unsigned char)((ts[x].a - td[x].a) * a >> 16);
+        }
+        ts += st;
+        td += dt;
+    } while (--h);
+}
+
+// Blends a straight alpha source onto a premultiplied destination, premultiplying it on the way.
+static void tigrBlitToPremultiplied(TPixel* td, int dt, TPixel* ts, int st, int w, int h, TPixel tint, int blitMode) {
+    TPixel buffer[256];
+    do {
+        for (int x = 0; x < w; x += 256) {
+            int n = w - x < 256 ? w - x : 256;
+            for (int i = 0; i < n; i++) {
+                buffer[i] = tigrPremultiplyPixel(ts[x + i]);
+            }
+            tigrBlitPremultiplied(td + x, 0, buffer, 0, n, 1, tint, blitMode);
+        }
+        ts += st;
+        td += dt;
+    } while (--h);
+}
+
+typedef void (*TigrBlitFunc)(TPixel* td, int dt, TPixel* ts, int st, int w, int h, TPixel tint, int blitMode);
+
+// Picks the blend for a source with the given flags.
+static TigrBlitFunc tigrBlitFor(Tigr* dst, int flags) {
+    if (flags & TIGR_BITMAP_PREMULTIPLIED) {
+        return tigrBlitPremultiplied;
+    }
+    return (dst->flags & TIGR_BITMAP_PREMULTIPLIED) ? tigrBlitToPremultiplied : tigrBlitStraight;
+}
+
+void tigrBlitTint(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint) {
+    int cw = dst->cw >= 0 ? dst->cw : dst->w;
+    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+
+    CLIP();
+    MARK(dst, dx, dy, w, h);
+
+    TigrBlitFunc blend = tigrBlitFor(dst, src->flags);
+    if (!src->opacity) {
+        blend(&dst->pix[dy * dst->stride + dx], dst->stride, &src->pix[sy * src->stride + sx], src->stride, w, h,
+              tint, dst->blitMode);
+        return;
+    }
+
+    // Take rows of the same opacity together. Opaque pixels can be copied as they are,
+    // unless they are tinted or keep the destination alpha.
+    int copy = tint.r == 255 && tint.g == 255 && tint.b == 255 && tint.a == 255 && dst->blitMode;
+    while (h > 0) {
+        int opacity = tigrRowOpacity(src, sy);
+        int n = 1;
+        while (n < h && tigrRowOpacity(src, sy + n) == opacity) {
+            n++;
+        }
+        TPixel* ts = &src->pix[sy * src->stride + sx];
+        TPixel* td = &dst->pix[dy * dst->stride + dx];
+        if (opacity == TIGR_ROW_OPAQUE && copy) {
+            for (int y = 0; y < n; y++) {
+                memcpy(td + y * dst->stride, ts + y * src->stride, w * sizeof(TPixel));
+            }
+        } else if (opacity != TIGR_ROW_TRANSPARENT) {
+            blend(td, dst->stride, ts, src->stride, w, n, tint, dst->blitMode);
+        }
+        sy += n;
+        dy += n;
+        h -= n;
+    }
+}
+
+// Sprite pixels are left out if blending them changes nothing.
+static int tigrSpriteSkips(TPixel p, int premultiplied) {
+    return premultiplied ? (p.r | p.g | p.b | p.a) == 0 : p.a == 0;
+}
+
+// Splits a row into runs, or only counts them if runs and pix are NULL.
+static void tigrSpriteRow(TPixel* row, int w, int premultiplied, int* runs, TPixel* pix, int* numRuns, int* numPix) {
+    int x = 0;
+    while (x < w) {
+        int skip = x;
+        while (x < w && tigrSpriteSkips(row[x], premultiplied)) {
+            x++;
+        }
+        if (x == w) {
+            break;
+        }
+        int copy = x;
+        while (x < w && row[x].a == 255) {
+            x++;
+        }
+        int blend = x;
+        while (x < w && row[x].a != 255 && !tigrSpriteSkips(row[x], premultiplied)) {
+            x++;
+        }
+        if (runs) {
+            int* counts = &runs[3 * *numRuns];
+            counts[0] = copy - skip;
+            counts[1] = blend - copy;
+            counts[2] = x - blend;
+            memcpy(pix + *numPix, row + copy, (x - copy) * sizeof(TPixel));
+        }
+        *numRuns += 1;
+        *numPix += x - copy;
+    }
+}
+
+TigrSprite* tigrSprite(Tigr* src) {
+    int premultiplied = (src->flags & TIGR_BITMAP_PREMULTIPLIED) != 0;
+
+    // Count first, so everything fits one allocation.
+    int numRuns = 0;
+    int numPix = 0;
+    for (int y = 0; y < src->h; y++) {
+        tigrSpriteRow(&src->pix[y * src->stride], src->w, premultiplied, NULL, NULL, &numRuns, &numPix);
+    }
+
+    size_t size = sizeof(TigrSprite) + (size_t)numPix * sizeof(TPixel) + (2 * (size_t)src->h + 2) * sizeof(int) +
+                  3 * (size_t)numRuns * sizeof(int);
+    TigrSprite* sprite = (TigrSprite*)malloc(size);
+    if (!sprite) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    sprite->w = src->w;
+    sprite->h = src->h;
+    sprite->flags = src->flags & TIGR_BITMAP_PREMULTIPLIED;
+    sprite->pix = (TPixel*)(sprite + 1);
+    sprite->rows = (int*)(sprite->pix + numPix);
+    sprite->runs = sprite->rows + 2 * src->h + 2;
+
+    numRuns = 0;
+    numPix = 0;
+    for (int y = 0; y < src->h; y++) {
+        sprite->rows[2 * y] = numRuns;
+        sprite->rows[2 * y + 1] = numPix;
+        tigrSpriteRow(&src->pix[y * src->stride], src->w, premultiplied, sprite->runs, sprite->pix, &numRuns, &numPix);
+    }
+    sprite->rows[2 * src->h] = numRuns;
+    sprite->rows[2 * src->h + 1] = numPix;
+    return sprite;
+}
+
+void tigrBlitSprite(Tigr* dst, TigrSprite* sprite, int dx, int dy, TPixel tint) {
+    int cw = dst->cw >= 0 ? dst->cw : dst->w;
+    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+
+    // Visible part, in sprite coordinates.
+    int x0 = dst->cx - dx > 0 ? dst->cx - dx : 0;
+    int y0 = dst->cy - dy > 0 ? dst->cy - dy : 0;
+    int x1 = dst->cx + cw - dx < sprite->w ? dst->cx + cw - dx : sprite->w;
+    int y1 = dst->cy + ch - dy < sprite->h ? dst->cy + ch - dy : sprite->h;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+    MARK(dst, dx + x0, dy + y0, x1 - x0, y1 - y0);
+
+    TigrBlitFunc blend = tigrBlitFor(dst, sprite->flags);
+    // Opaque pixels can be copied as they are, unless they are tinted or keep the destination alpha.
+    int copy = tint.r == 255 && tint.g == 255 && tint.b == 255 && tint.a == 255 && dst->blitMode;
+
+    for (int y = y0; y < y1; y++) {
+        int* run = &sprite->runs[3 * sprite->rows[2 * y]];
+        int* end = &sprite->runs[3 * sprite->rows[2 * y + 2]];
+        TPixel* ts = &sprite->pix[sprite->rows[2 * y + 1]];
+        TPixel* td = &dst->pix[(dy + y) * dst->stride + dx];
+        for (int x = 0; run < end && x < x1; run += 3) {
+            x += run[0];
+            // Copied pixels, then blended ones, each clipped to x0/x1.
+            for (int i = 1; i <= 2; i++) {
+                int a = x > x0 ? x : x0;
+                int b = x + run[i] < x1 ? x + run[i] : x1;
+                if (a < b) {
+                    if (i == 1 && copy) {
+                        memcpy(td + a, ts + a - x, (b - a) * sizeof(TPixel));
+                    } else {
+                        blend(td + a, 0, ts + a - x, 0, b - a, 1, tint, dst->blitMode);
+                    }
+                }
+                ts += run[i];
+                x += run[i];
+            }
+        }
+    }
+}
+
+void tigrFreeSprite(TigrSprite* sprite) {
+    free(sprite);
+}
+
+TigrIndexed* tigrIndexed(int w, int h, int bits) {
+    if (w <= 0 || h <= 0 || (bits != 1 && bits != 2 && bits != 4 && bits != 8) || w > INT_MAX / 8 - 1) {
+        errno = EINVAL;
+        return NULL;
+    }
+    int stride = (w * bits + 7) / 8;
+    TigrIndexed* bmp = (TigrIndexed*)calloc(1, sizeof(TigrIndexed) + (size_t)stride * h);
+    if (!bmp) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    bmp->w = w;
+    bmp->h = h;
+    bmp->bits = bits;
+    bmp->stride = stride;
+    bmp->data = (unsigned char*)(bmp + 1);
+    return bmp;
+}
+
+int tigrGetIndex(TigrIndexed* bmp, int x, int y) {
+    if (x < 0 || y < 0 || x >= bmp->w || y >= bmp->h) {
+        return 0;
+    }
+    int bit = x * bmp->bits;
+    int shift = 8 - bmp->bits - (bit & 7);
+    return (bmp->data[y * bmp->stride + (bit >> 3)] >> shift) & ((1 << bmp->bits) - 1);
+}
+
+void tigrSetIndex(TigrIndexed* bmp, int x, int y, int index) {
+    if (x < 0 || y < 0 || x >= bmp->w || y >= bmp->h) {
+        return;
+    }
+    int bit = x * bmp->bits;
+    int shift = 8 - bmp->bits - (bit & 7);
+    int mask = ((1 << bmp->bits) - 1) << shift;
+    unsigned char* p = &bmp->data[y * bmp->stride + (bit >> 3)];
+    *p = (unsigned char)((*p & ~mask) | ((index << shift) & mask));
+}
+
+// Looks up a run of indices in a palette, starting at pixel x of a row.
+static void tigrExpandIndices(TPixel* out, const unsigned char* row, int x, int n, int bits, const TPixel* palette) {
+    if (bits == 8) {
+        for (int i = 0; i < n; i++) {
+            out[i] = palette[row[x + i]];
+        }
+        return;
+    }
+    int mask = (1 << bits) - 1;
+    int perByte = 8 / bits;
+    const unsigned char* p = row + x / perByte;
+    int shift = 8 - bits - (x % perByte) * bits;
+    for (int i = 0; i < n; i++) {
+        out[i] = palette[(*p >> shift) & mask];
+        if ((shift -= bits) < 0) {
+            shift = 8 - bits;
+            p++;
+        }
+    }
+}
+
+void tigrBlitIndexed(Tigr* dst, TigrIndexed* src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint) {
+    int cw = dst->cw >= 0 ? dst->cw : dst->w;
+    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+
+    CLIP();
+    MARK(dst, dx, dy, w, h);
+
+    // With only opaque and fully transparent colors, and no tint, pixels are either written or skipped.
+    int colors = 1 << src->bits;
+    int direct = tint.r == 255 && tint.g == 255 && tint.b == 255 && tint.a == 255 && dst->blitMode;
+    for (int i = 0; i < colors && direct; i++) {
+        direct = src->palette[i].a == 0 || src->palette[i].a == 255;
+    }
+
+    TigrBlitFunc blend = tigrBlitFor(dst, 0);
+    TPixel buffer[256];
+    for (int y = 0; y < h; y++) {
+        const unsigned char* row = src->data + (sy + y) * src->stride;
+        TPixel* td = &dst->pix[(dy + y) * dst->stride + dx];
+        for (int x = 0; x < w; x += 256) {
+            int n = w - x < 256 ? w - x : 256;
+            tigrExpandIndices(buffer, row, sx + x, n, src->bits, src->palette);
+            if (direct) {
+                for (int i = 0; i < n; i++) {
+                    if (buffer[i].a) {
+                        td[x + i] = buffer[i];
+                    }
+                }
+            } else {
+                blend(td + x, 0, buffer, 0, n, 1, tint, dst->blitMode);
+            }
+        }
+    }
+}
+
+void tigrFreeIndexed(TigrIndexed* bmp) {
+    free(bmp);
+}
+
+void tigrBlitAlpha(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h, float alpha) {
+    alpha = (alpha < 0) ? 0 : (alpha > 1 ? 1 : alpha);
+    tigrBlitTint(dst, src, dx, dy, sx, sy, w, h, tigrRGBA(0xff, 0xff, 0xff, (unsigned char)(alpha * 255)));
+}
+
+void tigrBlitMode(Tigr* dst, int mode) {
+    dst->blitMode = mode;
+}
+
+// Blend ops for tigrBlitBlend, on a 0-255 destination channel D, the source color W
+// already weighted by its alpha (0-255), and the blend alpha A (0-256).
+#define BLEND_ADD(D, W, A) ((D) + (W) > 255 ? 255 : (D) + (W))
+#define BLEND_MULTIPLY(D, W, A) ((D) * (256 - (A) + EXPAND(W)) >> 8)
+#define BLEND_SCREEN(D, W, A) ((D) + (EXPAND(W) * (255 - (D)) >> 8))
+
+#ifdef TIGR_SSE2
+// Same on 16-bit lanes, giving identical results. Packing clamps the sum for BLEND_ADD.
+#define EXPAND16(X) _mm_add_epi16(X, _mm_min_epi16(X, one))
+#define BLEND_ADD_SSE2(D, W, A) _mm_add_epi16(D, W)
+#define BLEND_MULTIPLY_SSE2(D, W, A) \
+    _mm_srli_epi16(_mm_mullo_epi16(D, _mm_add_epi16(_mm_sub_epi16(k256, A), EXPAND16(W))), 8)
+#define BLEND_SCREEN_SSE2(D, W, A) \
+    _mm_add_epi16(D, _mm_srli_epi16(_mm_mullo_epi16(EXPAND16(W), _mm_sub_epi16(k255, D)), 8))
+
+// Blends two pixels unpacked to 16-bit lanes, like BLEND_PIXEL below.
+#define BLEND_LANES_SSE2(OUT, OP, S, D)                                                       \
+    {                                                                                         \
+        __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(S, 0xff), 0xff);                 \
+        a = _mm_srli_epi16(_mm_mullo_epi16(a, xav), 8);                                       \
+        a = EXPAND16(a);                                                                      \
+        __m128i m = _mm_srli_epi16(_mm_mullo_epi16(tv, premultiplied ? xav : a), 8);         \
+        __m128i wc = _mm_srli_epi16(_mm_mullo_epi16(S, EXPAND16(m)), 8);                     \
+        __m128i na = _mm_add_epi16(_mm_mullo_epi16(k255, a), _mm_mullo_epi16(D, _mm_sub_epi16(k256, a))); \
+        OUT = _mm_or_si128(_mm_andnot_si128(amask, OP(D, wc, a)), _mm_and_si128(amask, _mm_srli_epi16(na, 8))); \
+    }
+
+// Blends four pixels at a time, leaving the rest of the row in x.
+#define BLEND_ROW_SSE2(OP)                                                                    \
+    for (; x + 4 <= w; x += 4) {                                                              \
+        __m128i sv = _mm_loadu_si128((const __m128i*)(ts + x));                               \
+        __m128i dv = _mm_loadu_si128((const __m128i*)(td + x));                               \
+        __m128i lo, hi;                                                                       \
+        BLEND_LANES_SSE2(lo, OP, _mm_unpacklo_epi8(sv, zero), _mm_unpacklo_epi8(dv, zero));  \
+        BLEND_LANES_SSE2(hi, OP, _mm_unpackhi_epi8(sv, zero), _mm_unpackhi_epi8(dv, zero));  \
+        __m128i out = _mm_packus_epi16(lo, hi);                                               \
+        _mm_storeu_si128((__m128i*)(td + x), _mm_or_si128(_mm_and_si128(keep, out), _mm_andnot_si128(keep, dv))); \
+    }
+
+#define BLEND_SETUP_SSE2()                                                                    \
+    __m128i zero = _mm_setzero_si128();                                                       \
+    __m128i one = _mm_set1_epi16(1);                                                          \
+    __m128i k255 = _mm_set1_epi16(255);                                                       \
+    __m128i k256 = _mm_set1_epi16(256);                                                       \
+    __m128i xav = _mm_set1_epi16((short)xa);                                                  \
+    __m128i tv = _mm_setr_epi16(tint.r, tint.g, tint.b, tint.a, tint.r, tint.g, tint.b, tint.a); \
+    __m128i amask = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);                                 \
+    __m128i keep = _mm_set1_epi32(blitMode ? -1 : 0x00ffffff);
+#else
+#define BLEND_ROW_SSE2(OP)
+#define BLEND_SETUP_SSE2()
+#endif
+
+// Weighs a source pixel by its alpha and the tint, and blends it onto the destination with OP.
+// A premultiplied source is only weighed by the tint.
+#define BLEND_PIXEL(OP)                                                                       \
+    {                                                                                         \
+        TPixel sp = ts[x];                                                                    \
+        TPixel dp = td[x];                                                                    \
+        unsigned a = EXPAND(xa * sp.a >> 8);                                                  \
+        unsigned f = premultiplied ? (unsigned)xa : a;                                        \
+        unsigned wr = sp.r * EXPAND(tint.r * f >> 8) >> 8;                                    \
+        unsigned wg = sp.g * EXPAND(tint.g * f >> 8) >> 8;                                    \
+        unsigned wb = sp.b * EXPAND(tint.b * f >> 8) >> 8;                                    \
+        td[x].r = (unsigned char)OP(dp.r, wr, a);                                             \
+        td[x].g = (unsigned char)OP(dp.g, wg, a);                                             \
+        td[x].b = (unsigned char)OP(dp.b, wb, a);                                             \
+        td[x].a = blitMode ? (unsigned char)((255 * a + dp.a * (256 - a)) >> 8) : dp.a;       \
+    }
+
+// Each blend mode gets a loop of its own.
+#define BLEND_KERNEL(NAME, OP)                                                                          \
+    static void NAME(TPixel* td, int dt, TPixel* ts, int st, int w, int h, TPixel tint, int blitMode,   \
+                     int premultiplied) {                                                               \
+        int xa = EXPAND(tint.a);                                                                        \
+        BLEND_SETUP_SSE2()                                                                              \
+        do {                                                                                            \
+            int x = 0;                                                                                  \
+            BLEND_ROW_SSE2(OP##_SSE2)                                                                   \
+            for (; x < w; x++) {                                                                        \
+                BLEND_PIXEL(OP)                                                                         \
+            }                                                                                           \
+            ts += st;                                                                                   \
+            td += dt;                                                                                   \
+        } while (--h);                                                                                  \
+    }
+
+BLEND_KERNEL(tigrBlendAdd, BLEND_ADD)
+BLEND_KERNEL(tigrBlendMultiply, BLEND_MULTIPLY)
+BLEND_KERNEL(tigrBlendScreen, BLEND_SCREEN)
+
+void tigrBlitBlend(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint, int blend) {
+    static void (*const kernels[])(TPixel*, int, TPixel*, int, int, int, TPixel, int, int) = {
+        tigrBlendAdd,
+        tigrBlendMultiply,
+        tigrBlendScreen,
+    };
+    int cw = dst->cw >= 0 ? dst->cw : dst->w;
+    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+
+    if (blend < 0 || blend >= (int)(sizeof(kernels) / sizeof(kernels[0]))) {
+        return;
+    }
+
+    CLIP();
+    MARK(dst, dx, dy, w, h);
+
+    kernels[blend](&dst->pix[dy * dst->stride + dx], dst->stride, &src->pix[sy * src->stride + sx], src->stride, w,
+                   h, tint, dst->blitMode, (src->flags & TIGR_BITMAP_PREMULTIPLIED) != 0);
+}
+
+// Tints a source pixel and blends it onto a destination pixel, like tigrBlitTint.
+#define BLEND_TINTED(TD, S)                                                  \
+    {                                                                        \
+        unsigned r = (xr * (S).r) >> 8;                                      \
+        unsigned g = (xg * (S).g) >> 8;                                      \
+        unsigned b = (xb * (S).b) >> 8;                                      \
+        unsigned a = xa * EXPAND((S).a);                                     \
+        (TD).r += (unsigned char)((r - (TD).r) * a >> 16);                   \
+        (TD).g += (unsigned char)((g - (TD).g) * a >> 16);                   \
+        (TD).b += (unsigned char)((b - (TD).b) * a >> 16);                   \
+        (TD).a += blitMode * (unsigned char)(((S).a - (TD).a) * a >> 16);    \
+    }
+
+// Same for a premultiplied source, with tr/tg/tb/ta being the tint scaled by its alpha.
+#define BLEND_PREMULTIPLIED(TD, S)                                                 \
+    {                                                                              \
+        unsigned inv = 65536 - EXPAND((S).a) * xa;                                 \
+        (TD).r = (unsigned char)(((S).r * tr >> 16) + ((TD).r * inv >> 16));      \
+        (TD).g = (unsigned char)(((S).g * tg >> 16) + ((TD).g * inv >> 16));      \
+        (TD).b = (unsigned char)(((S).b * tb >> 16) + ((TD).b * inv >> 16));      \
+        if (blitMode)                                                              \
+            (TD).a = (unsigned char)(((S).a * ta >> 16) + ((TD).a * inv >> 16));  \
+    }
+
+// Same for a straight source onto a premultiplied destination, like tigrBlitToPremultiplied.
+#define BLEND_OVER(TD, S)                          \
+    {                                              \
+        TPixel sp = tigrPremultiplyPixel(S);       \
+        BLEND_PREMULTIPLIED(TD, sp);               \
+    }
+
+#ifdef TIGR_SSE2
+// Splits 32-bit weights W of up to 65536 into H * 256 + L, packed as (L, H << 4) for MULSHIFT_SSE2.
+#define SPLIT_SSE2(W) _mm_or_si128(_mm_and_si128(W, byte), _mm_slli_epi32(_mm_srli_epi32(W, 8), 20))
+
+// X * W >> 16 on two pixels unpacked to 16-bit lanes X (-255 to 255), with the split weights
+// W0 and W1 for each channel of the first and second pixel. The products are summed in
+// 32-bit lanes as (X, X << 4) . (L, H << 4), so nothing is lost.
+#define MULSHIFT_SSE2(X, W0, W1)                                                                     \
+    _mm_packs_epi32(_mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(X, _mm_slli_epi16(X, 4)), W0), 16), \
+                    _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(X, _mm_slli_epi16(X, 4)), W1), 16))
+
+// Spreads the weight of each of four pixels across its channels.
+#define SPREAD_SSE2(W, I) _mm_shuffle_epi32(W, (I) * 0x55)
+
+// BLEND_TINTED on two pixels unpacked to 16-bit lanes, with tv holding (xr, xg, xb, 256)
+// and W the split weights xa * EXPAND(alpha) of all four pixels.
+#define TINTED_LANES_SSE2(OUT, S, D, W, I)                                                       \
+    {                                                                                            \
+        __m128i diff = _mm_sub_epi16(_mm_srli_epi16(_mm_mullo_epi16(tv, S), 8), D);              \
+        OUT = _mm_add_epi16(D, MULSHIFT_SSE2(diff, SPREAD_SSE2(W, I), SPREAD_SSE2(W, I + 1)));   \
+    }
+
+// BLEND_PREMULTIPLIED on two pixels, with tw holding tr/tg/tb/ta split up.
+// The destination is weighed by 65536 - xa * EXPAND(alpha).
+#define PREMULTIPLIED_LANES_SSE2(OUT, S, D, W, I)                                                \
+    OUT = _mm_add_epi16(MULSHIFT_SSE2(S, tw, tw),                                                \
+                        MULSHIFT_SSE2(D, SPREAD_SSE2(W, I), SPREAD_SSE2(W, I + 1)));
+#define TINTED_WEIGHT_SSE2(A) SPLIT_SSE2(A)
+#define PREMULTIPLIED_WEIGHT_SSE2(A) SPLIT_SSE2(_mm_sub_epi32(k65536, A))
+
+// Blends the four pixels S0-S3 onto TD, two at a time with NAME##_LANES_SSE2. Channels wrap
+// like the unsigned char stores of the scalar versions.
+#define BLEND4_SSE2(TD, S0, S1, S2, S3, NAME)                                                    \
+    {                                                                                            \
+        int c0, c1, c2, c3;                                                                      \
+        memcpy(&c0, &(S0), sizeof(int));                                                         \
+        memcpy(&c1, &(S1), sizeof(int));                                                         \
+        memcpy(&c2, &(S2), sizeof(int));                                                         \
+        memcpy(&c3, &(S3), sizeof(int));                                                         \
+        __m128i svec = _mm_setr_epi32(c0, c1, c2, c3);                                           \
+        __m128i dvec = _mm_loadu_si128((const __m128i*)(TD));                                    \
+        __m128i a = _mm_srli_epi32(svec, 24);                                                    \
+        a = _mm_madd_epi16(_mm_add_epi16(a, _mm_min_epi16(a, one)), xav);                        \
+        __m128i w = NAME##_WEIGHT_SSE2(a);                                                       \
+        __m128i slo = _mm_unpacklo_epi8(svec, zero), dlo = _mm_unpacklo_epi8(dvec, zero);        \
+        __m128i shi = _mm_unpackhi_epi8(svec, zero), dhi = _mm_unpackhi_epi8(dvec, zero);        \
+        __m128i out0, out1;                                                                      \
+        NAME##_LANES_SSE2(out0, slo, dlo, w, 0)                                                  \
+        NAME##_LANES_SSE2(out1, shi, dhi, w, 2)                                                  \
+        __m128i out = _mm_packus_epi16(_mm_and_si128(out0, k255), _mm_and_si128(out1, k255));    \
+        _mm_storeu_si128((__m128i*)(TD), _mm_or_si128(_mm_and_si128(keep, out), _mm_andnot_si128(keep, dvec))); \
+    }
+#define BLEND_TINTED_SSE2(TD, S0, S1, S2, S3) BLEND4_SSE2(TD, S0, S1, S2, S3, TINTED)
+#define BLEND_PREMULTIPLIED_SSE2(TD, S0, S1, S2, S3) BLEND4_SSE2(TD, S0, S1, S2, S3, PREMULTIPLIED)
+#define BLEND_OVER_SSE2(TD, S0, S1, S2, S3)                                                      \
+    {                                                                                            \
+        TPixel p0 = tigrPremultiplyPixel(S0), p1 = tigrPremultiplyPixel(S1);                     \
+        TPixel p2 = tigrPremultiplyPixel(S2), p3 = tigrPremultiplyPixel(S3);                     \
+        BLEND_PREMULTIPLIED_SSE2(TD, p0, p1, p2, p3)                                             \
+    }
+#endif
+
+// Interpolates between four pixels, with 8-bit fractions fx and fy.
+static TPixel tigrBilinear(TPixel p00, TPixel p01, TPixel p10, TPixel p11, int fx, int fy) {
+    int w11 = (fx * fy) >> 8;
+    int w01 = fx - w11;
+    int w10 = fy - w11;
+    int w00 = 256 - w01 - w10 - w11;
+#ifdef TIGR_SSE2
+    int c[4];
+    memcpy(&c[0], &p00, sizeof(int));
+    memcpy(&c[1], &p01, sizeof(int));
+    memcpy(&c[2], &p10, sizeof(int));
+    memcpy(&c[3], &p11, sizeof(int));
+    __m128i zero = _mm_setzero_si128();
+    __m128i top = _mm_unpacklo_epi8(_mm_setr_epi32(c[0], c[1], 0, 0), zero);
+    __m128i bottom = _mm_unpacklo_epi8(_mm_setr_epi32(c[2], c[3], 0, 0), zero);
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(top, _mm_setr_epi16(w00, w00, w00, w00, w01, w01, w01, w01)),
+                                _mm_mullo_epi16(bottom, _mm_setr_epi16(w10, w10, w10, w10, w11, w11, w11, w11)));
+    sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+    sum = _mm_srli_epi16(sum, 8);
+    int packed = _mm_cvtsi128_si32(_mm_packus_epi16(sum, zero));
+    TPixel out;
+    memcpy(&out, &packed, sizeof(out));
+    return out;
+#else
+    TPixel out;
+    out.r = (unsigned char)((p00.r * w00 + p01.r * w01 + p10.r * w10 + p11.r * w11) >> 8);
+    out.g = (unsigned char)((p00.g * w00 + p01.g * w01 + p10.g * w10 + p11.g * w11) >> 8);
+    out.b = (unsigned char)((p00.b * w00 + p01.b * w01 + p10.b * w10 + p11.b * w11) >> 8);
+    out.a = (unsigned char)((p00.a * w00 + p01.a * w01 + p10.a * w10 + p11.a * w11) >> 8);
+    return out;
+#endif
+}
+
+// Rounds num / den up, for den > 0.
+static long long tigrCeilDiv(long long num, long long den) {
+    return num >= 0 ? (num + den - 1) / den : -(-num / den);
+}
+
+// Rounds down, without needing libm.
+static long long tigrFloor(double x) {
+    long long t = (long long)x;
+    return t - (t > x);
+}
+
+// Finds the run of steps k in [0, n) for which lo <= base + step * k < hi.
+// The ends may be off by one where the bounds are hit exactly, callers check them.
+static void tigrSpan(long long base, long long step, long long lo, long long hi, int n, int* k0, int* k1) {
+    if (step == 0) {
+        if (base < lo || base >= hi) {
+            *k1 = *k0;
+        }
+        return;
+    }
+    long long a = step > 0 ? tigrCeilDiv(lo - base, step) : tigrCeilDiv(base - hi, -step);
+    long long b = step > 0 ? tigrCeilDiv(hi - base, step) : tigrCeilDiv(base - lo, -step);
+    if (a > *k0) {
+        *k0 = a < n ? (int)a : n;
+    }
+    if (b < *k1) {
+        *k1 = b > 0 ? (int)b : 0;
+    }
+    if (*k1 < *k0) {
+        *k1 = *k0;
+    }
+}
+
+// Transformed blit from source pixels in rows of `stride` pixels, or in tiles if tilesX is non-zero.
+static void tigrTransform(Tigr* dst, TPixel* pix, int stride, int tilesX, int srcW, int srcH, int flags, int sx,
+                          int sy, int sw, int sh, const float m[6], TPixel tint, int filter) {
+    double det = (double)m[0] * m[4] - (double)m[1] * m[3];
+    if (sw <= 0 || sh <= 0 || det == 0) {
+        return;
+    }
+
+    // Part of the source rect inside the source bitmap, relative to sx, sy.
+    int u0 = sx < 0 ? -sx : 0;
+    int v0 = sy < 0 ? -sy : 0;
+    int u1 = sx + sw > srcW ? srcW - sx : sw;
+    int v1 = sy + sh > srcH ? srcH - sy : sh;
+    if (u0 >= u1 || v0 >= v1) {
+        return;
+    }
+
+    // Destination bounds, clipped.
+    float minX = m[2], maxX = m[2], minY = m[5], maxY = m[5];
+    for (int i = 1; i < 4; i++) {
+        float u = (i & 1) ? (float)sw : 0;
+        float v = (i & 2) ? (float)sh : 0;
+        float x = m[0] * u + m[1] * v + m[2];
+        float y = m[3] * u + m[4] * v + m[5];
+        minX = x < minX ? x : minX;
+        maxX = x > maxX ? x : maxX;
+        minY = y < minY ? y : minY;
+        maxY = y > maxY ? y : maxY;
+    }
+
+    int cx0 = dst->cx > 0 ? dst->cx : 0;
+    int cy0 = dst->cy > 0 ? dst->cy : 0;
+    int cx1 = dst->cw >= 0 ? dst->cx + dst->cw : dst->w;
+    int cy1 = dst->ch >= 0 ? dst->cy + dst->ch : dst->h;
+    cx1 = cx1 < dst->w ? cx1 : dst->w;
+    cy1 = cy1 < dst->h ? cy1 : dst->h;
+
+    if (maxX <= cx0 || maxY <= cy0 || minX >= cx1 || minY >= cy1) {
+        return;
+    }
+    int x0 = minX > cx0 ? (int)tigrFloor(minX) : cx0;
+    int y0 = minY > cy0 ? (int)tigrFloor(minY) : cy0;
+    int x1 = maxX < cx1 ? (int)-tigrFloor(-maxX) : cx1;
+    int y1 = maxY < cy1 ? (int)-tigrFloor(-maxY) : cy1;
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    MARK(dst, x0, y0, x1 - x0, y1 - y0);
+
+    // Source position of destination pixel centers, stepped in 16.16 fixed point.
+    double ia = m[4] / det, ib = -m[1] / det;
+    double ic = -m[3] / det, id = m[0] / det;
+    long long du = (long long)(ia * 65536.0);
+    long long dv = (long long)(ic * 65536.0);
+    long long lu0 = (long long)u0 << 16, lu1 = (long long)u1 << 16;
+    long long lv0 = (long long)v0 << 16, lv1 = (long long)v1 << 16;
+
+    int xr = EXPAND(tint.r);
+    int xg = EXPAND(tint.g);
+    int xb = EXPAND(tint.b);
+    int xa = EXPAND(tint.a);
+    int blitMode = dst->blitMode;
+    int premultiplied = flags & TIGR_BITMAP_PREMULTIPLIED;
+    int over = dst->flags & TIGR_BITMAP_PREMULTIPLIED;
+    unsigned tr = xr * xa, tg = xg * xa, tb = xb * xa, ta = xa << 8;
+    TPixel* base = tilesX ? pix : pix + sy * stride + sx;
+    int st = stride;
+    int n = x1 - x0;
+#ifdef TIGR_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i one = _mm_set1_epi16(1);
+    __m128i k255 = _mm_set1_epi16(255);
+    __m128i byte = _mm_set1_epi32(255);
+    __m128i k65536 = _mm_set1_epi32(65536);
+    __m128i xav = _mm_set1_epi32(xa);
+    __m128i tv = _mm_setr_epi16(xr, xg, xb, 256, xr, xg, xb, 256);
+    __m128i tw = SPLIT_SSE2(_mm_setr_epi32(tr, tg, tb, ta));
+    __m128i keep = _mm_set1_epi32(blitMode ? -1 : 0x00ffffff);
+#endif
+
+    for (int y = y0; y < y1; y++) {
+        double rx = x0 + 0.5 - m[2];
+        double ry = y + 0.5 - m[5];
+        long long ub = tigrFloor((ia * rx + ib * ry) * 65536.0);
+        long long vb = tigrFloor((ic * rx + id * ry) * 65536.0);
+
+        // Clip the scanline to the pixels whose centers map into the source.
+        int k0 = 0, k1 = n;
+        tigrSpan(ub, du, lu0, lu1, n, &k0, &k1);
+        tigrSpan(vb, dv, lv0, lv1, n, &k0, &k1);
+#define INSIDE(K)                                                                                          \
+    (ub + du * (K) >= lu0 && ub + du * (K) < lu1 && vb + dv * (K) >= lv0 && vb + dv * (K) < lv1)
+        while (k0 < k1 && !INSIDE(k0))
+            k0++;
+        while (k1 > k0 && !INSIDE(k1 - 1))
+            k1--;
+        if (k0 == k1) {
+            continue;
+        }
+        while (k0 > 0 && INSIDE(k0 - 1))
+            k0--;
+        while (k1 < n && INSIDE(k1))
+            k1++;
+#undef INSIDE
+
+        TPixel* td = dst->pix + y * dst->stride + x0;
+        long long u = ub + du * k0;
+        long long v = vb + dv * k0;
+
+        // Source pixels relative to sx/sy, from rows or tiles.
+#define ROW_TEXEL(X, Y) base[(Y) * st + (X)]
+#define TILE_TEXEL(X, Y)                                                                              \
+    base[(((unsigned)(sy + (Y)) / TIGR_TILE) * tilesX + (unsigned)(sx + (X)) / TIGR_TILE) *            \
+             (TIGR_TILE * TIGR_TILE) +                                                                \
+         ((unsigned)(sy + (Y)) % TIGR_TILE) * TIGR_TILE + (unsigned)(sx + (X)) % TIGR_TILE]
+
+        // Sample around the pixel center, clamping to the edges of the source rect.
+#define BILINEAR_SAMPLE(S, TEXEL)                                                                 \
+    {                                                                                             \
+        long long su = u - 32768;                                                                 \
+        long long sv = v - 32768;                                                                 \
+        int px = (int)(su >> 16);                                                                 \
+        int py = (int)(sv >> 16);                                                                 \
+        int fx = (int)(su >> 8) & 0xff;                                                           \
+        int fy = (int)(sv >> 8) & 0xff;                                                           \
+        int qx = px + 1;                                                                          \
+        int qy = py + 1;                                                                          \
+        px = px < u0 ? u0 : px;                                                                   \
+        py = py < v0 ? v0 : py;                                                                   \
+        qx = qx >= u1 ? u1 - 1 : qx;                                                              \
+        qy = qy >= v1 ? v1 - 1 : qy;                                                              \
+        S = tigrBilinear(TEXEL(px, py), TEXEL(qx, py), TEXEL(px, qy), TEXEL(qx, qy), fx, fy);     \
+    }
+#define NEAREST_SAMPLE(S, TEXEL) S = TEXEL((int)(u >> 16), (int)(v >> 16))
+
+        // With SSE2, gather four source pixels and blend them together, then finish the row singly.
+#ifdef TIGR_SSE2
+#define BLEND4_LOOP(BLEND, SAMPLE, TEXEL)                                                         \
+    for (; k + 4 <= k1; k += 4) {                                                                 \
+        TPixel s0, s1, s2, s3;                                                                    \
+        SAMPLE(s0, TEXEL);                                                                        \
+        u += du, v += dv;                                                                         \
+        SAMPLE(s1, TEXEL);                                                                        \
+        u += du, v += dv;                                                                         \
+        SAMPLE(s2, TEXEL);                                                                        \
+        u += du, v += dv;                                                                         \
+        SAMPLE(s3, TEXEL);                                                                        \
+        u += du, v += dv;                                                                         \
+        BLEND##_SSE2(td + k, s0, s1, s2, s3);                                                     \
+    }
+#else
+#define BLEND4_LOOP(BLEND, SAMPLE, TEXEL)
+#endif
+#define SAMPLE_LOOP(BLEND, SAMPLE, TEXEL)                                                         \
+    {                                                                                             \
+        int k = k0;                                                                               \
+        BLEND4_LOOP(BLEND, SAMPLE, TEXEL)                                                         \
+        for (; k < k1; k++, u += du, v += dv) {                                                   \
+            TPixel s;                                                                             \
+            SAMPLE(s, TEXEL);                                                                     \
+            BLEND(td[k], s);                                                                      \
+        }                                                                                         \
+    }
+#define FILTER_LOOP(BLEND, TEXEL)                     \
+    if (filter == TIGR_BILINEAR) {                    \
+        SAMPLE_LOOP(BLEND, BILINEAR_SAMPLE, TEXEL);   \
+    } else {                                          \
+        SAMPLE_LOOP(BLEND, NEAREST_SAMPLE, TEXEL);    \
+    }
+
+        if (tilesX) {
+            if (premultiplied) {
+                FILTER_LOOP(BLEND_PREMULTIPLIED, TILE_TEXEL);
+            } else if (over) {
+                FILTER_LOOP(BLEND_OVER, TILE_TEXEL);
+            } else {
+                FILTER_LOOP(BLEND_TINTED, TILE_TEXEL);
+            }
+        } else {
+            if (premultiplied) {
+                FILTER_LOOP(BLEND_PREMULTIPLIED, ROW_TEXEL);
+            } else if (over) {
+                FILTER_LOOP(BLEND_OVER, ROW_TEXEL);
+            } else {
+                FILTER_LOOP(BLEND_TINTED, ROW_TEXEL);
+            }
+        }
+#undef ROW_TEXEL
+#undef TILE_TEXEL
+#undef BILINEAR_SAMPLE
+#undef NEAREST_SAMPLE
+#undef BLEND4_LOOP
+#undef SAMPLE_LOOP
+#undef FILTER_LOOP
+    }
+}
+
+void tigrBlitTransformed(Tigr* dst, Tigr* src, int sx, int sy, int sw, int sh, const float m[6], TPixel tint,
+                         int filter) {
+    tigrTransform(dst, src->pix, src->stride, 0, src->w, src->h, src->flags, sx, sy, sw, sh, m, tint, filter);
+}
+
+void tigrBlitTiledTransformed(Tigr* dst, TigrTiled* src, int sx, int sy, int sw, int sh, const float m[6],
+                              TPixel tint, int filter) {
+    tigrTransform(dst, src->pix, 0, src->tilesX, src->w, src->h, 0, sx, sy, sw, sh, m, tint, filter);
+}
+
+void tigrBlitScaled(Tigr* dst, Tigr* src, int dx, int dy, int dw, int dh, int sx, int sy, int sw, int sh,
+                    TPixel tint, int filter) {
+    if (sw <= 0 || sh <= 0) {
+        return;
+    }
+    float m[6] = { (float)dw / sw, 0, (float)dx, 0, (float)dh / sh, (float)dy };
+    if (dw < 0) {
+        m[2] -= dw;
+    }
+    if (dh < 0) {
+        m[5] -= dh;
+    }
+    tigrBlitTransformed(dst, src, sx, sy, sw, sh, m, tint, filter);
+}
+
+#undef BLEND_TINTED
+#undef BLEND_PREMULTIPLIED
+#undef BLEND_OVER
+#ifdef TIGR_SSE2
+#undef SPLIT_SSE2
+#undef MULSHIFT_SSE2
+#undef SPREAD_SSE2
+#undef TINTED_LANES_SSE2
+#undef PREMULTIPLIED_LANES_SSE2
+#undef TINTED_WEIGHT_SSE2
+#undef PREMULTIPLIED_WEIGHT_SSE2
+#undef BLEND4_SSE2
+#undef BLEND_TINTED_SSE2
+#undef BLEND_PREMULTIPLIED_SSE2
+#undef BLEND_OVER_SSE2
+#endif
+
+TigrTiled* tigrTiled(int w, int h) {
+    if (w <= 0 || h <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    TigrTiled* bmp = (TigrTiled*)calloc(1, sizeof(TigrTiled));
+    if (!bmp) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    bmp->w = w;
+    bmp->h = h;
+    bmp->tilesX = (w + TIGR_TILE - 1) / TIGR_TILE;
+    int tilesY = (h + TIGR_TILE - 1) / TIGR_TILE;
+    bmp->pix = tigrAllocPixels((size_t)bmp->tilesX * tilesY * TIGR_TILE * TIGR_TILE * sizeof(TPixel), 0);
+    if (!bmp->pix) {
+        free(bmp);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return bmp;
+}
+
+TPixel tigrTiledGet(TigrTiled* bmp, int x, int y) {
+    TPixel empty = { 0, 0, 0, 0 };
+    if (x >= 0 && y >= 0 && x < bmp->w && y < bmp->h)
+        return *tigrTiledPixel(bmp, x, y);
+    return empty;
+}
+
+void tigrTiledPlot(TigrTiled* bmp, int x, int y, TPixel pix) {
+    if (x >= 0 && y >= 0 && x < bmp->w && y < bmp->h) {
+        int xa = EXPAND(pix.a);
+        int a = xa * xa;
+        TPixel* p = tigrTiledPixel(bmp, x, y);
+        p->r += (unsigned char)((pix.r - p->r) * a >> 16);
+        p->g += (unsigned char)((pix.g - p->g) * a >> 16);
+        p->b += (unsigned char)((pix.b - p->b) * a >> 16);
+        p->a += (unsigned char)((pix.a - p->a) * a >> 16);
+    }
+}
+
+void tigrTiledFill(TigrTiled* bmp, int x, int y, int w, int h, TPixel color) {
+    int x1 = x + w < bmp->w ? x + w : bmp->w;
+    int y1 = y + h < bmp->h ? y + h : bmp->h;
+    x = x > 0 ? x : 0;
+    y = y > 0 ? y : 0;
+    if (x >= x1 || y >= y1) {
+        return;
+    }
+
+    // Tiles next to each other are next to each other in memory, so whole tiles are filled in one go.
+    for (int ty = y / TIGR_TILE; ty <= (y1 - 1) / TIGR_TILE; ty++) {
+        int r0 = y > ty * TIGR_TILE ? y - ty * TIGR_TILE : 0;
+        int r1 = y1 < (ty + 1) * TIGR_TILE ? y1 - ty * TIGR_TILE : TIGR_TILE;
+        int tx = x / TIGR_TILE;
+        while (tx <= (x1 - 1) / TIGR_TILE) {
+            int c0 = x > tx * TIGR_TILE ? x - tx * TIGR_TILE : 0;
+            int c1 = x1 < (tx + 1) * TIGR_TILE ? x1 - tx * TIGR_TILE : TIGR_TILE;
+            TPixel* tile = bmp->pix + (ty * bmp->tilesX + tx) * (TIGR_TILE * TIGR_TILE);
+            int n = 0;
+            if (r0 == 0 && r1 == TIGR_TILE && c0 == 0) {
+                while ((tx + n + 1) * TIGR_TILE <= x1) {
+                    n++;
+                }
+            }
+            if (n > 0) {
+                tigrFillArea(tile, n * TIGR_TILE * TIGR_TILE, n * TIGR_TILE * TIGR_TILE, 1, color);
+                tx += n;
+            } else {
+                tigrFillArea(tile + r0 * TIGR_TILE + c0, TIGR_TILE, c1 - c0, r1 - r0, color);
+                tx++;
+            }
+        }
+    }
+}
+
+void tigrTiledLine(TigrTiled* bmp, int x0, int y0, int x1, int y1, TPixel color) {
+    int sx = x0 < x1 ? 1 : -1;
+    int sy = y0 < y1 ? 1 : -1;
+    int dx = abs(x1 - x0);
+    int dy = abs(y1 - y0);
+    int err = dx - dy;
+
+    do {
+        tigrTiledPlot(bmp, x0, y0, color);
+        int e2 = 2 * err;
+        if (e2 > -dy) {
+            err -= dy;
+            x0 += sx;
+        }
+        if (e2 < dx) {
+            err += dx;
+            y0 += sy;
+        }
+    } while (x0 != x1 || y0 != y1);
+}
+
+// Copies between rows and tiles, one row of a tile at a time.
+static void tigrCopyTiles(Tigr* bmp, TigrTiled* tiled, int toTiles) {
+    int w = bmp->w < tiled->w ? bmp->w : tiled->w;
+    int h = bmp->h < tiled->h ? bmp->h : tiled->h;
+    for (int y = 0; y < h; y++) {
+        TPixel* row = &bmp->pix[y * bmp->stride];
+        TPixel* tileRow = tiled->pix + (y / TIGR_TILE) * tiled->tilesX * (TIGR_TILE * TIGR_TILE) +
+                          (y % TIGR_TILE) * TIGR_TILE;
+        for (int x = 0; x < w; x += TIGR_TILE, tileRow += TIGR_TILE * TIGR_TILE) {
+            int n = w - x < TIGR_TILE ? w - x : TIGR_TILE;
+            if (toTiles) {
+                memcpy(tileRow, row + x, n * sizeof(TPixel));
+            } else {
+                memcpy(row + x, tileRow, n * sizeof(TPixel));
+            }
+        }
+    }
+}
+
+void tigrTile(TigrTiled* dst, Tigr* src) {
+    tigrCopyTiles(src, dst, 1);
+}
+
+void tigrLinearize(Tigr* dst, TigrTiled* src) {
+    MARK(dst, 0, 0, src->w, src->h);
+    tigrCopyTiles(dst, src, 0);
+}
+
+void tigrFreeTiled(TigrTiled* bmp) {
+    if (bmp) {
+        tigrReleasePixels(bmp->pix);
+        free(bmp);
+    }
+}
+
+TPixel tigrPremultiplyPixel(TPixel p) {
+    p.r = (unsigned char)TIGR_MUL255(p.r, p.a);
+    p.g = (unsigned char)TIGR_MUL255(p.g, p.a);
+    p.b = (unsigned char)TIGR_MUL255(p.b, p.a);
+    return p;
+}
+
+TPixel tigrUnpremultiplyPixel(TPixel p) {
+    if (p.a == 0) {
+        return tigrRGBA(0, 0, 0, 0);
+    }
+    if (p.a < 255) {
+        unsigned r = (p.r * 255 + p.a / 2) / p.a;
+        unsigned g = (p.g * 255 + p.a / 2) / p.a;
+        unsigned b = (p.b * 255 + p.a / 2) / p.a;
+        p.r = (unsigned char)(r > 255 ? 255 : r);
+        p.g = (unsigned char)(g > 255 ? 255 : g);
+        p.b = (unsigned char)(b > 255 ? 255 : b);
+    }
+    return p;
+}
+
+void tigrPremultiply(Tigr* bmp) {
+    if (bmp->flags & TIGR_BITMAP_PREMULTIPLIED) {
+        return;
+    }
+    for (int y = 0; y < bmp->h; y++) {
+        TPixel* row = bmp->pix + y * bmp->stride;
+        for (int x = 0; x < bmp->w; x++) {
+            row[x] = tigrPremultiplyPixel(row[x]);
+        }
+    }
+    bmp->flags |= TIGR_BITMAP_PREMULTIPLIED;
+    MARK(bmp, 0, 0, bmp->w, bmp->h);
+}
+
+void tigrUnpremultiply(Tigr* bmp) {
+    if (!(bmp->flags & TIGR_BITMAP_PREMULTIPLIED)) {
+        return;
+    }
+    for (int y = 0; y < bmp->h; y++) {
+        TPixel* row = bmp->pix + y * bmp->stride;
+        for (int x = 0; x < bmp->w; x++) {
+            row[x] = tigrUnpremultiplyPixel(row[x]);
+        }
+    }
+    bmp->flags &= ~TIGR_BITMAP_PREMULTIPLIED;
+    MARK(bmp, 0, 0, bmp->w, bmp->h);
+}
+
+#undef CLIP0
+#undef CLIP1
+#undef CLIP
+#undef MARK
+
+//////// End of inlined file: tigr_bitmaps.c ////////
+
+//////// Start of inlined file: tigr_shared.c ////////
+
+//#include "tigr_internal.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Shared frames, for handing rendered frames to other local processes.
+#if !defined(_WIN32) && !defined(__ANDROID__)
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+// Frame buffers start on their own page.
+#define TIGR_SHARED_OFFSET 4096
+
+struct TigrShared {
+    TigrSharedHeader* header;
+    size_t size;
+    int fd;
+    int owner;                 // Non-zero in the creating process
+    int flags;                 // TIGR_SHARED_*, in the creating process
+    int current;               // Buffer being drawn, or held by the consumer
+    unsigned long long frame;  // Last frame published or acquired
+    char name[256];
+};
+
+static TPixel* tigrSharedBuffer(TigrShared* s, int i) {
+    TigrSharedHeader* hdr = s->header;
+    return (TPixel*)((char*)hdr + hdr->offset + (size_t)i * hdr->w * hdr->h * sizeof(TPixel));
+}
+
+static Tigr* tigrSharedBitmap(void* mem, size_t size, int fd, int owner, int flags) {
+    Tigr* bmp = (Tigr*)calloc(1, sizeof(Tigr) + sizeof(TigrShared));
+    TigrShared* s = (TigrShared*)(bmp + 1);
+    TigrSharedHeader* hdr = (TigrSharedHeader*)mem;
+    s->header = hdr;
+    s->size = size;
+    s->fd = fd;
+    s->owner = owner;
+    s->flags = flags;
+    s->current = owner ? 0 : -1;
+    bmp->w = hdr->w;
+    bmp->h = hdr->h;
+    bmp->cw = -1;
+    bmp->ch = -1;
+    bmp->pix = tigrSharedBuffer(s, 0);
+    bmp->stride = hdr->w;
+    bmp->blitMode = TIGR_BLEND_ALPHA;
+    bmp->shared = s;
+    return bmp;
+}
+
+// Creates shared memory that has no name, and so goes away with its last user.
+static int tigrAnonymousShm(void) {
+#ifdef __linux__
+    return (int)syscall(SYS_memfd_create, "tigr", 0);
+#else
+    static int counter;
+    char name[64];
+    for (int tries = 0; tries < 100; tries++) {
+        snprintf(name, sizeof(name), "/tigr-%d-%d", (int)getpid(), counter++);
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0) {
+            shm_unlink(name);
+            return fd;
+        }
+        if (errno != EEXIST) {
+            break;
+        }
+    }
+    return -1;
+#endif
+}
+
+Tigr* tigrShared(const char* name, int w, int h, int buffers, int flags) {
+    if (w <= 0 || h <= 0 || buffers < 2 || buffers > 3 || (name && strlen(name) >= sizeof(((TigrShared*)0)->name))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    int fd;
+    if (name) {
+        // Replace any leftovers from an earlier run. Consumers still mapping them are not affected.
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    } else {
+        fd = tigrAnonymousShm();
+    }
+    if (fd < 0) {
+        return NULL;
+    }
+
+    size_t size = TIGR_SHARED_OFFSET + (size_t)buffers * w * h * sizeof(TPixel);
+    void* mem = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mem == MAP_FAILED) {
+        int error = errno;
+        close(fd);
+        if (name) {
+            shm_unlink(name);
+        }
+        errno = error;
+        return NULL;
+    }
+
+    TigrSharedHeader* hdr = (TigrSharedHeader*)mem;
+    hdr->w = w;
+    hdr->h = h;
+    hdr->buffers = buffers;
+    hdr->offset = TIGR_SHARED_OFFSET;
+    hdr->latest = -1;
+    hdr->reading = -1;
+    // Consumers check the magic before trusting the rest.
+    __atomic_store_n(&hdr->magic, TIGR_SHARED_MAGIC, __ATOMIC_RELEASE);
+
+    Tigr* bmp = tigrSharedBitmap(mem, size, fd, 1, flags);
+    if (name) {
+        strcpy(bmp->shared->name, name);
+    }
+    return bmp;
+}
+
+int tigrSharedPublish(Tigr* bmp) {
+    TigrShared* s = bmp->shared;
+    if (!s || !s->owner) {
+        errno = EINVAL;
+        return 0;
+    }
+
+    TigrSharedHeader* hdr = s->header;
+    int published = s->current;
+    hdr->frame[published] = ++s->frame;
+    __atomic_store_n(&hdr->latest, published, __ATOMIC_SEQ_CST);
+
+    // Continue in a buffer the consumer can't be holding. The consumer re-checks `latest` after
+    // claiming a buffer, so a claim we don't see here is for a frame it will retry.
+    int next = -1;
+    unsigned long long deadline = tigrTimeNs() + TIGR_SHARED_TIMEOUT * 1000000ull;
+    for (;;) {
+        int reading = __atomic_load_n(&hdr->reading, __ATOMIC_SEQ_CST);
+        for (int i = 0; i < hdr->buffers && next < 0; i++) {
+            if (i != published && i != reading) {
+                next = i;
+            }
+        }
+        if (next >= 0) {
+            break;
+        }
+        // Double buffered, and the consumer holds the other buffer.
+        // It may have died holding it, so don't wait forever.
+        if (tigrTimeNs() > deadline) {
+            errno = ETIMEDOUT;
+            return 0;
+        }
+        sched_yield();
+    }
+
+    TPixel* pix = tigrSharedBuffer(s, next);
+    if (s->flags & TIGR_SHARED_KEEP) {
+        memcpy(pix, bmp->pix, (size_t)bmp->w * bmp->h * sizeof(TPixel));
+    }
+    bmp->pix = pix;
+    s->current = next;
+    return 1;
+}
+
+Tigr* tigrSharedOpen(const char* name, int fd) {
+    if (name) {
+        fd = shm_open(name, O_RDWR, 0);
+        if (fd < 0) {
+            return NULL;
+        }
+    }
+
+    struct stat st;
+    void* mem = MAP_FAILED;
+    if (fstat(fd, &st) == 0) {
+        if (st.st_size >= TIGR_SHARED_OFFSET) {
+            mem = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        } else {
+            errno = EINVAL;
+        }
+    }
+    if (name) {
+        int error = errno;
+        close(fd);
+        errno = error;
+    }
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+
+    TigrSharedHeader* hdr = (TigrSharedHeader*)mem;
+    size_t size = (size_t)st.st_size;
+    if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != TIGR_SHARED_MAGIC || hdr->w <= 0 || hdr->h <= 0 ||
+        hdr->buffers < 2 || hdr->buffers > 3 || hdr->offset < (int)sizeof(TigrSharedHeader) ||
+        hdr->offset + (size_t)hdr->buffers * hdr->w * hdr->h * sizeof(TPixel) > size) {
+        munmap(mem, size);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return tigrSharedBitmap(mem, size, -1, 0, 0);
+}
+
+int tigrSharedAcquire(Tigr* bmp) {
+    TigrShared* s = bmp->shared;
+    if (!s || s->owner) {
+        return 0;
+    }
+
+    // Claim the newest frame, and make sure it still was the newest once claimed.
+    TigrSharedHeader* hdr = s->header;
+    int latest;
+    for (;;) {
+        latest = __atomic_load_n(&hdr->latest, __ATOMIC_SEQ_CST);
+        if (latest < 0 || latest >= hdr->buffers) {
+            return 0;
+        }
+        __atomic_store_n(&hdr->reading, latest, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&hdr->latest, __ATOMIC_SEQ_CST) == latest) {
+            break;
+        }
+    }
 
-        bmp->pix[i].r += (unsigned char)((pix.r - bmp->pix[i].r) * a >> 16);
-        bmp->pix[i].g += (unsigned char)((pix.g - bmp->pix[i].g) * a >> 16);
-        bmp->pix[i].b += (unsigned char)((pix.b - bmp->pix[i].b) * a >> 16);
-        bmp->pix[i].a += (bmp->blitMode) * (unsigned char)((pix.a - bmp->pix[i].a) * a >> 16);
+    s->current = latest;
+    bmp->pix = tigrSharedBuffer(s, latest);
+    if (hdr->frame[latest] == s->frame) {
+        return 0;
     }
+    s->frame = hdr->frame[latest];
+    if (bmp->opacity) {
+        memset(bmp->opacity, 0, bmp->h);
+    }
+    return 1;
 }
 
-void tigrClip(Tigr* bmp, int cx, int cy, int cw, int ch) {
-    bmp->cx = cx;
-    bmp->cy = cy;
-    bmp->cw = cw;
-    bmp->ch = ch;
+int tigrSharedFd(Tigr* bmp) {
+    return bmp->shared ? bmp->shared->fd : -1;
 }
 
-void tigrBlit(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h) {
-    int cw = dst->cw >= 0 ? dst->cw : dst->w;
-    int ch = dst->ch >= 0 ? dst->ch : dst->h;
+void tigrSharedFree(Tigr* bmp) {
+    TigrShared* s = bmp->shared;
+    if (!s->owner && s->current >= 0) {
+        __atomic_store_n(&s->header->reading, -1, __ATOMIC_SEQ_CST);
+    }
+    munmap(s->header, s->size);
+    if (s->fd >= 0) {
+        close(s->fd);
+    }
+    if (s->name[0]) {
+        shm_unlink(s->name);
+    }
+}
 
-    CLIP();
+#else
 
-    TPixel* ts = &src->pix[sy * src->w + sx];
-    TPixel* td = &dst->pix[dy * dst->w + dx];
-    int st = src->w;
-    int dt = dst->w;
-    do {
-        memcpy(td, ts, w * sizeof(TPixel));
-        ts += st;
-        td += dt;
-    } while (--h);
+Tigr* tigrShared(const char* name, int w, int h, int buffers, int flags) {
+    errno = ENOSYS;
+    return NULL;
 }
 
-void tigrBlitTint(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint) {
-    int cw = dst->cw >= 0 ? dst->cw : dst->w;
-    int ch = dst->ch >= 0 ? dst->ch : dst->h;
-
-    CLIP();
+int tigrSharedPublish(Tigr* bmp) {
+    errno = ENOSYS;
+    return 0;
+}
 
-    int xr = EXPAND(tint.r);
-    int xg = EXPAND(tint.g);
-    int xb = EXPAND(tint.b);
-    int xa = EXPAND(tint.a);
+Tigr* tigrSharedOpen(const char* name, int fd) {
+    errno = ENOSYS;
+    return NULL;
+}
 
-    TPixel* ts = &src->pix[sy * src->w + sx];
-    TPixel* td = &dst->pix[dy * dst->w + dx];
-    int st = src->w;
-    int dt = dst->w;
-    do {
-        for (int x = 0; x < w; x++) {
-            unsigned r = (xr * ts[x].r) >> 8;
-            unsigned g = (xg * ts[x].g) >> 8;
-            unsigned b = (xb * ts[x].b) >> 8;
-            unsigned a = xa * EXPAND(ts[x].a);
-            td[x].r += (unsigned char)((r - td[x].r) * a >> 16);
-            td[x].g += (unsigned char)((g - td[x].g) * a >> 16);
-            td[x].b += (unsigned char)((b - td[x].b) * a >> 16);
-            td[x].a += (dst->blitMode) * (unsigned char)((ts[x].a - td[x].a) * a >> 16);
-        }
-        ts += st;
-        td += dt;
-    } while (--h);
+int tigrSharedAcquire(Tigr* bmp) {
+    return 0;
 }
 
-void tigrBlitAlpha(Tigr* dst, Tigr* src, int dx, int dy, int sx, int sy, int w, int h, float alpha) {
-    alpha = (alpha < 0) ? 0 : (alpha > 1 ? 1 : alpha);
-    tigrBlitTint(dst, src, dx, dy, sx, sy, w, h, tigrRGBA(0xff, 0xff, 0xff, (unsigned char)(alpha * 255)));
+int tigrSharedFd(Tigr* bmp) {
+    return -1;
 }
 
-void tigrBlitMode(Tigr* dst, int mode) {
-    dst->blitMode = mode;
+void tigrSharedFree(Tigr* bmp) {
 }
 
-#undef CLIP0
-#undef CLIP1
-#undef CLIP
+#endif
 
-//////// End of inlined file: tigr_bitmaps.c ////////
+//////// End of inlined file: tigr_shared.c ////////
 
 //////// Start of inlined file: tigr_loadpng.c ////////
 
@@ -733,45 +2892,61 @@ static int unfilter(int w, int h, int bipp, unsigned char* raw) {
     return 1;
 }
 
-static void convert(int bypp, int w, int h, const unsigned char* src, TPixel* dest, const unsigned char* trns) {
+static void convert(int bypp, int w, int h, const unsigned char* src, TPixel* dest, const unsigned char* trns,
+                    int premultiply) {
     int x, y;
     for (y = 0; y < h; y++) {
         src++;  // skip filter byte
         for (x = 0; x < w; x++, src += bypp) {
+            TPixel p;
             switch (bypp) {
                 case 1: {
                     unsigned char c = src[0];
                     if (trns && c == *trns) {
-                        *dest++ = tigrRGBA(c, c, c, 0);
+                        p = tigrRGBA(c, c, c, 0);
                         break;
                     } else {
-                        *dest++ = tigrRGB(c, c, c);
+                        p = tigrRGB(c, c, c);
                         break;
                     }
                 }
                 case 2:
-                    *dest++ = tigrRGBA(src[0], src[0], src[0], src[1]);
+                    p = tigrRGBA(src[0], src[0], src[0], src[1]);
                     break;
                 case 3: {
                     unsigned char r = src[0];
                     unsigned char g = src[1];
                     unsigned char b = src[2];
                     if (trns && trns[1] == r && trns[3] == g && trns[5] == b) {
-                        *dest++ = tigrRGBA(r, g, b, 0);
+                        p = tigrRGBA(r, g, b, 0);
                         break;
                     } else {
-                        *dest++ = tigrRGB(r, g, b);
+                        p = tigrRGB(r, g, b);
                         break;
                     }
                 }
-                case 4:
-                    *dest++ = tigrRGBA(src[0], src[1], src[2], src[3]);
+                default:
+                    p = tigrRGBA(src[0], src[1], src[2], src[3]);
                     break;
             }
+            if (premultiply && p.a != 255) {
+                p = tigrPremultiplyPixel(p);
+            }
+            *dest++ = p;
         }
     }
 }
 
+// Reads PLTE and tRNS into 256 colors. Colors missing from the file are transparent black.
+static void readPalette(TPixel palette[256], const unsigned char* plte, const unsigned char* trns, int trnsSize) {
+    int colors = get32(plte - 8) / 3;
+    memset(palette, 0, 256 * sizeof(TPixel));
+    for (int c = 0; c < colors && c < 256; c++) {
+        unsigned char alpha = c < trnsSize ? trns[c] : 255;
+        palette[c] = tigrRGBA(plte[c * 3 + 0], plte[c * 3 + 1], plte[c * 3 + 2], alpha);
+    }
+}
+
 static void depalette(int w,
                       int h,
                       unsigned char* src,
@@ -779,10 +2954,19 @@ static void depalette(int w,
                       int bipp,
                       const unsigned char* plte,
                       const unsigned char* trns,
-                      int trnsSize) {
+                      int trnsSize,
+                      int premultiply) {
     int x, y, c;
-    unsigned char alpha;
     int mask = 0, len = 0;
+    TPixel palette[256];
+
+    // Colors are looked up ready to use, premultiplied if asked to.
+    readPalette(palette, plte, trns, trnsSize);
+    if (premultiply) {
+        for (c = 0; c < 256; c++) {
+            palette[c] = tigrPremultiplyPixel(palette[c]);
+        }
+    }
 
     switch (bipp) {
         case 4:
@@ -810,11 +2994,11 @@ static void depalette(int w,
                     src++;
                 }
             }
-            alpha = 255;
-            if (c < trnsSize) {
-                alpha = trns[c];
-            }
-            *dest++ = tigrRGBA(plte[c * 3 + 0], plte[c * 3 + 1], plte[c * 3 + 2], alpha);
+            *dest++ = palette[c];
+        }
+        // Rows start on a byte boundary.
+        if (bipp < 8 && (w & len)) {
+            src++;
         }
     }
 }
@@ -828,18 +3012,25 @@ static void depalette(int w,
     if (!(X))    \
     FAIL()
 
-static int outsize(Tigr* bmp, int bipp) {
-    return (rowBytes(bmp->w, bipp) + 1) * bmp->h;
+static int outsize(int w, int h, int bipp) {
+    return (rowBytes(w, bipp) + 1) * h;
 }
 
-static Tigr* tigrLoadPng(PNG* png) {
-    const unsigned char *ihdr, *idat, *plte, *trns, *first;
-    int trnsSize = 0;
+// Chunks and image data of a PNG file.
+typedef struct {
+    int w, h;
     int depth, ctype, bipp;
-    int datalen = 0;
-    unsigned char *data = NULL, *out;
-    Tigr* bmp = NULL;
+    const unsigned char *plte, *trns;
+    int trnsSize;
+    unsigned char* data;  // Joined IDAT chunks
+    int datalen;
+} PNGImage;
 
+// Reads the chunks of a PNG file. Frees img->data on error.
+static int readPng(PNG* png, PNGImage* img) {
+    const unsigned char *ihdr, *idat, *first;
+
+    memset(img, 0, sizeof(PNGImage));
     CHECK(memcmp(png->p, "\211PNG\r\n\032\n", 8) == 0);  // PNG signature
     png->p += 8;
     first = png->p;
@@ -847,98 +3038,157 @@ static Tigr* tigrLoadPng(PNG* png) {
     // Read IHDR
     ihdr = find(png, "IHDR", 13);
     CHECK(ihdr);
-    depth = ihdr[8];
-    ctype = ihdr[9];
-    switch (ctype) {
+    img->w = get32(ihdr + 0);
+    img->h = get32(ihdr + 4);
+    img->depth = ihdr[8];
+    img->ctype = ihdr[9];
+    switch (img->ctype) {
         case 0:
-            bipp = depth;
+            img->bipp = img->depth;
             break;  // greyscale
         case 2:
-            bipp = 3 * depth;
+            img->bipp = 3 * img->depth;
             break;  // RGB
         case 3:
-            bipp = depth;
+            img->bipp = img->depth;
             break;  // paletted
         case 4:
-            bipp = 2 * depth;
+            img->bipp = 2 * img->depth;
             break;  // grey+alpha
         case 6:
-            bipp = 4 * depth;
+            img->bipp = 4 * img->depth;
             break;  // RGBA
         default:
             FAIL();
     }
 
-    // Allocate bitmap (+1 width to save room for stupid PNG filter bytes)
-    bmp = tigrBitmap(get32(ihdr + 0) + 1, get32(ihdr + 4));
-    CHECK(bmp);
-    bmp->w--;
-
     // We support 8-bit color components and 1, 2, 4 and 8 bit palette formats.
     // No interlacing, or wacky filter types.
-    CHECK((depth != 16) && ihdr[10] == 0 && ihdr[11] == 0 && ihdr[12] == 0);
+    CHECK((img->depth != 16) && ihdr[10] == 0 && ihdr[11] == 0 && ihdr[12] == 0);
 
     // Join IDAT chunks.
     for (idat = find(png, "IDAT", 0); idat; idat = find(png, "IDAT", 0)) {
         unsigned len = get32(idat - 8);
-        data = (unsigned char*)realloc(data, datalen + len);
-        if (!data)
-            break;
-
-        memcpy(data + datalen, idat, len);
-        datalen += len;
+        unsigned char* data = (unsigned char*)realloc(img->data, img->datalen + len);
+        CHECK(data);
+        img->data = data;
+        memcpy(img->data + img->datalen, idat, len);
+        img->datalen += len;
     }
 
     // Find palette.
     png->p = first;
-    plte = find(png, "PLTE", 0);
+    img->plte = find(png, "PLTE", 0);
 
     // Find transparency info.
     png->p = first;
-    trns = find(png, "tRNS", 0);
-    if (trns) {
-        trnsSize = get32(trns - 8);
+    img->trns = find(png, "tRNS", 0);
+    if (img->trns) {
+        img->trnsSize = get32(img->trns - 8);
+    }
+
+    CHECK(img->data && img->datalen >= 6);
+    CHECK((img->data[0] & 0x0f) == 0x08     // compression method (RFC 1950)
+          && (img->data[0] & 0xf0) <= 0x70  // window size
+          && (img->data[1] & 0x20) == 0);   // preset dictionary present
+    return 1;
+
+err:
+    free(img->data);
+    img->data = NULL;
+    return 0;
+}
+
+// Inflates and unfilters the image data into out, each row starting with its filter byte.
+static int decodePng(PNGImage* img, unsigned char* out) {
+    return tigrInflate(out, outsize(img->w, img->h, img->bipp), img->data + 2, img->datalen - 6) &&
+           unfilter(img->w, img->h, img->bipp, out);
+}
+
+static Tigr* tigrLoadPng(PNG* png, int premultiply) {
+    PNGImage img;
+    unsigned char* out;
+    Tigr* bmp = NULL;
+
+    if (!readPng(png, &img)) {
+        return NULL;
     }
 
-    CHECK(data && datalen >= 6);
-    CHECK((data[0] & 0x0f) == 0x08     // compression method (RFC 1950)
-          && (data[0] & 0xf0) <= 0x70  // window size
-          && (data[1] & 0x20) == 0);   // preset dictionary present
+    // Allocate bitmap (+1 width to save room for stupid PNG filter bytes)
+    // Decoding writes every pixel, so there is no need to clear the bitmap first.
+    bmp = tigrBitmapUninit(img.w + 1, img.h);
+    CHECK(bmp);
+    bmp->w--;
+    bmp->stride = bmp->w;
 
-    out = (unsigned char*)bmp->pix + outsize(bmp, 32) - outsize(bmp, bipp);
-    CHECK(tigrInflate(out, outsize(bmp, bipp), data + 2, datalen - 6));
-    CHECK(unfilter(bmp->w, bmp->h, bipp, out));
+    out = (unsigned char*)bmp->pix + outsize(bmp->w, bmp->h, 32) - outsize(bmp->w, bmp->h, img.bipp);
+    CHECK(decodePng(&img, out));
 
-    if (ctype == 3) {
-        CHECK(plte);
-        depalette(bmp->w, bmp->h, out, bmp->pix, bipp, plte, trns, trnsSize);
+    if (img.ctype == 3) {
+        CHECK(img.plte);
+        depalette(bmp->w, bmp->h, out, bmp->pix, img.bipp, img.plte, img.trns, img.trnsSize, premultiply);
     } else {
-        CHECK(bipp % 8 == 0);
-        convert(bipp / 8, bmp->w, bmp->h, out, bmp->pix, trns);
+        CHECK(img.bipp % 8 == 0);
+        convert(img.bipp / 8, bmp->w, bmp->h, out, bmp->pix, img.trns, premultiply);
+    }
+    if (premultiply) {
+        bmp->flags |= TIGR_BITMAP_PREMULTIPLIED;
     }
 
-    free(data);
+    free(img.data);
     return bmp;
 
 err:
-    if (data)
-        free(data);
+    free(img.data);
     if (bmp)
         tigrFree(bmp);
     return NULL;
 }
 
+// Keeps the indices of a paletted PNG, instead of looking up their colors.
+static TigrIndexed* tigrLoadIndexedPng(PNG* png) {
+    PNGImage img;
+    unsigned char* out = NULL;
+    TigrIndexed* bmp = NULL;
+
+    if (!readPng(png, &img)) {
+        return NULL;
+    }
+    CHECK(img.ctype == 3 && img.plte);
+
+    bmp = tigrIndexed(img.w, img.h, img.depth);
+    out = (unsigned char*)malloc(outsize(img.w, img.h, img.bipp));
+    CHECK(bmp && out);
+    CHECK(decodePng(&img, out));
+
+    // PNG rows are packed the same way, after their filter byte.
+    for (int y = 0; y < img.h; y++) {
+        memcpy(bmp->data + y * bmp->stride, out + y * (bmp->stride + 1) + 1, bmp->stride);
+    }
+    readPalette(bmp->palette, img.plte, img.trns, img.trnsSize);
+
+    free(out);
+    free(img.data);
+    return bmp;
+
+err:
+    free(out);
+    free(img.data);
+    tigrFreeIndexed(bmp);
+    return NULL;
+}
+
 #undef CHECK
 #undef FAIL
 
-Tigr* tigrLoadImageMem(const void* data, int length) {
+static Tigr* tigrLoadPngMem(const void* data, int length, int premultiply) {
     PNG png;
     png.p = (unsigned char*)data;
     png.end = (unsigned char*)data + length;
-    return tigrLoadPng(&png);
+    return tigrLoadPng(&png, premultiply);
 }
 
-Tigr* tigrLoadImage(const char* fileName) {
+static Tigr* tigrLoadPngFile(const char* fileName, int premultiply) {
     int len;
     void* data;
     Tigr* bmp;
@@ -947,7 +3197,44 @@ Tigr* tigrLoadImage(const char* fileName) {
     if (!data)
         return NULL;
 
-    bmp = tigrLoadImageMem(data, len);
+    bmp = tigrLoadPngMem(data, len, premultiply);
+    free(data);
+    return bmp;
+}
+
+Tigr* tigrLoadImageMem(const void* data, int length) {
+    return tigrLoadPngMem(data, length, 0);
+}
+
+Tigr* tigrLoadImage(const char* fileName) {
+    return tigrLoadPngFile(fileName, 0);
+}
+
+Tigr* tigrLoadImageMemPremultiplied(const void* data, int length) {
+    return tigrLoadPngMem(data, length, 1);
+}
+
+Tigr* tigrLoadImagePremultiplied(const char* fileName) {
+    return tigrLoadPngFile(fileName, 1);
+}
+
+TigrIndexed* tigrLoadIndexedMem(const void* data, int length) {
+    PNG png;
+    png.p = (unsigned char*)data;
+    png.end = (unsigned char*)data + length;
+    return tigrLoadIndexedPng(&png);
+}
+
+TigrIndexed* tigrLoadIndexed(const char* fileName) {
+    int len;
+    void* data;
+    TigrIndexed* bmp;
+
+    data = tigrReadFile(fileName, &len);
+    if (!data)
+        return NULL;
+
+    bmp = tigrLoadIndexedMem(data, len);
     free(data);
     return bmp;
 }
@@ -1092,17 +3379,20 @@ static long savePngData(Save* s, Tigr* bmp, long dataPos) {
     put(s, 0x08);      // zlib compression method
     put(s, 0x1d);      // zlib compression flags
     putbits(s, 3, 3);  // zlib last block + fixed dictionary
+    int premultiplied = bmp->flags & TIGR_BITMAP_PREMULTIPLIED;
     for (y = 0; y < bmp->h; y++) {
-        TPixel* row = &bmp->pix[y * bmp->w];
+        TPixel* row = &bmp->pix[y * bmp->stride];
         TPixel prev = tigrRGBA(0, 0, 0, 0);
 
         encodeByte(s, 1);  // sub filter
         for (x = 0; x < bmp->w; x++) {
-            encodeByte(s, row[x].r - prev.r);
-            encodeByte(s, row[x].g - prev.g);
-            encodeByte(s, row[x].b - prev.b);
-            encodeByte(s, row[x].a - prev.a);
-            prev = row[x];
+            // PNG stores straight alpha.
+            TPixel p = premultiplied ? tigrUnpremultiplyPixel(row[x]) : row[x];
+            encodeByte(s, p.r - prev.r);
+            encodeByte(s, p.g - prev.g);
+            encodeByte(s, p.b - prev.b);
+            encodeByte(s, p.a - prev.a);
+            prev = p;
         }
     }
     endrun(s);
@@ -1661,6 +3951,10 @@ int tigr_font_size = (int)sizeof(tigr_font);
 #include <stdarg.h>
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 #ifdef _MSC_VER
 #define vsnprintf _vsnprintf
@@ -1683,22 +3977,22 @@ static int cp1252[] = {
     0x00f5, 0x00f6, 0x00f7, 0x00f8, 0x00f9, 0x00fa, 0x00fb, 0x00fc, 0x00fd, 0x00fe, 0x00ff,
 };
 
-static int border(Tigr* bmp, int x, int y) {
-    TPixel top = tigrGet(bmp, 0, 0);
-    TPixel c = tigrGet(bmp, x, y);
-    return (c.r == top.r && c.g == top.g && c.b == top.b) || x >= bmp->w || y >= bmp->h;
+static int border(TPixel c, TPixel top) {
+    return c.r == top.r && c.g == top.g && c.b == top.b;
 }
 
-static void scan(Tigr* bmp, int* x, int* y, int* rowh) {
+// Finds the top left corner of the next glyph, scanning row by row.
+static void scan(Tigr* bmp, TPixel top, int* x, int* y, int* rowh) {
     while (*y < bmp->h) {
-        if (*x >= bmp->w) {
-            *x = 0;
-            (*y) += *rowh;
-            *rowh = 1;
+        TPixel* row = &bmp->pix[*y * bmp->stride];
+        while (*x < bmp->w) {
+            if (!border(row[*x], top))
+                return;
+            (*x)++;
         }
-        if (!border(bmp, *x, *y))
-            return;
-        (*x)++;
+        *x = 0;
+        (*y) += *rowh;
+        *rowh = 1;
     }
 }
 
@@ -1728,6 +4022,22 @@ static int readWatermark(Tigr* bmp, int x, int y, int* big, int* small) {
     return 1;
 }
 
+static int compareGlyphs(const void* a, const void* b) {
+    int ca = ((const TigrGlyph*)a)->code;
+    int cb = ((const TigrGlyph*)b)->code;
+    return (ca > cb) - (ca < cb);
+}
+
+// Sorts glyphs by code point, unless they already are.
+static void sortGlyphs(TigrFont* font) {
+    for (int i = 1; i < font->numGlyphs; i++) {
+        if (font->glyphs[i - 1].code > font->glyphs[i].code) {
+            qsort(font->glyphs, font->numGlyphs, sizeof(TigrGlyph), compareGlyphs);
+            return;
+        }
+    }
+}
+
 int tigrLoadGlyphs(TigrFont* font, int codepage) {
     int x = 0;
     int y = 0;
@@ -1735,6 +4045,9 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
     int h = 0;
     int rowh = 1;
 
+    Tigr* bmp = font->bitmap;
+    TPixel top = bmp->pix[0];
+
     TigrGlyph* g;
     switch (codepage) {
         case TCP_ASCII:
@@ -1744,7 +4057,8 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
             font->numGlyphs = 256 - 32;
             break;
         case TCP_UTF32:
-            if (!readWatermark(font->bitmap, 0, 0, &font->numGlyphs, &rowh)) {
+            if (!readWatermark(bmp, 0, 0, &font->numGlyphs, &rowh) || font->numGlyphs <= 0) {
+                errno = EINVAL;
                 return 0;
             }
             h = rowh;
@@ -1763,20 +4077,22 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
 
         if (codepage != TCP_UTF32) {
             // Find the next glyph.
-            scan(font->bitmap, &x, &y, &rowh);
+            scan(bmp, top, &x, &y, &rowh);
 
-            if (y >= font->bitmap->h) {
+            if (y >= bmp->h) {
                 errno = EINVAL;
                 return 0;
             }
 
             // Scan the width and height
+            TPixel* p = &bmp->pix[y * bmp->stride + x];
             w = h = 0;
-            while (!border(font->bitmap, x + w, y)) {
+            while (x + w < bmp->w && !border(p[w], top)) {
                 w++;
             }
 
-            while (!border(font->bitmap, x, y + h)) {
+            while (y + h < bmp->h && !border(*p, top)) {
+                p += bmp->stride;
                 h++;
             }
         }
@@ -1793,11 +4109,12 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
                 }
                 break;
             case TCP_UTF32:
-                if (!readWatermark(font->bitmap, x, y, &g->code, &w)) {
+                if (!readWatermark(bmp, x, y, &g->code, &w)) {
                     // Maybe we are at the end of a row?
                     x = 0;
                     y += rowh;
-                    if (!readWatermark(font->bitmap, x, y, &g->code, &w)) {
+                    if (!readWatermark(bmp, x, y, &g->code, &w)) {
+                        errno = EINVAL;
                         return 0;
                     }
                 }
@@ -1811,6 +4128,7 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
         g->y = y;
         g->w = w;
         g->h = h;
+        g->advance = w;
         x += w;
         if (h != font->glyphs[0].h) {
             errno = EINVAL;
@@ -1822,20 +4140,171 @@ int tigrLoadGlyphs(TigrFont* font, int codepage) {
         }
     }
 
-    // Sort by code point.
-    for (int i = 1; i < font->numGlyphs; i++) {
-        int j = i;
-        TigrGlyph g = font->glyphs[i];
-        while (j > 0 && font->glyphs[j - 1].code > g.code) {
-            font->glyphs[j] = font->glyphs[j - 1];
-            j--;
+    sortGlyphs(font);
+    return 1;
+}
+
+/*
+ * Glyph metrics sidecar files start with the magic "TFNT" and a version
+ * number, followed by chunks of a four character id, a byte length and
+ * the chunk data. All numbers are 32-bit little endian.
+ *
+ * "GLYF" - code, x, y, w, h for each glyph, sorted by code point
+ * "ADVN" - bearing, advance for each glyph, in "GLYF" order (optional)
+ * "KERN" - left, right, amount for each kerning pair (optional)
+ *
+ * Unknown chunks are skipped.
+ */
+#define METRICS_VERSION 1
+
+static unsigned getLE32(const unsigned char* v) {
+    return v[0] | (v[1] << 8) | (v[2] << 16) | ((unsigned)v[3] << 24);
+}
+
+static void putLE32(FILE* out, unsigned v) {
+    fputc(v & 0xff, out);
+    fputc((v >> 8) & 0xff, out);
+    fputc((v >> 16) & 0xff, out);
+    fputc((v >> 24) & 0xff, out);
+}
+
+static int loadGlyphMetrics(TigrFont* font, const unsigned char* p, const unsigned char* end) {
+    if (end - p < 8 || memcmp(p, "TFNT", 4) != 0 || getLE32(p + 4) != METRICS_VERSION) {
+        return 0;
+    }
+    p += 8;
+
+    while (end - p >= 8) {
+        unsigned len = getLE32(p + 4);
+        const unsigned char* data = p + 8;
+        if (len > (unsigned)(end - data)) {
+            return 0;
+        }
+        const unsigned char* next = data + len;
+
+        if (memcmp(p, "GLYF", 4) == 0 && !font->glyphs) {
+            if (len == 0 || len % 20 != 0) {
+                return 0;
+            }
+            font->numGlyphs = len / 20;
+            font->glyphs = (TigrGlyph*)calloc(font->numGlyphs, sizeof(TigrGlyph));
+            for (int i = 0; i < font->numGlyphs; i++, data += 20) {
+                TigrGlyph* g = &font->glyphs[i];
+                g->code = getLE32(data + 0);
+                g->x = getLE32(data + 4);
+                g->y = getLE32(data + 8);
+                g->w = getLE32(data + 12);
+                g->h = getLE32(data + 16);
+                g->advance = g->w;
+                if (g->x < 0 || g->y < 0 || g->w < 0 || g->h < 0 || g->x > font->bitmap->w ||
+                    g->y > font->bitmap->h || g->w > font->bitmap->w - g->x || g->h > font->bitmap->h - g->y) {
+                    return 0;
+                }
+            }
+        } else if (memcmp(p, "ADVN", 4) == 0) {
+            if (!font->glyphs || len != (unsigned)font->numGlyphs * 8) {
+                return 0;
+            }
+            for (int i = 0; i < font->numGlyphs; i++, data += 8) {
+                font->glyphs[i].bearing = (int)getLE32(data + 0);
+                font->glyphs[i].advance = (int)getLE32(data + 4);
+            }
+        } else if (memcmp(p, "KERN", 4) == 0) {
+            if (len % 12 != 0) {
+                return 0;
+            }
+            int numPairs = len / 12;
+            TigrKerningPair* pairs = (TigrKerningPair*)malloc(numPairs * sizeof(TigrKerningPair));
+            for (int i = 0; i < numPairs; i++, data += 12) {
+                pairs[i].left = getLE32(data + 0);
+                pairs[i].right = getLE32(data + 4);
+                pairs[i].amount = (int)getLE32(data + 8);
+            }
+            tigrSetFontKerning(font, pairs, numPairs);
+            free(pairs);
         }
-        font->glyphs[j] = g;
+
+        p = next;
     }
 
+    if (!font->glyphs) {
+        return 0;
+    }
+
+    sortGlyphs(font);
     return 1;
 }
 
+TigrFont* tigrLoadFontMetrics(Tigr* bitmap, const void* data, int length) {
+    TigrFont* font = (TigrFont*)calloc(1, sizeof(TigrFont));
+    font->bitmap = bitmap;
+    if (!loadGlyphMetrics(font, (const unsigned char*)data, (const unsigned char*)data + length)) {
+        errno = EINVAL;
+        tigrFreeFont(font);
+        return NULL;
+    }
+    return font;
+}
+
+int tigrSaveFontMetrics(const char* fileName, TigrFont* font) {
+    FILE* out = fopen(fileName, "wb");
+    if (!out)
+        return 0;
+
+    tigrSetupFont(font);
+
+    fwrite("TFNT", 4, 1, out);
+    putLE32(out, METRICS_VERSION);
+
+    fwrite("GLYF", 4, 1, out);
+    putLE32(out, font->numGlyphs * 20);
+    for (int i = 0; i < font->numGlyphs; i++) {
+        TigrGlyph* g = &font->glyphs[i];
+        putLE32(out, g->code);
+        putLE32(out, g->x);
+        putLE32(out, g->y);
+        putLE32(out, g->w);
+        putLE32(out, g->h);
+    }
+
+    int hasAdvances = 0;
+    for (int i = 0; i < font->numGlyphs; i++) {
+        TigrGlyph* g = &font->glyphs[i];
+        hasAdvances |= g->bearing != 0 || g->advance != g->w;
+    }
+
+    if (hasAdvances) {
+        fwrite("ADVN", 4, 1, out);
+        putLE32(out, font->numGlyphs * 8);
+        for (int i = 0; i < font->numGlyphs; i++) {
+            putLE32(out, font->glyphs[i].bearing);
+            putLE32(out, font->glyphs[i].advance);
+        }
+    }
+
+    if (font->kerning) {
+        int numPairs = 0;
+        for (int i = 0; i <= font->kerningMask; i++) {
+            numPairs += font->kerning[i].amount != 0;
+        }
+
+        fwrite("KERN", 4, 1, out);
+        putLE32(out, numPairs * 12);
+        for (int i = 0; i <= font->kerningMask; i++) {
+            TigrKerningPair* k = &font->kerning[i];
+            if (k->amount != 0) {
+                putLE32(out, k->left);
+                putLE32(out, k->right);
+                putLE32(out, k->amount);
+            }
+        }
+    }
+
+    int err = ferror(out);
+    fclose(out);
+    return !err;
+}
+
 TigrFont* tigrLoadFont(Tigr* bitmap, int codepage) {
     TigrFont* font = (TigrFont*)calloc(1, sizeof(TigrFont));
     font->bitmap = bitmap;
@@ -1849,10 +4318,68 @@ TigrFont* tigrLoadFont(Tigr* bitmap, int codepage) {
 void tigrFreeFont(TigrFont* font) {
     tigrFree(font->bitmap);
     free(font->glyphs);
+    free(font->kerning);
     free(font);
 }
 
-static TigrGlyph* get(TigrFont* font, int code) {
+static unsigned hashPair(int left, int right) {
+    return ((unsigned)left * 0x9e3779b1u) ^ ((unsigned)right * 0x85ebca77u);
+}
+
+void tigrSetFontKerning(TigrFont* font, const TigrKerningPair* pairs, int numPairs) {
+    free(font->kerning);
+    font->kerning = NULL;
+    font->kerningMask = 0;
+
+    // Open addressing, kept at most half full so that probing stays short
+    // and always finds an empty slot.
+    unsigned size = 1;
+    while (size < 2 * (unsigned)numPairs) {
+        size *= 2;
+    }
+
+    TigrKerningPair* table = (TigrKerningPair*)calloc(size, sizeof(TigrKerningPair));
+    int used = 0;
+
+    for (int i = 0; i < numPairs; i++) {
+        const TigrKerningPair* pair = &pairs[i];
+        if (pair->amount == 0) {
+            continue;
+        }
+        for (unsigned h = hashPair(pair->left, pair->right);; h++) {
+            TigrKerningPair* k = &table[h & (size - 1)];
+            if (k->amount == 0) {
+                *k = *pair;
+                used++;
+                break;
+            }
+            if (k->left == pair->left && k->right == pair->right) {
+                k->amount = pair->amount;
+                break;
+            }
+        }
+    }
+
+    if (used == 0) {
+        free(table);
+        return;
+    }
+
+    font->kerning = table;
+    font->kerningMask = size - 1;
+}
+
+// Returns the kerning between two code points. Empty slots have a zero amount.
+static int kerning(TigrFont* font, int left, int right) {
+    for (unsigned h = hashPair(left, right);; h++) {
+        TigrKerningPair* k = &font->kerning[h & font->kerningMask];
+        if (k->amount == 0 || (k->left == left && k->right == right)) {
+            return k->amount;
+        }
+    }
+}
+
+static TigrGlyph* findGlyph(TigrFont* font, int code) {
     unsigned lo = 0, hi = font->numGlyphs;
     while (lo < hi) {
         unsigned guess = (lo + hi) / 2;
@@ -1863,16 +4390,48 @@ static TigrGlyph* get(TigrFont* font, int code) {
     }
 
     if (lo == 0 || font->glyphs[lo - 1].code != code)
-        return &font->glyphs['?' - 32];
+        return NULL;
     else
         return &font->glyphs[lo - 1];
 }
 
+// Unknown code points are drawn as '?', or the first glyph if the font has none.
+static TigrGlyph* get(TigrFont* font, int code) {
+    TigrGlyph* g = findGlyph(font, code);
+    if (!g) {
+        g = findGlyph(font, '?');
+    }
+    return g ? g : &font->glyphs[0];
+}
+
+static void loadStockFont(void) {
+    tigrStockFont.bitmap = tigrLoadImageMem(tigr_font, tigr_font_size);
+    tigrLoadGlyphs(&tigrStockFont, 1252);
+}
+
+#ifdef _WIN32
+static INIT_ONCE stockFontOnce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK loadStockFontOnce(PINIT_ONCE once, PVOID param, PVOID* context) {
+    loadStockFont();
+    return TRUE;
+}
+#else
+static pthread_once_t stockFontOnce = PTHREAD_ONCE_INIT;
+#endif
+
+void tigrPreloadFonts(void) {
+#ifdef _WIN32
+    InitOnceExecuteOnce(&stockFontOnce, loadStockFontOnce, NULL, NULL);
+#else
+    pthread_once(&stockFontOnce, loadStockFont);
+#endif
+}
+
 void tigrSetupFont(TigrFont* font) {
     // Load the stock font if needed.
-    if (font == tfont && !tfont->bitmap) {
-        tfont->bitmap = tigrLoadImageMem(tigr_font, tigr_font_size);
-        tigrLoadGlyphs(tfont, 1252);
+    if (font == tfont) {
+        tigrPreloadFonts();
     }
 }
 
@@ -1881,9 +4440,10 @@ void tigrPrint(Tigr* dest, TigrFont* font, int x, int y, TPixel color, const cha
     TigrGlyph* g;
     va_list args;
     const char* p;
-    int start = x, c;
+    int start = x, c, prev = 0;
 
     tigrSetupFont(font);
+    int rowh = get(font, 0)->h;
 
     // Expand the formatting string.
     va_start(args, text);
@@ -1899,26 +4459,36 @@ void tigrPrint(Tigr* dest, TigrFont* font, int x, int y, TPixel color, const cha
             continue;
         if (c == '\n') {
             x = start;
-            y += tigrTextHeight(font, "");
+            y += rowh;
+            prev = 0;
             continue;
         }
         g = get(font, c);
-        tigrBlitTint(dest, font->bitmap, x, y, g->x, g->y, g->w, g->h, color);
-        x += g->w;
+        if (font->kerning && prev) {
+            x += kerning(font, prev, c);
+        }
+        tigrBlitTint(dest, font->bitmap, x + g->bearing, y, g->x, g->y, g->w, g->h, color);
+        x += g->advance;
+        prev = c;
     }
 }
 
 int tigrTextWidth(TigrFont* font, const char* text) {
-    int x = 0, w = 0, c;
+    int x = 0, w = 0, c, prev = 0;
     tigrSetupFont(font);
 
     while (*text) {
         text = tigrDecodeUTF8(text, &c);
         if (c == '\n' || c == '\r') {
             x = 0;
+            prev = 0;
         } else {
-            x += get(font, c)->w;
+            if (font->kerning && prev) {
+                x += kerning(font, prev, c);
+            }
+            x += get(font, c)->advance;
             w = (x > w) ? x : w;
+            prev = c;
         }
     }
     return w;
@@ -2113,6 +4683,7 @@ void tigrUpdate(Tigr* bmp) {
     RECT rc;
     int dw, dh;
     TigrInternal* win = tigrInternal(bmp);
+    tigrFrameBegin(win);
 
     if (!win->shown) {
         win->shown = 1;
@@ -2129,8 +4700,12 @@ void tigrUpdate(Tigr* bmp) {
     tigrWinUpdateWidgets(bmp, dw, dh);
 
     if (!tigrGAPIBegin(bmp)) {
+        tigrFrameStage(win, TIGR_STAGE_INPUT);
         tigrGAPIPresent(bmp, dw, dh);
+        tigrFrameStage(win, TIGR_STAGE_DRAW);
         SwapBuffers(win->gl.dc);
+        tigrFrameStage(win, TIGR_STAGE_SWAP);
+        tigrFrameWait(win);
         tigrGAPIEnd(bmp);
     }
 
@@ -2146,11 +4721,22 @@ void tigrUpdate(Tigr* bmp) {
         TranslateMessage(&msg);
         DispatchMessage(&msg);
     }
+    tigrFrameEnd(win, TIGR_STAGE_INPUT);
 }
 
 typedef BOOL(APIENTRY* PFNWGLSWAPINTERVALFARPROC_)(int);
 static PFNWGLSWAPINTERVALFARPROC_ wglSwapIntervalEXT_ = 0;
 
+int tigrSetSwapInterval(Tigr* bmp, int interval) {
+    int ok = 0;
+    if (wglSwapIntervalEXT_ && !tigrGAPIBegin(bmp)) {
+        // Negative intervals need WGL_EXT_swap_control_tear, the driver refuses them otherwise.
+        ok = wglSwapIntervalEXT_(interval) != 0;
+        tigrGAPIEnd(bmp);
+    }
+    return ok;
+}
+
 int tigrGAPIBegin(Tigr* bmp) {
     TigrInternal* win = tigrInternal(bmp);
 
@@ -2479,10 +5065,15 @@ void tigrFree(Tigr* bmp) {
         win->gl.dc = NULL;
 
         DestroyWindow((HWND)bmp->handle);
+        if (win->limiter.timer) {
+            CloseHandle(win->limiter.timer);
+        }
         free(win->wtitle);
         tigrFree(win->widgets);
     }
-    free(bmp->pix);
+    free(bmp->dirty);
+    free(bmp->opacity);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -3289,7 +5880,9 @@ void tigrFree(Tigr* bmp) {
         objc_msgSend_void((id)win->gl.glContext, sel("release"));
         objc_msgSend_void(window, sel("release"));
     }
-    free(bmp->pix);
+    free(bmp->dirty);
+    free(bmp->opacity);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -3753,6 +6346,7 @@ void tigrUpdate(Tigr* bmp) {
     win = tigrInternal(bmp);
     window = (id)bmp->handle;
     openGLContext = (id)win->gl.glContext;
+    tigrFrameBegin(win);
 
     if (terminated || _tigrIsWindowClosed(window)) {
         return;
@@ -3806,7 +6400,9 @@ void tigrUpdate(Tigr* bmp) {
         win->scale = tigrEnforceScale(tigrCalcScale(bmp->w, bmp->h, windowSize.width, windowSize.height), win->flags);
 
     tigrPosition(bmp, win->scale, windowSize.width, windowSize.height, win->pos);
+    tigrFrameStage(win, TIGR_STAGE_INPUT);
     tigrGAPIPresent(bmp, windowSize.width, windowSize.height);
+    tigrFrameStage(win, TIGR_STAGE_DRAW);
     objc_msgSend_void(openGLContext, sel("flushBuffer"));
     tigrGAPIEnd(bmp);
 
@@ -3830,6 +6426,22 @@ void tigrUpdate(Tigr* bmp) {
             break;
         }
     }
+    tigrFrameEnd(win, TIGR_STAGE_SWAP);
+    tigrFrameWait(win);
+}
+
+int tigrSetSwapInterval(Tigr* bmp, int interval) {
+    TigrInternal* win = tigrInternal(bmp);
+    GLint swapInterval = interval;
+    NSInteger NSOpenGLCPSwapInterval = 222;
+
+    // No adaptive vsync on macOS.
+    if (interval < 0) {
+        return 0;
+    }
+    objc_msgSend_t(void, GLint*, NSInteger)((id)win->gl.glContext, sel("setValues:forParameter:"), &swapInterval,
+                                            NSOpenGLCPSwapInterval);
+    return 1;
 }
 
 int tigrGAPIBegin(Tigr* bmp) {
@@ -4352,6 +6964,7 @@ static int toWindowY(TigrInternal* win, int y) {
 
 void tigrUpdate(Tigr* bmp) {
     TigrInternal* win = tigrInternal(bmp);
+    tigrFrameBegin(win);
 
     processEvents(win);
 
@@ -4374,8 +6987,12 @@ void tigrUpdate(Tigr* bmp) {
     }
 
     tigrPosition(bmp, win->scale, gState.screenW, gState.screenH, win->pos);
+    tigrFrameStage(win, TIGR_STAGE_INPUT);
     tigrGAPIPresent(bmp, gState.screenW, gState.screenH);
+    tigrFrameStage(win, TIGR_STAGE_DRAW);
     waitForFrame();
+    tigrFrameEnd(win, TIGR_STAGE_SWAP);
+    tigrFrameWait(win);
 }
 
 int tigrClosed(Tigr* bmp) {
@@ -4434,10 +7051,17 @@ void tigrFree(Tigr* bmp) {
     if (bmp->handle) {
         TigrInternal* win = tigrInternal(bmp);
     }
-    free(bmp->pix);
+    free(bmp->dirty);
+    free(bmp->opacity);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
+int tigrSetSwapInterval(Tigr* bmp, int interval) {
+    // Frames are always paced by the display link.
+    return interval == 1;
+}
+
 int tigrGAPIBegin(Tigr* bmp) {
     (void)bmp;
     return 0;
@@ -4543,7 +7167,6 @@ void tigr_android_destroy();
 #include <stdbool.h>
 #include <string.h>
 #include <stdarg.h>
-#include <sys/time.h>
 #include <X11/X.h>
 #include <X11/Xlib.h>
 #include <X11/Xlocale.h>
@@ -4560,6 +7183,14 @@ static GLXFBConfig fbConfig;
 
 static PFNGLXCREATECONTEXTATTRIBSARBPROC glXCreateContextAttribsARB = 0;
 
+// Events read by tigrProcessInput.
+#define INPUT_EVENT_MASK \
+    (KeyPressMask | KeyReleaseMask | ButtonPressMask | ButtonReleaseMask | PointerMotionMask | FocusChangeMask)
+
+// Open windows, for handing them events read while updating another window.
+static TigrInternal** windows;
+static int numWindows;
+
 static void tearDownX11Stuff() {
     XCloseDisplay(dpy);
 }
@@ -4616,6 +7247,9 @@ static void initX11Stuff() {
 
         wmDeleteMessage = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
 
+        // Report held keys as repeated presses, without the fake releases in between.
+        XkbSetDetectableAutoRepeat(dpy, True, NULL);
+
         atexit(tearDownX11Stuff);
 
         done = 1;
@@ -4638,26 +7272,33 @@ static int hasGLXExtension(Display* display, const char* wanted) {
     return found != 0;
 }
 
-static void setupVSync(Display* display, Window win) {
+// Sets the swap interval of the current context, negative intervals being adaptive.
+static int setupVSync(Display* display, Window win, int interval) {
     if (hasGLXExtension(display, "GLX_EXT_swap_control")) {
+        if (interval < 0 && !hasGLXExtension(display, "GLX_EXT_swap_control_tear")) {
+            return 0;
+        }
         PFNGLXSWAPINTERVALEXTPROC glXSwapIntervalEXT =
             (PFNGLXSWAPINTERVALEXTPROC)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalEXT");
         if (glXSwapIntervalEXT) {
-            glXSwapIntervalEXT(display, win, 1);
+            glXSwapIntervalEXT(display, win, interval);
+            return 1;
         }
     } else if (hasGLXExtension(display, "GLX_MESA_swap_control")) {
         PFNGLXSWAPINTERVALMESAPROC glXSwapIntervalMESA =
             (PFNGLXSWAPINTERVALMESAPROC)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalMESA");
-        if (glXSwapIntervalMESA) {
-            glXSwapIntervalMESA(1);
+        if (glXSwapIntervalMESA && interval >= 0) {
+            return glXSwapIntervalMESA(interval) == 0;
         }
     } else if (hasGLXExtension(display, "GLX_SGI_swap_control")) {
         PFNGLXSWAPINTERVALSGIPROC glXSwapIntervalSGI =
             (PFNGLXSWAPINTERVALSGIPROC)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalSGI");
-        if (glXSwapIntervalSGI) {
-            glXSwapIntervalSGI(1);
+        // SGI has no way to turn vsync off.
+        if (glXSwapIntervalSGI && interval > 0) {
+            return glXSwapIntervalSGI(interval) == 0;
         }
     }
+    return 0;
 }
 
 static void tigrHideCursor(TigrInternal* win) {
@@ -4738,8 +7379,8 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
         XResizeWindow(dpy, xwin, w * scale, h * scale);
     }
 
-    // Enable mouse events reporting (needed for mouse wheel events)
-    XSelectInput(dpy, xwin, ButtonPressMask);
+    // Input is read from the event queue, see tigrProcessInput.
+    XSelectInput(dpy, xwin, INPUT_EVENT_MASK);
 
     XTextProperty prop;
     int result = Xutf8TextListToTextProperty(dpy, (char**)&title, 1, XUTF8StringStyle, &prop);
@@ -4762,7 +7403,7 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
     glc = glXCreateContextAttribsARB(dpy, fbConfig, NULL, GL_TRUE, contextAttributes);
     glXMakeCurrent(dpy, xwin, glc);
 
-    setupVSync(dpy, xwin);
+    setupVSync(dpy, xwin, 1);
 
     bmp = tigrBitmap2(w, h, sizeof(TigrInternal));
     bmp->handle = (void*)xwin;
@@ -4777,7 +7418,6 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
     win->closed = 0;
     win->scale = scale;
 
-    win->lastChar = 0;
     win->flags = flags;
     win->p1 = win->p2 = win->p3 = 0;
     win->p4 = 1;
@@ -4798,6 +7438,12 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
     tigrGAPICreate(bmp);
     tigrGAPIBegin(bmp);
 
+    TigrInternal** grown = (TigrInternal**)realloc(windows, (numWindows + 1) * sizeof(TigrInternal*));
+    if (grown) {
+        windows = grown;
+        windows[numWindows++] = win;
+    }
+
     return bmp;
 }
 
@@ -4806,6 +7452,12 @@ int tigrClosed(Tigr* bmp) {
     return win->win == 0;
 }
 
+int tigrSetSwapInterval(Tigr* bmp, int interval) {
+    TigrInternal* win = tigrInternal(bmp);
+    glXMakeCurrent(win->dpy, win->win, win->glc);
+    return setupVSync(win->dpy, win->win, interval);
+}
+
 int tigrGAPIBegin(Tigr* bmp) {
     TigrInternal* win = tigrInternal(bmp);
     return glXMakeCurrent(win->dpy, win->win, win->glc) ? 0 : -1;
@@ -4831,10 +7483,7 @@ int tigrKeyHeld(Tigr* bmp, int key) {
 }
 
 int tigrReadChar(Tigr* bmp) {
-    TigrInternal* win = tigrInternal(bmp);
-    int c = win->lastChar;
-    win->lastChar = 0;
-    return c;
+    return tigrPopChar(tigrInternal(bmp));
 }
 
 uint8_t tigrKeyFromX11(KeySym sym) {
@@ -4995,124 +7644,198 @@ static void tigrUpdateModifiers(TigrInternal* win) {
     win->keys[TK_ALT] = win->keys[TK_LALT] || win->keys[TK_RALT];
 }
 
-static void tigrInterpretChar(TigrInternal* win, Window root, unsigned int keycode, unsigned int mask) {
-    XKeyEvent event;
-    memset(&event, 0, sizeof(event));
-    event.type = KeyPress;
-    event.display = win->dpy;
-    event.root = root;
-    event.window = win->win;
-    event.state = mask;
-    event.keycode = keycode;
-    char inputTextUTF8[10];
-    Status status = 0;
-    Xutf8LookupString(win->ic, &event, inputTextUTF8, sizeof(inputTextUTF8), NULL, &status);
+// Maps X server timestamps (ms) onto the monotonic clock.
+// The smallest offset seen is the one with the least delivery delay.
+static unsigned long long tigrEventTime(Time time) {
+    static long long offset;
+    static int synced = 0;
+    long long now = (long long)tigrTimeNs();
+    long long server = (long long)time * 1000000;
 
-    if (status == XLookupChars) {
-        tigrDecodeUTF8(inputTextUTF8, &win->lastChar);
+    // Also resync if the 32-bit server time wraps around.
+    if (!synced || now - server < offset || now - (server + offset) > 10000000000ll) {
+        offset = now - server;
+        synced = 1;
     }
+    return (unsigned long long)(server + offset);
 }
 
-static void tigrProcessInput(TigrInternal* win, int winWidth, int winHeight) {
-    {
-        Window focused;
-        int revertTo;
-        XGetInputFocus(win->dpy, &focused, &revertTo);
+// Text input is skipped for key presses the input method has filtered, as part of a
+// dead key or composed sequence, but their key state still counts.
+static void tigrProcessKey(TigrInternal* win, XKeyEvent* xkey, int filtered) {
+    TigrEvent event = { 0 };
+    event.time = tigrEventTime(xkey->time);
 
-        if (win->win != focused) {
-            return;
-        }
+    KeySym keySym = XkbKeycodeToKeysym(win->dpy, xkey->keycode, 0, 0);
+    if (keySym != NoSymbol) {
+        int key = tigrKeyFromX11(keySym);
+        win->keys[key] = xkey->type == KeyPress;
+        tigrUpdateModifiers(win);
+
+        event.type = xkey->type == KeyPress ? TIGR_EVENT_KEY_DOWN : TIGR_EVENT_KEY_UP;
+        event.key = key;
+        tigrPushEvent(win, &event);
     }
 
-    Window root;
-    Window child;
-    int rootX;
-    int rootY;
-    int winX;
-    int winY;
-    unsigned int mask;
+    if (xkey->type == KeyPress && !filtered) {
+        char inputTextUTF8[32];
+        Status status = 0;
+        int length = Xutf8LookupString(win->ic, xkey, inputTextUTF8, sizeof(inputTextUTF8) - 1, NULL, &status);
 
-    if (XQueryPointer(win->dpy, win->win, &root, &child, &rootX, &rootY, &winX, &winY, &mask)) {
-        static unsigned int prevButtons;
-        unsigned int buttons = mask & (Button1Mask | Button2Mask | Button3Mask);
+        if (status == XLookupChars) {
+            inputTextUTF8[length] = 0;
+            event.type = TIGR_EVENT_CHAR;
+            for (const char* text = inputTextUTF8; *text;) {
+                text = tigrDecodeUTF8(text, &event.key);
+                tigrPushEvent(win, &event);
+            }
+        }
+    }
+}
 
-        win->mouseX = (winX - win->pos[0]) / win->scale;
-        win->mouseY = (winY - win->pos[1]) / win->scale;
+static void tigrProcessButton(TigrInternal* win, XButtonEvent* xbutton) {
+    TigrEvent event = { 0 };
+    event.time = tigrEventTime(xbutton->time);
+    event.x = win->mouseX = (xbutton->x - win->pos[0]) / win->scale;
+    event.y = win->mouseY = (xbutton->y - win->pos[1]) / win->scale;
 
-        if (buttons != prevButtons && (winX > 0 && winX < winWidth) && (winY > 0 && winY < winHeight)) {
-            win->mouseButtons = (buttons & Button1Mask)       ? 1
-                                : 0 | (buttons & Button3Mask) ? 2
-                                : 0 | (buttons & Button2Mask) ? 4
-                                                              : 0;
+    // Button4 = WheelUp / Button5 = WheelDown, 6 and 7 scroll sideways.
+    if (xbutton->button >= Button4 && xbutton->button <= 7) {
+        if (xbutton->type == ButtonPress) {
+            event.type = TIGR_EVENT_WHEEL;
+            event.dy = xbutton->button == Button4 ? 1.0f : xbutton->button == Button5 ? -1.0f : 0.0f;
+            event.dx = xbutton->button == 6 ? 1.0f : xbutton->button == 7 ? -1.0f : 0.0f;
+            win->scrollDeltaX += event.dx;
+            win->scrollDeltaY += event.dy;
+            tigrPushEvent(win, &event);
         }
-        prevButtons = buttons;
+        return;
     }
 
-    // Retrieve mouse wheel events - Cannot be done in the XQueryPointer call
-    // -> https://comp.unix.programmer.narkive.com/eOnjkQ6L/xlib-xquerypointer-and-button4mask-button5mask#post2
-    // Button4 = WheelUp / Button5 = WheelDown
-    XEvent mouseButtonEvent;
-    while (XPending(win->dpy)) {
-        XPeekEvent(win->dpy, &mouseButtonEvent);
-        if (mouseButtonEvent.xany.type == ButtonPress) {
-            switch (mouseButtonEvent.xbutton.button) {
-                case Button4:
-                    win->scrollDeltaY += 1;
-                    break;
-                case Button5:
-                    win->scrollDeltaY -= 1;
-                    break;
-                case 6:
-                    win->scrollDeltaX += 1;
-                    break;
-                case 7:
-                    win->scrollDeltaX -= 1;
-                    break;
-            }
-            XNextEvent(win->dpy, &mouseButtonEvent);
+    int button = xbutton->button == Button1 ? 1 : xbutton->button == Button3 ? 2 : xbutton->button == Button2 ? 4 : 0;
+    if (button) {
+        if (xbutton->type == ButtonPress) {
+            win->mouseButtons |= button;
         } else {
-            break;
+            win->mouseButtons &= ~button;
+        }
+        event.type = xbutton->type == ButtonPress ? TIGR_EVENT_MOUSE_DOWN : TIGR_EVENT_MOUSE_UP;
+        event.key = button;
+        tigrPushEvent(win, &event);
+    }
+}
+
+// Releases everything held when the window loses focus,
+// since the releases themselves go to another window.
+static void tigrReleaseAll(TigrInternal* win) {
+    TigrEvent event = { 0 };
+    event.time = tigrTimeNs();
+    event.type = TIGR_EVENT_KEY_UP;
+    for (int key = 0; key < 256; key++) {
+        if (win->keys[key]) {
+            win->keys[key] = 0;
+            event.key = key;
+            tigrPushEvent(win, &event);
+        }
+    }
+    event.type = TIGR_EVENT_MOUSE_UP;
+    event.x = win->mouseX;
+    event.y = win->mouseY;
+    for (int button = 1; button <= 4; button <<= 1) {
+        if (win->mouseButtons & button) {
+            win->mouseButtons &= ~button;
+            event.key = button;
+            tigrPushEvent(win, &event);
         }
     }
+}
 
-    static char prevKeys[32];
-    char keys[32];
-    XQueryKeymap(win->dpy, keys);
-    for (int i = 0; i < 32; i++) {
-        char thisBlock = keys[i];
-        char prevBlock = prevKeys[i];
-        if (thisBlock != prevBlock) {
-            for (int j = 0; j < 8; j++) {
-                int thisBit = thisBlock & 1;
-                int prevBit = prevBlock & 1;
-                thisBlock >>= 1;
-                prevBlock >>= 1;
-                if (thisBit != prevBit) {
-                    int keyCode = 8 * i + j;
-                    KeySym keySym = XkbKeycodeToKeysym(win->dpy, keyCode, 0, 0);
-                    if (keySym != NoSymbol) {
-                        int key = tigrKeyFromX11(keySym);
-                        win->keys[key] = thisBit;
-                        tigrUpdateModifiers(win);
-
-                        if (thisBit) {
-                            tigrInterpretChar(win, root, keyCode, mask);
-                        }
-                    }
-                }
-            }
+static TigrInternal* tigrFindWindow(Window xwin) {
+    for (int i = 0; i < numWindows; i++) {
+        if (windows[i]->win == xwin) {
+            return windows[i];
         }
     }
-    memcpy(prevKeys, keys, 32);
+    return NULL;
+}
+
+static void tigrCloseWindow(TigrInternal* win) {
+    glXMakeCurrent(win->dpy, None, NULL);
+    glXDestroyContext(win->dpy, win->glc);
+    XDestroyWindow(win->dpy, win->win);
+    win->win = 0;
+}
+
+// Hands an event to the window it is for.
+static void tigrDispatchEvent(XEvent* event) {
+    // Input methods consume the keys of dead key and composed sequences.
+    int filtered = XFilterEvent(event, None);
+
+    if (event->type == MappingNotify) {
+        XRefreshKeyboardMapping(&event->xmapping);
+        return;
+    }
+
+    TigrInternal* win = tigrFindWindow(event->xany.window);
+    if (!win) {
+        return;
+    }
+
+    switch (event->type) {
+        case KeyPress:
+        case KeyRelease:
+            tigrProcessKey(win, &event->xkey, filtered);
+            break;
+        case ButtonPress:
+        case ButtonRelease:
+            if (!filtered) {
+                tigrProcessButton(win, &event->xbutton);
+            }
+            break;
+        case MotionNotify:
+            if (!filtered) {
+                TigrEvent move = { 0 };
+                move.type = TIGR_EVENT_MOUSE_MOVE;
+                move.time = tigrEventTime(event->xmotion.time);
+                move.x = win->mouseX = (event->xmotion.x - win->pos[0]) / win->scale;
+                move.y = win->mouseY = (event->xmotion.y - win->pos[1]) / win->scale;
+                tigrPushEvent(win, &move);
+            }
+            break;
+        case FocusIn:
+            if (event->xfocus.mode != NotifyGrab && event->xfocus.mode != NotifyUngrab) {
+                XSetICFocus(win->ic);
+            }
+            break;
+        case FocusOut:
+            // Keyboard grabs, such as during a window manager drag, move focus
+            // only for their duration, and keys held through them stay held.
+            if (event->xfocus.mode != NotifyGrab && event->xfocus.mode != NotifyUngrab) {
+                XUnsetICFocus(win->ic);
+                tigrReleaseAll(win);
+            }
+            break;
+        case ClientMessage:
+            if (!filtered && (Atom)event->xclient.data.l[0] == wmDeleteMessage) {
+                tigrCloseWindow(win);
+            }
+            break;
+    }
+}
 
+// Reads queued input events, rather than querying input state,
+// which would cost a server round trip each and miss short presses.
+// Events for other windows are handed to them, to be read on their next update.
+static void tigrProcessInput(TigrInternal* win) {
     XEvent event;
-    while (XCheckTypedWindowEvent(win->dpy, win->win, ClientMessage, &event)) {
-        if (event.xclient.data.l[0] == wmDeleteMessage) {
-            glXMakeCurrent(win->dpy, None, NULL);
-            glXDestroyContext(win->dpy, win->glc);
-            XDestroyWindow(win->dpy, win->win);
-            win->win = 0;
-        }
+    while (XPending(win->dpy)) {
+        XNextEvent(win->dpy, &event);
+        tigrDispatchEvent(&event);
+    }
+
+    // Closing another window may have released this one's context.
+    if (win->win && glXGetCurrentContext() != win->glc) {
+        glXMakeCurrent(win->dpy, win->win, win->glc);
     }
     XFlush(win->dpy);
 }
@@ -5121,6 +7844,7 @@ void tigrUpdate(Tigr* bmp) {
     XWindowAttributes gwa;
 
     TigrInternal* win = tigrInternal(bmp);
+    tigrFrameBegin(win);
 
     memcpy(win->prev, win->keys, 256);
     win->scrollDeltaX = 0;
@@ -5135,23 +7859,34 @@ void tigrUpdate(Tigr* bmp) {
 
     tigrPosition(bmp, win->scale, gwa.width, gwa.height, win->pos);
     glXMakeCurrent(win->dpy, win->win, win->glc);
+    tigrFrameStage(win, TIGR_STAGE_INPUT);
     tigrGAPIPresent(bmp, gwa.width, gwa.height);
+    tigrFrameStage(win, TIGR_STAGE_DRAW);
     glXSwapBuffers(win->dpy, win->win);
+    tigrFrameStage(win, TIGR_STAGE_SWAP);
+    tigrFrameWait(win);
 
-    tigrProcessInput(win, gwa.width, gwa.height);
+    tigrProcessInput(win);
+    tigrNextEvents(win);
+    tigrFrameEnd(win, TIGR_STAGE_INPUT);
 }
 
 void tigrFree(Tigr* bmp) {
     if (bmp->handle) {
         TigrInternal* win = tigrInternal(bmp);
         if (win->win) {
-            glXMakeCurrent(win->dpy, None, NULL);
-            glXDestroyContext(win->dpy, win->glc);
-            XDestroyWindow(win->dpy, win->win);
-            win->win = 0;
+            tigrCloseWindow(win);
+        }
+        for (int i = 0; i < numWindows; i++) {
+            if (windows[i] == win) {
+                windows[i] = windows[--numWindows];
+                break;
+            }
         }
     }
-    free(bmp->pix);
+    free(bmp->dirty);
+    free(bmp->opacity);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -5170,16 +7905,8 @@ void tigrError(Tigr* bmp, const char* message, ...) {
 }
 
 float tigrTime() {
-    static double lastTime = 0;
-
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-
-    double now = (double)tv.tv_sec + (tv.tv_usec / 1000000.0);
-    double elapsed = lastTime == 0 ? 0 : now - lastTime;
-    lastTime = now;
-
-    return (float)elapsed;
+    static TigrTimer timer;
+    return tigrTimerDelta(&timer);
 }
 
 void tigrMouse(Tigr* bmp, int* x, int* y, int* buttons) {
@@ -5615,11 +8342,76 @@ static int tigrKeyFromAndroidKey(int key) {
     }
 }
 
+static int toWindowX(TigrInternal* win, int x) {
+    return (x - win->pos[0]) / win->scale;
+}
+
+static int toWindowY(TigrInternal* win, int y) {
+    return (y - win->pos[1]) / win->scale;
+}
+
+// Queues touch events for the pointers changed by a motion event,
+// including the moves batched up since the last one.
+static void pushTouchEvents(TigrInternal* win, AInputEvent* motion, int32_t action) {
+    int32_t actionCode = action & AMOTION_EVENT_ACTION_MASK;
+    size_t index = (action & AMOTION_EVENT_ACTION_POINTER_INDEX_MASK) >> AMOTION_EVENT_ACTION_POINTER_INDEX_SHIFT;
+    size_t count = AMotionEvent_getPointerCount(motion);
+    TigrEvent event = { 0 };
+
+    for (size_t i = 0; i < count; i++) {
+        event.key = AMotionEvent_getPointerId(motion, i);
+        switch (actionCode) {
+            case AMOTION_EVENT_ACTION_DOWN:
+            case AMOTION_EVENT_ACTION_POINTER_DOWN:
+                event.type = TIGR_EVENT_TOUCH_DOWN;
+                break;
+            case AMOTION_EVENT_ACTION_UP:
+            case AMOTION_EVENT_ACTION_POINTER_UP:
+            case AMOTION_EVENT_ACTION_CANCEL:
+                event.type = TIGR_EVENT_TOUCH_UP;
+                break;
+            case AMOTION_EVENT_ACTION_MOVE:
+                event.type = TIGR_EVENT_TOUCH_MOVE;
+                for (size_t h = 0; h < AMotionEvent_getHistorySize(motion); h++) {
+                    event.time = AMotionEvent_getHistoricalEventTime(motion, h);
+                    event.x = toWindowX(win, AMotionEvent_getHistoricalX(motion, i, h));
+                    event.y = toWindowY(win, AMotionEvent_getHistoricalY(motion, i, h));
+                    tigrPushEvent(win, &event);
+                }
+                break;
+            default:
+                return;
+        }
+        if (event.type != TIGR_EVENT_TOUCH_MOVE && actionCode != AMOTION_EVENT_ACTION_CANCEL && i != index) {
+            continue;
+        }
+        event.time = AMotionEvent_getEventTime(motion);
+        event.x = toWindowX(win, AMotionEvent_getX(motion, i));
+        event.y = toWindowY(win, AMotionEvent_getY(motion, i));
+        tigrPushEvent(win, &event);
+    }
+}
+
 static int processInputEvent(AInputEvent* event, TigrInternal* win) {
     if (AInputEvent_getType(event) == AINPUT_EVENT_TYPE_MOTION) {
         int32_t action = AMotionEvent_getAction(event);
         int32_t actionCode = action & AMOTION_EVENT_ACTION_MASK;
 
+        if (actionCode == AMOTION_EVENT_ACTION_SCROLL) {
+            if (win) {
+                TigrEvent wheel = { 0 };
+                wheel.type = TIGR_EVENT_WHEEL;
+                wheel.time = AMotionEvent_getEventTime(event);
+                wheel.dx = AMotionEvent_getAxisValue(event, AMOTION_EVENT_AXIS_HSCROLL, 0);
+                wheel.dy = AMotionEvent_getAxisValue(event, AMOTION_EVENT_AXIS_VSCROLL, 0);
+                tigrPushEvent(win, &wheel);
+            }
+            return 1;
+        }
+        if (win) {
+            pushTouchEvents(win, event, action);
+        }
+
         size_t touchPoints = AMotionEvent_getPointerCount(event);
         size_t releasedIndex = -1;
         if (actionCode == AMOTION_EVENT_ACTION_POINTER_UP) {
@@ -5658,11 +8450,23 @@ static int processInputEvent(AInputEvent* event, TigrInternal* win) {
         // We pass the character in the scancode field from the Java side
         int32_t unicodeChar = AKeyEvent_getScanCode(event);
 
+        TigrEvent keyEvent = { 0 };
+        keyEvent.time = AKeyEvent_getEventTime(event);
+        keyEvent.key = key;
+
         if (action == AKEY_EVENT_ACTION_DOWN) {
             win->keys[key] = 1;
-            win->lastChar = unicodeChar;
+            keyEvent.type = TIGR_EVENT_KEY_DOWN;
+            tigrPushEvent(win, &keyEvent);
+            if (unicodeChar) {
+                keyEvent.type = TIGR_EVENT_CHAR;
+                keyEvent.key = unicodeChar;
+                tigrPushEvent(win, &keyEvent);
+            }
         } else if (action == AKEY_EVENT_ACTION_UP) {
             win->released[key] = 1;
+            keyEvent.type = TIGR_EVENT_KEY_UP;
+            tigrPushEvent(win, &keyEvent);
         }
         return 1;
     }
@@ -5772,7 +8576,6 @@ Tigr* tigrWindow(int w, int h, const char* title, int flags) {
     win->closed = 0;
     win->scale = scale;
 
-    win->lastChar = 0;
     win->flags = flags;
     win->p1 = win->p2 = win->p3 = 0;
     win->p4 = 1;
@@ -5803,6 +8606,11 @@ int tigrClosed(Tigr* bmp) {
     return win->closed;
 }
 
+int tigrSetSwapInterval(Tigr* bmp, int interval) {
+    // EGL has no adaptive vsync.
+    return interval >= 0 && eglSwapInterval(gState.display, interval);
+}
+
 int tigrGAPIBegin(Tigr* bmp) {
     assert(gState.display != EGL_NO_DISPLAY);
     assert(gState.surface != EGL_NO_SURFACE);
@@ -5835,10 +8643,7 @@ int tigrKeyHeld(Tigr* bmp, int key) {
 }
 
 int tigrReadChar(Tigr* bmp) {
-    TigrInternal* win = tigrInternal(bmp);
-    int c = win->lastChar;
-    win->lastChar = 0;
-    return c;
+    return tigrPopChar(tigrInternal(bmp));
 }
 
 static void tigrUpdateModifiers(TigrInternal* win) {
@@ -5847,23 +8652,18 @@ static void tigrUpdateModifiers(TigrInternal* win) {
     win->keys[TK_ALT] = win->keys[TK_LALT] || win->keys[TK_RALT];
 }
 
-static int toWindowX(TigrInternal* win, int x) {
-    return (x - win->pos[0]) / win->scale;
-}
-
-static int toWindowY(TigrInternal* win, int y) {
-    return (y - win->pos[1]) / win->scale;
-}
-
 void tigrUpdate(Tigr* bmp) {
     TigrInternal* win = tigrInternal(bmp);
+    tigrFrameBegin(win);
     memcpy(win->prev, win->keys, 256);
     for (int i = 0; i < 256; i++) {
         win->keys[i] ^= win->released[i];
         win->released[i] = 0;
     }
 
-    if (!processEvents(win)) {
+    int alive = processEvents(win);
+    tigrNextEvents(win);
+    if (!alive) {
         win->closed = 1;
         return;
     }
@@ -5899,9 +8699,13 @@ void tigrUpdate(Tigr* bmp) {
 
     tigrPosition(bmp, win->scale, gState.screenW, gState.screenH, win->pos);
     tigrGAPIBegin(bmp);
+    tigrFrameStage(win, TIGR_STAGE_INPUT);
     tigrGAPIPresent(bmp, gState.screenW, gState.screenH);
+    tigrFrameStage(win, TIGR_STAGE_DRAW);
     android_swap(gState.display, gState.surface);
     tigrGAPIEnd(bmp);
+    tigrFrameEnd(win, TIGR_STAGE_SWAP);
+    tigrFrameWait(win);
 }
 
 void tigrFree(Tigr* bmp) {
@@ -5919,7 +8723,9 @@ void tigrFree(Tigr* bmp) {
 
         win->context = EGL_NO_CONTEXT;
     }
-    free(bmp->pix);
+    free(bmp->dirty);
+    free(bmp->opacity);
+    tigrFreePixels(bmp);
     free(bmp);
 }
 
@@ -5998,6 +8804,10 @@ void* tigrReadFile(const char* fileName, int* length) {
 
 //#include "tigr_internal.h"
 #include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifdef TIGR_GAPI_GL
 #if __linux__
@@ -6024,18 +8834,38 @@ extern const int tigr_upscale_gl_vs_size, tigr_upscale_gl_fs_size, tigr_default_
 #define APIENTRYP APIENTRY*
 #endif
 typedef ptrdiff_t GLsizeiptr;
+typedef ptrdiff_t GLintptr;
 #define GL_COMPILE_STATUS 0x8B81
 #define GL_LINK_STATUS 0x8B82
 #define GL_ARRAY_BUFFER 0x8892
 #define GL_STATIC_DRAW 0x88E4
+#define GL_STREAM_DRAW 0x88E0
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#define GL_MAP_WRITE_BIT 0x0002
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
 #define GL_VERTEX_SHADER 0x8B31
 #define GL_FRAGMENT_SHADER 0x8B30
 #define GL_BGRA 0x80E1
 #define GL_TEXTURE0 0x84C0
+#define GL_MAJOR_VERSION 0x821B
+#define GL_MINOR_VERSION 0x821C
+#define GL_NUM_EXTENSIONS 0x821D
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_TEXTURE1 0x84C1
+#define GL_FRAMEBUFFER 0x8D40
+#define GL_FRAMEBUFFER_BINDING 0x8CA6
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#define GL_UNIFORM_BUFFER 0x8A11
+#define GL_DYNAMIC_DRAW 0x88E8
+#define GL_INVALID_INDEX 0xFFFFFFFFu
 typedef void(APIENTRYP PFNGLGENVERTEXARRAYSPROC)(GLsizei n, GLuint* arrays);
 typedef void(APIENTRYP PFNGLGENBUFFERSARBPROC)(GLsizei n, GLuint* buffers);
 typedef void(APIENTRYP PFNGLBINDBUFFERPROC)(GLenum target, GLuint buffer);
 typedef void(APIENTRYP PFNGLBUFFERDATAPROC)(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+typedef void(APIENTRYP PFNGLDELETEBUFFERSPROC)(GLsizei n, const GLuint* buffers);
+typedef void*(APIENTRYP PFNGLMAPBUFFERRANGEPROC)(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean(APIENTRYP PFNGLUNMAPBUFFERPROC)(GLenum target);
 typedef void(APIENTRYP PFNGLBINDVERTEXARRAYPROC)(GLuint array);
 typedef void(APIENTRYP PFNGLENABLEVERTEXATTRIBARRAYPROC)(GLuint index);
 typedef void(APIENTRYP PFNGLVERTEXATTRIBPOINTERPROC)(GLuint index,
@@ -6068,6 +8898,28 @@ typedef void(APIENTRYP PFNGLUNIFORMMATRIX4FVPROC)(GLint location,
                                                   GLboolean transpose,
                                                   const GLfloat* value);
 typedef void(APIENTRYP PFNGLACTIVETEXTUREPROC)(GLenum texture);
+typedef const GLubyte*(APIENTRYP PFNGLGETSTRINGIPROC)(GLenum name, GLuint index);
+typedef void(APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program,
+                                                  GLsizei bufSize,
+                                                  GLsizei* length,
+                                                  GLenum* binaryFormat,
+                                                  void* binary);
+typedef void(APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void(APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+typedef void(APIENTRYP PFNGLUNIFORM1IPROC)(GLint location, GLint v0);
+typedef void(APIENTRYP PFNGLGENFRAMEBUFFERSPROC)(GLsizei n, GLuint* framebuffers);
+typedef void(APIENTRYP PFNGLDELETEFRAMEBUFFERSPROC)(GLsizei n, const GLuint* framebuffers);
+typedef void(APIENTRYP PFNGLBINDFRAMEBUFFERPROC)(GLenum target, GLuint framebuffer);
+typedef void(APIENTRYP PFNGLFRAMEBUFFERTEXTURE2DPROC)(GLenum target,
+                                                      GLenum attachment,
+                                                      GLenum textarget,
+                                                      GLuint texture,
+                                                      GLint level);
+typedef GLuint(APIENTRYP PFNGLGETUNIFORMBLOCKINDEXPROC)(GLuint program, const GLchar* uniformBlockName);
+typedef void(APIENTRYP PFNGLUNIFORMBLOCKBINDINGPROC)(GLuint program,
+                                                     GLuint uniformBlockIndex,
+                                                     GLuint uniformBlockBinding);
+typedef void(APIENTRYP PFNGLBINDBUFFERBASEPROC)(GLenum target, GLuint index, GLuint buffer);
 #define WGL_DRAW_TO_WINDOW_ARB 0x2001
 #define WGL_SUPPORT_OPENGL_ARB 0x2010
 #define WGL_DOUBLE_BUFFER_ARB 0x2011
@@ -6093,6 +8945,9 @@ PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
 PFNGLGENBUFFERSARBPROC glGenBuffers;
 PFNGLBINDBUFFERPROC glBindBuffer;
 PFNGLBUFFERDATAPROC glBufferData;
+PFNGLDELETEBUFFERSPROC glDeleteBuffers;
+PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+PFNGLUNMAPBUFFERPROC glUnmapBuffer;
 PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
 PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
 PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
@@ -6113,6 +8968,18 @@ PFNGLGETUNIFORMLOCATIONPROC glGetUniformLocation;
 PFNGLUNIFORM4FPROC glUniform4f;
 PFNGLUNIFORMMATRIX4FVPROC glUniformMatrix4fv;
 PFNGLACTIVETEXTUREPROC glActiveTexture;
+PFNGLGETSTRINGIPROC glGetStringi;
+PFNGLGETPROGRAMBINARYPROC glGetProgramBinary;
+PFNGLPROGRAMBINARYPROC glProgramBinary;
+PFNGLPROGRAMPARAMETERIPROC glProgramParameteri;
+PFNGLUNIFORM1IPROC glUniform1i;
+PFNGLGENFRAMEBUFFERSPROC glGenFramebuffers;
+PFNGLDELETEFRAMEBUFFERSPROC glDeleteFramebuffers;
+PFNGLBINDFRAMEBUFFERPROC glBindFramebuffer;
+PFNGLFRAMEBUFFERTEXTURE2DPROC glFramebufferTexture2D;
+PFNGLGETUNIFORMBLOCKINDEXPROC glGetUniformBlockIndex;
+PFNGLUNIFORMBLOCKBINDINGPROC glUniformBlockBinding;
+PFNGLBINDBUFFERBASEPROC glBindBufferBase;
 int tigrGL11Init(Tigr* bmp) {
     int pixel_format;
     TigrInternal* win = tigrInternal(bmp);
@@ -6178,6 +9045,9 @@ int tigrGL33Init(Tigr* bmp) {
     glGenBuffers = (PFNGLGENBUFFERSARBPROC)wglGetProcAddress("glGenBuffers");
     glBindBuffer = (PFNGLBINDBUFFERPROC)wglGetProcAddress("glBindBuffer");
     glBufferData = (PFNGLBUFFERDATAPROC)wglGetProcAddress("glBufferData");
+    glDeleteBuffers = (PFNGLDELETEBUFFERSPROC)wglGetProcAddress("glDeleteBuffers");
+    glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)wglGetProcAddress("glMapBufferRange");
+    glUnmapBuffer = (PFNGLUNMAPBUFFERPROC)wglGetProcAddress("glUnmapBuffer");
     glBindVertexArray = (PFNGLBINDVERTEXARRAYPROC)wglGetProcAddress("glBindVertexArray");
     glEnableVertexAttribArray = (PFNGLENABLEVERTEXATTRIBARRAYPROC)wglGetProcAddress("glEnableVertexAttribArray");
     glVertexAttribPointer = (PFNGLVERTEXATTRIBPOINTERPROC)wglGetProcAddress("glVertexAttribPointer");
@@ -6198,6 +9068,18 @@ int tigrGL33Init(Tigr* bmp) {
     glUniform4f = (PFNGLUNIFORM4FPROC)wglGetProcAddress("glUniform4f");
     glUniformMatrix4fv = (PFNGLUNIFORMMATRIX4FVPROC)wglGetProcAddress("glUniformMatrix4fv");
     glActiveTexture = (PFNGLACTIVETEXTUREPROC)wglGetProcAddress("glActiveTexture");
+    glGetStringi = (PFNGLGETSTRINGIPROC)wglGetProcAddress("glGetStringi");
+    glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)wglGetProcAddress("glGetProgramBinary");
+    glProgramBinary = (PFNGLPROGRAMBINARYPROC)wglGetProcAddress("glProgramBinary");
+    glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)wglGetProcAddress("glProgramParameteri");
+    glUniform1i = (PFNGLUNIFORM1IPROC)wglGetProcAddress("glUniform1i");
+    glGenFramebuffers = (PFNGLGENFRAMEBUFFERSPROC)wglGetProcAddress("glGenFramebuffers");
+    glDeleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSPROC)wglGetProcAddress("glDeleteFramebuffers");
+    glBindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC)wglGetProcAddress("glBindFramebuffer");
+    glFramebufferTexture2D = (PFNGLFRAMEBUFFERTEXTURE2DPROC)wglGetProcAddress("glFramebufferTexture2D");
+    glGetUniformBlockIndex = (PFNGLGETUNIFORMBLOCKINDEXPROC)wglGetProcAddress("glGetUniformBlockIndex");
+    glUniformBlockBinding = (PFNGLUNIFORMBLOCKBINDINGPROC)wglGetProcAddress("glUniformBlockBinding");
+    glBindBufferBase = (PFNGLBINDBUFFERBASEPROC)wglGetProcAddress("glBindBufferBase");
 
     if (!wglChoosePixelFormat || !wglCreateContextAttribs) {
         tigrError(bmp, "Cannot create OpenGL context.\n");
@@ -6231,74 +9113,330 @@ int tigrGL33Init(Tigr* bmp) {
         tigrError(bmp, "Cannot activate OpenGL context.\n");
         return -1;
     }
-    gl->gl_legacy = 0;
-    return 0;
+    gl->gl_legacy = 0;
+    return 0;
+}
+#endif
+
+void tigrCheckGLError(const char* state) {
+    GLenum err = glGetError();
+    if (err != GL_NO_ERROR) {
+        tigrError(NULL, "got GL error %x when doing %s\n", err, state);
+    }
+}
+
+void tigrCheckShaderErrors(GLuint object) {
+    GLint success;
+    GLchar info[2048];
+    glGetShaderiv(object, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(object, sizeof(info), NULL, info);
+        tigrError(NULL, "shader compile error : %s\n", info);
+    }
+}
+
+void tigrCheckProgramErrors(GLuint object) {
+    GLint success;
+    GLchar info[2048];
+    glGetProgramiv(object, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(object, sizeof(info), NULL, info);
+        tigrError(NULL, "shader link error : %s\n", info);
+    }
+}
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+static char shaderCacheDir[512];
+
+void tigrSetShaderCache(const char* directory) {
+    snprintf(shaderCacheDir, sizeof(shaderCacheDir), "%s", directory ? directory : "");
+}
+
+static unsigned long long tigrHashSource(unsigned long long hash, const char* source, int size) {
+    for (int i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char)source[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static int tigrHasGLExtension(const char* name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (ext && strcmp(ext, name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void tigrShaderCachePath(TigrProgram* p, char* path, int size) {
+    // Binaries are only valid for the driver that produced them.
+    const char* renderer = (const char*)glGetString(GL_RENDERER);
+    const char* version = (const char*)glGetString(GL_VERSION);
+    unsigned long long hash = p->hash;
+    hash = tigrHashSource(hash, renderer, (int)strlen(renderer));
+    hash = tigrHashSource(hash, version, (int)strlen(version));
+    snprintf(path, size, "%s/tigr-%016llx.bin", shaderCacheDir, hash);
+}
+
+// Tries to create a program from a binary saved by an earlier run.
+static int tigrLoadProgramBinary(TigrProgram* p) {
+    char path[600];
+    char magic[4];
+    GLenum format;
+    GLint length;
+
+    tigrShaderCachePath(p, path, sizeof(path));
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+
+    void* binary = NULL;
+    if (fread(magic, 4, 1, file) == 1 && memcmp(magic, "TGPB", 4) == 0 && fread(&format, sizeof(format), 1, file) == 1 &&
+        fread(&length, sizeof(length), 1, file) == 1 && length > 0) {
+        binary = malloc(length);
+        if (binary && fread(binary, length, 1, file) != 1) {
+            free(binary);
+            binary = NULL;
+        }
+    }
+    fclose(file);
+    if (!binary) {
+        return 0;
+    }
+
+    GLint success = 0;
+    p->program = glCreateProgram();
+    glProgramBinary(p->program, format, binary, length);
+    glGetProgramiv(p->program, GL_LINK_STATUS, &success);
+    free(binary);
+
+    if (!success) {
+        // Stale binary, typically after a driver update. Clear the error and compile instead.
+        glGetError();
+        glDeleteProgram(p->program);
+        p->program = 0;
+    }
+    return success;
+}
+
+static void tigrSaveProgramBinary(TigrProgram* p) {
+    char path[600];
+    GLint length = 0;
+    GLenum format = 0;
+
+    glGetProgramiv(p->program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    void* binary = malloc(length);
+    if (!binary) {
+        return;
+    }
+    glGetProgramBinary(p->program, length, &length, &format, binary);
+
+    tigrShaderCachePath(p, path, sizeof(path));
+    FILE* file = fopen(path, "wb");
+    if (file) {
+        fwrite("TGPB", 4, 1, file);
+        fwrite(&format, sizeof(format), 1, file);
+        fwrite(&length, sizeof(length), 1, file);
+        fwrite(binary, length, 1, file);
+        fclose(file);
+    }
+    free(binary);
+}
+
+// Compiles and links a program without waiting for the result.
+// Errors are checked once the program is finished, see tigrFinishProgram.
+static void tigrStartProgram(GLStuff* gl, TigrProgram* p) {
+    p->vs = glCreateShader(GL_VERTEX_SHADER);
+    const char* vs_source = (const char*)&tigr_upscale_gl_vs;
+    glShaderSource(p->vs, 1, &vs_source, &tigr_upscale_gl_vs_size);
+    glCompileShader(p->vs);
+
+    p->fs = glCreateShader(GL_FRAGMENT_SHADER);
+    const char* fs_sources[] = {
+        (const char*)tigr_upscale_gl_fs,
+        p->source,
+    };
+    const int fs_lengths[] = {
+        tigr_upscale_gl_fs_size,
+        p->size,
+    };
+    glShaderSource(p->fs, 2, fs_sources, fs_lengths);
+    glCompileShader(p->fs);
+
+    p->program = glCreateProgram();
+    glAttachShader(p->program, p->vs);
+    glAttachShader(p->program, p->fs);
+    if (gl->program_binary && shaderCacheDir[0]) {
+        glProgramParameteri(p->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(p->program);
+}
+
+static void tigrFinishProgram(GLStuff* gl, TigrProgram* p) {
+    if (p->vs) {
+        tigrCheckShaderErrors(p->vs);
+        tigrCheckShaderErrors(p->fs);
+        tigrCheckProgramErrors(p->program);
+        glDeleteShader(p->vs);
+        glDeleteShader(p->fs);
+        p->vs = p->fs = 0;
+
+        if (gl->program_binary && shaderCacheDir[0]) {
+            tigrSaveProgramBinary(p);
+        }
+    }
+
+    p->uniform_projection = glGetUniformLocation(p->program, "projection");
+    p->uniform_model = glGetUniformLocation(p->program, "model");
+    p->uniform_parameters = glGetUniformLocation(p->program, "parameters");
+
+    // The window bitmap is always on texture unit 1, pass uniforms on binding 0.
+    glUseProgram(p->program);
+    glUniform1i(glGetUniformLocation(p->program, "source"), 1);
+    GLuint block = glGetUniformBlockIndex(p->program, "PassUniforms");
+    if (block != GL_INVALID_INDEX) {
+        glUniformBlockBinding(p->program, block, 0);
+    }
+    p->ready = 1;
+}
+
+// Returns whether a program can be used, finishing it when linking is done.
+// Waits for linking if asked to, or if the driver cannot tell whether it is done.
+static int tigrProgramReady(GLStuff* gl, TigrProgram* p, int wait) {
+    if (p->ready) {
+        return 1;
+    }
+    if (!wait && gl->parallel_compile) {
+        GLint done = 0;
+        glGetProgramiv(p->program, GL_COMPLETION_STATUS_KHR, &done);
+        if (!done) {
+            return 0;
+        }
+    }
+    tigrFinishProgram(gl, p);
+    return 1;
 }
-#endif
 
-void tigrCheckGLError(const char* state) {
-    GLenum err = glGetError();
-    if (err != GL_NO_ERROR) {
-        tigrError(NULL, "got GL error %x when doing %s\n", err, state);
+static int tigrProgramInUse(GLStuff* gl, TigrProgram* p) {
+    if (p->program == gl->program || p == gl->pending) {
+        return 1;
+    }
+    for (int i = 0; i < gl->pass_count; i++) {
+        if (gl->passes[i].program == p) {
+            return 1;
+        }
     }
+    return 0;
 }
 
-void tigrCheckShaderErrors(GLuint object) {
-    GLint success;
-    GLchar info[2048];
-    glGetShaderiv(object, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(object, sizeof(info), NULL, info);
-        tigrError(NULL, "shader compile error : %s\n", info);
+static void tigrDeleteProgram(TigrProgram* p) {
+    if (p->vs) {
+        glDeleteShader(p->vs);
+        glDeleteShader(p->fs);
+    }
+    if (p->program) {
+        glDeleteProgram(p->program);
     }
+    free(p->source);
+    memset(p, 0, sizeof(TigrProgram));
 }
 
-void tigrCheckProgramErrors(GLuint object) {
-    GLint success;
-    GLchar info[2048];
-    glGetProgramiv(object, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(object, sizeof(info), NULL, info);
-        tigrError(NULL, "shader link error : %s\n", info);
-    }
+static void tigrUseProgram(GLStuff* gl, TigrProgram* p) {
+    gl->program = p->program;
+    gl->uniform_projection = p->uniform_projection;
+    gl->uniform_model = p->uniform_model;
+    gl->uniform_parameters = p->uniform_parameters;
+    p->used = ++gl->program_uses;
 }
 
-void tigrCreateShaderProgram(GLStuff* gl, const char* fxSource, int fxSize) {
-    if (gl->program != 0) {
-        glDeleteProgram(gl->program);
-        gl->program = 0;
+// Finds a cached program for an effect, or starts building one
+// in the least recently used slot.
+static TigrProgram* tigrFindProgram(GLStuff* gl, const char* fxSource, int fxSize) {
+    unsigned long long hash = 0xcbf29ce484222325ull;
+    hash = tigrHashSource(hash, tigr_upscale_gl_vs, tigr_upscale_gl_vs_size);
+    hash = tigrHashSource(hash, tigr_upscale_gl_fs, tigr_upscale_gl_fs_size);
+    hash = tigrHashSource(hash, fxSource, fxSize);
+
+    TigrProgram* slot = NULL;
+    for (int i = 0; i < TIGR_PROGRAM_CACHE_SIZE; i++) {
+        TigrProgram* p = &gl->programs[i];
+        if (!p->program) {
+            if (!slot || slot->program) {
+                slot = p;
+            }
+            continue;
+        }
+        if (p->hash == hash && p->size == fxSize && memcmp(p->source, fxSource, fxSize) == 0) {
+            return p;
+        }
+        if (tigrProgramInUse(gl, p)) {
+            continue;
+        }
+        if (!slot || (slot->program && p->used < slot->used)) {
+            slot = p;
+        }
     }
 
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    const char* vs_source = (const char*)&tigr_upscale_gl_vs;
-    glShaderSource(vs, 1, &vs_source, &tigr_upscale_gl_vs_size);
-    glCompileShader(vs);
-    tigrCheckShaderErrors(vs);
+    tigrDeleteProgram(slot);
+    slot->hash = hash;
+    slot->size = fxSize;
+    slot->source = (char*)malloc(fxSize);
+    memcpy(slot->source, fxSource, fxSize);
 
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    const char* fs_sources[] = {
-        (const char*)tigr_upscale_gl_fs,
-        fxSource,
-    };
-    const int fs_lengths[] = {
-        tigr_upscale_gl_fs_size,
-        fxSize,
-    };
-    glShaderSource(fs, 2, fs_sources, fs_lengths);
-    glCompileShader(fs);
-    tigrCheckShaderErrors(fs);
+    if (gl->program_binary && shaderCacheDir[0] && tigrLoadProgramBinary(slot)) {
+        tigrFinishProgram(gl, slot);
+    } else {
+        tigrStartProgram(gl, slot);
+    }
+    return slot;
+}
+
+// Switches to a post shader program. Cached programs are used right away,
+// new ones replace the current program once they have finished linking.
+void tigrSelectShaderProgram(GLStuff* gl, const char* fxSource, int fxSize) {
+    if (gl->gl_legacy) {
+        return;
+    }
+    TigrProgram* p = tigrFindProgram(gl, fxSource, fxSize);
+    if (p->ready) {
+        tigrUseProgram(gl, p);
+        gl->pending = NULL;
+    } else {
+        gl->pending = p;
+    }
+}
 
-    gl->program = glCreateProgram();
-    glAttachShader(gl->program, vs);
-    glAttachShader(gl->program, fs);
-    glLinkProgram(gl->program);
-    tigrCheckProgramErrors(gl->program);
-    glDeleteShader(vs);
-    glDeleteShader(fs);
+// Picks up a pending program. Without a way to ask if linking is done,
+// this waits for it, which still moves the stall from tigrSetPostShader
+// to the next frame, leaving the driver time to link in the background.
+static void tigrUpdateShaderProgram(GLStuff* gl) {
+    TigrProgram* p = gl->pending;
+    if (p && tigrProgramReady(gl, p, !gl->program)) {
+        tigrUseProgram(gl, p);
+        gl->pending = NULL;
+    }
+}
 
-    gl->uniform_projection = glGetUniformLocation(gl->program, "projection");
-    gl->uniform_model = glGetUniformLocation(gl->program, "model");
-    gl->uniform_parameters = glGetUniformLocation(gl->program, "parameters");
+int tigrAddShaderPass(GLStuff* gl, const char* fxSource, int fxSize, float scale) {
+    if (gl->gl_legacy || gl->pass_count == TIGR_MAX_POST_PASSES) {
+        return -1;
+    }
+    TigrPostPass* pass = &gl->passes[gl->pass_count];
+    memset(pass, 0, sizeof(TigrPostPass));
+    pass->program = tigrFindProgram(gl, fxSource, fxSize);
+    pass->scale = scale > 0 ? scale : 1.0f;
+    pass->enabled = 1;
+    return gl->pass_count++;
 }
 
 void tigrGAPICreate(Tigr* bmp) {
@@ -6328,8 +9466,26 @@ void tigrGAPICreate(Tigr* bmp) {
         glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), NULL);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), NULL);
 
+        // check for program binaries and background shader compilation
+#if __ANDROID__ || __IOS__
+        gl->program_binary = 1;
+#else
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        gl->program_binary = major * 10 + minor >= 41 || tigrHasGLExtension("GL_ARB_get_program_binary");
+#ifdef _WIN32
+        gl->program_binary = gl->program_binary && glGetProgramBinary && glProgramBinary && glProgramParameteri;
+#endif
+#endif
+        gl->parallel_compile =
+            tigrHasGLExtension("GL_KHR_parallel_shader_compile") || tigrHasGLExtension("GL_ARB_parallel_shader_compile");
+
         // create program
-        tigrCreateShaderProgram(gl, tigr_default_fx_gl_fs, tigr_default_fx_gl_fs_size);
+        tigrSelectShaderProgram(gl, tigr_default_fx_gl_fs, tigr_default_fx_gl_fs_size);
+
+        // create pixel buffers for texture uploads
+        glGenBuffers(TIGR_PBO_COUNT, gl->pbo);
     }
 
     // create textures
@@ -6359,7 +9515,24 @@ void tigrGAPIDestroy(Tigr* bmp) {
 
     if (!gl->gl_legacy) {
         glDeleteTextures(2, gl->tex);
-        glDeleteProgram(gl->program);
+        for (int i = 0; i < TIGR_PROGRAM_CACHE_SIZE; i++) {
+            tigrDeleteProgram(&gl->programs[i]);
+        }
+        gl->program = 0;
+        gl->pending = NULL;
+        for (int i = 0; i < gl->pass_count; i++) {
+            TigrPostPass* pass = &gl->passes[i];
+            if (pass->fbo) {
+                glDeleteFramebuffers(1, &pass->fbo);
+                glDeleteTextures(1, &pass->tex);
+            }
+            if (pass->ubo) {
+                glDeleteBuffers(1, &pass->ubo);
+            }
+            free(pass->uniforms);
+        }
+        gl->pass_count = 0;
+        glDeleteBuffers(TIGR_PBO_COUNT, gl->pbo);
     }
 
     tigrCheckGLError("destroy");
@@ -6370,9 +9543,97 @@ void tigrGAPIDestroy(Tigr* bmp) {
     }
 }
 
+// Copies bitmap regions into the next pixel buffer of the ring, and leaves it bound.
+// The buffer keeps the bitmap layout, so regions are uploaded from the same offsets.
+// Returns the address to upload from, which is an offset into the buffer,
+// or the bitmap pixels themselves when pixel buffers are not available.
+static uintptr_t tigrGAPIStage(GLStuff* gl, Tigr* bmp, int (*rects)[4], int count) {
+    if (gl->gl_legacy) {
+        return (uintptr_t)bmp->pix;
+    }
+
+    int size = ((bmp->h - 1) * bmp->stride + bmp->w) * sizeof(TPixel);
+    int index = gl->pbo_index;
+    gl->pbo_index = (index + 1) % TIGR_PBO_COUNT;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, gl->pbo[index]);
+    if (gl->pbo_size[index] != size) {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        gl->pbo_size[index] = size;
+    }
+
+    // Invalidating lets the driver hand out fresh storage instead of
+    // waiting for pending uploads from this buffer to finish.
+    TPixel* mapped =
+        (TPixel*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!mapped) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return (uintptr_t)bmp->pix;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int* r = rects[i];
+        if (r[2] - r[0] == bmp->w) {
+            int offset = r[1] * bmp->stride;
+            memcpy(mapped + offset, bmp->pix + offset, ((r[3] - r[1] - 1) * bmp->stride + bmp->w) * sizeof(TPixel));
+        } else {
+            for (int y = r[1]; y < r[3]; y++) {
+                int offset = y * bmp->stride + r[0];
+                memcpy(mapped + offset, bmp->pix + offset, (r[2] - r[0]) * sizeof(TPixel));
+            }
+        }
+    }
+
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    return 0;
+}
+
+// Uploads bitmap contents to one of the textures.
+// Only the dirty regions are uploaded when tracking dirty regions.
+void tigrGAPIUpload(GLStuff* gl, int index, Tigr* bmp) {
+    TigrDirty* dirty = bmp->dirty;
+    int all[1][4] = { { 0, 0, bmp->w, bmp->h } };
+    int(*rects)[4] = all;
+    int count = 1;
+
+    glBindTexture(GL_TEXTURE_2D, gl->tex[index]);
+
+    if (gl->tex_w[index] != bmp->w || gl->tex_h[index] != bmp->h) {
+        // Texture storage is only allocated when the size changes.
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, bmp->w, bmp->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        gl->tex_w[index] = bmp->w;
+        gl->tex_h[index] = bmp->h;
+    } else if (dirty && !dirty->full) {
+        rects = dirty->rects;
+        count = dirty->count;
+    }
+
+    // An empty bitmap has nothing to upload, and its staging size would come out negative.
+    if (count > 0 && bmp->w > 0 && bmp->h > 0) {
+        uintptr_t base = tigrGAPIStage(gl, bmp, rects, count);
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, bmp->stride);
+        for (int i = 0; i < count; i++) {
+            int* r = rects[i];
+            uintptr_t offset = (r[1] * bmp->stride + r[0]) * sizeof(TPixel);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, r[0], r[1], r[2] - r[0], r[3] - r[1], GL_RGBA, GL_UNSIGNED_BYTE,
+                            (const void*)(base + offset));
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+        if (!gl->gl_legacy) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+
+    if (dirty) {
+        dirty->full = 0;
+        dirty->count = 0;
+    }
+}
+
 void tigrGAPIDraw(int legacy, GLuint uniform_model, GLuint tex, Tigr* bmp, int x1, int y1, int x2, int y2) {
     glBindTexture(GL_TEXTURE_2D, tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, bmp->w, bmp->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, bmp->pix);
 
     if (!legacy) {
         float sx = (float)(x2 - x1);
@@ -6402,9 +9663,89 @@ void tigrGAPIDraw(int legacy, GLuint uniform_model, GLuint tex, Tigr* bmp, int x
     }
 }
 
+// Runs the enabled post passes, each one reading the output of the one before.
+// Passes still being linked are skipped. Returns the texture holding the result.
+static GLuint tigrGAPIRunPasses(GLStuff* gl, TigrInternal* win, Tigr* bmp) {
+    GLuint image = gl->tex[0];
+    GLint target = 0;
+
+    if (gl->pass_count == 0) {
+        return image;
+    }
+
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+    glDisable(GL_BLEND);
+
+    for (int i = 0; i < gl->pass_count; i++) {
+        TigrPostPass* pass = &gl->passes[i];
+        if (!pass->enabled || !tigrProgramReady(gl, pass->program, 0)) {
+            continue;
+        }
+
+        int w = (int)(bmp->w * pass->scale + 0.5f);
+        int h = (int)(bmp->h * pass->scale + 0.5f);
+        w = w > 0 ? w : 1;
+        h = h > 0 ? h : 1;
+
+        if (!pass->fbo) {
+            glGenFramebuffers(1, &pass->fbo);
+            glGenTextures(1, &pass->tex);
+            glBindTexture(GL_TEXTURE_2D, pass->tex);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, pass->fbo);
+        if (pass->w != w || pass->h != h) {
+            glBindTexture(GL_TEXTURE_2D, pass->tex);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pass->tex, 0);
+            pass->w = w;
+            pass->h = h;
+        }
+
+        if (pass->uniforms_dirty) {
+            if (!pass->ubo) {
+                glGenBuffers(1, &pass->ubo);
+            }
+            glBindBuffer(GL_UNIFORM_BUFFER, pass->ubo);
+            glBufferData(GL_UNIFORM_BUFFER, pass->uniforms_size, pass->uniforms, GL_DYNAMIC_DRAW);
+            pass->uniforms_dirty = 0;
+        }
+        glBindBufferBase(GL_UNIFORM_BUFFER, 0, pass->ubo);
+
+        // Unlike the window, targets are not flipped, so they keep the bitmap layout.
+        float projection[16] = { 2.0f / w, 0.0f, 0.0f, 0.0f, 0.0f,  2.0f / h, 0.0f, 0.0f,
+                                 0.0f,     0.0f, 1.0f, 0.0f, -1.0f, -1.0f,    0.0f, 1.0f };
+
+        TigrProgram* p = pass->program;
+        glViewport(0, 0, w, h);
+        glUseProgram(p->program);
+        glUniformMatrix4fv(p->uniform_projection, 1, GL_FALSE, projection);
+        glUniform4f(p->uniform_parameters, win->p1, win->p2, win->p3, win->p4);
+        tigrGAPIDraw(0, p->uniform_model, image, bmp, 0, 0, w, h);
+        image = pass->tex;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    return image;
+}
+
 void tigrGAPIPresent(Tigr* bmp, int w, int h) {
     TigrInternal* win = tigrInternal(bmp);
     GLStuff* gl = &win->gl;
+    GLuint image = gl->tex[0];
+
+    tigrGAPIUpload(gl, 0, bmp);
+    tigrFrameStage(win, TIGR_STAGE_UPLOAD);
+    if (!gl->gl_legacy) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, gl->tex[0]);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(gl->vao);
+        image = tigrGAPIRunPasses(gl, win, bmp);
+    }
 
     glViewport(0, 0, w, h);
     if (!gl->gl_user_opengl_rendering) {
@@ -6416,8 +9757,8 @@ void tigrGAPIPresent(Tigr* bmp, int w, int h) {
         float projection[16] = { 2.0f / w, 0.0f, 0.0f, 0.0f, 0.0f,  -2.0f / h, 0.0f, 0.0f,
                                  0.0f,     0.0f, 1.0f, 0.0f, -1.0f, 1.0f,      0.0f, 1.0f };
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindVertexArray(gl->vao);
+        tigrUpdateShaderProgram(gl);
+
         glUseProgram(gl->program);
         glUniformMatrix4fv(gl->uniform_projection, 1, GL_FALSE, projection);
         glUniform4f(gl->uniform_parameters, win->p1, win->p2, win->p3, win->p4);
@@ -6438,11 +9779,12 @@ void tigrGAPIPresent(Tigr* bmp, int w, int h) {
     } else {
         glDisable(GL_BLEND);
     }
-    tigrGAPIDraw(gl->gl_legacy, gl->uniform_model, gl->tex[0], bmp, win->pos[0], win->pos[1], win->pos[2], win->pos[3]);
+    tigrGAPIDraw(gl->gl_legacy, gl->uniform_model, image, bmp, win->pos[0], win->pos[1], win->pos[2], win->pos[3]);
 
     if (win->widgetsScale > 0) {
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        tigrGAPIUpload(gl, 1, win->widgets);
         tigrGAPIDraw(gl->gl_legacy, gl->uniform_model, gl->tex[1], win->widgets,
                      (int)(w - win->widgets->w * win->widgetsScale), 0, w, (int)(win->widgets->h * win->widgetsScale));
     }
@@ -6461,6 +9803,12 @@ void tigrGAPIPresent(Tigr* bmp, int w, int h) {
 //#include "tigr_internal.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sched.h>
+#include <time.h>
+#endif
 
 #ifndef __ANDROID__
 
@@ -6568,7 +9916,139 @@ char* tigrEncodeUTF8(char* text, int cp) {
 #undef EMIT
 }
 
+unsigned long long tigrTimeNs(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    unsigned long long seconds = now.QuadPart / freq.QuadPart;
+    unsigned long long rest = now.QuadPart % freq.QuadPart;
+    return seconds * 1000000000ull + rest * 1000000000ull / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+float tigrTimerDelta(TigrTimer* timer) {
+    unsigned long long now = tigrTimeNs();
+    float elapsed = timer->last ? (now - timer->last) / 1e9f : 0.0f;
+    timer->last = now;
+    return elapsed;
+}
+
+#ifdef _WIN32
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Sleep rounds up to the 15.6 ms system tick, which at 60 Hz loses whole frames.
+// High resolution waitable timers don't, but need Windows 10 1803 or later.
+// Without them, only whole ticks are slept and the rest is spun.
+static void tigrLimiterSleep(TigrLimiter* limiter, unsigned long long ns) {
+    static int noHighResolutionTimers;
+    if (!limiter->timer && !noHighResolutionTimers) {
+        limiter->timer =
+            CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        noHighResolutionTimers = limiter->timer == NULL;
+    }
+    if (limiter->timer) {
+        LARGE_INTEGER due;
+        due.QuadPart = -(LONGLONG)(ns / 100);
+        if (SetWaitableTimer(limiter->timer, &due, 0, NULL, NULL, FALSE)) {
+            WaitForSingleObject(limiter->timer, INFINITE);
+            return;
+        }
+    }
+    const unsigned long long tick = 16000000;
+    if (ns > tick) {
+        Sleep((DWORD)((ns - tick) / 1000000));
+    }
+}
+#endif
+
+void tigrLimitFrame(TigrLimiter* limiter) {
+    if (!limiter->interval) {
+        return;
+    }
+
+    unsigned long long now = tigrTimeNs();
+    if (now + limiter->interval < limiter->next || now > limiter->next + limiter->interval) {
+        // First frame, or far off schedule after a stall. Start over rather than catching up.
+        limiter->next = now + limiter->interval;
+        return;
+    }
+
+    // Sleep most of the way, since sleeps can overshoot by a scheduler tick,
+    // then yield until the deadline.
+    const unsigned long long margin = 2000000;
+    if (limiter->next > now + margin) {
+        unsigned long long sleep = limiter->next - now - margin;
+#ifdef _WIN32
+        tigrLimiterSleep(limiter, sleep);
+#else
+        struct timespec ts = { (time_t)(sleep / 1000000000ull), (long)(sleep % 1000000000ull) };
+        nanosleep(&ts, NULL);
+#endif
+    }
+    while (tigrTimeNs() < limiter->next) {
+#ifdef _WIN32
+        Sleep(0);
+#else
+        sched_yield();
+#endif
+    }
+    limiter->next += limiter->interval;
+}
+
+static TigrLimiter waitLimiter;
+
+static void setLimiterRate(TigrLimiter* limiter, float fps) {
+    limiter->interval = fps > 0 ? (unsigned long long)(1e9 / fps) : 0;
+    limiter->next = 0;
+}
+
+void tigrSetFrameRate(Tigr* bmp, float fps) {
+    if (!bmp) {
+        setLimiterRate(&waitLimiter, fps);
+    }
 #ifndef TIGR_HEADLESS
+    else if (bmp->handle) {
+        setLimiterRate(&tigrInternal(bmp)->limiter, fps);
+    }
+#endif
+}
+
+void tigrWaitFrame(void) {
+    tigrLimitFrame(&waitLimiter);
+}
+
+#ifdef TIGR_HEADLESS
+
+void tigrError(Tigr* bmp, const char* message, ...) {
+    char tmp[1024];
+
+    va_list args;
+    va_start(args, message);
+    vsnprintf(tmp, sizeof(tmp), message, args);
+    tmp[sizeof(tmp) - 1] = 0;
+    va_end(args);
+
+    fprintf(stderr, "tigr fatal error: %s\n", tmp);
+
+    exit(1);
+}
+
+float tigrTime(void) {
+    static TigrTimer timer;
+    return tigrTimerDelta(&timer);
+}
+
+#else
 
 int tigrBeginOpenGL(Tigr* bmp) {
 #ifdef TIGR_GAPI_GL
@@ -6585,11 +10065,171 @@ void tigrSetPostShader(Tigr* bmp, const char* code, int size) {
     tigrGAPIBegin(bmp);
     TigrInternal* win = tigrInternal(bmp);
     GLStuff* gl = &win->gl;
-    tigrCreateShaderProgram(gl, code, size);
+    tigrSelectShaderProgram(gl, code, size);
+    tigrGAPIEnd(bmp);
+#endif
+}
+
+int tigrAddPostPass(Tigr* bmp, const char* code, int size, float scale) {
+#ifdef TIGR_GAPI_GL
+    tigrGAPIBegin(bmp);
+    TigrInternal* win = tigrInternal(bmp);
+    int pass = tigrAddShaderPass(&win->gl, code, size, scale);
     tigrGAPIEnd(bmp);
+    return pass;
+#else
+    return -1;
+#endif
+}
+
+void tigrEnablePostPass(Tigr* bmp, int pass, int enable) {
+#ifdef TIGR_GAPI_GL
+    GLStuff* gl = &tigrInternal(bmp)->gl;
+    if (pass >= 0 && pass < gl->pass_count) {
+        gl->passes[pass].enabled = enable;
+    }
+#endif
+}
+
+void tigrSetPostPassUniforms(Tigr* bmp, int pass, const void* data, int size) {
+#ifdef TIGR_GAPI_GL
+    GLStuff* gl = &tigrInternal(bmp)->gl;
+    if (pass < 0 || pass >= gl->pass_count) {
+        return;
+    }
+    // Uploaded on the next present, so this can be called every frame.
+    TigrPostPass* p = &gl->passes[pass];
+    if (p->uniforms_size != size) {
+        void* uniforms = realloc(p->uniforms, size);
+        if (!uniforms) {
+            return;
+        }
+        p->uniforms = uniforms;
+        p->uniforms_size = size;
+    }
+    memcpy(p->uniforms, data, size);
+    p->uniforms_dirty = 1;
 #endif
 }
 
+void tigrPushEvent(TigrInternal* win, const TigrEvent* event) {
+    TigrEventQueue* q = &win->events;
+
+    if (q->head - TIGR_LOAD_ACQUIRE(&q->tail) < TIGR_EVENT_QUEUE) {
+        q->events[q->head % TIGR_EVENT_QUEUE] = *event;
+        TIGR_STORE_RELEASE(&q->head, q->head + 1);
+    }
+
+    if (event->type == TIGR_EVENT_CHAR && q->charHead - TIGR_LOAD_ACQUIRE(&q->charTail) < TIGR_CHAR_QUEUE) {
+        q->chars[q->charHead % TIGR_CHAR_QUEUE] = event->key;
+        TIGR_STORE_RELEASE(&q->charHead, q->charHead + 1);
+    }
+}
+
+void tigrNextEvents(TigrInternal* win) {
+    TigrEventQueue* q = &win->events;
+    TIGR_STORE_RELEASE(&q->tail, q->frame);
+    TIGR_STORE_RELEASE(&q->charTail, q->charFrame);
+    q->frame = TIGR_LOAD_ACQUIRE(&q->head);
+    q->charFrame = TIGR_LOAD_ACQUIRE(&q->charHead);
+}
+
+int tigrPopChar(TigrInternal* win) {
+    TigrEventQueue* q = &win->events;
+    if (q->charTail == q->charFrame) {
+        return 0;
+    }
+    int c = q->chars[q->charTail % TIGR_CHAR_QUEUE];
+    TIGR_STORE_RELEASE(&q->charTail, q->charTail + 1);
+    return c;
+}
+
+int tigrPollEvent(Tigr* bmp, TigrEvent* event) {
+    if (!bmp->handle) {
+        return 0;
+    }
+    TigrEventQueue* q = &tigrInternal(bmp)->events;
+    if (q->tail == q->frame) {
+        return 0;
+    }
+    *event = q->events[q->tail % TIGR_EVENT_QUEUE];
+    TIGR_STORE_RELEASE(&q->tail, q->tail + 1);
+    return 1;
+}
+
+static int frameBucket(float ms) {
+    return ms < TIGR_STATS_BUCKETS * 2 ? (int)ms / 2 : TIGR_STATS_BUCKETS - 1;
+}
+
+void tigrFrameBegin(TigrInternal* win) {
+    TigrFrameTimer* timer = &win->timer;
+    TigrFrameStats* stats = &timer->stats;
+    unsigned long long now = tigrTimeNs();
+
+    if (timer->frameStart) {
+        float frame = (now - timer->frameStart) / 1e6f;
+
+        // The histogram covers the most recent frames, drop the one falling out.
+        if (timer->recentCount == TIGR_STATS_WINDOW) {
+            stats->histogram[frameBucket(timer->recent[timer->recentPos])]--;
+        }
+        stats->histogram[frameBucket(frame)]++;
+        timer->recent[timer->recentPos] = frame;
+        timer->recentPos = (timer->recentPos + 1) % TIGR_STATS_WINDOW;
+
+        stats->frame = frame;
+        float average = timer->recentCount ? stats->averageFrame : frame;
+        stats->averageFrame = average + (frame - average) / 16;
+        if (timer->recentCount < TIGR_STATS_WINDOW) {
+            timer->recentCount++;
+        }
+    }
+
+    timer->frameStart = timer->mark = now;
+    memset(stats->stage, 0, sizeof(stats->stage));
+    stats->wait = 0;
+}
+
+void tigrFrameStage(TigrInternal* win, int stage) {
+    TigrFrameTimer* timer = &win->timer;
+    unsigned long long now = tigrTimeNs();
+    timer->stats.stage[stage] += (now - timer->mark) / 1e6f;
+    timer->mark = now;
+}
+
+void tigrFrameEnd(TigrInternal* win, int stage) {
+    TigrFrameStats* stats = &win->timer.stats;
+    tigrFrameStage(win, stage);
+    for (int i = 0; i < TIGR_STAGES; i++) {
+        float average = stats->frames ? stats->average[i] : stats->stage[i];
+        stats->average[i] = average + (stats->stage[i] - average) / 16;
+    }
+    stats->frames++;
+}
+
+void tigrFrameWait(TigrInternal* win) {
+    TigrFrameTimer* timer = &win->timer;
+    tigrLimitFrame(&win->limiter);
+    unsigned long long now = tigrTimeNs();
+    timer->stats.wait = (now - timer->mark) / 1e6f;
+    timer->mark = now;
+}
+
+void tigrGetFrameStats(Tigr* bmp, TigrFrameStats* stats) {
+    if (!bmp->handle) {
+        memset(stats, 0, sizeof(TigrFrameStats));
+        return;
+    }
+    TigrFrameTimer* timer = &tigrInternal(bmp)->timer;
+    *stats = timer->stats;
+    stats->worstFrame = 0;
+    for (int i = 0; i < timer->recentCount; i++) {
+        if (timer->recent[i] > stats->worstFrame) {
+            stats->worstFrame = timer->recent[i];
+        }
+    }
+}
+
 void tigrSetPostFX(Tigr* bmp, float p1, float p2, float p3, float p4) {
     TigrInternal* win = tigrInternal(bmp);
     win->p1 = p1;
@@ -46,13 +46,31 @@ typedef struct {
 #define TIGR_NOCURSOR   32  // hide cursor
 #define TIGR_FULLSCREEN 64  // start in full-screen mode
 
+#define TIGR_MAX_DIRTY 16
+
+// Bitmap flags.
+#define TIGR_BITMAP_EXTERNAL 1      // Pixels are owned by the caller, see tigrBitmapFromMemory
+#define TIGR_BITMAP_PREMULTIPLIED 2 // Colors are premultiplied by alpha, see tigrPremultiply
+
+// Regions changed since the last present, see tigrTrackDirty.
+typedef struct {
+    int full;                       // non-zero if the whole bitmap is dirty
+    int count;                      // number of dirty rects
+    int rects[TIGR_MAX_DIRTY][4];   // x0, y0, x1, y1 (exclusive)
+} TigrDirty;
+
 // A Tigr bitmap.
 typedef struct Tigr {
     int w, h;           // width/height (unscaled)
     int cx, cy, cw, ch; // clip rect
     TPixel *pix;        // pixel data
+    int stride;         // pixels from the start of one row to the next, at least w
+    int flags;          // TIGR_BITMAP_* flags
     void *handle;       // OS window handle, NULL for off-screen bitmaps.
     int blitMode;       // Target bitmap blit mode
+    TigrDirty *dirty;   // Dirty regions, NULL unless tracked
+    struct TigrShared *shared; // Shared memory frames, NULL unless made by tigrShared/tigrSharedOpen
+    unsigned char *opacity;    // Opacity per row, NULL unless tracked, see tigrTrackOpacity
 } Tigr;
 
 // Creates a new empty window with a given bitmap size.
@@ -77,6 +95,24 @@ Tigr *tigrWindow(int w, int h, const char *title, int flags);
 // Creates an empty off-screen bitmap.
 Tigr *tigrBitmap(int w, int h);
 
+// Creates an off-screen bitmap without clearing it, for bitmaps that are about to be
+// completely overwritten anyway. The initial pixel contents are undefined.
+Tigr *tigrBitmapUninit(int w, int h);
+
+// Pads the rows of bitmaps and windows created from now on to a multiple of `bytes`,
+// for example 64 to start every row on a cache line. The default, 4, adds no padding.
+// Padded bitmaps have a stride larger than their width.
+// Pixel data created by tigr always starts 64-byte aligned.
+void tigrSetRowAlignment(int bytes);
+
+// Creates an off-screen bitmap using existing pixel memory, without copying.
+// Rows are `stride` pixels apart, which makes it possible to wrap a part of a larger
+// image, such as a sub-rectangle of an atlas:
+//   tigrBitmapFromMemory(atlas->pix + y * atlas->stride + x, w, h, atlas->stride)
+// The memory is not freed by tigrFree, and must outlive the bitmap.
+// On error, returns NULL and sets errno.
+Tigr *tigrBitmapFromMemory(TPixel *pix, int w, int h, int stride);
+
 // Deletes a window/bitmap.
 void tigrFree(Tigr *bmp);
 
@@ -86,14 +122,104 @@ int tigrClosed(Tigr *bmp);
 // Displays a window's contents on-screen and updates input.
 void tigrUpdate(Tigr *bmp);
 
+// Stages of tigrUpdate, as timed by tigrGetFrameStats.
+enum {
+    TIGR_STAGE_INPUT,   // Event processing and window bookkeeping
+    TIGR_STAGE_UPLOAD,  // Copying the bitmap to the GPU
+    TIGR_STAGE_DRAW,    // Post passes, post shader and widgets
+    TIGR_STAGE_SWAP,    // Presenting, including any wait for vsync, but not for tigrSetFrameRate
+    TIGR_STAGES
+};
+
+// Number of recent frames in the frame time histogram.
+#define TIGR_STATS_WINDOW 128
+
+// Number of histogram buckets. Each bucket is 2 ms wide,
+// the last one also counting all slower frames.
+#define TIGR_STATS_BUCKETS 16
+
+typedef struct {
+    int frames;                        // Frames timed since the window was created
+    float stage[TIGR_STAGES];          // CPU time per stage of the last frame (ms)
+    float average[TIGR_STAGES];        // Moving average of the stage times (ms)
+    float frame;                       // Time between the last two tigrUpdate calls (ms)
+    float averageFrame;                // Moving average of the frame time (ms)
+    float worstFrame;                  // Slowest of the recent frames (ms)
+    int histogram[TIGR_STATS_BUCKETS]; // Recent frames by frame time
+    float wait;                        // Time the last frame slept to keep to tigrSetFrameRate (ms),
+                                       // counted in the frame time but in none of the stages
+} TigrFrameStats;
+
+// Gets timing statistics for the frames shown by tigrUpdate.
+// Timing is always on, and costs a few clock reads per frame.
+void tigrGetFrameStats(Tigr *bmp, TigrFrameStats *stats);
+
+// Sets how many vertical blanks a window waits for when swapping buffers.
+// 1 syncs to every vblank (the default), 0 turns vsync off, and -1 asks
+// for adaptive vsync, which only tears when a frame is late.
+// Returns non-zero if the driver accepted the interval.
+int tigrSetSwapInterval(Tigr *bmp, int interval);
+
+// Caps the frame rate of a window, with tigrUpdate sleeping until 1/fps
+// seconds have passed since the previous frame. Zero removes the cap (the default).
+// With a NULL bitmap, sets the frame rate used by tigrWaitFrame instead.
+void tigrSetFrameRate(Tigr *bmp, float fps);
+
+// Sleeps until the next frame is due, at the rate set by tigrSetFrameRate(NULL, fps).
+// Paces loops that have no window, such as headless renderers.
+void tigrWaitFrame(void);
+
 // Called before doing direct OpenGL calls and before tigrUpdate.
 // Returns non-zero if OpenGL is available.
 int tigrBeginOpenGL(Tigr *bmp);
 
+// Enables or disables dirty region tracking for a window/bitmap.
+//
+// When enabled, the drawing functions record the regions they change,
+// and tigrUpdate only uploads those regions to the GPU - or nothing at all,
+// if nothing changed. Changes made directly to bmp->pix must be reported
+// using tigrDirty. Tracking starts out with the whole bitmap dirty.
+void tigrTrackDirty(Tigr *bmp, int enable);
+
+// Marks a region of a bitmap as changed.
+// Does nothing unless dirty or opacity tracking is enabled.
+void tigrDirty(Tigr *bmp, int x, int y, int w, int h);
+
+// Enables or disables opacity tracking for a bitmap used as a blit source.
+//
+// When enabled, tigrBlitTint and tigrBlitAlpha copy rows that are fully
+// opaque and skip rows that are fully transparent, and only blend the rest.
+// Rows are checked when first blitted, and again after the drawing functions
+// change them. Changes made directly to bmp->pix must be reported using tigrDirty.
+void tigrTrackOpacity(Tigr *bmp, int enable);
+
 // Sets post shader for a window.
 // This replaces the built-in post-FX shader.
+// Shaders are compiled in the background where the driver allows it,
+// the previous shader stays active until the new one is ready.
+// Recently used shaders are kept, so switching back to one is instant.
 void tigrSetPostShader(Tigr *bmp, const char* code, int size);
 
+// Adds a post pass to a window, run before the post shader.
+// A pass shader has the same form as a post shader, with `image` being the
+// output of the previous pass, and `source` always being the window bitmap.
+// Passes render at `scale` times the bitmap size, 0.5 giving a half-size pass.
+// The post shader then reads the output of the last enabled pass as `image`.
+// Returns the pass index, or -1 if no more passes can be added.
+int tigrAddPostPass(Tigr *bmp, const char* code, int size, float scale);
+
+// Enables or disables a post pass. Disabled passes are skipped.
+void tigrEnablePostPass(Tigr *bmp, int pass, int enable);
+
+// Sets the contents of the `uniform PassUniforms` block of a post pass.
+// The data must follow the std140 layout of the block in the pass shader.
+void tigrSetPostPassUniforms(Tigr *bmp, int pass, const void* data, int size);
+
+// Sets a directory for caching compiled post shaders between runs,
+// or NULL to disable caching (the default).
+// Only used when the OpenGL driver supports program binaries.
+void tigrSetShaderCache(const char *directory);
+
 // Sets post-FX properties for a window.
 //
 // The built-in post-FX shader uses the following parameters:
@@ -104,6 +230,57 @@ void tigrSetPostShader(Tigr *bmp, const char* code, int size);
 void tigrSetPostFX(Tigr *bmp, float p1, float p2, float p3, float p4);
 
 
+// Shared frames ----------------------------------------------------------
+
+// Layout of the shared memory behind a shared bitmap, for consumers not using tigr.
+// Frame buffers follow at `offset`, each w*h pixels. To read the newest frame, store
+// `latest` into `reading`, then check that `latest` is unchanged, retrying if not.
+// The held buffer is left alone until `reading` changes. Access `latest` and `reading`
+// with sequentially consistent atomics.
+#define TIGR_SHARED_MAGIC 0x48534754 // "TGSH"
+typedef struct {
+    unsigned magic;
+    int w, h;
+    int buffers;                 // Number of frame buffers, 2 or 3
+    int offset;                  // Byte offset of the first frame buffer
+    int latest;                  // Newest published buffer, -1 before the first frame
+    int reading;                 // Buffer held by the consumer, -1 if none
+    int pad;
+    unsigned long long frame[3]; // Frame number of each buffer, counting from 1
+} TigrSharedHeader;
+
+// Creates an off-screen bitmap whose pixels live in shared memory, so that finished
+// frames can be handed to another local process (an encoder, a compositor) without copying.
+// `name` is a POSIX shared memory name like "/frames", removed again by tigrFree.
+// With a NULL name, the memory is anonymous and can be passed on using tigrSharedFd.
+// With 3 buffers, tigrSharedPublish never waits. With 2, it waits while the consumer
+// holds the previous frame. The size is fixed for the life of the bitmap.
+// Not available on Windows or Android. On error, returns NULL and sets errno.
+Tigr *tigrShared(const char *name, int w, int h, int buffers, int flags);
+
+// Flags for tigrShared.
+#define TIGR_SHARED_KEEP 1 // each new frame starts out as a copy of the one just published
+
+// Publishes the contents of a shared bitmap as a finished frame.
+// Drawing continues in another buffer, which holds an older frame, unless made with
+// TIGR_SHARED_KEEP. Without it, redraw every pixel, or track what changed yourself.
+// Returns 0 and sets errno to ETIMEDOUT if the consumer holds on to the other of
+// two buffers for longer than TIGR_SHARED_TIMEOUT (a second), as when it has died.
+// The frame is published regardless, and drawing carries on in it.
+int tigrSharedPublish(Tigr *bmp);
+
+// Opens a shared bitmap created by another process, by name, or by fd if name is NULL.
+// The bitmap is read-only, and only has valid contents after tigrSharedAcquire.
+// On error, returns NULL and sets errno.
+Tigr *tigrSharedOpen(const char *name, int fd);
+
+// Points an opened shared bitmap at the newest published frame, holding on to it
+// until the next call or tigrFree. Returns non-zero if there was a new frame.
+int tigrSharedAcquire(Tigr *bmp);
+
+// Returns the file descriptor of a bitmap made by tigrShared, or -1.
+int tigrSharedFd(Tigr *bmp);
+
 // Drawing ----------------------------------------------------------------
 
 // Helper for reading pixels.
@@ -123,6 +300,13 @@ void tigrClear(Tigr *bmp, TPixel color);
 // No blending, no clipping.
 void tigrFill(Tigr *bmp, int x, int y, int w, int h, TPixel color);
 
+// Lets tigrClear and tigrFill split very large areas (several megabytes)
+// between up to `count` threads. The default, 1, fills on the calling thread only.
+// The extra threads are started here and wait between fills, so call this once
+// rather than per frame. Fills made while another thread's fill is using them
+// run on the calling thread alone.
+void tigrSetFillThreads(int count);
+
 // Draws a line.
 // Start pixel is drawn, end pixel is not.
 // Clips and blends.
@@ -154,6 +338,19 @@ void tigrCircle(Tigr *bmp, int x, int y, int r, TPixel color);
 // Clips and blends.
 void tigrFillCircle(Tigr *bmp, int x, int y, int r, TPixel color);
 
+// Converts a bitmap to premultiplied alpha, where colors are stored already multiplied by
+// their alpha, or back to straight alpha. Sets or clears TIGR_BITMAP_PREMULTIPLIED.
+//
+// Blits from premultiplied bitmaps use the "over" operator, which composes layers
+// correctly and needs one multiply per channel when the tint is white:
+// RGBAdest = RGBAsrc + RGBAdest * (1 - Asrc)
+// Drawn onto an opaque or premultiplied target, they look the same as straight alpha
+// blits, without dark fringes around filtered or translucent edges.
+// Drawing functions taking a color always use straight alpha colors. On a premultiplied
+// target, they and straight alpha blits premultiply what they draw, and blend with "over".
+void tigrPremultiply(Tigr *bmp);
+void tigrUnpremultiply(Tigr *bmp);
+
 // Sets clip rect.
 // Set to (0, 0, -1, -1) to reset clipping to full bitmap.
 void tigrClip(Tigr *bmp, int cx, int cy, int cw, int ch);
@@ -199,6 +396,29 @@ void tigrBlitAlpha(Tigr *dest, Tigr *src, int dx, int dy, int sx, int sy, int w,
 // Clips and blends.
 void tigrBlitTint(Tigr *dest, Tigr *src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint);
 
+// Filtering for scaled and transformed blits.
+enum TIGRFilter {
+    TIGR_NEAREST = 0,   // Pick the nearest source pixel
+    TIGR_BILINEAR = 1,  // Interpolate between the four nearest source pixels
+};
+
+// Same as tigrBlitTint, but scales the source rect sx/sy/sw/sh to fill the
+// destination rect dx/dy/dw/dh. A negative dw or dh mirrors the image.
+// Clips and blends.
+void tigrBlitScaled(Tigr *dest, Tigr *src, int dx, int dy, int dw, int dh, int sx, int sy, int sw, int sh,
+                    TPixel tint, int filter);
+
+// Same as tigrBlitTint, but transforms the source rect sx/sy/sw/sh by an affine matrix.
+// A point u/v in the source rect (relative to sx/sy) lands on the destination at
+//   x = m[0] * u + m[1] * v + m[2]
+//   y = m[3] * u + m[4] * v + m[5]
+// For example, rotating by angle a around the rect center, placed at cx/cy:
+//   { cos(a), -sin(a), cx - cos(a) * sw/2 + sin(a) * sh/2,
+//     sin(a),  cos(a), cy - sin(a) * sw/2 - cos(a) * sh/2 }
+// Clips and blends.
+void tigrBlitTransformed(Tigr *dest, Tigr *src, int sx, int sy, int sw, int sh, const float m[6], TPixel tint,
+                         int filter);
+
 enum TIGRBlitMode {
     TIGR_KEEP_ALPHA = 0,    // Keep destination alpha value
     TIGR_BLEND_ALPHA = 1,   // Blend destination alpha (default)
@@ -207,6 +427,115 @@ enum TIGRBlitMode {
 // Set destination bitmap blend mode for blit operations.
 void tigrBlitMode(Tigr *dest, int mode);
 
+// Blend operations for tigrBlitBlend.
+enum TIGRBlend {
+    TIGR_ADD = 0,       // RGBdest = RGBdest + RGBblend * Ablend
+    TIGR_MULTIPLY = 1,  // RGBdest = RGBdest * (RGBblend * Ablend + (1 - Ablend))
+    TIGR_SCREEN = 2,    // RGBdest = RGBdest + RGBblend * Ablend * (1 - RGBdest)
+};
+
+// Same as tigrBlitTint, but combines the tinted source with the destination
+// using one of the blend operations above, for example additive particles or
+// multiplied shadows. A premultiplied source is used as is for RGBblend * Ablend.
+//
+// Blit mode == TIGR_KEEP_ALPHA:
+// Adest = Adest
+//
+// Blit mode == TIGR_BLEND_ALPHA:
+// Adest = Ablend + Adest * (1 - Ablend)
+// Clips and blends.
+void tigrBlitBlend(Tigr *dest, Tigr *src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint, int blend);
+
+// A bitmap compiled into runs of transparent, opaque and partly
+// transparent pixels, so blits can skip and copy most of it.
+typedef struct {
+    int w, h;       // Size of the source bitmap
+    int flags;      // Flags of the source bitmap
+    int *rows;      // Per row, the first run and the first pixel; 2 * h + 2 entries
+    int *runs;      // Counts of skipped, copied and blended pixels, three per run
+    TPixel *pix;    // Copied and blended pixels, in order
+} TigrSprite;
+
+// Compiles a sprite from a bitmap. Pixels with zero alpha are left out,
+// or, for a premultiplied bitmap, pixels that are zero altogether.
+// Returns NULL on error, and sets errno.
+TigrSprite *tigrSprite(Tigr *src);
+
+// Same as tigrBlitTint for the whole source bitmap of a sprite.
+// Clips and blends.
+void tigrBlitSprite(Tigr *dest, TigrSprite *sprite, int dx, int dy, TPixel tint);
+
+// Frees a sprite.
+void tigrFreeSprite(TigrSprite *sprite);
+
+// A bitmap of palette indices, at a quarter or less of the memory of a Tigr.
+typedef struct {
+    int w, h;               // Size in pixels
+    int bits;               // Bits per index: 1, 2, 4 or 8
+    int stride;             // Bytes from the start of one row to the next
+    unsigned char *data;    // Indices, packed from the high bits of each byte down
+    TPixel palette[256];    // Color of each index
+} TigrIndexed;
+
+// Creates an indexed bitmap, with every index 0 and every color transparent black.
+// Returns NULL on error, and sets errno.
+TigrIndexed *tigrIndexed(int w, int h, int bits);
+
+// Reads and writes an index. Out of bounds reads give 0, and writes do nothing.
+int tigrGetIndex(TigrIndexed *bmp, int x, int y);
+void tigrSetIndex(TigrIndexed *bmp, int x, int y, int index);
+
+// Same as tigrBlitTint, but looks up each source pixel in the palette.
+// Changing the palette recolors the bitmap on the next blit.
+// Clips and blends.
+void tigrBlitIndexed(Tigr *dest, TigrIndexed *src, int dx, int dy, int sx, int sy, int w, int h, TPixel tint);
+
+// Frees an indexed bitmap.
+void tigrFreeIndexed(TigrIndexed *bmp);
+
+// Width and height of the tiles of a TigrTiled bitmap.
+#define TIGR_TILE 8
+
+// An off-screen bitmap stored in square tiles instead of rows, so pixels
+// above and below each other are close in memory. Drawing down columns or
+// at an angle, such as rotated blits from it, touches far fewer cache lines.
+typedef struct {
+    int w, h;       // Size in pixels
+    int tilesX;     // Tiles across
+    TPixel *pix;    // Tiles, row by row, each TIGR_TILE rows of TIGR_TILE pixels
+} TigrTiled;
+
+// Finds a pixel of a tiled bitmap. Does not check bounds.
+TIGR_INLINE TPixel *tigrTiledPixel(TigrTiled *bmp, int x, int y)
+{
+    unsigned tx = (unsigned)x / TIGR_TILE, ty = (unsigned)y / TIGR_TILE;
+    return bmp->pix + (ty * bmp->tilesX + tx) * (TIGR_TILE * TIGR_TILE) +
+           ((unsigned)y % TIGR_TILE) * TIGR_TILE + (unsigned)x % TIGR_TILE;
+}
+
+// Creates a tiled bitmap, cleared to transparent black.
+// Returns NULL on error, and sets errno.
+TigrTiled *tigrTiled(int w, int h);
+
+// Same as tigrGet, tigrPlot, tigrFill and tigrLine, for a tiled bitmap.
+// Clips to the bitmap, and blends destination alpha.
+TPixel tigrTiledGet(TigrTiled *bmp, int x, int y);
+void tigrTiledPlot(TigrTiled *bmp, int x, int y, TPixel pix);
+void tigrTiledFill(TigrTiled *bmp, int x, int y, int w, int h, TPixel color);
+void tigrTiledLine(TigrTiled *bmp, int x0, int y0, int x1, int y1, TPixel color);
+
+// Copies a bitmap into a tiled bitmap, or back, for the area both cover.
+// tigrLinearize is the step before showing a tiled bitmap in a window.
+void tigrTile(TigrTiled *dest, Tigr *src);
+void tigrLinearize(Tigr *dest, TigrTiled *src);
+
+// Same as tigrBlitTransformed, from a tiled bitmap.
+void tigrBlitTiledTransformed(Tigr *dest, TigrTiled *src, int sx, int sy, int sw, int sh, const float m[6],
+                              TPixel tint, int filter);
+
+// Frees a tiled bitmap.
+void tigrFreeTiled(TigrTiled *bmp);
+
 // Helper for making colors.
 TIGR_INLINE TPixel tigrRGB(unsigned char r, unsigned char g, unsigned char b)
 {
@@ -224,12 +553,21 @@ TIGR_INLINE TPixel tigrRGBA(unsigned char r, unsigned char g, unsigned char b, u
 
 typedef struct {
     int code, x, y, w, h;
+    int bearing;        // x offset of the glyph image from the pen position
+    int advance;        // pen movement after the glyph, defaults to w
 } TigrGlyph;
 
+typedef struct {
+    int left, right;    // code points of the pair
+    int amount;         // extra pen movement between the pair, often negative
+} TigrKerningPair;
+
 typedef struct {
     Tigr *bitmap;
     int numGlyphs;
     TigrGlyph *glyphs;
+    int kerningMask;            // kerning table size - 1
+    TigrKerningPair *kerning;   // hashed kerning pairs, NULL if none
 } TigrFont;
 
 typedef enum {
@@ -255,9 +593,25 @@ typedef enum {
 //
 TigrFont *tigrLoadFont(Tigr *bitmap, int codepage);
 
+// Loads a font from a bitmap font sheet and precomputed glyph metrics,
+// skipping the font sheet scan. Handy for large UTF32 fonts.
+// The metrics are in the format written by tigrSaveFontMetrics,
+// and can also carry glyph bearings, advances and kerning pairs.
+// The loaded font takes ownership of the provided bitmap.
+// On error, returns NULL and sets errno.
+TigrFont *tigrLoadFontMetrics(Tigr *bitmap, const void *data, int length);
+
+// Saves the glyph metrics and kerning of a font to a file. (fileName is UTF-8)
+// On error, returns zero and sets errno.
+int tigrSaveFontMetrics(const char *fileName, TigrFont *font);
+
 // Frees a font and associated font sheet.
 void tigrFreeFont(TigrFont *font);
 
+// Sets the kerning pairs of a font, replacing any previous ones.
+// Pairs with a zero amount are ignored.
+void tigrSetFontKerning(TigrFont *font, const TigrKerningPair *pairs, int numPairs);
+
 // Prints UTF-8 text onto a bitmap.
 // NOTE:
 //  This uses the target bitmap blit mode.
@@ -271,6 +625,11 @@ int tigrTextHeight(TigrFont *font, const char *text);
 // The built-in font.
 extern TigrFont *tfont;
 
+// Decodes the built-in font up front.
+// Otherwise, this happens on first use of tfont, which can cause a hitch.
+// Safe to call from any thread, any number of times.
+void tigrPreloadFonts(void);
+
 
 // User Input -------------------------------------------------------------
 
@@ -315,8 +674,39 @@ int tigrKeyHeld(Tigr *bmp, int key);
 
 // Reads character input for a window.
 // Returns the Unicode value of the last key pressed, or 0 if none.
+// On Linux and Android, every character typed during the last tigrUpdate
+// is returned in order, so call this until it returns 0.
 int tigrReadChar(Tigr *bmp);
 
+// Input event types, see tigrPollEvent.
+enum {
+    TIGR_EVENT_KEY_DOWN = 1,  // key: key code, repeats while a key is held
+    TIGR_EVENT_KEY_UP,        // key: key code
+    TIGR_EVENT_CHAR,          // key: Unicode value of the character typed
+    TIGR_EVENT_MOUSE_MOVE,    // x, y: new mouse position
+    TIGR_EVENT_MOUSE_DOWN,    // key: button, as in tigrMouse (1, 2 or 4)
+    TIGR_EVENT_MOUSE_UP,      // key: button
+    TIGR_EVENT_WHEEL,         // dx, dy: wheel movement, as in tigrScrollWheel
+    TIGR_EVENT_TOUCH_DOWN,    // key: touch point id, x, y: position
+    TIGR_EVENT_TOUCH_MOVE,    // key: touch point id, x, y: new position
+    TIGR_EVENT_TOUCH_UP,      // key: touch point id, x, y: last position
+};
+
+typedef struct {
+    int type;                 // TIGR_EVENT_*
+    unsigned long long time;  // When the event happened, on a monotonic clock (ns)
+    int key;                  // Key, character or button, depending on type
+    int x, y;                 // Mouse or touch position, in bitmap pixels
+    float dx, dy;             // Wheel movement
+} TigrEvent;
+
+// Reads the next input event gathered by the last tigrUpdate.
+// Returns zero when there are no more events.
+// Unlike the functions above, events catch every press, release and move,
+// even when several happen between two frames.
+// Events are currently reported on Linux (X11) and Android.
+int tigrPollEvent(Tigr *bmp, TigrEvent *event);
+
 // Show / hide virtual keyboard.
 // (Only available on iOS / Android)
 void tigrShowKeyboard(int show);
@@ -329,6 +719,16 @@ void tigrShowKeyboard(int show);
 Tigr *tigrLoadImage(const char *fileName);
 Tigr *tigrLoadImageMem(const void *data, int length);
 
+// Same as tigrLoadImage, but premultiplies the colors while decoding.
+// See tigrPremultiply. tigrSaveImage converts premultiplied bitmaps back to straight alpha.
+Tigr *tigrLoadImagePremultiplied(const char *fileName);
+Tigr *tigrLoadImageMemPremultiplied(const void *data, int length);
+
+// Loads a paletted PNG as an indexed bitmap, keeping its indices and palette.
+// On error, or if the PNG has no palette, returns NULL and sets errno.
+TigrIndexed *tigrLoadIndexed(const char *fileName);
+TigrIndexed *tigrLoadIndexedMem(const void *data, int length);
+
 // Saves a PNG to a file. (fileName is UTF-8)
 // On error, returns zero and sets errno.
 int tigrSaveImage(const char *fileName, Tigr *bmp);
@@ -338,8 +738,21 @@ int tigrSaveImage(const char *fileName, Tigr *bmp);
 
 // Returns the amount of time elapsed since tigrTime was last called,
 // or zero on the first call.
+// All callers share one timer, see tigrTimerDelta for separate ones.
 float tigrTime(void);
 
+// Returns a timestamp in nanoseconds, from a monotonic clock that does not
+// jump when the system time is adjusted. Only differences are meaningful.
+unsigned long long tigrTimeNs(void);
+
+typedef struct {
+    unsigned long long last;
+} TigrTimer;
+
+// Returns the time in seconds elapsed since the previous call with the same timer,
+// or zero on the first call. Zero-initialize a timer before first use.
+float tigrTimerDelta(TigrTimer *timer);
+
 // Displays an error message and quits. (UTF-8)
 // 'bmp' can be NULL.
 void tigrError(Tigr *bmp, const char *message, ...);